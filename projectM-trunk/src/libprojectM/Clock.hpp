@@ -0,0 +1,33 @@
+/*
+ * Clock.hpp
+ *
+ *  Time source of projectM. Hosts that render against a clock of their own,
+ *  an audio device or a video timeline, hand it to projectM::setClock().
+ */
+
+#ifndef CLOCK_HPP_
+#define CLOCK_HPP_
+
+class Clock
+{
+public:
+    virtual ~Clock() {}
+
+    /// Seconds since an arbitrary start, never running backwards
+    virtual double seconds() = 0;
+};
+
+/// A clock standing at whatever time it was set to last
+class ManualClock : public Clock
+{
+public:
+    ManualClock() : _seconds(0) {}
+
+    inline void set(double seconds) { _seconds = seconds; }
+    double seconds() { return _seconds; }
+
+private:
+    double _seconds;
+};
+
+#endif /* CLOCK_HPP_ */
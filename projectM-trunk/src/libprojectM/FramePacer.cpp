@@ -0,0 +1,115 @@
+/*
+ * FramePacer.cpp
+ *
+ *  Paces renderFrame() to a target frame rate on the monotonic clock.
+ */
+
+#include "FramePacer.hpp"
+#include "FrameStats.hpp"
+#include "timer.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/* A frame counts as late when it misses its deadline by more than this
+ * fraction of a frame. In host mode a frame taking one and a half periods
+ * means a vsync was skipped */
+#define LATE_TOLERANCE 0.5
+
+FramePacer::FramePacer()
+    : _mode(PACE_TARGET_FPS), _period(0), _spinMargin(2.0), _deadline(0), _missed(0),
+      _fpsStart(0), _fpsFrames(0), _measuredFps(0)
+{
+#ifdef WIN32
+    /* There never was a limiter on Windows, hosts there wait on vsync */
+    _mode = PACE_HOST;
+#endif
+}
+
+void FramePacer::setMode(Mode mode)
+{
+    _mode = mode;
+    restart();
+}
+
+void FramePacer::setTargetFps(float fps)
+{
+    _period = fps > 0 ? 1000.0 / fps : 0;
+    restart();
+}
+
+void FramePacer::restart()
+{
+    _deadline = 0;
+    _missed = 0;
+    _fpsStart = 0;
+    _fpsFrames = 0;
+}
+
+void FramePacer::frameDone(FrameStats & stats)
+{
+    double now = getMonotonicTime();
+
+    stats.stages[FrameStats::STAGE_WAIT] = 0;
+    stats.stages[FrameStats::STAGE_LATE] = 0;
+
+    if (_fpsStart == 0)
+        _fpsStart = now;
+    else if (++_fpsFrames && now - _fpsStart >= 1000) {
+        _measuredFps = _fpsFrames * 1000.0 / (now - _fpsStart);
+        _fpsStart = now;
+        _fpsFrames = 0;
+    }
+
+    if (_mode == PACE_UNLIMITED || _period <= 0) {
+        _deadline = 0;
+        return;
+    }
+
+    /* The deadline is when the frame after this one may start */
+    if (_deadline == 0) {
+        _deadline = now + _period;
+        return;
+    }
+
+    if (now > _deadline + _period * LATE_TOLERANCE) {
+        stats.stages[FrameStats::STAGE_LATE] = now - _deadline;
+        _missed++;
+
+        /* Start over from now rather than rushing the next frames to catch up */
+        _deadline = now + _period;
+        return;
+    }
+
+    if (_mode == PACE_HOST) {
+        _deadline = now + _period;
+        return;
+    }
+
+    if (now < _deadline) {
+        sleepUntil(_deadline);
+        stats.stages[FrameStats::STAGE_WAIT] = getMonotonicTime() - now;
+    }
+    _deadline += _period;
+}
+
+void FramePacer::sleepUntil(double deadline) const
+{
+    double now = getMonotonicTime();
+
+    /* Sleep for the coarse part, spin for the last bit */
+    if (deadline - now > _spinMargin) {
+        const double ms = deadline - now - _spinMargin;
+#ifdef WIN32
+        Sleep((DWORD) ms);
+#else
+        usleep((useconds_t) (ms * 1000));
+#endif
+    }
+
+    while (getMonotonicTime() < deadline)
+        ;
+}
@@ -0,0 +1,70 @@
+/*
+ * FramePacer.hpp
+ *
+ *  Paces renderFrame() to a target frame rate on the monotonic clock, or
+ *  leaves the pacing to the host, and keeps track of the frames that came
+ *  in later than they were due.
+ */
+
+#ifndef FRAMEPACER_HPP_
+#define FRAMEPACER_HPP_
+
+class FrameStats;
+
+class FramePacer
+{
+public:
+    enum Mode {
+        PACE_HOST,       /* the host paces, e.g. on vsync; frames are never held back */
+        PACE_TARGET_FPS, /* renderFrame() waits until the next frame is due */
+        PACE_UNLIMITED   /* frames are never held back and never late */
+    };
+
+    FramePacer();
+
+    void setMode(Mode mode);
+    inline Mode mode() const { return _mode; }
+
+    /// The frame rate to hold, or in host mode the rate the host is expected
+    /// to call at (the display refresh rate with vsync)
+    void setTargetFps(float fps);
+    inline float targetFps() const { return _period > 0 ? 1000.0f / _period : 0; }
+
+    /// Sleeping stops this many milliseconds before a frame is due and the
+    /// rest is spent spinning, as sleeps overshoot by up to a scheduler tick
+    inline void setSpinMargin(double ms) { _spinMargin = ms; }
+    inline double spinMargin() const { return _spinMargin; }
+
+    /// Called once at the end of every frame. Waits until the next one is due
+    /// if the mode asks for it, and stores the wait and by how much the frame
+    /// was late in stats
+    void frameDone(FrameStats & stats);
+
+    /// Forgets the deadlines so far, for when frames stop coming for a while
+    /// on purpose
+    void restart();
+
+    /// Frames that were due before they were done since the last restart()
+    inline unsigned int missedDeadlines() const { return _missed; }
+
+    /// Frames per second over about the last second
+    inline float measuredFps() const { return _measuredFps; }
+
+private:
+    void sleepUntil(double deadline) const;
+
+    Mode _mode;
+    /// Milliseconds per frame, 0 without a target
+    double _period;
+    double _spinMargin;
+
+    /// When the next frame is due, 0 before the first frame
+    double _deadline;
+    unsigned int _missed;
+
+    double _fpsStart;
+    unsigned int _fpsFrames;
+    float _measuredFps;
+};
+
+#endif /* FRAMEPACER_HPP_ */
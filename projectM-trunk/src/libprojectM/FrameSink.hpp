@@ -0,0 +1,45 @@
+/*
+ * FrameSink.hpp
+ *
+ *  Receiver of the frames copied out with projectM::startCapture().
+ */
+
+#ifndef FRAMESINK_HPP_
+#define FRAMESINK_HPP_
+
+class CapturedFrame
+{
+public:
+    enum Format {
+        /// 4 bytes per pixel
+        FORMAT_RGBA,
+        /// 3 bytes per pixel
+        FORMAT_RGB,
+        /// One unsigned short per pixel, 5 bits red in the high bits
+        FORMAT_RGB565,
+        /// Planar BT.601 studio range YUV: width x height luma bytes, then
+        /// the half width, half height U and V planes. Needs a width
+        /// divisible by 4 and an even height
+        FORMAT_I420
+    };
+
+    /// Rows run top to bottom without padding. Only valid during frameCaptured()
+    const unsigned char * data;
+    unsigned int size;
+    int width;
+    int height;
+    Format format;
+    /// Frames captured before this one
+    unsigned int number;
+};
+
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+    /// Called on the rendering thread, with the GL context current
+    virtual void frameCaptured(const CapturedFrame & frame) = 0;
+};
+
+#endif /* FRAMESINK_HPP_ */
@@ -0,0 +1,142 @@
+/*
+ * FrameStats.cpp
+ *
+ *  Per-stage frame timing.
+ */
+
+#include "FrameStats.hpp"
+#include "timer.h"
+
+#include <algorithm>
+#include <cstring>
+
+void FrameStats::clear()
+{
+    memset(stages, 0, sizeof(stages));
+}
+
+void FrameStats::add(const FrameStats & other)
+{
+    for (int i = 0; i < STAGE_COUNT; i++)
+        stages[i] += other.stages[i];
+}
+
+const char * FrameStats::stageName(Stage stage)
+{
+    switch (stage) {
+    case STAGE_AUDIO:
+        return "audio";
+    case STAGE_BEAT_DETECT:
+        return "beat detect";
+    case STAGE_PER_FRAME:
+        return "per frame";
+    case STAGE_PER_PIXEL:
+        return "per pixel";
+    case STAGE_PER_PIXEL_MATH:
+        return "per pixel math";
+    case STAGE_WAVES_SHAPES:
+        return "waves/shapes";
+    case STAGE_MERGE:
+        return "merge";
+    case STAGE_PASS1:
+        return "pass 1";
+    case STAGE_PASS2:
+        return "pass 2";
+    case STAGE_CAPTURE:
+        return "capture";
+    case STAGE_GPU:
+        return "gpu";
+    case STAGE_FRAME:
+        return "frame";
+    case STAGE_WAIT:
+        return "wait";
+    case STAGE_LATE:
+        return "late";
+    default:
+        return "";
+    }
+}
+
+StageTimer::StageTimer(FrameStats * stats, FrameStats::Stage stage)
+    : _stats(stats), _stage(stage), _start(stats ? getMonotonicTime() : 0)
+{
+}
+
+StageTimer::~StageTimer()
+{
+    if (_stats)
+        _stats->stages[_stage] += getMonotonicTime() - _start;
+}
+
+FrameHistogram::FrameHistogram()
+{
+    clear();
+}
+
+void FrameHistogram::clear()
+{
+    _next = 0;
+    _count = 0;
+    memset(_buckets, 0, sizeof(_buckets));
+}
+
+int FrameHistogram::bucketIndex(float ms)
+{
+    int index = (int) (ms / BUCKET_MS);
+    if (index < 0)
+        return 0;
+    return std::min(index, BUCKETS - 1);
+}
+
+void FrameHistogram::add(const FrameStats & frame)
+{
+    // The oldest frame drops out of the histogram once the ring is full
+    if (_count == HISTORY)
+        _buckets[bucketIndex(_history[_next][FrameStats::STAGE_FRAME])]--;
+    else
+        _count++;
+
+    _history[_next] = frame;
+    _buckets[bucketIndex(frame[FrameStats::STAGE_FRAME])]++;
+
+    _next = (_next + 1) % HISTORY;
+}
+
+const FrameStats & FrameHistogram::last() const
+{
+    if (_count == 0)
+        return _empty;
+    return _history[(_next + HISTORY - 1) % HISTORY];
+}
+
+FrameStats FrameHistogram::average() const
+{
+    FrameStats mean;
+
+    if (_count == 0)
+        return mean;
+
+    for (unsigned int i = 0; i < _count; i++)
+        mean.add(_history[i]);
+
+    for (int stage = 0; stage < FrameStats::STAGE_COUNT; stage++)
+        mean.stages[stage] /= _count;
+
+    return mean;
+}
+
+float FrameHistogram::percentile(FrameStats::Stage stage, float fraction) const
+{
+    if (_count == 0)
+        return 0;
+
+    float values[HISTORY];
+    for (unsigned int i = 0; i < _count; i++)
+        values[i] = _history[i][stage];
+
+    int index = (int) (fraction * (_count - 1) + 0.5f);
+    index = std::max(0, std::min(index, (int) _count - 1));
+
+    std::nth_element(values, values + index, values + _count);
+    return values[index];
+}
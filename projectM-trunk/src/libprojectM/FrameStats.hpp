@@ -0,0 +1,100 @@
+/*
+ * FrameStats.hpp
+ *
+ *  Per-stage frame timing. projectM fills in one FrameStats per rendered frame
+ *  and keeps a rolling FrameHistogram of the most recent ones.
+ */
+
+#ifndef FRAMESTATS_HPP_
+#define FRAMESTATS_HPP_
+
+/// Time spent in each stage of one frame, in milliseconds
+class FrameStats
+{
+public:
+    enum Stage {
+        STAGE_AUDIO,          /* preset snapshot of the beat detection / audio values */
+        STAGE_BEAT_DETECT,    /* BeatDetect::detectFromSamples */
+        STAGE_PER_FRAME,      /* per frame init and per frame equations */
+        STAGE_PER_PIXEL,      /* per pixel equations */
+        STAGE_PER_PIXEL_MATH, /* mesh warp math in PresetOutputs */
+        STAGE_WAVES_SHAPES,   /* custom wave / shape equations and drawing */
+        STAGE_MERGE,          /* pipeline merge while blending two presets */
+        STAGE_PASS1,          /* render to texture, without drawing waves and shapes */
+        STAGE_PASS2,          /* composite to screen and overlays */
+        STAGE_CAPTURE,        /* scaling, converting and reading back captured frames */
+        STAGE_GPU,            /* GPU time of pass 1 + 2 from timer queries, from an earlier frame */
+        STAGE_FRAME,          /* whole renderFrame() call, without the frame limiter */
+        STAGE_WAIT,           /* time the frame pacer held the frame back */
+        STAGE_LATE,           /* how much later than due the frame was done, 0 on time */
+        STAGE_COUNT
+    };
+
+    float stages[STAGE_COUNT];
+
+    FrameStats() { clear(); }
+
+    void clear();
+
+    /// Adds the stage times of another frame to this one
+    void add(const FrameStats & other);
+
+    inline float operator[](Stage stage) const { return stages[stage]; }
+
+    static const char * stageName(Stage stage);
+};
+
+/// Adds the time between its construction and destruction to a stage.
+/// Does nothing when the stats pointer is null.
+class StageTimer
+{
+public:
+    StageTimer(FrameStats * stats, FrameStats::Stage stage);
+    ~StageTimer();
+
+private:
+    FrameStats * _stats;
+    FrameStats::Stage _stage;
+    double _start;
+};
+
+/// The last HISTORY frames plus a histogram of their total frame times
+class FrameHistogram
+{
+public:
+    static const int HISTORY = 128;
+    static const int BUCKETS = 32;
+    /// Width of one bucket in milliseconds; the last bucket also holds everything slower
+    static const int BUCKET_MS = 2;
+
+    FrameHistogram();
+
+    void add(const FrameStats & frame);
+    void clear();
+
+    /// Number of frames currently in the history
+    inline unsigned int size() const { return _count; }
+
+    /// Most recent frame, all zero when there is none
+    const FrameStats & last() const;
+
+    /// Mean of every stage over the history
+    FrameStats average() const;
+
+    /// Time below which the given fraction (0-1) of frames in the history stayed for a stage
+    float percentile(FrameStats::Stage stage, float fraction) const;
+
+    /// Frames in the history whose total time falls in bucket index
+    inline unsigned int bucket(int index) const { return _buckets[index]; }
+
+private:
+    static int bucketIndex(float ms);
+
+    FrameStats _history[HISTORY];
+    FrameStats _empty;
+    int _next;
+    unsigned int _count;
+    unsigned int _buckets[BUCKETS];
+};
+
+#endif /* FRAMESTATS_HPP_ */
@@ -21,14 +21,14 @@
 
 std::map<std::string, Func*> BuiltinFuncs::builtin_func_tree;
 
-int BuiltinFuncs::load_builtin_func(const std::string & name, float (*func_ptr)(float*), int num_args)
+int BuiltinFuncs::load_builtin_func(const std::string & name, float (*func_ptr)(float*), int num_args, int evaluation)
 {
 
     Func * func;
     int retval;
 
     /* Create new function */
-    func = new Func(name, func_ptr, num_args);
+    func = new Func(name, func_ptr, num_args, evaluation);
 
     if (func == 0)
         return PROJECTM_OUTOFMEM_ERROR;
@@ -96,13 +96,13 @@ int BuiltinFuncs::load_all_builtin_func()
         return PROJECTM_ERROR;
     if (load_builtin_func("rand", FuncWrappers::rand_wrapper, 1) < 0)
         return PROJECTM_ERROR;
-    if (load_builtin_func("band", FuncWrappers::band_wrapper, 2) < 0)
+    if (load_builtin_func("band", FuncWrappers::band_wrapper, 2, PREFUN_BAND) < 0)
         return PROJECTM_ERROR;
-    if (load_builtin_func("bor", FuncWrappers::bor_wrapper, 2) < 0)
+    if (load_builtin_func("bor", FuncWrappers::bor_wrapper, 2, PREFUN_BOR) < 0)
         return PROJECTM_ERROR;
     if (load_builtin_func("bnot", FuncWrappers::bnot_wrapper, 1) < 0)
         return PROJECTM_ERROR;
-    if (load_builtin_func("if", FuncWrappers::if_wrapper, 3) < 0)
+    if (load_builtin_func("if", FuncWrappers::if_wrapper, 3, PREFUN_IF) < 0)
         return PROJECTM_ERROR;
     if (load_builtin_func("equal", FuncWrappers::equal_wrapper, 2) < 0)
         return PROJECTM_ERROR;
@@ -114,12 +114,31 @@ int BuiltinFuncs::load_all_builtin_func()
         return PROJECTM_ERROR;
     if (load_builtin_func("fact", FuncWrappers::fact_wrapper, 1) < 0)
         return PROJECTM_ERROR;
+    if (load_builtin_func("exec2", FuncWrappers::exec2_wrapper, 2) < 0)
+        return PROJECTM_ERROR;
+    if (load_builtin_func("exec3", FuncWrappers::exec3_wrapper, 3) < 0)
+        return PROJECTM_ERROR;
+    if (load_builtin_func("loop", FuncWrappers::loop_wrapper, 2, PREFUN_LOOP) < 0)
+        return PROJECTM_ERROR;
+    if (load_builtin_func("while", FuncWrappers::while_wrapper, 1, PREFUN_WHILE) < 0)
+        return PROJECTM_ERROR;
 
     return PROJECTM_SUCCESS;
 }
 
 volatile bool BuiltinFuncs::initialized = false;
 
+/* Loads the database once per process, before any preset factory exists, so
+   factories on different threads never race to fill or tear it down. Defined
+   after builtin_func_tree, which is constructed first */
+class BuiltinFuncDatabase {
+public:
+    BuiltinFuncDatabase() { BuiltinFuncs::init_builtin_func_db(); }
+    ~BuiltinFuncDatabase() { BuiltinFuncs::destroy_builtin_func_db(); }
+};
+
+static BuiltinFuncDatabase builtinFuncDatabase;
+
 /* Initialize the builtin function database.
    Should only be necessary once */
 int BuiltinFuncs::init_builtin_func_db()
@@ -93,6 +93,23 @@ return arg_list[2];
 return arg_list[1];
 }
 
+static inline float exec2_wrapper(float * arg_list) {
+return arg_list[1];
+}
+
+static inline float exec3_wrapper(float * arg_list) {
+return arg_list[2];
+}
+
+/* Called only where loop and while aren't evaluated as such */
+static inline float loop_wrapper(float * arg_list) {
+return arg_list[1];
+}
+
+static inline float while_wrapper(float * arg_list) {
+return arg_list[0];
+}
+
 
 static inline float rand_wrapper(float * arg_list) {
 float l=1;
@@ -222,7 +239,8 @@ public:
     static int init_builtin_func_db();
     static int destroy_builtin_func_db();
     static int load_all_builtin_func();
-    static int load_builtin_func( const std::string & name, float (*func_ptr)(float*), int num_args );
+    static int load_builtin_func( const std::string & name, float (*func_ptr)(float*), int num_args,
+                                  int evaluation = PREFUN_EAGER );
 
     static int insert_func( Func *func );
     static int remove_func( Func *func );
@@ -30,14 +30,13 @@
 #include <string>
 #include "PresetFrameIO.hpp"
 #include "Param.hpp"
+#include "ParamSchema.hpp"
 #include <map>
 #include <cstdio>
 
 class BuiltinParams {
 
 public:
-   typedef std::map<std::string, std::string> AliasMap;
-
     /** Default constructor leaves database in an uninitialized state.  */
     BuiltinParams();
 
@@ -47,40 +46,36 @@ public:
 
     ~BuiltinParams();
 
-    /** Param database initalizer / destructor functions */
+    /** Param database initalizer */
     int init_builtin_param_db(const PresetInputs & presetInputs, PresetOutputs & presetOutputs);
-    int load_all_builtin_param(const PresetInputs & presetInputs, PresetOutputs & presetOutputs);
-    int destroy_builtin_param_db();
 
-    int insert_param_alt_name( Param *param, const std::string& salt_name );
     Param *find_builtin_param( const std::string & name );
-    int load_builtin_param_float( const std::string & name, void *engine_val, void *matrix,
-                                  short int flags,
-                                  float init_val, float upper_bound,
-                                  float lower_bound, const std::string & alt_name );
-    int load_builtin_param_int( const std::string & name, void *engine_val, short int flags,
-                                int init_val, int upper_bound,
-                                int lower_bound, const std::string & alt_name );
-    int load_builtin_param_bool( const std::string & name, void *engine_val, short int flags,
-                                int init_val, const std::string & alt_name );
-
-    int load_builtin_param_string( const std::string & name, std::string * engine_val, short int flags);
-
-    int insert_builtin_param( Param *param );
 
     template <class Fun>
     void apply(Fun & fun) {
-	traverse(builtin_param_tree, fun);
+	builtin_param_tree.apply(fun);
     }
 
 
 private:
     static const bool BUILTIN_PARAMS_DEBUG = false;
 
-    // Used to associate multiple string names to one parameter
-    AliasMap aliasMap;
-
-    // Internal datastructure to store the parameters
-    std::map<std::string,Param*> builtin_param_tree;
+    /// The schema is the same for every preset, built from the first one
+    static const ParamSchema & paramSchema(const PresetInputs & presetInputs, PresetOutputs & presetOutputs);
+    static ParamSchema * loadParamSchema(const PresetInputs & presetInputs, PresetOutputs & presetOutputs);
+
+    static void load_builtin_param_float( ParamSchema & schema, const std::string & name, void *engine_val,
+                                          const void * matrix, short int flags,
+                                          float init_val, float upper_bound,
+                                          float lower_bound, const std::string & alt_name );
+    static void load_builtin_param_int( ParamSchema & schema, const std::string & name, void *engine_val, short int flags,
+                                        int init_val, int upper_bound,
+                                        int lower_bound, const std::string & alt_name );
+    static void load_builtin_param_bool( ParamSchema & schema, const std::string & name, void *engine_val, short int flags,
+                                         int init_val, const std::string & alt_name );
+
+    // Internal datastructure to store the parameters, names and their
+    // alternate names resolve through the schema
+    ParamTable builtin_param_tree;
 };
 #endif
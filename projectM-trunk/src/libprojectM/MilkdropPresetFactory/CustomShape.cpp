@@ -31,6 +31,7 @@
 #include "PerFrameEqn.hpp"
 #include "Preset.hpp"
 #include <map>
+#include <memory>
 #include "ParamUtils.hpp"
 #include "InitCondUtils.hpp"
 #include "wipemalloc.h"
@@ -50,148 +51,74 @@ CustomShape::CustomShape ( int id ) : Shape()
     this->id = id;
     this->per_frame_count = 0;
 
+    /* Read only, so left alone by the init conditions unless the shapecode sets it */
+    this->num_inst = 1;
+    this->instance = 0;
+
     /* Start: Load custom shape parameters */
-    param = Param::new_param_float ( "r", P_FLAG_NONE, &this->r, NULL, 1.0, 0.0, 0.5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "g", P_FLAG_NONE, &this->g, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "b", P_FLAG_NONE, &this->b, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "a", P_FLAG_NONE, &this->a, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "border_r", P_FLAG_NONE, &this->border_r, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "border_g", P_FLAG_NONE, &this->border_g, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "border_b", P_FLAG_NONE, &this->border_b, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "border_a", P_FLAG_NONE, &this->border_a, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "r2", P_FLAG_NONE, &this->r2, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "g2", P_FLAG_NONE, &this->g2, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "b2", P_FLAG_NONE, &this->b2, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "a2", P_FLAG_NONE, &this->a2, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "x", P_FLAG_NONE, &this->x, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "y", P_FLAG_NONE, &this->y, NULL, 1.0, 0.0, .5 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_bool ( "thickoutline", P_FLAG_NONE, &this->thickOutline, 1, 0, 0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_bool ( "enabled", P_FLAG_NONE, &this->enabled, 1, 0, 0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_int ( "sides", P_FLAG_NONE, &this->sides, 100, 3, 3 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_bool ( "additive", P_FLAG_NONE, &this->additive, 1, 0, 0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_bool ( "textured", P_FLAG_NONE, &this->textured, 1, 0, 0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "rad", P_FLAG_NONE, &this->radius, NULL, MAX_DOUBLE_SIZE, 0, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "ang", P_FLAG_NONE, &this->ang, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "tex_zoom", P_FLAG_NONE, &this->tex_zoom, NULL, MAX_DOUBLE_SIZE, .00000000001, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "tex_ang", P_FLAG_NONE, &this->tex_ang, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
+    param_tree.load ( paramSchema ( this ), this );
 
-    param = Param::new_param_float ( "t1", P_FLAG_TVAR, &this->t1, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "t2", P_FLAG_TVAR, &this->t2, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "t3", P_FLAG_TVAR, &this->t3, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "t4", P_FLAG_TVAR, &this->t4, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "t5", P_FLAG_TVAR, &this->t5, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "t6", P_FLAG_TVAR, &this->t6, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "t7", P_FLAG_TVAR, &this->t7, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
-        abort();
-    }
-    param = Param::new_param_float ( "t8", P_FLAG_TVAR, &this->t8, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 );
-    if ( !ParamUtils::insert( param, &this->param_tree ) ) {
+    param = Param::new_param_string ( "imageurl", P_FLAG_NONE, &this->imageUrl);
+    if ( !ParamUtils::insert( param, &this->text_properties_tree ) ) {
         abort();
     }
 
+}
+
+/// Built from the first shape constructed, the params of every other are at
+/// the same places in it
+const ParamSchema & CustomShape::paramSchema ( CustomShape * prototype )
+{
+    static const std::auto_ptr<const ParamSchema> schema ( loadParamSchema ( prototype ) );
+    return *schema;
+}
+
+ParamSchema * CustomShape::loadParamSchema ( CustomShape * shape )
+{
+    ParamSchema * schema = new ParamSchema ( shape, sizeof ( CustomShape ) );
+
+    schema->add ( Param::new_param_float ( "r", P_FLAG_NONE, &shape->r, NULL, 1.0, 0.0, 0.5 ) );
+    schema->add ( Param::new_param_float ( "g", P_FLAG_NONE, &shape->g, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "b", P_FLAG_NONE, &shape->b, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "a", P_FLAG_NONE, &shape->a, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "border_r", P_FLAG_NONE, &shape->border_r, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "border_g", P_FLAG_NONE, &shape->border_g, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "border_b", P_FLAG_NONE, &shape->border_b, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "border_a", P_FLAG_NONE, &shape->border_a, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "r2", P_FLAG_NONE, &shape->r2, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "g2", P_FLAG_NONE, &shape->g2, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "b2", P_FLAG_NONE, &shape->b2, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "a2", P_FLAG_NONE, &shape->a2, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "x", P_FLAG_NONE, &shape->x, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_float ( "y", P_FLAG_NONE, &shape->y, NULL, 1.0, 0.0, .5 ) );
+    schema->add ( Param::new_param_bool ( "thickoutline", P_FLAG_NONE, &shape->thickOutline, 1, 0, 0 ) );
+    schema->add ( Param::new_param_bool ( "enabled", P_FLAG_NONE, &shape->enabled, 1, 0, 0 ) );
+    schema->add ( Param::new_param_int ( "sides", P_FLAG_NONE, &shape->sides, 100, 3, 3 ) );
+    schema->add ( Param::new_param_bool ( "additive", P_FLAG_NONE, &shape->additive, 1, 0, 0 ) );
+    schema->add ( Param::new_param_bool ( "textured", P_FLAG_NONE, &shape->textured, 1, 0, 0 ) );
+    schema->add ( Param::new_param_int ( "num_inst", P_FLAG_READONLY, &shape->num_inst, MAX_SHAPE_INSTANCES, 1, 1 ) );
+    schema->add ( Param::new_param_float ( "instance", P_FLAG_READONLY, &shape->instance, NULL, MAX_SHAPE_INSTANCES, 0, 0.0 ) );
+    schema->add ( Param::new_param_float ( "rad", P_FLAG_NONE, &shape->radius, NULL, MAX_DOUBLE_SIZE, 0, 0.0 ) );
+    schema->add ( Param::new_param_float ( "ang", P_FLAG_NONE, &shape->ang, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "tex_zoom", P_FLAG_NONE, &shape->tex_zoom, NULL, MAX_DOUBLE_SIZE, .00000000001, 0.0 ) );
+    schema->add ( Param::new_param_float ( "tex_ang", P_FLAG_NONE, &shape->tex_ang, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t1", P_FLAG_TVAR, &shape->t1, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t2", P_FLAG_TVAR, &shape->t2, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t3", P_FLAG_TVAR, &shape->t3, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t4", P_FLAG_TVAR, &shape->t4, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t5", P_FLAG_TVAR, &shape->t5, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t6", P_FLAG_TVAR, &shape->t6, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t7", P_FLAG_TVAR, &shape->t7, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+    schema->add ( Param::new_param_float ( "t8", P_FLAG_TVAR, &shape->t8, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0 ) );
+
     for (unsigned int i = 1; i <= NUM_Q_VARIABLES; i++) {
         std::ostringstream os;
         os << "q" << i;
-        param = Param::new_param_float ( os.str().c_str(), P_FLAG_QVAR, &this->q[i], NULL, MAX_DOUBLE_SIZE,
-                                         -MAX_DOUBLE_SIZE, 0.0 );
-        if ( ParamUtils::insert ( param, &this->param_tree ) < 0 ) {
-            abort();
-        }
-    }
-
-    param = Param::new_param_string ( "imageurl", P_FLAG_NONE, &this->imageUrl);
-    if ( !ParamUtils::insert( param, &this->text_properties_tree ) ) {
-        abort();
+        schema->add ( Param::new_param_float ( os.str().c_str(), P_FLAG_QVAR, &shape->q[i - 1], NULL, MAX_DOUBLE_SIZE,
+                                               -MAX_DOUBLE_SIZE, 0.0 ) );
     }
 
+    return schema;
 }
 
 /* Frees a custom shape form object */
@@ -200,7 +127,6 @@ CustomShape::~CustomShape()
 
     traverseVector<TraverseFunctors::Delete<PerFrameEqn> > ( per_frame_eqn_tree );
     traverse<TraverseFunctors::Delete<InitCond> > ( init_cond_tree );
-    traverse<TraverseFunctors::Delete<Param> > ( param_tree );
     traverse<TraverseFunctors::Delete<InitCond> > ( per_frame_init_eqn_tree );
     traverse<TraverseFunctors::Delete<Param> > ( text_properties_tree );
 
@@ -210,7 +136,7 @@ void CustomShape::loadUnspecInitConds()
 {
 
     InitCondUtils::LoadUnspecInitCond fun ( this->init_cond_tree, this->per_frame_init_eqn_tree );
-    traverse ( param_tree, fun );
+    param_tree.apply ( fun );
 }
 
 void CustomShape::evalInitConds()
@@ -30,8 +30,12 @@
 #define _CUSTOM_SHAPE_H
 
 #define CUSTOM_SHAPE_DEBUG 0
+
+/* Most copies of a shape a preset can ask for with num_inst */
+#define MAX_SHAPE_INSTANCES 1024
 #include <map>
 #include "Param.hpp"
+#include "ParamSchema.hpp"
 #include "PerFrameEqn.hpp"
 #include "InitCond.hpp"
 #include "Renderer/Renderable.hpp"
@@ -47,12 +51,17 @@ public:
     int per_frame_count;
 
     /* Parameter tree associated with this custom shape */
-    std::map<std::string,Param*> param_tree;
+    ParamTable param_tree;
 
     /* Engine variables */
 
     bool enabled;
 
+    /* Copies drawn, set from the shapecode only */
+    int num_inst;
+    /* Copy the per frame equations are being run for, from 0 */
+    float instance;
+
     /* stupid t variables */
     float t1;
     float t2;
@@ -63,7 +72,7 @@ public:
     float t7;
     float t8;
 
-    /* stupider q variables */
+    /* stupider q variables, q1 in q[0] */
     float q[NUM_Q_VARIABLES];
 
     // Data structure to hold per frame  / per frame init equations
@@ -83,6 +92,10 @@ public:
     void loadUnspecInitConds();
     void evalInitConds();
 
+private:
+    static const ParamSchema & paramSchema( CustomShape * prototype );
+    static ParamSchema * loadParamSchema( CustomShape * shape );
+
   };
 
 
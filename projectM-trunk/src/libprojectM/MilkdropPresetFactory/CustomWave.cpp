@@ -36,7 +36,11 @@
 #include "PerFrameEqn.hpp"
 #include "PerPointEqn.hpp"
 #include "Preset.hpp"
+#include "timer.h"
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <set>
 #include "ParamUtils.hpp"
 #include "InitCondUtils.hpp"
 #include "wipemalloc.h"
@@ -49,11 +53,13 @@ CustomWave::CustomWave(int _id) : Waveform(512),
     r(0),
     g(0),
     b(0),
-    a(0)
+    a(0),
+    per_point_batched(false),
+    per_point_threaded(false),
+    per_point_time(0),
+    per_point_loop_time(0)
 {
 
-    Param * param;
-
     /// @bug deprecate the use of wipemalloc
     this->r_mesh = (float*)wipemalloc(MAX_SAMPLE_SIZE*sizeof(float));
     this->g_mesh = (float*)wipemalloc(MAX_SAMPLE_SIZE*sizeof(float));
@@ -65,301 +71,64 @@ CustomWave::CustomWave(int _id) : Waveform(512),
     this->value2 = (float*)wipemalloc(MAX_SAMPLE_SIZE*sizeof(float));
     this->sample_mesh = (float*)wipemalloc(MAX_SAMPLE_SIZE*sizeof(float));
 
-    /* Start: Load custom wave parameters */
-
-    if ((param = Param::new_param_float("r", P_FLAG_NONE | P_FLAG_PER_POINT, &this->r, this->r_mesh, 1.0, 0.0, .5)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &param_tree) < 0) {
-        /// @bug make exception
-        abort();
-    }
-
-    if ((param = Param::new_param_float("g", P_FLAG_NONE | P_FLAG_PER_POINT, &this->g,  this->g_mesh, 1.0, 0.0, .5)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &param_tree) < 0) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if ((param = Param::new_param_float("b", P_FLAG_NONE | P_FLAG_PER_POINT, &this->b,  this->b_mesh, 1.0, 0.0, .5)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if ((param = Param::new_param_float("a", P_FLAG_NONE | P_FLAG_PER_POINT, &this->a,  this->a_mesh, 1.0, 0.0, .5)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if ((param = Param::new_param_float("x", P_FLAG_NONE | P_FLAG_PER_POINT, &this->x,  this->x_mesh, 1.0, 0.0, .5)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if ((param = Param::new_param_float("y", P_FLAG_NONE | P_FLAG_PER_POINT, &this->y,  this->y_mesh, 1.0, 0.0, .5)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-
-        /// @bug make exception
-        abort();
-
-    }
-
-    if ((param = Param::new_param_bool("enabled", P_FLAG_NONE, &this->enabled, 1, 0, 0)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-
-
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-
-        /// @bug make exception
-        abort();
-
-    }
-
-    if ((param = Param::new_param_int("sep", P_FLAG_NONE, &this->sep, 100, -100, 0)) == NULL) {
-        ;
-        /// @bug make exception
-        abort();
-
-
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        /// @bug make exception
-        abort();
-
-
-    }
-
-    if ((param = Param::new_param_bool("bspectrum", P_FLAG_NONE, &this->spectrum, 1, 0, 0)) == NULL) {
-        /// @bug make exception
-        abort();
-
-
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        /// @bug make exception
-        abort();
-
-    }
-
-    if ((param = Param::new_param_bool("bdrawthick", P_FLAG_NONE, &this->thick, 1, 0, 0)) == NULL) {
-        /// @bug make exception
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        /// @bug make exception
-        abort();
-
-    }
-
-    if ((param = Param::new_param_bool("busedots", P_FLAG_NONE, &this->dots, 1, 0, 0)) == NULL) {
-
-        /// @bug make exception
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
-
-    if ((param = Param::new_param_bool("badditive", P_FLAG_NONE, &this->additive, 1, 0, 0)) == NULL) {
-        ;
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
-
-    if ((param = Param::new_param_int("samples", P_FLAG_NONE, &this->samples, 2048, 1, 512)) == NULL) {
-        ;
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
-
-    if ((param = Param::new_param_float("sample", P_FLAG_READONLY | P_FLAG_NONE | P_FLAG_ALWAYS_MATRIX | P_FLAG_PER_POINT,
-                                        &this->sample, this->sample_mesh, 1.0, 0.0, 0.0)) == NULL) {
-        ;
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        abort();
-    }
-
-    if ((param = Param::new_param_float("value1", P_FLAG_READONLY | P_FLAG_NONE | P_FLAG_ALWAYS_MATRIX | P_FLAG_PER_POINT, &this->v1, this->value1, 1.0, -1.0, 0.0)) == NULL) {
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        abort();
-    }
-
-    if ((param = Param::new_param_float("value2", P_FLAG_READONLY | P_FLAG_NONE | P_FLAG_ALWAYS_MATRIX | P_FLAG_PER_POINT, &this->v2, this->value2, 1.0, -1.0, 0.0)) == NULL) {
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
-
-    if ((param = Param::new_param_float("smoothing", P_FLAG_NONE, &this->smoothing, NULL, 1.0, 0.0, 0.0)) == NULL) {
-        ;
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
-
-    if ((param = Param::new_param_float("scaling", P_FLAG_NONE, &this->scaling, NULL, MAX_DOUBLE_SIZE, 0.0, 1.0)) == NULL) {
-        ;
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
-
-    if ((param = Param::new_param_float("t1", P_FLAG_PER_POINT | P_FLAG_TVAR, &this->t1, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
-        ;
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
-
-    if ((param = Param::new_param_float("t2",  P_FLAG_PER_POINT |P_FLAG_TVAR, &this->t2, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
-        ;
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        abort();
-    }
-
-    if ((param = Param::new_param_float("t3",  P_FLAG_PER_POINT |P_FLAG_TVAR, &this->t3, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-
-        abort();
-    }
-    if ((param = Param::new_param_float("t4",  P_FLAG_PER_POINT |P_FLAG_TVAR, &this->t4, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
-
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        abort();
-    }
-    if ((param = Param::new_param_float("t5", P_FLAG_TVAR, &this->t5, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        abort();
-    }
-
-    if ((param = Param::new_param_float("t6", P_FLAG_TVAR | P_FLAG_PER_POINT, &this->t6, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-
-        abort();
-    }
-    if ((param = Param::new_param_float("t7", P_FLAG_TVAR | P_FLAG_PER_POINT, &this->t7, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
+    param_tree.load(paramSchema(this), this);
 
-        abort();
-    }
-
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
+}
 
-    if ((param = Param::new_param_float("t8", P_FLAG_TVAR | P_FLAG_PER_POINT, &this->t8, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0)) == NULL) {
-        ;
-        abort();
-    }
+/// Built from the first wave constructed, the params of every other are at
+/// the same places in it
+const ParamSchema & CustomWave::paramSchema(CustomWave * prototype)
+{
+    static const std::auto_ptr<const ParamSchema> schema(loadParamSchema(prototype));
+    return *schema;
+}
 
-    if (ParamUtils::insert(param, &this->param_tree) < 0) {
-        ;
-        abort();
-    }
+ParamSchema * CustomWave::loadParamSchema(CustomWave * wave)
+{
+    ParamSchema * schema = new ParamSchema(wave, sizeof(CustomWave));
+
+    schema->add(Param::new_param_float("r", P_FLAG_NONE | P_FLAG_PER_POINT, &wave->r, wave->r_mesh, 1.0, 0.0, .5), &wave->r_mesh);
+    schema->add(Param::new_param_float("g", P_FLAG_NONE | P_FLAG_PER_POINT, &wave->g, wave->g_mesh, 1.0, 0.0, .5), &wave->g_mesh);
+    schema->add(Param::new_param_float("b", P_FLAG_NONE | P_FLAG_PER_POINT, &wave->b, wave->b_mesh, 1.0, 0.0, .5), &wave->b_mesh);
+    schema->add(Param::new_param_float("a", P_FLAG_NONE | P_FLAG_PER_POINT, &wave->a, wave->a_mesh, 1.0, 0.0, .5), &wave->a_mesh);
+    schema->add(Param::new_param_float("x", P_FLAG_NONE | P_FLAG_PER_POINT, &wave->x, wave->x_mesh, 1.0, 0.0, .5), &wave->x_mesh);
+    schema->add(Param::new_param_float("y", P_FLAG_NONE | P_FLAG_PER_POINT, &wave->y, wave->y_mesh, 1.0, 0.0, .5), &wave->y_mesh);
+    schema->add(Param::new_param_bool("enabled", P_FLAG_NONE, &wave->enabled, 1, 0, 0));
+    schema->add(Param::new_param_int("sep", P_FLAG_NONE, &wave->sep, 100, -100, 0));
+    schema->add(Param::new_param_bool("bspectrum", P_FLAG_NONE, &wave->spectrum, 1, 0, 0));
+    schema->add(Param::new_param_bool("bdrawthick", P_FLAG_NONE, &wave->thick, 1, 0, 0));
+    schema->add(Param::new_param_bool("busedots", P_FLAG_NONE, &wave->dots, 1, 0, 0));
+    schema->add(Param::new_param_bool("badditive", P_FLAG_NONE, &wave->additive, 1, 0, 0));
+    schema->add(Param::new_param_int("samples", P_FLAG_NONE, &wave->samples, 2048, 1, 512));
+    schema->add(Param::new_param_float("sample", P_FLAG_READONLY | P_FLAG_NONE | P_FLAG_ALWAYS_MATRIX | P_FLAG_PER_POINT,
+                                       &wave->sample, wave->sample_mesh, 1.0, 0.0, 0.0), &wave->sample_mesh);
+    schema->add(Param::new_param_float("value1", P_FLAG_READONLY | P_FLAG_NONE | P_FLAG_ALWAYS_MATRIX | P_FLAG_PER_POINT,
+                                       &wave->v1, wave->value1, 1.0, -1.0, 0.0), &wave->value1);
+    schema->add(Param::new_param_float("value2", P_FLAG_READONLY | P_FLAG_NONE | P_FLAG_ALWAYS_MATRIX | P_FLAG_PER_POINT,
+                                       &wave->v2, wave->value2, 1.0, -1.0, 0.0), &wave->value2);
+    schema->add(Param::new_param_float("smoothing", P_FLAG_NONE, &wave->smoothing, NULL, 1.0, 0.0, 0.0));
+    schema->add(Param::new_param_float("scaling", P_FLAG_NONE, &wave->scaling, NULL, MAX_DOUBLE_SIZE, 0.0, 1.0));
+    schema->add(Param::new_param_float("t1", P_FLAG_PER_POINT | P_FLAG_TVAR, &wave->t1, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
+    schema->add(Param::new_param_float("t2", P_FLAG_PER_POINT | P_FLAG_TVAR, &wave->t2, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
+    schema->add(Param::new_param_float("t3", P_FLAG_PER_POINT | P_FLAG_TVAR, &wave->t3, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
+    schema->add(Param::new_param_float("t4", P_FLAG_PER_POINT | P_FLAG_TVAR, &wave->t4, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
+    schema->add(Param::new_param_float("t5", P_FLAG_TVAR, &wave->t5, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
+    schema->add(Param::new_param_float("t6", P_FLAG_TVAR | P_FLAG_PER_POINT, &wave->t6, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
+    schema->add(Param::new_param_float("t7", P_FLAG_TVAR | P_FLAG_PER_POINT, &wave->t7, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
+    schema->add(Param::new_param_float("t8", P_FLAG_TVAR | P_FLAG_PER_POINT, &wave->t8, NULL, MAX_DOUBLE_SIZE, -MAX_DOUBLE_SIZE, 0.0));
 
     for (unsigned int i = 1; i <= NUM_Q_VARIABLES; i++) {
         std::ostringstream os;
         os << "q" << i;
-        param = Param::new_param_float ( os.str().c_str(), P_FLAG_QVAR, &this->q[i], NULL, MAX_DOUBLE_SIZE,
-                                         -MAX_DOUBLE_SIZE, 0.0 );
-        if ( ParamUtils::insert ( param, &this->param_tree ) < 0 ) {
-            abort();
-        }
+        schema->add(Param::new_param_float(os.str().c_str(), P_FLAG_QVAR, &wave->q[i - 1], NULL, MAX_DOUBLE_SIZE,
+                                           -MAX_DOUBLE_SIZE, 0.0));
     }
 
     /* End of parameter loading. Note that the read only parameters associated
     with custom waves (ie, sample) are variables stored in PresetFrameIO.hpp,
     and not specific to the custom wave datastructure. */
 
+    return schema;
 }
 
 CustomWave::~CustomWave()
@@ -378,9 +147,6 @@ CustomWave::~CustomWave()
     for (std::map<std::string, InitCond*>::iterator pos = per_frame_init_eqn_tree.begin(); pos != per_frame_init_eqn_tree.end(); ++pos)
         delete(pos->second);
 
-    for (std::map<std::string, Param*>::iterator pos = param_tree.begin(); pos != param_tree.end(); ++pos)
-        delete(pos->second);
-
     free(r_mesh);
     free(g_mesh);
     free(b_mesh);
@@ -391,13 +157,16 @@ CustomWave::~CustomWave()
     free(value2);
     free(sample_mesh);
 
+    for (std::vector<Param*>::iterator pos = per_point_locals.begin(); pos != per_point_locals.end(); ++pos)
+        free((*pos)->matrix);
+
 }
 
 
 
 
 // Comments: index is not passed, so we assume monotonic increment by 1 is ok here
-int CustomWave::add_per_point_eqn(char * name, GenExpr * gen_expr)
+int CustomWave::add_per_point_eqn(char * name, GenExpr * gen_expr, unsigned int line)
 {
 
     PerPointEqn * per_point_eqn;
@@ -426,6 +195,9 @@ int CustomWave::add_per_point_eqn(char * name, GenExpr * gen_expr)
     /* Create the per point equation given the index, parameter, and general expression */
     if ((per_point_eqn = new PerPointEqn(index, param, gen_expr, samples)) == NULL)
         return PROJECTM_FAILURE;
+
+    per_point_eqn->line = line;
+
     if (CUSTOM_WAVE_DEBUG)
         printf("add_per_point_eqn: created new equation (index = %d) (name = \"%s\")\n", per_point_eqn->index, per_point_eqn->param->name.c_str());
 
@@ -448,30 +220,91 @@ void CustomWave::evalInitConds()
 
 }
 
-ColoredPoint CustomWave::PerPoint(ColoredPoint p, const WaveformContext context)
+void CustomWave::planPerPoint()
 {
-    r_mesh[context.sample_int] = r;
-    g_mesh[context.sample_int] = g;
-    b_mesh[context.sample_int] = b;
-    a_mesh[context.sample_int] = a;
-    x_mesh[context.sample_int] = x;
-    y_mesh[context.sample_int] = y;
-    sample = context.sample;
-    sample_mesh[context.sample_int] = context.sample;
-    v1 = context.left;
-    v2 = context.right;
+    per_point_batched = per_point_threaded = false;
 
-    for (std::vector<PerPointEqn*>::iterator pos = per_point_eqn_tree.begin(); pos != per_point_eqn_tree.end(); ++pos)
-        (*pos)->evaluate(context.sample_int);
+    std::set<const Param*> read;
+    std::vector<Param*> locals;
+    int ordered = 0;
+
+    for (std::vector<PerPointEqn*>::iterator pos = per_point_eqn_tree.begin(); pos != per_point_eqn_tree.end(); ++pos) {
+        Param * param = (*pos)->param;
+
+        /* What it assigns within itself or keeps in megabuf goes on to the next point */
+        if (ExprOptimizer::effects((*pos)->gen_expr))
+            return;
+
+        ExprOptimizer::reads((*pos)->gen_expr, read);
+        if (per_point_optimizer.ordered((*pos)->gen_expr))
+            ordered++;
 
-    p.a = a_mesh[context.sample_int];
-    p.r = r_mesh[context.sample_int];
-    p.g = g_mesh[context.sample_int];
-    p.b = b_mesh[context.sample_int];
-    p.x = x_mesh[context.sample_int];
-    p.y = y_mesh[context.sample_int];
+        if (param->matrix != NULL || std::find(locals.begin(), locals.end(), param) != locals.end())
+            continue;
 
-    return p;
+        /* Read before it is written, the value carries over from the point before */
+        if (param->type != P_TYPE_DOUBLE || read.count(param))
+            return;
+        locals.push_back(param);
+    }
+
+    /* Passes over the points would interleave the calls to rand differently */
+    if (ordered > 1)
+        return;
+
+    for (std::vector<Param*>::iterator pos = locals.begin(); pos != locals.end(); ++pos) {
+        (*pos)->matrix = wipemalloc(MAX_SAMPLE_SIZE*sizeof(float));
+        per_point_locals.push_back(*pos);
+    }
+
+    per_point_batched = true;
+    per_point_threaded = ordered == 0;
+}
+
+void CustomWave::PerPoints(std::vector<ColoredPoint> &points, const float *left, const float *right, BeatDetect *music)
+{
+    const double start = getMonotonicTime();
+
+    std::fill(r_mesh, r_mesh + samples, r);
+    std::fill(g_mesh, g_mesh + samples, g);
+    std::fill(b_mesh, b_mesh + samples, b);
+    std::fill(a_mesh, a_mesh + samples, a);
+    std::fill(x_mesh, x_mesh + samples, x);
+    std::fill(y_mesh, y_mesh + samples, y);
+    for (int i = 0; i < samples; i++)
+        sample_mesh[i] = i / (float)(samples - 1);
+
+    LoopTime own;
+    LoopBudget budget(per_point_loop_time ? *per_point_loop_time : own);
+    if (per_point_batched) {
+        for (std::vector<PerPointEqn*>::iterator pos = per_point_eqn_tree.begin(); pos != per_point_eqn_tree.end(); ++pos)
+            (*pos)->evaluate(0, samples, per_point_threaded);
+    } else {
+        for (int i = 0; i < samples; i++)
+            for (std::vector<PerPointEqn*>::iterator pos = per_point_eqn_tree.begin(); pos != per_point_eqn_tree.end(); ++pos)
+                (*pos)->evaluate(i);
+    }
+
+    /* Left as the last point left them, for the per frame equations */
+    if (samples > 0) {
+        sample = sample_mesh[samples - 1];
+        v1 = left[samples - 1];
+        v2 = right[samples - 1];
+
+        for (std::vector<Param*>::iterator pos = per_point_locals.begin(); pos != per_point_locals.end(); ++pos)
+            *(float*)(*pos)->engine_val = ((float*)(*pos)->matrix)[samples - 1];
+    }
+
+    for (int i = 0; i < samples; i++) {
+        points[i].x = x_mesh[i];
+        points[i].y = y_mesh[i];
+        points[i].r = r_mesh[i];
+        points[i].g = g_mesh[i];
+        points[i].b = b_mesh[i];
+        points[i].a = a_mesh[i];
+    }
+
+    per_point_time = getMonotonicTime() - start;
 }
 
 
@@ -479,6 +312,6 @@ void CustomWave::loadUnspecInitConds()
 {
 
     InitCondUtils::LoadUnspecInitCond fun(this->init_cond_tree, this->per_frame_init_eqn_tree);
-    traverse(param_tree, fun);
+    param_tree.apply(fun);
 }
 
@@ -33,6 +33,7 @@
 
 class CustomWave;
 class GenExpr;
+class LoopTime;
 class PerPointEqn;
 class Preset;
 
@@ -41,6 +42,8 @@ class Preset;
 #include "Common.hpp"
 #include "Param.hpp"
 #include "PerFrameEqn.hpp"
+#include "ExprOptimizer.hpp"
+#include "ParamSchema.hpp"
 #include "Renderer/Waveform.hpp"
 
 #include <map>
@@ -58,14 +61,14 @@ public:
     /** Destructor is necessary so we can free the per point matrices **/
     ~CustomWave();
 
-    ColoredPoint PerPoint(ColoredPoint p, const WaveformContext context);
+    void PerPoints(std::vector<ColoredPoint> &points, const float *left, const float *right, BeatDetect *music);
 
     /* Numerical id */
     int id;
     int per_frame_count;
 
     /* Parameter tree associated with this custom wave */
-    std::map<std::string,Param*> param_tree;
+    ParamTable param_tree;
 
     /* Engine variables */
     float x; /* x position for per point equations */
@@ -99,7 +102,7 @@ public:
     float t8;
 
 
-    /* stupider q variables */
+    /* stupider q variables, q1 in q[0] */
     float q[NUM_Q_VARIABLES];
 
     float v1,v2;
@@ -110,12 +113,29 @@ public:
     std::vector<PerPointEqn*>  per_point_eqn_tree;
     std::map<std::string,InitCond*>  per_frame_init_eqn_tree;
 
+    /* Holds what the per point equations compute once per frame */
+    ExprOptimizer per_point_optimizer;
+
+    /* Per point equations run one after the other over all points instead
+       of all of them point by point, side by side on several threads if
+       threaded. Set by planPerPoint() */
+    bool per_point_batched;
+    bool per_point_threaded;
+    /* Params written per point without a matrix, given one to batch */
+    std::vector<Param*> per_point_locals;
+
+    /* Milliseconds the last PerPoints() took, for the budget of the waves */
+    float per_point_time;
+    /* Loop time the per point equations of all waves of the preset share in
+       a frame, 0 for a full budget of its own every time */
+    LoopTime * per_point_loop_time;
+
     /* Denotes the index of the last character for each string buffer */
     int per_point_eqn_string_index;
     int per_frame_eqn_string_index;
     int per_frame_init_eqn_string_index;
 
-    int add_per_point_eqn(char * name, GenExpr * gen_expr);
+    int add_per_point_eqn(char * name, GenExpr * gen_expr, unsigned int line = 0);
     void evalCustomWaveInitConditions(Preset *preset);
     
 
@@ -123,6 +143,16 @@ public:
 
     void evalInitConds();
 
+    /// Decides how the per point equations run, before they are optimized.
+    /// They are batched when that computes what going point by point does:
+    /// no value written without a matrix is read before it is written in the
+    /// same point, and at most one equation calls rand
+    void planPerPoint();
+
+private:
+    static const ParamSchema & paramSchema(CustomWave * prototype);
+    static ParamSchema * loadParamSchema(CustomWave * wave);
+
 };
 
 #endif /** !_CUSTOM_WAVE_H */
@@ -33,60 +33,34 @@
 #include "wipemalloc.h"
 
 #include "BuiltinFuncs.hpp"
+#include "ExprOptimizer.hpp"
 
-InfixOp *Eval::infix_add = NULL;
-InfixOp *Eval::infix_minus = NULL;
-InfixOp *Eval::infix_div = NULL;
-InfixOp *Eval::infix_mult = NULL;
-InfixOp *Eval::infix_or = NULL;
-InfixOp *Eval::infix_and = NULL;
-InfixOp *Eval::infix_mod = NULL;
-InfixOp *Eval::infix_negative = NULL;
-InfixOp *Eval::infix_positive = NULL;
+/* The infix operators never change, so every preset on every thread shares
+   one immutable set */
+static InfixOp infixAdd(INFIX_ADD, 4);
+static InfixOp infixMinus(INFIX_MINUS, 3);
+static InfixOp infixDiv(INFIX_DIV, 2);
+static InfixOp infixOr(INFIX_OR, 5);
+static InfixOp infixAnd(INFIX_AND, 4);
+static InfixOp infixMod(INFIX_MOD, 1);
+static InfixOp infixMult(INFIX_MULT, 2);
 
-/* Initializes all infix operators */
-int Eval::init_infix_ops()
-{
-
-    Eval::infix_add = new InfixOp(INFIX_ADD, 4);
-    Eval::infix_minus = new InfixOp(INFIX_MINUS, 3);
-    Eval::infix_div = new InfixOp(INFIX_DIV, 2);
-    Eval::infix_or = new InfixOp(INFIX_OR, 5);
-    Eval::infix_and = new InfixOp(INFIX_AND,4);
-    Eval::infix_mod = new InfixOp(INFIX_MOD, 1);
-    Eval::infix_mult = new InfixOp(INFIX_MULT, 2);
+/* Prefix operators */
+static InfixOp infixPositive(INFIX_ADD, 0);
+static InfixOp infixNegative(INFIX_MINUS, 0);
 
-    /* Prefix operators */
-    Eval::infix_positive = new InfixOp(INFIX_ADD, 0);
-    Eval::infix_negative = new InfixOp(INFIX_MINUS, 0);
-
-    return PROJECTM_SUCCESS;
-}
+InfixOp * const Eval::infix_add = &infixAdd;
+InfixOp * const Eval::infix_minus = &infixMinus;
+InfixOp * const Eval::infix_div = &infixDiv;
+InfixOp * const Eval::infix_mult = &infixMult;
+InfixOp * const Eval::infix_or = &infixOr;
+InfixOp * const Eval::infix_and = &infixAnd;
+InfixOp * const Eval::infix_mod = &infixMod;
+InfixOp * const Eval::infix_negative = &infixNegative;
+InfixOp * const Eval::infix_positive = &infixPositive;
 
-/* Destroys the infix operator list. This should
-   be done on program exit */
-int Eval::destroy_infix_ops()
+GenExpr * Eval::opt_gen_expr(GenExpr * gen_expr)
 {
-
-    delete(Eval::infix_add);
-    delete(Eval::infix_minus);
-    delete(Eval::infix_div);
-    delete(Eval::infix_or);
-    delete(Eval::infix_and);
-    delete(Eval::infix_mod);
-    delete(Eval::infix_mult);
-    delete(Eval::infix_positive);
-    delete(Eval::infix_negative);
-
-    Eval::infix_add = NULL;
-    Eval::infix_minus = NULL;
-    Eval::infix_div = NULL;
-    Eval::infix_or = NULL;
-    Eval::infix_and = NULL;
-    Eval::infix_mod = NULL;
-    Eval::infix_mult = NULL;
-    Eval::infix_positive = NULL;
-    Eval::infix_negative = NULL;
-
-    return PROJECTM_SUCCESS;
+    ExprOptimizer optimizer;
+    return optimizer.optimize(gen_expr);
 }
@@ -42,6 +42,10 @@
 #define VAL_T 1
 #define PREFUN_T 3
 #define TREE_T 4
+#define SLOT_T 5
+#define NATIVE_T 6
+#define ASSIGN_T 7
+#define BUFFER_T 8
 #define NONE_T 0
 
 #define CONSTANT_TERM_T 0
@@ -59,18 +63,20 @@ class DLLEXPORT InfixOp;
 
 class Eval {
 public:
-    static InfixOp *infix_add,
-                   *infix_minus,
-                   *infix_div,
-                   *infix_mult,
-                   *infix_or,
-                   *infix_and,
-                   *infix_mod,
-                   *infix_negative,
-                   *infix_positive;
+    static InfixOp * const infix_add,
+                   * const infix_minus,
+                   * const infix_div,
+                   * const infix_mult,
+                   * const infix_or,
+                   * const infix_and,
+                   * const infix_mod,
+                   * const infix_negative,
+                   * const infix_positive;
 
     float eval_gen_expr(GenExpr * gen_expr);
-    inline GenExpr * opt_gen_expr(GenExpr * gen_expr, int ** param_list);
+    /// Folds constants, simplifies and computes repeated subexpressions once,
+    /// see ExprOptimizer. Takes gen_expr and returns its replacement
+    static GenExpr * opt_gen_expr(GenExpr * gen_expr);
 
     GenExpr * const_to_expr(float val);
     GenExpr * param_to_expr(Param * param);
@@ -81,8 +87,6 @@ public:
     static ValExpr * new_val_expr(int type, Term *term);
 
     static InfixOp * new_infix_op(int type, int precedence);
-    static int init_infix_ops();
-    static int destroy_infix_ops();
     void reset_engine_vars();
     
     GenExpr * clone_gen_expr(GenExpr * gen_expr);
@@ -0,0 +1,76 @@
+/*
+ * EvalProfiler.hpp
+ *
+ *  Evaluation counts and cycles per equation. The counters only exist when
+ *  libprojectM is built with USE_PROFILER, otherwise PROFILE_EVAL expands to
+ *  nothing and the equations carry no extra state.
+ */
+
+#ifndef EVALPROFILER_HPP_
+#define EVALPROFILER_HPP_
+
+#ifdef USE_PROFILER
+
+#include "timer.h"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
+/// Timestamp counter where the CPU has one, nanoseconds of the monotonic clock otherwise
+inline unsigned long long readCycles()
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    unsigned int lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long) hi << 32) | lo;
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    return __rdtsc();
+#else
+    return (unsigned long long) (getMonotonicTime() * 1000000.0);
+#endif
+}
+
+class EvalCounter
+{
+public:
+    unsigned long long evaluations;
+    unsigned long long cycles;
+
+    EvalCounter() : evaluations(0), cycles(0) {}
+
+    inline void reset() { evaluations = 0; cycles = 0; }
+
+    inline void add(const EvalCounter & other)
+    {
+        evaluations += other.evaluations;
+        cycles += other.cycles;
+    }
+};
+
+/// Counts one evaluation and adds the cycles between construction and destruction
+class EvalSample
+{
+public:
+    inline EvalSample(EvalCounter & counter) : _counter(counter), _start(readCycles()) {}
+
+    inline ~EvalSample()
+    {
+        _counter.evaluations++;
+        _counter.cycles += readCycles() - _start;
+    }
+
+private:
+    EvalCounter & _counter;
+    unsigned long long _start;
+};
+
+#define PROFILE_EVAL(counter) EvalSample _evalSample(counter)
+
+#else
+
+#define PROFILE_EVAL(counter)
+
+#endif /* USE_PROFILER */
+
+#endif /* EVALPROFILER_HPP_ */
@@ -22,10 +22,14 @@
 #include "wipemalloc.h"
 
 #include "Expr.hpp"
+#include <algorithm>
 #include <cassert>
 
 #include <iostream>
 #include "Eval.hpp"
+#include "Param.hpp"
+#include "Megabuf.hpp"
+#include "timer.h"
 
 float GenExpr::eval_gen_expr ( int mesh_i, int mesh_j )
 {
@@ -41,6 +45,14 @@ float GenExpr::eval_gen_expr ( int mesh_i, int mesh_j )
         return l;
     case TREE_T:
         return ( ( TreeExpr* ) ( item ) )->eval_tree_expr ( mesh_i, mesh_j );
+    case SLOT_T:
+        return ( ( SlotExpr* ) item )->eval_slot_expr ( mesh_i, mesh_j );
+    case NATIVE_T:
+        return ( ( NativeExpr* ) item )->eval_native_expr ( mesh_i, mesh_j );
+    case ASSIGN_T:
+        return ( ( AssignExpr* ) item )->eval_assign_expr ( mesh_i, mesh_j );
+    case BUFFER_T:
+        return ( ( BufferExpr* ) item )->eval_buffer_expr ( mesh_i, mesh_j );
     default:
         return EVAL_ERROR;
     }
@@ -51,28 +63,71 @@ float GenExpr::eval_gen_expr ( int mesh_i, int mesh_j )
 float PrefunExpr::eval_prefun_expr ( int mesh_i, int mesh_j )
 {
 
-
     assert ( func_ptr );
 
-    float * arg_list = new float[this->num_args];
-
-    assert(arg_list);
+    /* Control builtins evaluate only the arguments that decide the result,
+       with the same truth test as their wrappers */
+    switch ( evaluation ) {
+    case PREFUN_IF:
+        if ( ( int ) expr_list[0]->eval_gen_expr ( mesh_i, mesh_j ) == 0 )
+            return expr_list[2]->eval_gen_expr ( mesh_i, mesh_j );
+        return expr_list[1]->eval_gen_expr ( mesh_i, mesh_j );
+    case PREFUN_BAND:
+        if ( ( int ) expr_list[0]->eval_gen_expr ( mesh_i, mesh_j ) == 0 )
+            return 0;
+        return ( float ) ( ( int ) expr_list[1]->eval_gen_expr ( mesh_i, mesh_j ) != 0 );
+    case PREFUN_BOR:
+        if ( ( int ) expr_list[0]->eval_gen_expr ( mesh_i, mesh_j ) != 0 )
+            return 1;
+        return ( float ) ( ( int ) expr_list[1]->eval_gen_expr ( mesh_i, mesh_j ) != 0 );
+    case PREFUN_LOOP:
+    case PREFUN_WHILE:
+        if ( !LoopBudget::open() ) {
+            LoopBudget budget;
+            return eval_loop ( mesh_i, mesh_j );
+        }
+        return eval_loop ( mesh_i, mesh_j );
+    }
 
-    //printf("numargs %d", num_args);
+    float stack_args[PREFUN_MAX_ARGS];
+    float * arg_list = num_args <= PREFUN_MAX_ARGS ? stack_args : new float[num_args];
 
     /* Evaluate each argument before calling the function itself */
     for ( int i = 0; i < num_args; i++ ) {
         arg_list[i] = expr_list[i]->eval_gen_expr ( mesh_i, mesh_j );
-        //printf("numargs %x", arg_list[i]);
-
-
     }
+
     /* Now we call the function, passing a list of
        floats as its argument */
-
     const float value = ( func_ptr ) ( arg_list );
 
-    delete[](arg_list);
+    if ( arg_list != stack_args )
+        delete[](arg_list);
+    return value;
+}
+
+/* Runs the code of loop or while, the value is the last one it computed */
+float PrefunExpr::eval_loop ( int mesh_i, int mesh_j )
+{
+    float value = 0;
+
+    if ( evaluation == PREFUN_WHILE ) {
+        for ( int i = 0; i < PREFUN_LOOP_MAX && LoopBudget::running(); i++ ) {
+            value = expr_list[0]->eval_gen_expr ( mesh_i, mesh_j );
+            if ( ( int ) value == 0 )
+                break;
+        }
+        return value;
+    }
+
+    const float count = expr_list[0]->eval_gen_expr ( mesh_i, mesh_j );
+    if ( !( count >= 1 ) )
+        return 0;
+
+    const int runs = count < PREFUN_LOOP_MAX ? ( int ) count : PREFUN_LOOP_MAX;
+    for ( int i = 0; i < runs && LoopBudget::running(); i++ )
+        value = expr_list[1]->eval_gen_expr ( mesh_i, mesh_j );
+
     return value;
 }
 
@@ -238,7 +293,7 @@ GenExpr * GenExpr::param_to_expr ( Param * param )
 }
 
 /* Converts a prefix function to an expression */
-GenExpr * GenExpr::prefun_to_expr ( float ( *func_ptr ) ( void * ), GenExpr ** expr_list, int num_args )
+GenExpr * GenExpr::prefun_to_expr ( float ( *func_ptr ) ( void * ), GenExpr ** expr_list, int num_args, int evaluation )
 {
 
     GenExpr * gen_expr;
@@ -252,6 +307,7 @@ GenExpr * GenExpr::prefun_to_expr ( float ( *func_ptr ) ( void * ), GenExpr ** e
     prefun_expr->num_args = num_args;
     prefun_expr->func_ptr = ( float ( * ) ( void* ) ) func_ptr;
     prefun_expr->expr_list = expr_list;
+    prefun_expr->evaluation = evaluation;
 
     gen_expr = new GenExpr ( PREFUN_T, ( void* ) prefun_expr );
 
@@ -297,6 +353,18 @@ GenExpr::~GenExpr()
     case TREE_T:
         delete ( ( TreeExpr* ) item );
         break;
+    case SLOT_T:
+        delete ( ( SlotExpr* ) item );
+        break;
+    case NATIVE_T:
+        delete ( ( NativeExpr* ) item );
+        break;
+    case ASSIGN_T:
+        delete ( ( AssignExpr* ) item );
+        break;
+    case BUFFER_T:
+        delete ( ( BufferExpr* ) item );
+        break;
     }
 }
 
@@ -310,7 +378,7 @@ PrefunExpr::~PrefunExpr()
     for ( i = 0 ; i < num_args; i++ ) {
         delete expr_list[i];
     }
-    free ( expr_list );
+    ExprArena::destroy ( expr_list );
 }
 
 /* Frees values of type VARIABLE and CONSTANT */
@@ -351,4 +419,135 @@ InfixOp::InfixOp ( int type, int precedence )
 
 
 
-PrefunExpr::PrefunExpr() {}
+PrefunExpr::PrefunExpr() : evaluation ( PREFUN_EAGER ) {}
+
+SlotExpr::SlotExpr ( GenExpr * _expr ) : expr ( _expr ), value ( &stored ), stored ( 0 ) {}
+
+SlotExpr::SlotExpr ( float * _value ) : expr ( NULL ), value ( _value ), stored ( 0 ) {}
+
+SlotExpr::~SlotExpr()
+{
+    if ( expr != NULL )
+        delete expr;
+}
+
+/* Evaluates the stored expression, or reads what it stored */
+float SlotExpr::eval_slot_expr ( int mesh_i, int mesh_j )
+{
+    if ( expr != NULL )
+        *value = expr->eval_gen_expr ( mesh_i, mesh_j );
+
+    return *value;
+}
+
+NativeExpr::NativeExpr ( GenExpr * _expr ) : expr ( _expr ), code ( NULL ) {}
+
+NativeExpr::~NativeExpr()
+{
+    delete expr;
+}
+
+/* Runs the code, or the expression compiled while there is none */
+float NativeExpr::eval_native_expr ( int mesh_i, int mesh_j )
+{
+    if ( code != NULL )
+        return code ( mesh_i, mesh_j );
+
+    return expr->eval_gen_expr ( mesh_i, mesh_j );
+}
+
+BufferExpr::BufferExpr ( Megabuf * _buffer, GenExpr * _index ) : buffer ( _buffer ), index ( _index ) {}
+
+BufferExpr::~BufferExpr()
+{
+    delete index;
+}
+
+float BufferExpr::eval_buffer_expr ( int mesh_i, int mesh_j )
+{
+    return buffer->get ( index->eval_gen_expr ( mesh_i, mesh_j ) );
+}
+
+AssignExpr::AssignExpr ( Param * _param, GenExpr * _expr ) : param ( _param ), item ( NULL ), expr ( _expr ) {}
+
+AssignExpr::AssignExpr ( BufferExpr * _item, GenExpr * _expr ) : param ( NULL ), item ( _item ), expr ( _expr ) {}
+
+AssignExpr::~AssignExpr()
+{
+    delete item;
+    delete expr;
+}
+
+/* Assigns like the equation of the param would where it is evaluated:
+   the point of its matrix in per pixel and per point equations, the param
+   itself anywhere else. The index of an item is evaluated first */
+float AssignExpr::eval_assign_expr ( int mesh_i, int mesh_j )
+{
+    if ( item != NULL ) {
+        const float index = item->index->eval_gen_expr ( mesh_i, mesh_j );
+        const float value = expr->eval_gen_expr ( mesh_i, mesh_j );
+        item->buffer->set ( index, value );
+        return value;
+    }
+
+    const float value = expr->eval_gen_expr ( mesh_i, mesh_j );
+
+    if ( mesh_i >= 0 && param->matrix != NULL && param->type == P_TYPE_DOUBLE ) {
+        if ( mesh_j >= 0 )
+            ( ( float** ) param->matrix ) [mesh_i][mesh_j] = value;
+        else
+            ( ( float* ) param->matrix ) [mesh_i] = value;
+        param->matrix_flag = true;
+        return value;
+    }
+
+    param->set_param ( value );
+    return value;
+}
+
+EXPR_ARENA_THREAD LoopBudget * LoopBudget::_current = 0;
+
+LoopBudget::LoopBudget ( float milliseconds ) :
+    _previous ( _current ), _deadline ( getMonotonicTime() + milliseconds ),
+    _countdown ( PREFUN_LOOP_CLOCK ), _spent ( false ), _left ( 0 )
+{
+    _current = this;
+}
+
+LoopBudget::LoopBudget ( LoopTime & left ) :
+    _previous ( _current ), _deadline ( getMonotonicTime() + left.milliseconds ),
+    _countdown ( PREFUN_LOOP_CLOCK ), _spent ( left.milliseconds <= 0 ), _left ( &left )
+{
+    _current = this;
+}
+
+LoopBudget::~LoopBudget()
+{
+    _current = _previous;
+
+    if ( _left )
+        _left->milliseconds = _spent ? 0 : std::max ( 0.0, _deadline - getMonotonicTime() );
+}
+
+bool LoopBudget::running()
+{
+    LoopBudget * budget = _current;
+    if ( budget == 0 )
+        return true;
+    if ( budget->_spent )
+        return false;
+
+    if ( --budget->_countdown > 0 )
+        return true;
+
+    budget->_countdown = PREFUN_LOOP_CLOCK;
+    if ( getMonotonicTime() >= budget->_deadline ) {
+        if ( budget->_left )
+            budget->_left->ranOut = true;
+        else
+            std::cerr << "[LoopBudget] loops ran out of time, stopped" << std::endl;
+        budget->_spent = true;
+        return false;
+    }
+    return true;
+}
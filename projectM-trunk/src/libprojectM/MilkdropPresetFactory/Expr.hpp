@@ -31,14 +31,77 @@
 
 #include "dlldefs.h"
 #include "CValue.hpp"
+#include "ExprArena.hpp"
 
 class Param;
+class Megabuf;
 
 #define CONST_STACK_ELEMENT 0
 #define EXPR_STACK_ELEMENT 1
 
 #define EVAL_ERROR -1
 
+/* How a prefix function evaluates its arguments */
+#define PREFUN_EAGER 0 /* all of them, then calls the function */
+#define PREFUN_IF 1 /* the condition, then only the branch taken */
+#define PREFUN_BAND 2 /* the second only if the first is true */
+#define PREFUN_BOR 3 /* the second only if the first is false */
+#define PREFUN_LOOP 4 /* the first once, then the second that many times */
+#define PREFUN_WHILE 5 /* the only one again and again until it is false */
+
+/* Arguments of an eager function are passed on the stack up to this many */
+#define PREFUN_MAX_ARGS 8
+
+/* Most times loop and while run their code, as in Milkdrop 2 */
+#define PREFUN_LOOP_MAX 1048576
+/* Runs of the code of a loop between two looks at the clock */
+#define PREFUN_LOOP_CLOCK 1024
+/* Milliseconds the loops of one stage of a frame may take together */
+#define PREFUN_LOOP_BUDGET 20
+
+/// Time left to the loops of a stage, which may be evaluated in parts apart
+/// as the per point equations of the custom waves are, each wave while it
+/// is drawn. Whoever owns it reports the loops running out of time
+class LoopTime
+{
+public:
+  explicit LoopTime( float milliseconds = PREFUN_LOOP_BUDGET ) : milliseconds( milliseconds ), ranOut( false ) {}
+
+  float milliseconds;
+  bool ranOut;
+};
+
+/// The time left to the loops a thread evaluates. Each stage of a frame
+/// opens one for everything it runs, a loop run outside of any opens its
+/// own. Once the time is up every loop under the budget stops where it is,
+/// so a preset looping for too long slows a frame down but can't hang it
+class LoopBudget
+{
+public:
+  explicit LoopBudget( float milliseconds = PREFUN_LOOP_BUDGET );
+  /// Takes the time left to a stage, and hands back what it didn't use
+  explicit LoopBudget( LoopTime & left );
+  ~LoopBudget();
+
+  static bool open() { return _current != 0; }
+
+  /// False once the budget open on the thread is spent. Called before every
+  /// run of the code of a loop, looks at the clock only now and then
+  static bool running();
+
+private:
+  static EXPR_ARENA_THREAD LoopBudget * _current;
+
+  LoopBudget * _previous;
+  double _deadline;
+  int _countdown;
+  bool _spent;
+  LoopTime * _left;
+
+  LoopBudget( const LoopBudget & );
+  LoopBudget & operator=( const LoopBudget & );
+};
+
 /* Infix Operator Function */
 class InfixOp
 {
@@ -60,7 +123,7 @@ public:
 };
 
 /* General Expression Type */
-class GenExpr
+class GenExpr : public ArenaObject
 {
 public:
   int type;
@@ -73,11 +136,12 @@ public:
  
   static GenExpr *const_to_expr( float val );
   static GenExpr *param_to_expr( Param *param );
-  static GenExpr *prefun_to_expr( float (*func_ptr)(void *), GenExpr **expr_list, int num_args );
+  static GenExpr *prefun_to_expr( float (*func_ptr)(void *), GenExpr **expr_list, int num_args,
+                                  int evaluation = PREFUN_EAGER );
 };
 
 /* Value expression, contains a term union */
-class ValExpr
+class ValExpr : public ArenaObject
 {
 public:
   int type;
@@ -90,7 +154,7 @@ public:
 };
 
 /* A binary expression tree ordered by operator precedence */
-class TreeExpr
+class TreeExpr : public ArenaObject
 {
 public:
   InfixOp * infix_op; /* null if leaf */
@@ -105,18 +169,84 @@ public:
 };
 
 /* A function expression in prefix form */
-class PrefunExpr
+class PrefunExpr : public ArenaObject
 {
 public:
   float (*func_ptr)(void*);
   int num_args;
   GenExpr **expr_list;
+  int evaluation; /* PREFUN_EAGER or the short circuit of a control builtin */
   PrefunExpr();
   ~PrefunExpr();
 
   /* Evaluates functions in prefix form */
   float eval_prefun_expr(int mesh_i, int mesh_j);
 
+private:
+  float eval_loop(int mesh_i, int mesh_j);
+};
+
+/* A subexpression evaluated once and its value used again elsewhere */
+class SlotExpr : public ArenaObject
+{
+public:
+  GenExpr * expr; /* evaluated and stored, null where the value is only read */
+  float * value;
+
+  /* Stores the value of expr, which it takes */
+  SlotExpr( GenExpr * expr );
+  /* Reads the value stored by another slot expression */
+  SlotExpr( float * value );
+  ~SlotExpr();
+
+  float eval_slot_expr(int mesh_i, int mesh_j);
+
+private:
+  float stored;
+};
+
+/* megabuf(index) or gmegabuf(index) */
+class BufferExpr : public ArenaObject
+{
+public:
+  Megabuf * buffer;
+  GenExpr * index;
+
+  /* Takes index */
+  BufferExpr( Megabuf * buffer, GenExpr * index );
+  ~BufferExpr();
+
+  float eval_buffer_expr(int mesh_i, int mesh_j);
+};
+
+/* An assignment within an expression, its value the value assigned */
+class AssignExpr : public ArenaObject
+{
+public:
+  Param * param; /* assigned, null when item is */
+  BufferExpr * item; /* item of a buffer assigned, null when param is */
+  GenExpr * expr;
+
+  /* Take item and expr */
+  AssignExpr( Param * param, GenExpr * expr );
+  AssignExpr( BufferExpr * item, GenExpr * expr );
+  ~AssignExpr();
+
+  float eval_assign_expr(int mesh_i, int mesh_j);
+};
+
+/* An expression compiled to machine code, see ExprJit */
+class NativeExpr : public ArenaObject
+{
+public:
+  GenExpr * expr; /* what was compiled, the code reads the slots and constants in it */
+  float (*code)(int mesh_i, int mesh_j); /* null until the code is ready */
+
+  /* Takes expr */
+  NativeExpr( GenExpr * expr );
+  ~NativeExpr();
+
+  float eval_native_expr(int mesh_i, int mesh_j);
 };
 
 #endif /** _EXPR_H */
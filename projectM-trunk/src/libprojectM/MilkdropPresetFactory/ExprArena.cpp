@@ -0,0 +1,92 @@
+/*
+ * ExprArena.cpp
+ *
+ *  Bump allocation of what a preset parses.
+ */
+
+#include <cstdlib>
+
+#include "ExprArena.hpp"
+
+EXPR_ARENA_THREAD ExprArena * ExprArena::_current = NULL;
+
+ExprArena::ExprArena() : _chunks(NULL), _next(NULL), _end(NULL), _used(0), _reserved(0) {}
+
+ExprArena::~ExprArena()
+{
+    while (_chunks) {
+        Chunk * next = _chunks->next;
+        free(_chunks);
+        _chunks = next;
+    }
+}
+
+ExprArena::Scope::Scope(ExprArena & arena) : _previous(_current)
+{
+    _current = &arena;
+}
+
+ExprArena::Scope::~Scope()
+{
+    _current = _previous;
+}
+
+ExprArena::Chunk * ExprArena::chunk(size_t bytes)
+{
+    Chunk * taken = (Chunk *) malloc(sizeof(Chunk) + bytes);
+    if (taken == NULL)
+        return NULL;
+
+    taken->next = _chunks;
+    _chunks = taken;
+    _reserved += sizeof(Chunk) + bytes;
+    return taken;
+}
+
+void * ExprArena::allocate(size_t size)
+{
+    /* A large block leaves the chunk being filled as it is */
+    if (size > EXPR_ARENA_CHUNK / 4) {
+        Chunk * large = chunk(size);
+        if (large == NULL)
+            return NULL;
+        _used += size;
+        return large + 1;
+    }
+
+    if (size > (size_t) (_end - _next)) {
+        Chunk * next = chunk(EXPR_ARENA_CHUNK);
+        if (next == NULL)
+            return NULL;
+        _next = (char *) (next + 1);
+        _end = _next + EXPR_ARENA_CHUNK;
+    }
+
+    void * block = _next;
+    _next += size;
+    _used += size;
+    return block;
+}
+
+void * ExprArena::create(size_t size)
+{
+    /* Rounded up so the next block is aligned as well */
+    size = (size + sizeof(Header) - 1) / sizeof(Header) * sizeof(Header) + sizeof(Header);
+
+    Header * header = (Header *) (_current ? _current->allocate(size) : malloc(size));
+    if (header == NULL)
+        throw std::bad_alloc();
+
+    header->arena = _current;
+    return header + 1;
+}
+
+void ExprArena::destroy(void * block)
+{
+    if (block == NULL)
+        return;
+
+    Header * header = (Header *) block - 1;
+    if (header->arena == NULL)
+        free(header);
+}
@@ -0,0 +1,94 @@
+/*
+ * ExprArena.hpp
+ *
+ *  Memory of the expression trees, equations and params parsed for a preset.
+ *  While a preset loads, its arena is the current one of the loading thread
+ *  and objects derived from ArenaObject are carved out of large chunks one
+ *  after the other instead of coming from the heap one by one: the nodes of
+ *  an equation end up next to each other, deleting one frees nothing, and
+ *  the chunks are freed all at once with the preset. Objects created with
+ *  no arena current come from the heap as before.
+ */
+
+#ifndef EXPRARENA_HPP_
+#define EXPRARENA_HPP_
+
+#include <cstddef>
+#include <new>
+
+#ifdef _MSC_VER
+#define EXPR_ARENA_THREAD __declspec(thread)
+#else
+#define EXPR_ARENA_THREAD __thread
+#endif
+
+/* Bytes of a chunk, blocks over a quarter of it get a chunk of their own */
+#define EXPR_ARENA_CHUNK 65536
+
+class ExprArena
+{
+public:
+    ExprArena();
+    /// Frees the chunks. Whatever was allocated from them must be gone
+    ~ExprArena();
+
+    /// Makes an arena the current one of the thread for as long as it lives
+    class Scope
+    {
+    public:
+        explicit Scope(ExprArena & arena);
+        ~Scope();
+
+    private:
+        ExprArena * _previous;
+
+        Scope(const Scope &);
+        Scope & operator=(const Scope &);
+    };
+
+    /// A block from the current arena, from the heap if there is none.
+    /// Throws std::bad_alloc when out of memory
+    static void * create(size_t size);
+    /// Frees a block from the heap, blocks from an arena go with the arena
+    static void destroy(void * block);
+
+    /// Bytes handed out and bytes of chunks taken
+    size_t used() const { return _used; }
+    size_t reserved() const { return _reserved; }
+
+private:
+    /// Ahead of every block, aligned like anything stored after it
+    union Header {
+        ExprArena * arena;
+        double align;
+    };
+
+    struct Chunk {
+        Chunk * next;
+        Header align;
+    };
+
+    Chunk * chunk(size_t bytes);
+    void * allocate(size_t size);
+
+    static EXPR_ARENA_THREAD ExprArena * _current;
+
+    Chunk * _chunks;
+    char * _next;
+    char * _end;
+    size_t _used;
+    size_t _reserved;
+
+    ExprArena(const ExprArena &);
+    ExprArena & operator=(const ExprArena &);
+};
+
+/// Base of the classes allocated from the current arena
+class ArenaObject
+{
+public:
+    static void * operator new(size_t size) { return ExprArena::create(size); }
+    static void operator delete(void * block) { ExprArena::destroy(block); }
+};
+
+#endif /* EXPRARENA_HPP_ */
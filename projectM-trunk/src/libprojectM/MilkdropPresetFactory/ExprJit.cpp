@@ -0,0 +1,683 @@
+/*
+ * ExprJit.cpp
+ *
+ *  x86-64 code of preset equations, System V calling convention.
+ */
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "ExprJit.hpp"
+#include "Expr.hpp"
+#include "Eval.hpp"
+
+bool ExprJit::_enabled = true;
+
+#ifdef EXPR_JIT_X86_64
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "BuiltinFuncs.hpp"
+#include "Param.hpp"
+#include "fatal.h"
+
+/* Functions start on this many bytes */
+#define EXPR_JIT_ALIGN 16
+
+/* Builtins computed inline */
+#define INLINE_NONE 0
+#define INLINE_ABS 1
+#define INLINE_SQR 2
+#define INLINE_SQRT 3
+#define INLINE_SIGN 4
+#define INLINE_BNOT 5
+#define INLINE_MIN 6
+#define INLINE_MAX 7
+#define INLINE_ABOVE 8
+#define INLINE_BELOW 9
+#define INLINE_EQUAL 10
+
+/* Called by the code for what it doesn't compile itself */
+static float interpret(GenExpr * expr, int mesh_i, int mesh_j)
+{
+    return expr->eval_gen_expr(mesh_i, mesh_j);
+}
+
+/// Writes the function of one equation. The mesh point, passed in edi and
+/// esi, is kept in ebx and ebp. Every expression leaves its value in xmm0;
+/// the right operand of an operator goes to xmm1, and the value of the left
+/// one waits in a slot of the stack frame when computing the right one
+/// takes more than a load
+class X64Compiler
+{
+public:
+    X64Compiler(std::vector<unsigned char> & code) : _code(code), _depth(0), _slots(0) {}
+
+    void function(GenExpr * expr)
+    {
+        emit("55");                     /* push rbp */
+        emit("53");                     /* push rbx */
+        emit("48 81 EC");               /* sub rsp, frame */
+        const size_t frame = _code.size();
+        dword(0);
+        emit("89 FB");                  /* mov ebx, edi */
+        emit("89 F5");                  /* mov ebp, esi */
+
+        genExpr(expr);
+
+        /* Slots in 16 bytes, and 8 more so calls find the stack aligned */
+        const unsigned int size = (_slots * sizeof(float) + 15) / 16 * 16 + 8;
+        memcpy(&_code[frame], &size, sizeof(size));
+
+        emit("48 81 C4");               /* add rsp, frame */
+        dword(size);
+        emit("5B");                     /* pop rbx */
+        emit("5D");                     /* pop rbp */
+        emit("C3");                     /* ret */
+    }
+
+private:
+    /* Encoding */
+
+    void emit(const char * hex)
+    {
+        while (*hex) {
+            char * end;
+            _code.push_back((unsigned char) strtol(hex, &end, 16));
+            hex = end;
+            while (*hex == ' ')
+                hex++;
+        }
+    }
+
+    void dword(unsigned int value)
+    {
+        for (int i = 0; i < 4; i++)
+            _code.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    void qword(const void * address)
+    {
+        const unsigned long long value = (unsigned long long) (size_t) address;
+        for (int i = 0; i < 8; i++)
+            _code.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    /// Jump with a 32 bit displacement, returns where to land() it
+    size_t jump(const char * opcode)
+    {
+        emit(opcode);
+        dword(0);
+        return _code.size();
+    }
+
+    void land(size_t jump)
+    {
+        const int displacement = _code.size() - jump;
+        memcpy(&_code[jump - 4], &displacement, sizeof(displacement));
+    }
+
+    void address(const void * address)
+    {
+        emit("48 B8");                  /* mov rax, address */
+        qword(address);
+    }
+
+    void constant(float value, int xmm)
+    {
+        unsigned int bits;
+        memcpy(&bits, &value, sizeof(bits));
+        emit("B8");                     /* mov eax, bits */
+        dword(bits);
+        emit(xmm ? "66 0F 6E C8" : "66 0F 6E C0");  /* movd xmm, eax */
+    }
+
+    /// Slots hold values waiting while others are computed
+    int push()
+    {
+        if (++_depth > _slots)
+            _slots = _depth;
+        return _depth - 1;
+    }
+
+    void pop() { _depth--; }
+
+    void store(int slot)
+    {
+        emit("F3 0F 11 84 24");         /* movss [rsp + slot], xmm0 */
+        dword(slot * sizeof(float));
+    }
+
+    void load(int slot)
+    {
+        emit("F3 0F 10 84 24");         /* movss xmm0, [rsp + slot] */
+        dword(slot * sizeof(float));
+    }
+
+    /// The value of xmm0 converted to int, as (int) does, in eax and tested
+    void truth()
+    {
+        emit("F3 0F 2C C0");            /* cvttss2si eax, xmm0 */
+        emit("85 C0");                  /* test eax, eax */
+    }
+
+    /// xmm0 = 1 if the last test or comparison left al set, else 0
+    void flag(const char * setcc)
+    {
+        emit(setcc);                    /* setcc al */
+        emit("0F B6 C0");               /* movzx eax, al */
+        emit("F3 0F 2A C0");            /* cvtsi2ss xmm0, eax */
+    }
+
+    /* Values */
+
+    /// Whether reading the param depends on the mesh point
+    static bool perPoint(const Param * param)
+    {
+        return param->type == P_TYPE_DOUBLE && (param->matrix != NULL || (param->flags & P_FLAG_ALWAYS_MATRIX));
+    }
+
+    /// The constant or param a tree leaf holds, if loading it is all its value takes
+    static ValExpr * leaf(GenExpr * expr)
+    {
+        while (expr) {
+            if (expr->type == VAL_T) {
+                ValExpr * val = (ValExpr *) expr->item;
+                if (val->type == CONSTANT_TERM_T ||
+                    (val->type == PARAM_TERM_T && val->term.param->type <= P_TYPE_DOUBLE && !perPoint(val->term.param)))
+                    return val;
+                return NULL;
+            }
+            if (expr->type != TREE_T)
+                return NULL;
+
+            TreeExpr * tree = (TreeExpr *) expr->item;
+            if (tree->infix_op)
+                return NULL;
+            expr = tree->gen_expr;
+        }
+        return NULL;
+    }
+
+    static ValExpr * leaf(TreeExpr * tree)
+    {
+        if (tree->infix_op)
+            return NULL;
+        return leaf(tree->gen_expr);
+    }
+
+    void genExpr(GenExpr * expr)
+    {
+        switch (expr->type) {
+        case VAL_T:
+            genVal((ValExpr *) expr->item, 0);
+            break;
+        case PREFUN_T:
+            /* Loops are left to the interpreter, it keeps to their time budget */
+            if (((PrefunExpr *) expr->item)->evaluation == PREFUN_LOOP ||
+                ((PrefunExpr *) expr->item)->evaluation == PREFUN_WHILE)
+                genInterpret(expr);
+            else
+                genPrefun((PrefunExpr *) expr->item);
+            break;
+        case TREE_T:
+            genTree((TreeExpr *) expr->item);
+            break;
+        case SLOT_T:
+            genSlot((SlotExpr *) expr->item);
+            break;
+        case NATIVE_T:
+        case ASSIGN_T:
+        case BUFFER_T:
+            genInterpret(expr);
+            break;
+        default:
+            constant(EVAL_ERROR, 0);
+        }
+    }
+
+    void genInterpret(GenExpr * expr)
+    {
+        emit("48 BF");                  /* mov rdi, expr */
+        qword(expr);
+        emit("89 DE");                  /* mov esi, ebx */
+        emit("89 EA");                  /* mov edx, ebp */
+        call((const void *) interpret);
+    }
+
+    void call(const void * function)
+    {
+        address(function);
+        emit("FF D0");                  /* call rax */
+    }
+
+    /// Into xmm0, or xmm1 for values leaf() accepts
+    void genVal(ValExpr * val, int xmm)
+    {
+        if (val->type == CONSTANT_TERM_T) {
+            constant(val->term.constant, xmm);
+            return;
+        }
+        if (val->type != PARAM_TERM_T) {
+            constant(PROJECTM_FAILURE, xmm);
+            return;
+        }
+
+        Param * param = val->term.param;
+        switch (param->type) {
+        case P_TYPE_BOOL:
+            address(param->engine_val);
+            emit("0F B6 00");           /* movzx eax, byte [rax] */
+            emit(xmm ? "F3 0F 2A C8" : "F3 0F 2A C0");  /* cvtsi2ss xmm, eax */
+            break;
+        case P_TYPE_INT:
+            address(param->engine_val);
+            emit("8B 00");              /* mov eax, [rax] */
+            emit(xmm ? "F3 0F 2A C8" : "F3 0F 2A C0");
+            break;
+        case P_TYPE_DOUBLE:
+            if (perPoint(param)) {
+                assert(xmm == 0);
+                genMatrix(param);
+            } else {
+                address(param->engine_val);
+                emit(xmm ? "F3 0F 10 08" : "F3 0F 10 00");  /* movss xmm, [rax] */
+            }
+            break;
+        default:
+            constant(EVAL_ERROR, xmm);
+        }
+    }
+
+    /// The value of the mesh point while the param has one, as ValExpr reads it
+    void genMatrix(Param * param)
+    {
+        emit("85 DB");                  /* test ebx, ebx */
+        const size_t noPoint = jump("0F 88");  /* js */
+
+        address(&param->matrix_flag);
+        emit("0F B7 08");               /* movzx ecx, word [rax] */
+        address(&param->flags);
+        emit("0F B7 10");               /* movzx edx, word [rax] */
+        emit("83 E2");                  /* and edx, P_FLAG_ALWAYS_MATRIX */
+        _code.push_back(P_FLAG_ALWAYS_MATRIX);
+        emit("09 D1");                  /* or ecx, edx */
+        const size_t noMatrix = jump("0F 84");  /* jz */
+
+        address(&param->matrix);
+        emit("48 8B 00");               /* mov rax, [rax] */
+        emit("48 63 CB");               /* movsxd rcx, ebx */
+        emit("85 ED");                  /* test ebp, ebp */
+        const size_t row = jump("0F 88");  /* js */
+        emit("48 8B 04 C8");            /* mov rax, [rax + rcx * 8] */
+        emit("48 63 CD");               /* movsxd rcx, ebp */
+        land(row);
+        emit("F3 0F 10 04 88");         /* movss xmm0, [rax + rcx * 4] */
+        const size_t done = jump("E9");
+
+        land(noPoint);
+        land(noMatrix);
+        address(param->engine_val);
+        emit("F3 0F 10 00");            /* movss xmm0, [rax] */
+        land(done);
+    }
+
+    void genSlot(SlotExpr * slot)
+    {
+        if (slot->expr) {
+            genExpr(slot->expr);
+            address(slot->value);
+            emit("F3 0F 11 00");        /* movss [rax], xmm0 */
+        } else {
+            address(slot->value);
+            emit("F3 0F 10 00");        /* movss xmm0, [rax] */
+        }
+    }
+
+    /// The left operand is in xmm0, computes the right one into xmm1
+    void genRight(GenExpr * expr)
+    {
+        ValExpr * val = leaf(expr);
+        if (val) {
+            genVal(val, 1);
+            return;
+        }
+
+        const int slot = push();
+        store(slot);
+        genExpr(expr);
+        emit("0F 28 C8");               /* movaps xmm1, xmm0 */
+        load(slot);
+        pop();
+    }
+
+    void genRight(TreeExpr * tree)
+    {
+        ValExpr * val = leaf(tree);
+        if (val) {
+            genVal(val, 1);
+            return;
+        }
+
+        const int slot = push();
+        store(slot);
+        genTree(tree);
+        emit("0F 28 C8");               /* movaps xmm1, xmm0 */
+        load(slot);
+        pop();
+    }
+
+    void genTree(TreeExpr * tree)
+    {
+        if (tree->infix_op == NULL) {
+            if (tree->gen_expr == NULL)
+                emit("0F 57 C0");       /* xorps xmm0, xmm0 */
+            else
+                genExpr(tree->gen_expr);
+            return;
+        }
+
+        assert(tree->left);
+        assert(tree->right);
+        genTree(tree->left);
+        genRight(tree->right);
+
+        switch (tree->infix_op->type) {
+        case INFIX_ADD:
+            emit("F3 0F 58 C1");        /* addss xmm0, xmm1 */
+            break;
+        case INFIX_MINUS:
+            emit("F3 0F 5C C1");        /* subss xmm0, xmm1 */
+            break;
+        case INFIX_MULT:
+            emit("F3 0F 59 C1");        /* mulss xmm0, xmm1 */
+            break;
+        case INFIX_DIV: {
+            emit("0F 57 D2");           /* xorps xmm2, xmm2 */
+            emit("0F 2E CA");           /* ucomiss xmm1, xmm2 */
+            const size_t unordered = jump("0F 8A");  /* jp */
+            const size_t nonzero = jump("0F 85");  /* jne */
+            constant(MAX_DOUBLE_SIZE, 0);
+            const size_t done = jump("E9");
+            land(unordered);
+            land(nonzero);
+            emit("F3 0F 5E C1");        /* divss xmm0, xmm1 */
+            land(done);
+            break;
+        }
+        case INFIX_MOD: {
+            emit("F3 0F 2C C9");        /* cvttss2si ecx, xmm1 */
+            emit("85 C9");              /* test ecx, ecx */
+            const size_t nonzero = jump("0F 85");  /* jnz */
+            constant(PROJECTM_DIV_BY_ZERO, 0);
+            const size_t done = jump("E9");
+            land(nonzero);
+            emit("F3 0F 2C C0");        /* cvttss2si eax, xmm0 */
+            emit("99");                 /* cdq */
+            emit("F7 F9");              /* idiv ecx */
+            emit("F3 0F 2A C2");        /* cvtsi2ss xmm0, edx */
+            land(done);
+            break;
+        }
+        case INFIX_OR:
+        case INFIX_AND:
+            emit("F3 0F 2C C0");        /* cvttss2si eax, xmm0 */
+            emit("F3 0F 2C C9");        /* cvttss2si ecx, xmm1 */
+            emit(tree->infix_op->type == INFIX_OR ? "09 C8" : "21 C8");  /* or / and eax, ecx */
+            emit("F3 0F 2A C0");        /* cvtsi2ss xmm0, eax */
+            break;
+        default:
+            constant(EVAL_ERROR, 0);
+        }
+    }
+
+    /// Which builtin the function is, if it is computed inline
+    static int inlined(const PrefunExpr * prefun)
+    {
+        typedef float (*Function)(void *);
+        static const struct {
+            Function function;
+            int args;
+            int inlined;
+        } builtins[] = {
+            { (Function) FuncWrappers::abs_wrapper, 1, INLINE_ABS },
+            { (Function) FuncWrappers::sqr_wrapper, 1, INLINE_SQR },
+            { (Function) FuncWrappers::sqrt_wrapper, 1, INLINE_SQRT },
+            { (Function) FuncWrappers::sign_wrapper, 1, INLINE_SIGN },
+            { (Function) FuncWrappers::bnot_wrapper, 1, INLINE_BNOT },
+            { (Function) FuncWrappers::min_wrapper, 2, INLINE_MIN },
+            { (Function) FuncWrappers::max_wrapper, 2, INLINE_MAX },
+            { (Function) FuncWrappers::above_wrapper, 2, INLINE_ABOVE },
+            { (Function) FuncWrappers::below_wrapper, 2, INLINE_BELOW },
+            { (Function) FuncWrappers::equal_wrapper, 2, INLINE_EQUAL }
+        };
+
+        for (unsigned int i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++)
+            if (prefun->func_ptr == builtins[i].function && prefun->num_args == builtins[i].args)
+                return builtins[i].inlined;
+
+        return INLINE_NONE;
+    }
+
+    void genPrefun(PrefunExpr * prefun)
+    {
+        GenExpr ** args = prefun->expr_list;
+
+        switch (prefun->evaluation) {
+        case PREFUN_IF: {
+            genExpr(args[0]);
+            truth();
+            const size_t otherwise = jump("0F 84");  /* jz */
+            genExpr(args[1]);
+            const size_t done = jump("E9");
+            land(otherwise);
+            genExpr(args[2]);
+            land(done);
+            return;
+        }
+        case PREFUN_BAND:
+        case PREFUN_BOR: {
+            genExpr(args[0]);
+            truth();
+            const bool band = prefun->evaluation == PREFUN_BAND;
+            const size_t decided = jump(band ? "0F 84" : "0F 85");  /* jz / jnz */
+            genExpr(args[1]);
+            truth();
+            flag("0F 95 C0");           /* setne al */
+            const size_t done = jump("E9");
+            land(decided);
+            if (band)
+                emit("0F 57 C0");       /* xorps xmm0, xmm0 */
+            else
+                constant(1, 0);
+            land(done);
+            return;
+        }
+        }
+
+        const int builtin = inlined(prefun);
+        switch (builtin) {
+        case INLINE_ABS:
+        case INLINE_SIGN:
+            genExpr(args[0]);
+            constant(-0.0f, 1);
+            emit(builtin == INLINE_ABS ? "0F 55 C8" : "0F 57 C1");  /* andnps xmm1, xmm0 / xorps xmm0, xmm1 */
+            if (builtin == INLINE_ABS)
+                emit("0F 28 C1");       /* movaps xmm0, xmm1 */
+            return;
+        case INLINE_SQR:
+            genExpr(args[0]);
+            emit("F3 0F 59 C0");        /* mulss xmm0, xmm0 */
+            return;
+        case INLINE_SQRT:
+            genExpr(args[0]);
+            emit("F3 0F 51 C0");        /* sqrtss xmm0, xmm0 */
+            return;
+        case INLINE_BNOT:
+            genExpr(args[0]);
+            truth();
+            flag("0F 94 C0");           /* sete al */
+            return;
+        case INLINE_MIN:
+        case INLINE_MAX:
+        case INLINE_ABOVE:
+        case INLINE_BELOW:
+        case INLINE_EQUAL:
+            genExpr(args[0]);
+            genRight(args[1]);
+            genCompare(builtin);
+            return;
+        }
+
+        /* Arguments in consecutive slots, passed as an array */
+        const int base = _depth;
+        for (int i = 0; i < prefun->num_args; i++)
+            push();
+        for (int i = 0; i < prefun->num_args; i++) {
+            genExpr(args[i]);
+            store(base + i);
+        }
+
+        emit("48 8D BC 24");            /* lea rdi, [rsp + base] */
+        dword(base * sizeof(float));
+        call((const void *) prefun->func_ptr);
+
+        for (int i = 0; i < prefun->num_args; i++)
+            pop();
+    }
+
+    /// The two argument builtins, with the first in xmm0 and the second in xmm1
+    void genCompare(int builtin)
+    {
+        switch (builtin) {
+        case INLINE_MIN:
+            /* first > second ? second : first */
+            emit("F3 0F 5D C8");        /* minss xmm1, xmm0 */
+            emit("0F 28 C1");           /* movaps xmm0, xmm1 */
+            break;
+        case INLINE_MAX:
+            /* first > second ? first : second */
+            emit("F3 0F 5F C1");        /* maxss xmm0, xmm1 */
+            break;
+        case INLINE_ABOVE:
+            emit("0F 2E C1");           /* ucomiss xmm0, xmm1 */
+            flag("0F 97 C0");           /* seta al */
+            break;
+        case INLINE_BELOW:
+            emit("0F 2E C8");           /* ucomiss xmm1, xmm0 */
+            flag("0F 97 C0");           /* seta al */
+            break;
+        case INLINE_EQUAL:
+            emit("0F 2E C1");           /* ucomiss xmm0, xmm1 */
+            emit("0F 94 C0");           /* sete al */
+            emit("0F 9B C1");           /* setnp cl */
+            emit("20 C8");              /* and al, cl */
+            emit("0F B6 C0");           /* movzx eax, al */
+            emit("F3 0F 2A C0");        /* cvtsi2ss xmm0, eax */
+            break;
+        }
+    }
+
+    std::vector<unsigned char> & _code;
+    /// Slots in use and the most used at once
+    int _depth;
+    int _slots;
+};
+
+bool ExprJit::available()
+{
+    return true;
+}
+
+ExprJit::ExprJit() : _memory(NULL), _mapped(0), _size(0) {}
+
+ExprJit::~ExprJit()
+{
+    if (_memory)
+        munmap(_memory, _mapped);
+}
+
+GenExpr * ExprJit::compile(GenExpr * expr)
+{
+    if (!_enabled || expr == NULL || expr->type == NATIVE_T)
+        return expr;
+
+    assert(_memory == NULL);
+
+    while (_code.size() % EXPR_JIT_ALIGN)
+        _code.push_back(0xcc);
+
+    const size_t offset = _code.size();
+    X64Compiler compiler(_code);
+    compiler.function(expr);
+    _size = _code.size();
+
+    NativeExpr * native = new NativeExpr(expr);
+    _entries.push_back(std::make_pair(native, offset));
+    return new GenExpr(NATIVE_T, native);
+}
+
+bool ExprJit::finish()
+{
+    if (_entries.empty() || _memory)
+        return _memory != NULL;
+
+    const size_t page = sysconf(_SC_PAGESIZE);
+    _mapped = (_code.size() + page - 1) / page * page;
+
+    void * memory = mmap(NULL, _mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        std::cerr << "[ExprJit] no memory for the code, interpreting the equations" << std::endl;
+        return false;
+    }
+
+    memcpy(memory, &_code[0], _code.size());
+    if (mprotect(memory, _mapped, PROT_READ | PROT_EXEC) != 0) {
+        std::cerr << "[ExprJit] can't run the code, interpreting the equations" << std::endl;
+        munmap(memory, _mapped);
+        return false;
+    }
+
+    _memory = memory;
+    for (unsigned int i = 0; i < _entries.size(); i++)
+        _entries[i].first->code = (float (*)(int, int)) ((char *) _memory + _entries[i].second);
+
+    std::vector<unsigned char>().swap(_code);
+    return true;
+}
+
+#else /* EXPR_JIT_X86_64 */
+
+bool ExprJit::available()
+{
+    return false;
+}
+
+ExprJit::ExprJit() : _memory(NULL), _mapped(0), _size(0) {}
+
+ExprJit::~ExprJit() {}
+
+GenExpr * ExprJit::compile(GenExpr * expr)
+{
+    return expr;
+}
+
+bool ExprJit::finish()
+{
+    return false;
+}
+
+#endif /* EXPR_JIT_X86_64 */
+
+void ExprJit::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+}
+
+bool ExprJit::enabled()
+{
+    return available() && _enabled;
+}
@@ -0,0 +1,72 @@
+/*
+ * ExprJit.hpp
+ *
+ *  Compiles the equations of a preset to x86-64 machine code when it loads.
+ *  Every equation becomes a function of the mesh point, taking the place of
+ *  the tree walk: params are read from their fixed addresses, intermediate
+ *  values kept in a stack frame, the operators, if, band, bor and the
+ *  builtins computing with one instruction (abs, sqr, sqrt, min, max, above,
+ *  below, equal, sign, bnot) are inlined and the other builtins called. The
+ *  code computes exactly what the interpreter does, in the same order.
+ *  Assignments, megabuf items, loop and while are left to the interpreter.
+ *
+ *  Built with USE_JIT on x86-64 outside of Windows only, anywhere else the
+ *  equations are interpreted as before.
+ */
+
+#ifndef EXPRJIT_HPP_
+#define EXPRJIT_HPP_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#if defined(USE_JIT) && defined(__x86_64__) && !defined(_WIN32)
+#define EXPR_JIT_X86_64
+#endif
+
+class GenExpr;
+class NativeExpr;
+
+class ExprJit
+{
+public:
+    ExprJit();
+    /// Frees the code, whatever was compiled must be gone
+    ~ExprJit();
+
+    /// A code generator for this platform was built in
+    static bool available();
+
+    /// Compiling is on by default where available. Presets loading
+    /// afterwards follow the setting, those loaded already keep their code
+    static void setEnabled(bool enabled);
+    static bool enabled();
+
+    /// Takes expr and returns an expression running its code once finish()
+    /// was called, or expr as it was if compiling is off
+    GenExpr * compile(GenExpr * expr);
+
+    /// Copies the code compiled so far into executable memory. Expressions
+    /// without code keep being interpreted, false if it couldn't be done
+    bool finish();
+
+    unsigned int functions() const { return _entries.size(); }
+    size_t codeSize() const { return _size; }
+
+private:
+    static bool _enabled;
+
+    std::vector<unsigned char> _code;
+    /// Expressions compiled waiting for their code, by offset of their function
+    std::vector<std::pair<NativeExpr *, size_t> > _entries;
+
+    void * _memory;
+    size_t _mapped;
+    size_t _size;
+
+    ExprJit(const ExprJit &);
+    ExprJit & operator=(const ExprJit &);
+};
+
+#endif /* EXPRJIT_HPP_ */
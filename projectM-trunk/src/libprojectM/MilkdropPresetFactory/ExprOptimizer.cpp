@@ -0,0 +1,726 @@
+/*
+ * ExprOptimizer.cpp
+ *
+ *  Constant folding, simplification, common subexpressions and loop
+ *  invariants of parsed equations.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "ExprOptimizer.hpp"
+#include "Eval.hpp"
+#include "Expr.hpp"
+#include "Param.hpp"
+#include "BuiltinFuncs.hpp"
+
+/* Division by a power of two in this range is exactly a multiplication */
+#define EXACT_RECIPROCAL_EXPONENT 60
+
+static std::string hexKey(char kind, unsigned int bits)
+{
+    char buffer[32];
+    sprintf(buffer, "%c%x", kind, bits);
+    return buffer;
+}
+
+/* %p prints every bit of the pointer, unsigned long would cut it in half on
+   64 bit Windows */
+static std::string pointerKey(char kind, const void * pointer)
+{
+    char buffer[48];
+    sprintf(buffer, "%c%p", kind, pointer);
+    return buffer;
+}
+
+static std::string constantKey(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return hexKey('c', bits);
+}
+
+static std::string treeKey(const TreeExpr * tree);
+
+/// Equal for expressions computing the same thing the same way
+static std::string key(const GenExpr * expr)
+{
+    switch (expr->type) {
+    case VAL_T: {
+        const ValExpr * val = (const ValExpr *) expr->item;
+        if (val->type == CONSTANT_TERM_T)
+            return constantKey(val->term.constant);
+        return pointerKey('p', val->term.param);
+    }
+    case PREFUN_T: {
+        const PrefunExpr * prefun = (const PrefunExpr *) expr->item;
+        std::string result = pointerKey('f', (const void *) prefun->func_ptr) + "(";
+        for (int i = 0; i < prefun->num_args; i++)
+            result += (i ? "," : "") + key(prefun->expr_list[i]);
+        return result + ")";
+    }
+    case TREE_T:
+        return treeKey((const TreeExpr *) expr->item);
+    case SLOT_T:
+        return pointerKey('s', ((const SlotExpr *) expr->item)->value);
+    default:
+        return pointerKey('?', expr);
+    }
+}
+
+static std::string treeKey(const TreeExpr * tree)
+{
+    if (tree->infix_op == NULL)
+        return tree->gen_expr ? key(tree->gen_expr) : constantKey(0);
+
+    if (tree->left == NULL || tree->right == NULL)
+        return pointerKey('?', tree);
+
+    return "(" + hexKey('o', tree->infix_op->type) + " " + treeKey(tree->left) + " " + treeKey(tree->right) + ")";
+}
+
+/// The expression of a tree, taking it apart if it is a leaf
+static GenExpr * fromTree(TreeExpr * tree)
+{
+    if (tree->infix_op == NULL && tree->gen_expr != NULL) {
+        GenExpr * expr = tree->gen_expr;
+        tree->gen_expr = NULL;
+        delete tree;
+        return expr;
+    }
+
+    return new GenExpr(TREE_T, tree);
+}
+
+/// A tree of the expression, unwrapping tree expressions
+static TreeExpr * asTree(GenExpr * expr)
+{
+    if (expr->type == TREE_T) {
+        TreeExpr * tree = (TreeExpr *) expr->item;
+        expr->item = NULL;
+        delete expr;
+        return tree;
+    }
+
+    return new TreeExpr(NULL, expr, NULL, NULL);
+}
+
+static bool constantValue(const TreeExpr * tree, float & value)
+{
+    if (tree->infix_op != NULL || tree->gen_expr == NULL || tree->gen_expr->type != VAL_T)
+        return false;
+
+    const ValExpr * val = (const ValExpr *) tree->gen_expr->item;
+    if (val->type != CONSTANT_TERM_T)
+        return false;
+
+    value = val->term.constant;
+    return true;
+}
+
+/// Not worth keeping aside, reading it again costs as much
+static bool trivial(const GenExpr * expr)
+{
+    return expr->type == VAL_T || expr->type == SLOT_T;
+}
+
+/// The one builtin function with a different value on every call
+static float (*randFunction())(float *)
+{
+    Func * rand = BuiltinFuncs::find_func("rand");
+    return rand ? rand->func_ptr : 0;
+}
+
+/// Calls visitor on expr and every expression within it until it returns true
+template <class Visitor>
+static bool visit(const GenExpr * expr, Visitor & visitor)
+{
+    if (visitor(expr))
+        return true;
+
+    switch (expr->type) {
+    case PREFUN_T: {
+        const PrefunExpr * prefun = (const PrefunExpr *) expr->item;
+        for (int i = 0; i < prefun->num_args; i++)
+            if (visit(prefun->expr_list[i], visitor))
+                return true;
+        return false;
+    }
+    case TREE_T: {
+        std::vector<const TreeExpr *> trees(1, (const TreeExpr *) expr->item);
+        while (!trees.empty()) {
+            const TreeExpr * tree = trees.back();
+            trees.pop_back();
+            if (tree == NULL)
+                continue;
+            if (tree->gen_expr && visit(tree->gen_expr, visitor))
+                return true;
+            trees.push_back(tree->left);
+            trees.push_back(tree->right);
+        }
+        return false;
+    }
+    case SLOT_T:
+        return ((const SlotExpr *) expr->item)->expr && visit(((const SlotExpr *) expr->item)->expr, visitor);
+    case NATIVE_T:
+        return visit(((const NativeExpr *) expr->item)->expr, visitor);
+    case BUFFER_T:
+        return visit(((const BufferExpr *) expr->item)->index, visitor);
+    case ASSIGN_T: {
+        const AssignExpr * assign = (const AssignExpr *) expr->item;
+        return (assign->item && visit(assign->item->index, visitor)) || visit(assign->expr, visitor);
+    }
+    default:
+        return false;
+    }
+}
+
+class CollectRead
+{
+public:
+    CollectRead(std::set<const Param *> & params) : _params(params) {}
+
+    bool operator()(const GenExpr * expr)
+    {
+        if (expr->type == VAL_T && ((const ValExpr *) expr->item)->type == PARAM_TERM_T)
+            _params.insert(((const ValExpr *) expr->item)->term.param);
+        return false;
+    }
+
+private:
+    std::set<const Param *> & _params;
+};
+
+class CollectAssigned
+{
+public:
+    CollectAssigned(std::set<Param *> & params) : _params(params) {}
+
+    bool operator()(const GenExpr * expr)
+    {
+        if (expr->type == ASSIGN_T && ((const AssignExpr *) expr->item)->param)
+            _params.insert(((const AssignExpr *) expr->item)->param);
+        return false;
+    }
+
+private:
+    std::set<Param *> & _params;
+};
+
+class FindEffect
+{
+public:
+    bool operator()(const GenExpr * expr)
+    {
+        return expr->type == ASSIGN_T || expr->type == BUFFER_T;
+    }
+};
+
+bool ExprOptimizer::_enabled = true;
+
+ExprOptimizer::ExprOptimizer() : _loop(false), _rand(0) {}
+
+ExprOptimizer::~ExprOptimizer()
+{
+    for (std::vector<GenExpr *>::iterator pos = _invariants.begin(); pos != _invariants.end(); ++pos)
+        delete *pos;
+}
+
+void ExprOptimizer::addVarying(Param * param)
+{
+    _varying.insert(param);
+}
+
+bool ExprOptimizer::varying(const Param * param) const
+{
+    return (param->flags & P_FLAG_ALWAYS_MATRIX) || _varying.count(param);
+}
+
+void ExprOptimizer::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+}
+
+GenExpr * ExprOptimizer::optimize(GenExpr * expr)
+{
+    if (!_enabled)
+        return expr;
+
+    _loop = false;
+    _rand = randFunction();
+
+    Traits traits;
+    expr = rewrite(expr, traits);
+
+    if (!effects(expr))
+        shareCommon(expr);
+    return expr;
+}
+
+GenExpr * ExprOptimizer::optimizeLoop(GenExpr * expr, bool threaded)
+{
+    if (!_enabled)
+        return expr;
+
+    _loop = true;
+    _rand = randFunction();
+
+    Traits traits;
+    expr = hoist(rewrite(expr, traits), traits);
+
+    if (!threaded && !effects(expr))
+        shareCommon(expr);
+
+    _loop = false;
+    return expr;
+}
+
+void ExprOptimizer::evalInvariants()
+{
+    for (std::vector<GenExpr *>::iterator pos = _invariants.begin(); pos != _invariants.end(); ++pos)
+        (*pos)->eval_gen_expr(-1, -1);
+}
+
+bool ExprOptimizer::ordered(const GenExpr * expr)
+{
+    _rand = randFunction();
+    return !pure(expr);
+}
+
+void ExprOptimizer::reads(const GenExpr * expr, std::set<const Param *> & params)
+{
+    CollectRead collect(params);
+    visit(expr, collect);
+}
+
+void ExprOptimizer::assigns(const GenExpr * expr, std::set<Param *> & params)
+{
+    CollectAssigned collect(params);
+    visit(expr, collect);
+}
+
+bool ExprOptimizer::effects(const GenExpr * expr)
+{
+    FindEffect find;
+    return visit(expr, find);
+}
+
+GenExpr * ExprOptimizer::rewrite(GenExpr * expr, Traits & traits)
+{
+    traits.pure = traits.invariant = traits.constant = false;
+
+    switch (expr->type) {
+    case VAL_T: {
+        const ValExpr * val = (const ValExpr *) expr->item;
+        traits.pure = true;
+        traits.constant = val->type == CONSTANT_TERM_T;
+        traits.invariant = traits.constant || (val->term.param && !varying(val->term.param));
+        return expr;
+    }
+    case PREFUN_T: {
+        PrefunExpr * prefun = (PrefunExpr *) expr->item;
+        std::vector<Traits> args(prefun->num_args);
+
+        /* A loop is there to repeat what it does, not worth folding or keeping */
+        traits.pure = traits.invariant = traits.constant = (float (*)(float *)) prefun->func_ptr != _rand &&
+            prefun->evaluation != PREFUN_LOOP && prefun->evaluation != PREFUN_WHILE;
+        for (int i = 0; i < prefun->num_args; i++) {
+            prefun->expr_list[i] = rewrite(prefun->expr_list[i], args[i]);
+            traits.pure = traits.pure && args[i].pure;
+            traits.invariant = traits.invariant && args[i].invariant;
+            traits.constant = traits.constant && args[i].constant;
+        }
+
+        if (traits.constant)
+            return fold(expr);
+
+        if (prefun->evaluation != PREFUN_EAGER && args[0].constant) {
+            GenExpr * decided = decide(expr, args, traits);
+            if (decided != expr)
+                return decided;
+        }
+
+        if (!traits.invariant)
+            for (int i = 0; i < prefun->num_args; i++)
+                prefun->expr_list[i] = hoist(prefun->expr_list[i], args[i]);
+        return expr;
+    }
+    case TREE_T: {
+        TreeExpr * tree = (TreeExpr *) expr->item;
+        expr->item = NULL;
+        delete expr;
+        return rewriteTree(tree, traits);
+    }
+    case BUFFER_T: {
+        BufferExpr * item = (BufferExpr *) expr->item;
+        Traits index;
+        item->index = hoist(rewrite(item->index, index), index);
+        return expr;
+    }
+    case ASSIGN_T: {
+        AssignExpr * assign = (AssignExpr *) expr->item;
+        Traits index, value;
+        if (assign->item)
+            assign->item->index = hoist(rewrite(assign->item->index, index), index);
+        assign->expr = hoist(rewrite(assign->expr, value), value);
+        return expr;
+    }
+    default:
+        return expr;
+    }
+}
+
+GenExpr * ExprOptimizer::rewriteTree(TreeExpr * tree, Traits & traits)
+{
+    if (tree->infix_op == NULL) {
+        if (tree->gen_expr == NULL) {
+            delete tree;
+            traits.pure = traits.invariant = traits.constant = true;
+            return GenExpr::const_to_expr(0);
+        }
+
+        return rewrite(fromTree(tree), traits);
+    }
+
+    traits.pure = traits.invariant = traits.constant = false;
+    if (tree->left == NULL || tree->right == NULL)
+        return new GenExpr(TREE_T, tree);
+
+    Traits left, right;
+    tree->left = asTree(rewriteTree(tree->left, left));
+    tree->right = asTree(rewriteTree(tree->right, right));
+
+    traits.pure = left.pure && right.pure;
+    traits.invariant = left.invariant && right.invariant;
+    traits.constant = left.constant && right.constant;
+
+    if (traits.constant)
+        return fold(new GenExpr(TREE_T, tree));
+
+    GenExpr * expr = simplify(tree, left, right);
+    if (expr->type == TREE_T && expr->item == tree && !traits.invariant) {
+        tree->left = asTree(hoist(fromTree(tree->left), left));
+        tree->right = asTree(hoist(fromTree(tree->right), right));
+    }
+
+    return expr;
+}
+
+/// Identities that hold for every float: x+0, x-0, x*1 and x/1 are x.
+/// x/c is x*(1/c) if c is a power of two
+GenExpr * ExprOptimizer::simplify(TreeExpr * tree, const Traits & left, const Traits & right)
+{
+    float l = 0, r = 0;
+    const bool leftConstant = constantValue(tree->left, l);
+    const bool rightConstant = constantValue(tree->right, r);
+
+    TreeExpr ** keep = NULL;
+    switch (tree->infix_op->type) {
+    case INFIX_ADD:
+        if (rightConstant && r == 0)
+            keep = &tree->left;
+        else if (leftConstant && l == 0)
+            keep = &tree->right;
+        break;
+    case INFIX_MINUS:
+        if (rightConstant && r == 0)
+            keep = &tree->left;
+        break;
+    case INFIX_MULT:
+        if (rightConstant && r == 1)
+            keep = &tree->left;
+        else if (leftConstant && l == 1)
+            keep = &tree->right;
+        break;
+    case INFIX_DIV:
+        if (rightConstant && r == 1)
+            keep = &tree->left;
+        else if (rightConstant && r != 0) {
+            int exponent;
+            if (fabs(frexp(r, &exponent)) == 0.5 && abs(exponent) < EXACT_RECIPROCAL_EXPONENT) {
+                tree->infix_op = Eval::infix_mult;
+                ((ValExpr *) tree->right->gen_expr->item)->term.constant = 1 / r;
+            }
+        }
+        break;
+    }
+
+    if (keep == NULL)
+        return new GenExpr(TREE_T, tree);
+
+    TreeExpr * kept = *keep;
+    *keep = NULL;
+    delete tree;
+    return fromTree(kept);
+}
+
+/// A control builtin with a constant condition becomes the argument it
+/// evaluates, or its value when that doesn't depend on the other argument.
+/// Returns expr if neither is the case
+GenExpr * ExprOptimizer::decide(GenExpr * expr, const std::vector<Traits> & args, Traits & traits)
+{
+    PrefunExpr * prefun = (PrefunExpr *) expr->item;
+    const int condition = (int) prefun->expr_list[0]->eval_gen_expr(-1, -1);
+
+    if ((prefun->evaluation == PREFUN_BAND && condition == 0) ||
+        (prefun->evaluation == PREFUN_BOR && condition != 0)) {
+        traits.pure = traits.invariant = traits.constant = true;
+        return fold(expr);
+    }
+
+    if (prefun->evaluation != PREFUN_IF)
+        return expr;
+
+    const int taken = condition == 0 ? 2 : 1;
+    GenExpr * branch = prefun->expr_list[taken];
+    prefun->expr_list[taken] = NULL;
+    delete expr;
+
+    traits = args[taken];
+    return branch;
+}
+
+/// Replaces a pure expression reading no param by its value
+GenExpr * ExprOptimizer::fold(GenExpr * expr)
+{
+    const float value = expr->eval_gen_expr(-1, -1);
+    delete expr;
+    return GenExpr::const_to_expr(value);
+}
+
+/// Moves an invariant subexpression of the loop into the invariants, where
+/// each distinct one is computed once for all equations
+GenExpr * ExprOptimizer::hoist(GenExpr * expr, const Traits & traits)
+{
+    if (!_loop || !traits.invariant || trivial(expr))
+        return expr;
+
+    const std::string expressionKey = key(expr);
+    std::map<std::string, SlotExpr *>::iterator pos = _invariantKeys.find(expressionKey);
+    if (pos != _invariantKeys.end()) {
+        delete expr;
+        return load(pos->second);
+    }
+
+    SlotExpr * slot = new SlotExpr(expr);
+    _invariants.push_back(new GenExpr(SLOT_T, slot));
+    _invariantKeys[expressionKey] = slot;
+    return load(slot);
+}
+
+GenExpr * ExprOptimizer::load(SlotExpr * slot)
+{
+    return new GenExpr(SLOT_T, new SlotExpr(slot->value));
+}
+
+bool ExprOptimizer::pure(const GenExpr * expr) const
+{
+    switch (expr->type) {
+    case VAL_T:
+        return true;
+    case PREFUN_T: {
+        const PrefunExpr * prefun = (const PrefunExpr *) expr->item;
+        if ((float (*)(float *)) prefun->func_ptr == _rand ||
+            prefun->evaluation == PREFUN_LOOP || prefun->evaluation == PREFUN_WHILE)
+            return false;
+        for (int i = 0; i < prefun->num_args; i++)
+            if (!pure(prefun->expr_list[i]))
+                return false;
+        return true;
+    }
+    case TREE_T:
+        return pureTree((const TreeExpr *) expr->item);
+    default:
+        return false;
+    }
+}
+
+bool ExprOptimizer::pureTree(const TreeExpr * tree) const
+{
+    if (tree->infix_op == NULL)
+        return tree->gen_expr == NULL || pure(tree->gen_expr);
+
+    return tree->left && tree->right && pureTree(tree->left) && pureTree(tree->right);
+}
+
+/* Sharing common subexpressions: count every pure subexpression, then, in the
+ * order of evaluation, keep the value of the first occurrence of one counted
+ * twice or more and read it at the others. Slots nothing reads in the end,
+ * because their other occurrences were inside a subexpression read from a
+ * slot, are taken out again. A tree node is counted and shared as a tree, an
+ * expression wrapping it is not. */
+
+void ExprOptimizer::shareCommon(GenExpr *& expr)
+{
+    _counts.clear();
+    _shared.clear();
+    _loads.clear();
+
+    count(expr);
+    share(expr);
+    unshare(expr);
+}
+
+void ExprOptimizer::count(const GenExpr * expr)
+{
+    if (expr->type == TREE_T) {
+        countTree((const TreeExpr *) expr->item);
+        return;
+    }
+
+    if (expr->type != PREFUN_T)
+        return;
+
+    if (pure(expr))
+        _counts[key(expr)]++;
+
+    const PrefunExpr * prefun = (const PrefunExpr *) expr->item;
+    for (int i = 0; i < prefun->num_args; i++)
+        count(prefun->expr_list[i]);
+}
+
+void ExprOptimizer::countTree(const TreeExpr * tree)
+{
+    if (tree->infix_op == NULL) {
+        if (tree->gen_expr)
+            count(tree->gen_expr);
+        return;
+    }
+
+    if (tree->left == NULL || tree->right == NULL)
+        return;
+
+    if (pureTree(tree))
+        _counts[treeKey(tree)]++;
+
+    countTree(tree->left);
+    countTree(tree->right);
+}
+
+void ExprOptimizer::share(GenExpr *& expr)
+{
+    if (expr->type == TREE_T) {
+        TreeExpr * tree = (TreeExpr *) expr->item;
+        shareTree(tree);
+        expr->item = tree;
+        return;
+    }
+
+    if (expr->type != PREFUN_T)
+        return;
+
+    std::string expressionKey;
+    const bool common = pure(expr) && _counts[expressionKey = key(expr)] > 1;
+    if (common && _shared.count(expressionKey)) {
+        SlotExpr * slot = _shared[expressionKey];
+        _loads[slot]++;
+        delete expr;
+        expr = load(slot);
+        return;
+    }
+
+    PrefunExpr * prefun = (PrefunExpr *) expr->item;
+    for (int i = 0; i < prefun->num_args; i++) {
+        if (i == 0 || prefun->evaluation == PREFUN_EAGER) {
+            share(prefun->expr_list[i]);
+            continue;
+        }
+
+        /* Evaluated only sometimes: what is kept in there can't be read
+         * after it */
+        const std::map<std::string, SlotExpr *> shared = _shared;
+        share(prefun->expr_list[i]);
+        _shared = shared;
+    }
+
+    if (common) {
+        SlotExpr * slot = new SlotExpr(expr);
+        _shared[expressionKey] = slot;
+        _loads[slot] = 0;
+        expr = new GenExpr(SLOT_T, slot);
+    }
+}
+
+void ExprOptimizer::shareTree(TreeExpr *& tree)
+{
+    if (tree->infix_op == NULL) {
+        if (tree->gen_expr)
+            share(tree->gen_expr);
+        return;
+    }
+
+    if (tree->left == NULL || tree->right == NULL)
+        return;
+
+    std::string expressionKey;
+    const bool common = pureTree(tree) && _counts[expressionKey = treeKey(tree)] > 1;
+    if (common && _shared.count(expressionKey)) {
+        SlotExpr * slot = _shared[expressionKey];
+        _loads[slot]++;
+        delete tree;
+        tree = new TreeExpr(NULL, load(slot), NULL, NULL);
+        return;
+    }
+
+    shareTree(tree->left);
+    shareTree(tree->right);
+
+    if (common) {
+        SlotExpr * slot = new SlotExpr(new GenExpr(TREE_T, tree));
+        _shared[expressionKey] = slot;
+        _loads[slot] = 0;
+        tree = new TreeExpr(NULL, new GenExpr(SLOT_T, slot), NULL, NULL);
+    }
+}
+
+void ExprOptimizer::unshare(GenExpr *& expr)
+{
+    switch (expr->type) {
+    case SLOT_T: {
+        SlotExpr * slot = (SlotExpr *) expr->item;
+        if (slot->expr == NULL)
+            return;
+
+        if (_loads[slot] == 0) {
+            GenExpr * inner = slot->expr;
+            slot->expr = NULL;
+            delete expr;
+            expr = inner;
+            unshare(expr);
+        } else
+            unshare(slot->expr);
+        return;
+    }
+    case PREFUN_T: {
+        PrefunExpr * prefun = (PrefunExpr *) expr->item;
+        for (int i = 0; i < prefun->num_args; i++)
+            unshare(prefun->expr_list[i]);
+        return;
+    }
+    case TREE_T: {
+        TreeExpr * tree = (TreeExpr *) expr->item;
+        unshareTree(tree);
+        expr->item = tree;
+        return;
+    }
+    }
+}
+
+void ExprOptimizer::unshareTree(TreeExpr *& tree)
+{
+    if (tree->infix_op == NULL) {
+        if (tree->gen_expr == NULL)
+            return;
+
+        unshare(tree->gen_expr);
+        if (tree->gen_expr->type == TREE_T)
+            tree = asTree(fromTree(tree));
+        return;
+    }
+
+    if (tree->left)
+        unshareTree(tree->left);
+    if (tree->right)
+        unshareTree(tree->right);
+}
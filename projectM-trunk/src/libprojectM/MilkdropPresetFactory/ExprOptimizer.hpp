@@ -0,0 +1,119 @@
+/*
+ * ExprOptimizer.hpp
+ *
+ *  Rewrites parsed equations so they evaluate with less work: constant
+ *  subtrees are folded, identities like x*1 or x+0 dropped, if, band and bor
+ *  with a constant condition replaced by what they evaluate to and a
+ *  subexpression occurring several times in an equation computed once. Equations run once
+ *  per mesh point or wave point also have the subexpressions that don't vary
+ *  from point to point moved out of the loop, into invariants evaluated once
+ *  per frame. The results are exactly those of the original trees.
+ *  Assignments, megabuf items and loops are never moved, folded or shared,
+ *  and an equation with any of the first two shares nothing.
+ */
+
+#ifndef EXPROPTIMIZER_HPP_
+#define EXPROPTIMIZER_HPP_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class GenExpr;
+class TreeExpr;
+class SlotExpr;
+class Param;
+
+class ExprOptimizer
+{
+public:
+    ExprOptimizer();
+    /// Deletes the invariants, the equations optimized read them
+    ~ExprOptimizer();
+
+    /// Optimizing is on by default. Presets loading afterwards follow the
+    /// setting, those loaded already keep their equations as they are
+    static void setEnabled(bool enabled);
+    static bool enabled() { return _enabled; }
+
+    /// The loop changes param from one point to the next. Params always read
+    /// per point, like x or sample, vary without being added
+    void addVarying(Param * param);
+    bool varying(const Param * param) const;
+
+    /// Rewrites an equation evaluated once per frame. Takes expr and returns
+    /// the expression replacing it, expr as it was if optimizing is off
+    GenExpr * optimize(GenExpr * expr);
+
+    /// Rewrites an equation of the loop, after every param it assigns was
+    /// added with addVarying(). Points evaluated on several threads at once
+    /// (threaded) can't keep values for later in the same point, so only
+    /// the invariants are shared then
+    GenExpr * optimizeLoop(GenExpr * expr, bool threaded);
+
+    /// Computes the invariants. Once per frame, after the per frame equations
+    /// and before the loop
+    void evalInvariants();
+    unsigned int invariants() const { return _invariants.size(); }
+
+    /// expr calls rand, its evaluations have to stay in the order they were
+    bool ordered(const GenExpr * expr);
+
+    /// Adds the params expr reads to params
+    static void reads(const GenExpr * expr, std::set<const Param *> & params);
+    /// Adds the params expr assigns to params
+    static void assigns(const GenExpr * expr, std::set<Param *> & params);
+    /// expr assigns something or reads a megabuf item
+    static bool effects(const GenExpr * expr);
+
+private:
+    static bool _enabled;
+
+    struct Traits {
+        /// Same value for the same inputs and no side effects
+        bool pure;
+        /// Pure and reading no varying param
+        bool invariant;
+        /// Pure and reading no param at all
+        bool constant;
+    };
+
+    GenExpr * rewrite(GenExpr * expr, Traits & traits);
+    GenExpr * rewriteTree(TreeExpr * tree, Traits & traits);
+    GenExpr * simplify(TreeExpr * tree, const Traits & left, const Traits & right);
+    GenExpr * decide(GenExpr * expr, const std::vector<Traits> & args, Traits & traits);
+    GenExpr * fold(GenExpr * expr);
+    GenExpr * hoist(GenExpr * expr, const Traits & traits);
+
+    bool pure(const GenExpr * expr) const;
+    bool pureTree(const TreeExpr * tree) const;
+
+    void shareCommon(GenExpr *& expr);
+    void count(const GenExpr * expr);
+    void countTree(const TreeExpr * tree);
+    void share(GenExpr *& expr);
+    void shareTree(TreeExpr *& tree);
+    void unshare(GenExpr *& expr);
+    void unshareTree(TreeExpr *& tree);
+    GenExpr * load(SlotExpr * slot);
+
+    std::set<const Param *> _varying;
+    /// Outside of the loop: nothing varies, nothing is hoisted
+    bool _loop;
+    float (*_rand)(float *);
+
+    /// Hoisted subexpressions by key
+    std::map<std::string, SlotExpr *> _invariantKeys;
+    std::vector<GenExpr *> _invariants;
+
+    /* State of sharing within one equation */
+    std::map<std::string, int> _counts;
+    std::map<std::string, SlotExpr *> _shared;
+    std::map<const SlotExpr *, int> _loads;
+
+    ExprOptimizer(const ExprOptimizer &);
+    ExprOptimizer & operator=(const ExprOptimizer &);
+};
+
+#endif /* EXPROPTIMIZER_HPP_ */
@@ -30,8 +30,8 @@
 #include "Func.hpp"
 #include <map>
 
-Func::Func (const std::string & _name, float (*_func_ptr)(float*), int _num_args):
-    name(_name), func_ptr(_func_ptr), num_args(_num_args) {}
+Func::Func (const std::string & _name, float (*_func_ptr)(float*), int _num_args, int _evaluation):
+    func_ptr(_func_ptr), name(_name), num_args(_num_args), evaluation(_evaluation) {}
 
 /* Frees a function type, real complicated... */
 Func::~Func() {}
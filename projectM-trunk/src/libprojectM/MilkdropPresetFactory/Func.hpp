@@ -30,6 +30,7 @@
 #define _FUNC_H
 
 #include "Common.hpp"
+#include "Expr.hpp"
 #include <string>
 
 /* Function Type */
@@ -40,7 +41,9 @@ public:
     /// \param name a name to uniquely identify the function. 
     /// \param func_ptr a pointer to a function of floating point arguments
     /// \param num_args the number of floating point arguments this function requires
-    Func(const std::string & name, float (*func_ptr)(float*), int num_args );
+    /// \param evaluation PREFUN_EAGER, or how a control builtin short circuits its arguments
+    Func(const std::string & name, float (*func_ptr)(float*), int num_args,
+         int evaluation = PREFUN_EAGER );
 
     /* Public Prototypes */
     ~Func();
@@ -53,10 +56,15 @@ public:
 		return num_args;
 	}
 
+	inline int getEvaluation() const {
+		return evaluation;
+	}
+
     float (*func_ptr)(float*);
 private:	
     std::string name;
     int num_args;
+    int evaluation;
 
 };
 
@@ -40,7 +40,7 @@ char InitCond::init_cond_string_buffer[STRING_BUFFER_SIZE];
 int InitCond::init_cond_string_buffer_index = 0;
 
 /* Creates a new initial condition */
-InitCond::InitCond( Param * _param, CValue _init_val ):param(_param), init_val(_init_val)
+InitCond::InitCond( Param * _param, CValue _init_val ):param(_param), init_val(_init_val), line(0)
 {
 
 
@@ -61,6 +61,7 @@ void InitCond::evaluate()
 /* Evaluate an initial conditon */
 void InitCond::evaluate(bool evalUser)
 {
+    PROFILE_EVAL(profile);
 
 
 
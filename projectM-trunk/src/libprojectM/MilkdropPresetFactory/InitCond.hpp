@@ -34,15 +34,20 @@
 #define INIT_COND_DEBUG 0
 
 #include "Param.hpp"
+#include "EvalProfiler.hpp"
 
 class InitCond;
 class Param;
 #include <map>
 
-class InitCond {
+class InitCond : public ArenaObject {
 public:
     Param *param;
     CValue init_val;
+    unsigned int line; /* line of the preset file the condition is on, 0 for defaults */
+#ifdef USE_PROFILER
+    EvalCounter profile;
+#endif
 
     static char init_cond_string_buffer[STRING_BUFFER_SIZE];
     static int init_cond_string_buffer_index;
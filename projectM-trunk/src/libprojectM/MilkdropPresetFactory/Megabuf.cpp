@@ -0,0 +1,72 @@
+/*
+ * Megabuf.cpp
+ *
+ *  Paged storage of megabuf and gmegabuf.
+ */
+
+#include "Megabuf.hpp"
+
+#ifdef WIN32
+#include <windows.h>
+#define MEGABUF_BARRIER() MemoryBarrier()
+#else
+#define MEGABUF_BARRIER() __sync_synchronize()
+#endif
+
+/* Constructed before any preset loads, presets on different threads all
+   find it there */
+static Megabuf globalMegabuf;
+
+Megabuf::Megabuf()
+{
+    for (int i = 0; i < MEGABUF_PAGES; i++)
+        _pages[i] = NULL;
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+Megabuf::~Megabuf()
+{
+    for (int i = 0; i < MEGABUF_PAGES; i++)
+        delete[] _pages[i];
+    pthread_mutex_destroy(&_mutex);
+}
+
+Megabuf & Megabuf::global()
+{
+    return globalMegabuf;
+}
+
+void Megabuf::set(float index, float value)
+{
+    const int item = position(index);
+    if (item < 0)
+        return;
+
+    float * page = _pages[item / MEGABUF_PAGE_ITEMS];
+    if (page == NULL) {
+        /* gmegabuf is assigned by two presets at once while they blend */
+        pthread_mutex_lock(&_mutex);
+        page = _pages[item / MEGABUF_PAGE_ITEMS];
+        if (page == NULL) {
+            page = new float[MEGABUF_PAGE_ITEMS]();
+
+            /* The page is zeroed before a thread reading without the mutex
+               can find it, those reach the items through the pointer */
+            MEGABUF_BARRIER();
+            _pages[item / MEGABUF_PAGE_ITEMS] = page;
+        }
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    page[item % MEGABUF_PAGE_ITEMS] = value;
+}
+
+size_t Megabuf::allocated() const
+{
+    size_t pages = 0;
+    for (int i = 0; i < MEGABUF_PAGES; i++)
+        if (_pages[i])
+            pages++;
+
+    return pages * MEGABUF_PAGE_ITEMS * sizeof(float);
+}
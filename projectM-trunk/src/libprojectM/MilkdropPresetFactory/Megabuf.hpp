@@ -0,0 +1,66 @@
+/*
+ * Megabuf.hpp
+ *
+ *  Storage of megabuf(), the memory of one preset, and gmegabuf(), the
+ *  memory all presets share, as in Milkdrop 2. A buffer holds MEGABUF_ITEMS
+ *  floats, all 0 to begin with, but only the pages of it assigned to are
+ *  allocated: a preset using a few items costs a few pages, not megabytes.
+ */
+
+#ifndef MEGABUF_HPP_
+#define MEGABUF_HPP_
+
+#include <cstddef>
+#include <pthread.h>
+
+/* Items a buffer holds, indexes out of range read 0 and assign nothing */
+#define MEGABUF_ITEMS 1048576
+/* Items of a page, allocated when one of them is first assigned */
+#define MEGABUF_PAGE_ITEMS 4096
+#define MEGABUF_PAGES (MEGABUF_ITEMS / MEGABUF_PAGE_ITEMS)
+
+class Megabuf
+{
+public:
+    Megabuf();
+    ~Megabuf();
+
+    /// The item an index of the equations refers to, 0 if none was assigned
+    inline float get(float index) const
+    {
+        const int item = position(index);
+        if (item < 0)
+            return 0;
+
+        const float * page = _pages[item / MEGABUF_PAGE_ITEMS];
+        return page ? page[item % MEGABUF_PAGE_ITEMS] : 0;
+    }
+
+    void set(float index, float value);
+
+    /// Bytes of the pages allocated so far
+    size_t allocated() const;
+
+    /// gmegabuf, shared by every preset for as long as the library is loaded
+    static Megabuf & global();
+
+private:
+    /// Rounded as Milkdrop does, -1 out of range
+    static inline int position(float index)
+    {
+        index += 0.0001f;
+        if (!(index >= 0 && index < MEGABUF_ITEMS))
+            return -1;
+        return (int) index;
+    }
+
+    /* Written only under the mutex and after a barrier, read without: a
+       page, once there, stays */
+    float * volatile _pages[MEGABUF_PAGES];
+    pthread_mutex_t _mutex;
+
+    Megabuf(const Megabuf &);
+    Megabuf & operator=(const Megabuf &);
+};
+
+#endif /* MEGABUF_HPP_ */
@@ -34,15 +34,32 @@
 #include "Parser.hpp"
 #include "ParamUtils.hpp"
 #include "InitCondUtils.hpp"
+#include "PerPointEqn.hpp"
+#include "Eval.hpp"
 #include "fatal.h"
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 #include "PresetFrameIO.hpp"
+#include "FrameStats.hpp"
 
 MilkdropPreset::MilkdropPreset(std::istream & in, const std::string & presetName,  PresetOutputs & presetOutputs):
     Preset(presetName),
     builtinParams(_presetInputs, presetOutputs),
+    _music(0),
+    _context(0),
+    _sequential(false),
+    _loopsReported(false),
+    _budgetStrikes(0),
+    _tooExpensive(false),
+    _perPixelInterval(1),
+    _perPixelCountdown(0),
+    _perPixelSkipped(false),
+    _perPixelOver(false),
+    _waveSamples(0),
+    _waveSamplesWanted(0),
+    _waveSamplesSettle(0),
     _presetOutputs(presetOutputs)
 {
     initialize(in);
@@ -52,9 +69,22 @@ MilkdropPreset::MilkdropPreset(std::istream & in, const std::string & presetName
 MilkdropPreset::MilkdropPreset(const std::string & absoluteFilePath, const std::string & presetName, PresetOutputs & presetOutputs):
     Preset(presetName),
     builtinParams(_presetInputs, presetOutputs),
+    _filename(parseFilename(absoluteFilePath)),
+    _music(0),
+    _context(0),
+    _sequential(false),
+    _loopsReported(false),
+    _budgetStrikes(0),
+    _tooExpensive(false),
+    _perPixelInterval(1),
+    _perPixelCountdown(0),
+    _perPixelSkipped(false),
+    _perPixelOver(false),
+    _waveSamples(0),
+    _waveSamplesWanted(0),
+    _waveSamplesSettle(0),
     _absoluteFilePath(absoluteFilePath),
-    _presetOutputs(presetOutputs),
-    _filename(parseFilename(absoluteFilePath))
+    _presetOutputs(presetOutputs)
 {
 
     initialize(absoluteFilePath);
@@ -107,7 +137,7 @@ MilkdropPreset::~MilkdropPreset()
 /* Adds a per pixel equation according to its string name. This
    will be used only by the parser */
 
-int MilkdropPreset::add_per_pixel_eqn(char * name, GenExpr * gen_expr)
+int MilkdropPreset::add_per_pixel_eqn(char * name, GenExpr * gen_expr, unsigned int line)
 {
 
     PerPixelEqn * per_pixel_eqn = NULL;
@@ -135,7 +165,7 @@ int MilkdropPreset::add_per_pixel_eqn(char * name, GenExpr * gen_expr)
         return PROJECTM_FAILURE;
     }
 
-
+    per_pixel_eqn->line = line;
 
     /* Insert the per pixel equation into the preset per pixel database */
     std::pair<std::map<int, PerPixelEqn*>::iterator, bool> inserteeOption = per_pixel_eqn_tree.insert
@@ -186,29 +216,76 @@ void MilkdropPreset::evalCustomWavePerFrameEquations()
         for (std::vector<PerFrameEqn*>::iterator _pos = per_frame_eqn_tree.begin(); _pos != per_frame_eqn_tree.end(); ++_pos) {
             (*_pos)->evaluate();
         }
+
+        (*pos)->per_point_optimizer.evalInvariants();
     }
 
 }
 
+/// The samples are set again from the init conditions every frame, so a
+/// limit lasts only for the frame
+void MilkdropPreset::limitCustomWaveSamples(int samples)
+{
+    if (samples <= 0)
+        return;
+
+    for (PresetOutputs::cwave_container::iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos)
+        if ((*pos)->samples > samples)
+            (*pos)->samples = samples;
+}
+
+/// Shapes with num_inst over 1 run their per frame equations once for every
+/// copy, each starting over from the init conditions and the q variables
+/// with instance counting up, and keep what every run left to draw it
 void MilkdropPreset::evalCustomShapePerFrameEquations()
 {
 
     for (PresetOutputs::cshape_container::iterator pos = customShapes.begin(); pos != customShapes.end(); ++pos) {
 
-        std::map<std::string, InitCond*> & init_cond_tree = (*pos)->init_cond_tree;
-        for (std::map<std::string, InitCond*>::iterator _pos = init_cond_tree.begin(); _pos != init_cond_tree.end(); ++_pos) {
-            assert(_pos->second);
-            _pos->second->evaluate();
+        CustomShape & shape = **pos;
+        shape.instances.clear();
+        shape.instance = 0;
+
+        /* num_inst is an init condition, known only once it is evaluated */
+        std::map<std::string, InitCond*>::iterator numInst = shape.init_cond_tree.find("num_inst");
+        if (numInst != shape.init_cond_tree.end())
+            numInst->second->evaluate();
+
+        const int instances = std::min(shape.num_inst, MAX_SHAPE_INSTANCES);
+        if (instances <= 1) {
+            evalCustomShapeInstance(shape);
+            continue;
         }
 
-        std::vector<PerFrameEqn*> & per_frame_eqn_tree = (*pos)->per_frame_eqn_tree;
-        for (std::vector<PerFrameEqn*>::iterator _pos = per_frame_eqn_tree.begin(); _pos != per_frame_eqn_tree.end(); ++_pos) {
-            (*_pos)->evaluate();
+        /* The first copy starts over too, not from what the last one left */
+        shape.instances.reserve(instances);
+        for (int i = 0; i < instances; i++) {
+            shape.instance = i;
+            shape.evalInitConds();
+            for (unsigned int k = 0; k < NUM_Q_VARIABLES; k++)
+                shape.q[k] = _presetOutputs.q[k];
+
+            evalCustomShapeInstance(shape);
+            shape.instances.push_back(ShapeInstance(shape));
         }
     }
 
 }
 
+void MilkdropPreset::evalCustomShapeInstance(CustomShape & shape)
+{
+    std::map<std::string, InitCond*> & init_cond_tree = shape.init_cond_tree;
+    for (std::map<std::string, InitCond*>::iterator _pos = init_cond_tree.begin(); _pos != init_cond_tree.end(); ++_pos) {
+        assert(_pos->second);
+        _pos->second->evaluate();
+    }
+
+    std::vector<PerFrameEqn*> & per_frame_eqn_tree = shape.per_frame_eqn_tree;
+    for (std::vector<PerFrameEqn*>::iterator _pos = per_frame_eqn_tree.begin(); _pos != per_frame_eqn_tree.end(); ++_pos) {
+        (*_pos)->evaluate();
+    }
+}
+
 void MilkdropPreset::evalPerFrameInitEquations()
 {
 
@@ -273,16 +350,116 @@ void MilkdropPreset::postloadInitialize()
 
 void MilkdropPreset::Render(const BeatDetect &music, const PipelineContext &context)
 {
-    _presetInputs.update(music, context);
+    _music = &music;
+    _context = &context;
+
+    /* The same stages addFrameTasks hands out, one after the other */
+    const int tiles = perPixelTiles();
+    setPerPixelTiles(tiles);
+
+    evaluatePerFrame(0);
+    for (int tile = 0; tile < tiles; tile++)
+        evaluatePerPixel(tile);
+    evaluateWaves(0);
+    evaluateShapes(0);
+    finishFrame(0);
+}
+
+#ifdef USE_PROFILER
+
+template <class Eqn>
+static inline Eqn * profiledEqn(Eqn * eqn)
+{
+    return eqn;
+}
+
+template <class Key, class Eqn>
+static inline Eqn * profiledEqn(const std::pair<const Key, Eqn*> & entry)
+{
+    return entry.second;
+}
+
+/// Appends one entry per equation and adds their counters to total
+template <class Container>
+static void profileEquations(const Container & equations, PresetProfileEntry::Kind kind, int owner,
+                             PresetProfile & entries, EvalCounter & total)
+{
+    for (typename Container::const_iterator pos = equations.begin(); pos != equations.end(); ++pos) {
+        const EvalCounter & counter = profiledEqn(*pos)->profile;
+        entries.push_back(PresetProfileEntry(kind, owner, profiledEqn(*pos)->line, profiledEqn(*pos)->param->name,
+                                             counter.evaluations, counter.cycles));
+        total.evaluations += counter.evaluations;
+        total.cycles += counter.cycles;
+    }
+}
+
+template <class Container>
+static void resetEquations(const Container & equations)
+{
+    for (typename Container::const_iterator pos = equations.begin(); pos != equations.end(); ++pos)
+        profiledEqn(*pos)->profile.reset();
+}
 
-    evaluateFrame();
-    pipeline().Render(music, context);
+void MilkdropPreset::profile(PresetProfile & entries) const
+{
+    EvalCounter total;
+
+    profileEquations(per_frame_init_eqn_tree, PresetProfileEntry::INIT_COND, -1, entries, total);
+    profileEquations(init_cond_tree, PresetProfileEntry::INIT_COND, -1, entries, total);
+    profileEquations(per_frame_eqn_tree, PresetProfileEntry::PER_FRAME, -1, entries, total);
+    profileEquations(per_pixel_eqn_tree, PresetProfileEntry::PER_PIXEL, -1, entries, total);
+
+    for (PresetOutputs::cwave_container::const_iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos) {
+        EvalCounter wave;
+        profileEquations((*pos)->per_frame_init_eqn_tree, PresetProfileEntry::INIT_COND, (*pos)->id, entries, wave);
+        profileEquations((*pos)->init_cond_tree, PresetProfileEntry::INIT_COND, (*pos)->id, entries, wave);
+        profileEquations((*pos)->per_frame_eqn_tree, PresetProfileEntry::PER_FRAME, (*pos)->id, entries, wave);
+        profileEquations((*pos)->per_point_eqn_tree, PresetProfileEntry::PER_POINT, (*pos)->id, entries, wave);
+        entries.push_back(PresetProfileEntry(PresetProfileEntry::WAVE, (*pos)->id, 0, "", wave.evaluations, wave.cycles));
+    }
 
+    for (PresetOutputs::cshape_container::const_iterator pos = customShapes.begin(); pos != customShapes.end(); ++pos) {
+        EvalCounter shape;
+        profileEquations((*pos)->per_frame_init_eqn_tree, PresetProfileEntry::INIT_COND, (*pos)->id, entries, shape);
+        profileEquations((*pos)->init_cond_tree, PresetProfileEntry::INIT_COND, (*pos)->id, entries, shape);
+        profileEquations((*pos)->per_frame_eqn_tree, PresetProfileEntry::PER_FRAME, (*pos)->id, entries, shape);
+        entries.push_back(PresetProfileEntry(PresetProfileEntry::SHAPE, (*pos)->id, 0, "", shape.evaluations, shape.cycles));
+    }
 }
 
+void MilkdropPreset::resetProfile()
+{
+    resetEquations(per_frame_init_eqn_tree);
+    resetEquations(init_cond_tree);
+    resetEquations(per_frame_eqn_tree);
+    resetEquations(per_pixel_eqn_tree);
+
+    for (PresetOutputs::cwave_container::const_iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos) {
+        resetEquations((*pos)->per_frame_init_eqn_tree);
+        resetEquations((*pos)->init_cond_tree);
+        resetEquations((*pos)->per_frame_eqn_tree);
+        resetEquations((*pos)->per_point_eqn_tree);
+    }
+
+    for (PresetOutputs::cshape_container::const_iterator pos = customShapes.begin(); pos != customShapes.end(); ++pos) {
+        resetEquations((*pos)->per_frame_init_eqn_tree);
+        resetEquations((*pos)->init_cond_tree);
+        resetEquations((*pos)->per_frame_eqn_tree);
+    }
+}
+
+#else
+
+void MilkdropPreset::profile(PresetProfile &) const {}
+
+void MilkdropPreset::resetProfile() {}
+
+#endif /* USE_PROFILER */
+
 void MilkdropPreset::initialize(const std::string & pathname)
 {
     int retval;
+    ExprArena::Scope scope(_arena);
 
     preloadInitialize();
 
@@ -299,11 +476,14 @@ void MilkdropPreset::initialize(const std::string & pathname)
     }
 
     postloadInitialize();
+    optimizeEquations();
+    compileEquations();
 }
 
 void MilkdropPreset::initialize(std::istream & in)
 {
     int retval;
+    ExprArena::Scope scope(_arena);
 
     preloadInitialize();
 
@@ -317,6 +497,101 @@ void MilkdropPreset::initialize(std::istream & in)
     }
 
     postloadInitialize();
+    optimizeEquations();
+    compileEquations();
+}
+
+template <class Container>
+static void optimizePerFrameEquations(Container & equations)
+{
+    for (typename Container::iterator pos = equations.begin(); pos != equations.end(); ++pos)
+        (*pos)->gen_expr = Eval::opt_gen_expr((*pos)->gen_expr);
+}
+
+template <class Container>
+static bool effects(const Container & equations)
+{
+    for (typename Container::const_iterator pos = equations.begin(); pos != equations.end(); ++pos)
+        if (ExprOptimizer::effects((*pos)->gen_expr))
+            return true;
+    return false;
+}
+
+/// Adds what the equations assign, to their param or within them, as varying
+template <class Container>
+static void addAssigned(ExprOptimizer & optimizer, const Container & equations)
+{
+    std::set<Param*> assigned;
+    for (typename Container::const_iterator pos = equations.begin(); pos != equations.end(); ++pos) {
+        assigned.insert((*pos)->param);
+        ExprOptimizer::assigns((*pos)->gen_expr, assigned);
+    }
+
+    for (std::set<Param*>::iterator pos = assigned.begin(); pos != assigned.end(); ++pos)
+        optimizer.addVarying(*pos);
+}
+
+void MilkdropPreset::optimizeEquations()
+{
+    /* Equations assigning within themselves or using megabuf can touch what
+       equations of the other stages read, those run one after the other */
+    std::vector<PerPixelEqn*> perPixelEqns;
+    for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin(); pos != per_pixel_eqn_tree.end(); ++pos)
+        perPixelEqns.push_back(pos->second);
+
+    _sequential = effects(perPixelEqns);
+    for (PresetOutputs::cwave_container::iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos)
+        _sequential = _sequential || effects((*pos)->per_frame_eqn_tree) || effects((*pos)->per_point_eqn_tree);
+    for (PresetOutputs::cshape_container::iterator pos = customShapes.begin(); pos != customShapes.end(); ++pos)
+        _sequential = _sequential || effects((*pos)->per_frame_eqn_tree);
+
+    optimizePerFrameEquations(per_frame_eqn_tree);
+
+    /* Whatever a per pixel equation assigns differs from one mesh point to the
+       next, the tiles of the mesh are evaluated side by side */
+    addAssigned(_perPixelOptimizer, perPixelEqns);
+    for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin(); pos != per_pixel_eqn_tree.end(); ++pos)
+        pos->second->gen_expr = _perPixelOptimizer.optimizeLoop(pos->second->gen_expr, true);
+
+    for (PresetOutputs::cwave_container::iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos) {
+        CustomWave & wave = **pos;
+        optimizePerFrameEquations(wave.per_frame_eqn_tree);
+
+        wave.planPerPoint();
+        addAssigned(wave.per_point_optimizer, wave.per_point_eqn_tree);
+        for (std::vector<PerPointEqn*>::iterator eqn = wave.per_point_eqn_tree.begin(); eqn != wave.per_point_eqn_tree.end(); ++eqn)
+            (*eqn)->gen_expr = wave.per_point_optimizer.optimizeLoop((*eqn)->gen_expr, wave.per_point_threaded);
+    }
+
+    for (PresetOutputs::cshape_container::iterator pos = customShapes.begin(); pos != customShapes.end(); ++pos)
+        optimizePerFrameEquations((*pos)->per_frame_eqn_tree);
+}
+
+template <class Container>
+static void compileEach(ExprJit & jit, Container & equations)
+{
+    for (typename Container::iterator pos = equations.begin(); pos != equations.end(); ++pos)
+        (*pos)->gen_expr = jit.compile((*pos)->gen_expr);
+}
+
+void MilkdropPreset::compileEquations()
+{
+    if (!ExprJit::enabled())
+        return;
+
+    compileEach(_jit, per_frame_eqn_tree);
+    for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin(); pos != per_pixel_eqn_tree.end(); ++pos)
+        pos->second->gen_expr = _jit.compile(pos->second->gen_expr);
+
+    for (PresetOutputs::cwave_container::iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos) {
+        compileEach(_jit, (*pos)->per_frame_eqn_tree);
+        compileEach(_jit, (*pos)->per_point_eqn_tree);
+    }
+
+    for (PresetOutputs::cshape_container::iterator pos = customShapes.begin(); pos != customShapes.end(); ++pos)
+        compileEach(_jit, (*pos)->per_frame_eqn_tree);
+
+    _jit.finish();
 }
 
 void MilkdropPreset::loadBuiltinParamsUnspecInitConds()
@@ -350,34 +625,293 @@ void MilkdropPreset::loadCustomShapeUnspecInitConds()
 }
 
 
-void MilkdropPreset::evaluateFrame()
+/// Mesh columns evaluated by one per pixel task
+static const int perPixelTileColumns = 4;
+
+int MilkdropPreset::perPixelTiles() const
+{
+    if (_sequential)
+        return 1;
+
+    /* Equations writing a plain value instead of a mesh carry it over from
+       one pixel to the next, those have to run in order */
+    for (std::map<int, PerPixelEqn*>::const_iterator pos = per_pixel_eqn_tree.begin();
+            pos != per_pixel_eqn_tree.end(); ++pos)
+        if (pos->second->param->matrix == 0)
+            return 1;
+
+    return (presetInputs().gx + perPixelTileColumns - 1) / perPixelTileColumns;
+}
+
+void MilkdropPreset::setPerPixelTiles(int tiles)
+{
+    if ((int) _perPixelTasks.size() == tiles)
+        return;
+
+    _perPixelTasks.resize(tiles);
+    _perPixelStats.resize(tiles);
+    _perPixelLoops.resize(tiles);
+#ifdef USE_PROFILER
+    for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin(); pos != per_pixel_eqn_tree.end(); ++pos)
+        pos->second->tileProfiles.resize(tiles);
+#endif
+}
+
+void MilkdropPreset::addFrameTasks(TaskGraph & graph, Task & start, Task & done,
+                                   const BeatDetect & music, const PipelineContext & context)
+{
+    _music = &music;
+    _context = &context;
+
+    const int tiles = perPixelTiles();
+    setPerPixelTiles(tiles);
+
+    _perFrameTask.bind(this, &MilkdropPreset::evaluatePerFrame);
+    _wavesTask.bind(this, &MilkdropPreset::evaluateWaves);
+    _shapesTask.bind(this, &MilkdropPreset::evaluateShapes);
+    _finishTask.bind(this, &MilkdropPreset::finishFrame);
+
+    graph.add(_perFrameTask);
+    graph.add(_wavesTask);
+    graph.add(_shapesTask);
+    graph.add(_finishTask);
+
+    start.precede(_perFrameTask);
+
+    for (int tile = 0; tile < tiles; tile++) {
+        MemberTask<MilkdropPreset> & task = _perPixelTasks[tile];
+        task.bind(this, &MilkdropPreset::evaluatePerPixel, tile);
+        graph.add(task);
+
+        _perFrameTask.precede(task);
+        task.precede(_finishTask);
+
+        /* Keep the original order when the per pixel equations run as one task */
+        if (tiles == 1) {
+            task.precede(_wavesTask);
+            task.precede(_shapesTask);
+        }
+    }
+
+    _perFrameTask.precede(_wavesTask);
+    _perFrameTask.precede(_shapesTask);
+    if (_sequential)
+        _wavesTask.precede(_shapesTask);
+    _wavesTask.precede(_finishTask);
+    _shapesTask.precede(_finishTask);
+    _finishTask.precede(done);
+}
+
+void MilkdropPreset::evaluatePerFrame(int)
 {
+    _perFrameStats.clear();
+
+    {
+        StageTimer timer(&_perFrameStats, FrameStats::STAGE_AUDIO);
+        _presetInputs.update(*_music, *_context);
+    }
 
     // Evaluate all equation objects according to milkdrop flow diagram
 
-    evalPerFrameInitEquations();
-    evalPerFrameEquations();
+    {
+        StageTimer timer(&_perFrameStats, FrameStats::STAGE_PER_FRAME);
+        _perFrameLoops = LoopTime();
+        LoopBudget budget(_perFrameLoops);
+
+        evalPerFrameInitEquations();
+        evalPerFrameEquations();
+
+        // Important step to ensure custom shapes and waves don't stamp on the q variable values
+        // calculated by the per frame (init) and per pixel equations.
+        transfer_q_variables(customWaves);
+        transfer_q_variables(customShapes);
+    }
+
+    /* Over budget the per pixel pass may run on some frames only */
+    _perPixelSkipped = _perPixelCountdown > 0;
+    _perPixelCountdown = _perPixelSkipped ? _perPixelCountdown - 1 : _perPixelInterval - 1;
+    if (_perPixelSkipped)
+        return;
 
-    // Important step to ensure custom shapes and waves don't stamp on the q variable values
-    // calculated by the per frame (init) and per pixel equations.
-    transfer_q_variables(customWaves);
-    transfer_q_variables(customShapes);
+    {
+        StageTimer timer(&_perFrameStats, FrameStats::STAGE_PER_PIXEL);
+        initialize_PerPixelMeshes();
+        _perPixelOptimizer.evalInvariants();
+    }
+}
+
+void MilkdropPreset::evaluatePerPixel(int tile)
+{
+    const int tiles = _perPixelTasks.size();
+    const int begin = tiles == 1 ? 0 : tile * perPixelTileColumns;
+    const int end = tiles == 1 ? presetInputs().gx : std::min(begin + perPixelTileColumns, presetInputs().gx);
+
+    FrameStats & stats = _perPixelStats[tile];
+    stats.clear();
+
+    if (!_perPixelSkipped) {
+        StageTimer timer(&stats, FrameStats::STAGE_PER_PIXEL);
+        _perPixelLoops[tile] = LoopTime();
+        LoopBudget budget(_perPixelLoops[tile]);
+        evalPerPixelEqns(begin, end, _context->meshStride, tile);
+    }
 
-    initialize_PerPixelMeshes();
+    {
+        StageTimer timer(&stats, FrameStats::STAGE_PER_PIXEL_MATH);
+        _presetOutputs.PerPixelMath(*_context, begin, end);
+    }
+}
 
-    evalPerPixelEqns();
+void MilkdropPreset::evaluateWaves(int)
+{
+    _wavesStats.clear();
+    StageTimer timer(&_wavesStats, FrameStats::STAGE_WAVES_SHAPES);
+    _wavesLoops = LoopTime();
+    LoopBudget budget(_wavesLoops);
 
     evalCustomWaveInitConditions();
     evalCustomWavePerFrameEquations();
+    limitCustomWaveSamples(_context->waveSamples);
+
+    _waveSamplesWanted = 0;
+    for (PresetOutputs::cwave_container::iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos)
+        if ((*pos)->enabled)
+            _waveSamplesWanted = std::max(_waveSamplesWanted, (*pos)->samples);
+    limitCustomWaveSamples(_waveSamples);
+
+    for (PresetOutputs::cwave_container::iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos)
+        (*pos)->per_point_loop_time = &_perPointLoops;
+}
+
+void MilkdropPreset::evaluateShapes(int)
+{
+    _shapesStats.clear();
+    StageTimer timer(&_shapesStats, FrameStats::STAGE_WAVES_SHAPES);
+    _shapesLoops = LoopTime();
+    LoopBudget budget(_shapesLoops);
 
     evalCustomShapeInitConditions();
     evalCustomShapePerFrameEquations();
+}
+
+void MilkdropPreset::finishFrame(int)
+{
+    /* Tasks running side by side each timed themselves, the frame gets the sum */
+    if (_context->frameStats) {
+        _context->frameStats->add(_perFrameStats);
+        for (unsigned int tile = 0; tile < _perPixelStats.size(); tile++)
+            _context->frameStats->add(_perPixelStats[tile]);
+        _context->frameStats->add(_wavesStats);
+        _context->frameStats->add(_shapesStats);
+    }
+
+#ifdef USE_PROFILER
+    /* The tiles counted apart, so they didn't write the same counters */
+    for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin(); pos != per_pixel_eqn_tree.end(); ++pos)
+        for (std::vector<EvalCounter>::iterator tile = pos->second->tileProfiles.begin();
+                tile != pos->second->tileProfiles.end(); ++tile) {
+            pos->second->profile.add(*tile);
+            tile->reset();
+        }
+#endif
+
+    checkBudget();
+    reportLoops();
 
     // Setup pointers of the custom waves and shapes to the preset outputs instance
     /// @slow an extra O(N) per frame, could do this during eval
     _presetOutputs.customWaves = PresetOutputs::cwave_container(customWaves);
     _presetOutputs.customShapes = PresetOutputs::cshape_container(customShapes);
 
+    _presetOutputs.updateDrawables();
+}
+
+/// The per point loops are those of the frame before, drawn after it finished
+void MilkdropPreset::reportLoops()
+{
+    bool ranOut = _perFrameLoops.ranOut || _wavesLoops.ranOut || _shapesLoops.ranOut || _perPointLoops.ranOut;
+    for (unsigned int tile = 0; tile < _perPixelLoops.size(); tile++)
+        ranOut = ranOut || _perPixelLoops[tile].ranOut;
+
+    if (ranOut && !_loopsReported) {
+        std::cerr << "[MilkdropPreset] " << name() << ": loops ran out of time, stopped" << std::endl;
+        _loopsReported = true;
+    }
+
+    _perPointLoops = LoopTime();
+}
+
+void MilkdropPreset::checkBudget()
+{
+    _violations.clear();
+
+    const StageBudget * budget = _context->budget;
+    const int actions = budget && budget->enabled() ? budget->actions : StageBudget::REPORT;
+
+    /* Whatever the budget doesn't ask for any more is given back */
+    if (!(actions & StageBudget::SKIP_PER_PIXEL))
+        _perPixelInterval = 1;
+    if (!(actions & StageBudget::REDUCE_SAMPLES))
+        _waveSamples = 0;
+    if (budget == 0 || !budget->enabled()) {
+        _budgetStrikes = 0;
+        return;
+    }
+
+    float times[StageBudget::STAGE_COUNT];
+    times[StageBudget::PER_FRAME] = _perFrameStats[FrameStats::STAGE_PER_FRAME];
+    times[StageBudget::PER_PIXEL] = _perFrameStats[FrameStats::STAGE_PER_PIXEL];
+    for (unsigned int tile = 0; tile < _perPixelStats.size(); tile++)
+        times[StageBudget::PER_PIXEL] += _perPixelStats[tile][FrameStats::STAGE_PER_PIXEL];
+    /* The per point equations ran when the waves were drawn the last time */
+    times[StageBudget::WAVES] = _wavesStats[FrameStats::STAGE_WAVES_SHAPES];
+    for (PresetOutputs::cwave_container::iterator pos = customWaves.begin(); pos != customWaves.end(); ++pos)
+        if ((*pos)->enabled)
+            times[StageBudget::WAVES] += (*pos)->per_point_time;
+    times[StageBudget::SHAPES] = _shapesStats[FrameStats::STAGE_WAVES_SHAPES];
+
+    bool over[StageBudget::STAGE_COUNT];
+    for (int stage = 0; stage < StageBudget::STAGE_COUNT; stage++) {
+        over[stage] = budget->milliseconds[stage] > 0 && times[stage] > budget->milliseconds[stage];
+        if (over[stage])
+            _violations.push_back(BudgetViolation((StageBudget::Stage) stage, times[stage], budget->milliseconds[stage]));
+    }
+
+    /* A frame without the pass is as far over as the last one with it */
+    if (_perPixelSkipped)
+        over[StageBudget::PER_PIXEL] = _perPixelOver;
+    else if (actions & StageBudget::SKIP_PER_PIXEL) {
+        if (over[StageBudget::PER_PIXEL] && _perPixelInterval < BUDGET_MAX_INTERVAL)
+            _perPixelInterval *= 2;
+        else if (times[StageBudget::PER_PIXEL] < budget->milliseconds[StageBudget::PER_PIXEL] / 2 && _perPixelInterval > 1)
+            _perPixelInterval /= 2;
+    }
+    _perPixelOver = over[StageBudget::PER_PIXEL];
+    _perPixelCountdown = std::min(_perPixelCountdown, _perPixelInterval - 1);
+
+    if (actions & StageBudget::REDUCE_SAMPLES) {
+        if (_waveSamplesSettle > 0)
+            _waveSamplesSettle--;
+        else if (over[StageBudget::WAVES]) {
+            const int samples = _waveSamples > 0 ? std::min(_waveSamples, _waveSamplesWanted) : _waveSamplesWanted;
+            if (samples > BUDGET_MIN_SAMPLES) {
+                _waveSamples = std::max(samples / 2, BUDGET_MIN_SAMPLES);
+                _waveSamplesSettle = BUDGET_SETTLE_FRAMES;
+            }
+        } else if (_waveSamples > 0 && times[StageBudget::WAVES] < budget->milliseconds[StageBudget::WAVES] / 2) {
+            _waveSamples = _waveSamples * 2 < _waveSamplesWanted ? _waveSamples * 2 : 0;
+            _waveSamplesSettle = BUDGET_SETTLE_FRAMES;
+        }
+    }
+
+    _budgetStrikes = std::count(over, over + StageBudget::STAGE_COUNT, true) ? _budgetStrikes + 1 : 0;
+    if ((actions & StageBudget::SWITCH_PRESET) && _budgetStrikes >= BUDGET_STRIKES)
+        _tooExpensive = true;
+}
+
+void MilkdropPreset::budgetViolations(std::vector<BudgetViolation> & violations) const
+{
+    violations.insert(violations.end(), _violations.begin(), _violations.end());
 }
 
 void MilkdropPreset::initialize_PerPixelMeshes()
@@ -464,20 +998,69 @@ void MilkdropPreset::initialize_PerPixelMeshes()
         }
     }
 
+    /* Flagged here, before the tiles evaluating the equations side by side.
+       Until its equation ran at a point, the mesh holds the value the param had */
+    for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin(); pos != per_pixel_eqn_tree.end(); ++pos) {
+        Param * param = pos->second->param;
+        if (param->matrix == 0)
+            continue;
+        param->matrix_flag = true;
+        param->flags |= P_FLAG_PER_PIXEL;
+    }
+
+
 
+}
+/// Next point of a coarse grid with the given stride that always ends on end - 1
+static inline int coarseNext(int i, int stride, int end)
+{
+    if (i == end - 1)
+        return end;
+    return std::min(i + stride, end - 1);
+}
 
+/// Fills the points of matrix between the coarse grid points of columns
+/// [begin, end) bilinearly. Stays within those columns
+static void interpolateCoarse(float ** matrix, int begin, int end, int height, int stride)
+{
+    for (int x = begin; x < end; x = coarseNext(x, stride, end))
+        for (int y0 = 0, y1 = coarseNext(0, stride, height); y1 < height; y0 = y1, y1 = coarseNext(y1, stride, height))
+            for (int y = y0 + 1; y < y1; y++)
+                matrix[x][y] = matrix[x][y0] + (matrix[x][y1] - matrix[x][y0]) * (y - y0) / (float) (y1 - y0);
+
+    for (int x0 = begin, x1 = coarseNext(begin, stride, end); x1 < end; x0 = x1, x1 = coarseNext(x1, stride, end))
+        for (int x = x0 + 1; x < x1; x++)
+            for (int y = 0; y < height; y++)
+                matrix[x][y] = matrix[x0][y] + (matrix[x1][y] - matrix[x0][y]) * (x - x0) / (float) (x1 - x0);
 }
+
 // Evaluates all per-pixel equations
-void MilkdropPreset::evalPerPixelEqns()
+void MilkdropPreset::evalPerPixelEqns(int begin, int end, int stride, int tile)
 {
+    const int height = presetInputs().gy;
+
+    if (stride < 2) {
+        /* Evaluate all per pixel equations in the tree datastructure */
+        for (int mesh_x = begin; mesh_x < end; mesh_x++)
+            for (int mesh_y = 0; mesh_y < height; mesh_y++)
+                for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin();
+                        pos != per_pixel_eqn_tree.end(); ++pos)
+                    pos->second->evaluate(mesh_x, mesh_y, tile);
+        return;
+    }
 
-    /* Evaluate all per pixel equations in the tree datastructure */
-    for (int mesh_x = 0; mesh_x < presetInputs().gx; mesh_x++)
-        for (int mesh_y = 0; mesh_y < presetInputs().gy; mesh_y++)
+    /* Only on a coarse grid, the edges of the tile included, and the rest
+       of the per pixel meshes is interpolated */
+    for (int mesh_x = begin; mesh_x < end; mesh_x = coarseNext(mesh_x, stride, end))
+        for (int mesh_y = 0; mesh_y < height; mesh_y = coarseNext(mesh_y, stride, height))
             for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin();
                     pos != per_pixel_eqn_tree.end(); ++pos)
-                pos->second->evaluate(mesh_x, mesh_y);
+                pos->second->evaluate(mesh_x, mesh_y, tile);
 
+    for (std::map<int, PerPixelEqn*>::iterator pos = per_pixel_eqn_tree.begin();
+            pos != per_pixel_eqn_tree.end(); ++pos)
+        if (pos->second->param->matrix != 0)
+            interpolateCoarse((float **) pos->second->param->matrix, begin, end, height, stride);
 }
 
 int MilkdropPreset::readIn(std::istream & fs)
@@ -487,8 +1070,10 @@ int MilkdropPreset::readIn(std::istream & fs)
     presetOutputs().compositeShader.programSource.clear();
     presetOutputs().warpShader.programSource.clear();
 
+    Parser parser;
+
     /* Parse any comments */
-    if (Parser::parse_top_comment(fs) < 0) {
+    if (parser.parse_top_comment(fs) < 0) {
         if (MILKDROP_PRESET_DEBUG)
             std::cerr << "[Preset::readIn] no left bracket found..." << std::endl;
         return PROJECTM_FAILURE;
@@ -497,7 +1082,7 @@ int MilkdropPreset::readIn(std::istream & fs)
     /* Parse the preset name and a left bracket */
     char tmp_name[MAX_TOKEN_SIZE];
 
-    if (Parser::parse_preset_name(fs, tmp_name) < 0) {
+    if (parser.parse_preset_name(fs, tmp_name) < 0) {
         std::cerr <<  "[Preset::readIn] loading of preset name failed" << std::endl;
         return PROJECTM_ERROR;
     }
@@ -507,7 +1092,7 @@ int MilkdropPreset::readIn(std::istream & fs)
     // Loop through each line in file, trying to successfully parse the file.
     // If a line does not parse correctly, keep trucking along to next line.
     int retval;
-    while ((retval = Parser::parse_line(fs, this)) != EOF) {
+    while ((retval = parser.parse_line(fs, this)) != EOF) {
         if (retval == PROJECTM_PARSE_ERROR) {
             line_mode = UNSET_LINE_MODE;
             // std::cerr << "[Preset::readIn()] parse error in file \"" << this->absoluteFilePath() << "\"" << std::endl;
@@ -544,6 +1129,6 @@ int MilkdropPreset::loadPresetFile(const std::string & pathname)
 const std::string & MilkdropPreset::name() const
 {
 
-    return name().empty() ? filename() : name();
+    return Preset::name().empty() ? filename() : Preset::name();
 }
 
@@ -42,10 +42,15 @@
 #include "Expr.hpp"
 #include "PerPixelEqn.hpp"
 #include "PerFrameEqn.hpp"
+#include "ExprOptimizer.hpp"
+#include "ExprArena.hpp"
+#include "ExprJit.hpp"
+#include "Megabuf.hpp"
 #include "BuiltinParams.hpp"
 #include "PresetFrameIO.hpp"
 #include "InitCond.hpp"
 #include "Preset.hpp"
+#include "FrameStats.hpp"
 
 class CustomWave;
 class CustomShape;
@@ -54,6 +59,9 @@ class InitCond;
 
 class MilkdropPreset : public Preset
 {
+  /// Holds the equations, initial conditions and user params parsed. First
+  /// member, so it goes after everything pointing into it
+  ExprArena _arena;
 
 public:
 
@@ -95,7 +103,7 @@ public:
 
   /// Used by parser
   /// @bug refactor
-  int add_per_pixel_eqn( char *name, GenExpr *gen_expr );
+  int add_per_pixel_eqn( char *name, GenExpr *gen_expr, unsigned int line = 0 );
 
   /// Accessor method to retrieve the absolute file path of the loaded MilkdropPreset
   /// \returns a file path string
@@ -106,7 +114,7 @@ public:
 
 
   /// Accessor method for the MilkdropPreset outputs instance associated with this MilkdropPreset
-  /// \returns A MilkdropPreset output instance with values computed from most recent evaluateFrame()
+  /// \returns A MilkdropPreset output instance with values computed for the most recent frame
   PresetOutputs & presetOutputs() const
   {
 
@@ -119,6 +127,9 @@ public:
     return _presetInputs;
   }
 
+  /// megabuf() of the equations
+  Megabuf & megabuf() { return _megabuf; }
+
 
 // @bug encapsulate
 
@@ -137,14 +148,91 @@ public:
   PresetOutputs & pipeline() { return _presetOutputs; } 
 
   void Render(const BeatDetect &music, const PipelineContext &context);
+
+  /// Per frame equations first, then the per pixel equations in mesh column tiles
+  /// next to the custom waves and the custom shapes, then a task collecting the outputs
+  void addFrameTasks(TaskGraph & graph, Task & start, Task & done,
+                     const BeatDetect & music, const PipelineContext & context);
+
+  /// Per equation counters plus one total for each custom wave and shape, see USE_PROFILER
+  void profile(PresetProfile & entries) const;
+  void resetProfile();
+
+  /// See StageBudget, the per pixel pass of the frame counts only if it ran
+  void budgetViolations(std::vector<BudgetViolation> & violations) const;
+  bool tooExpensive() const { return _tooExpensive; }
+
   const std::string & name() const;
   const std::string & filename() const { return _filename; } 
 private:
   std::string _filename; 
   PresetInputs _presetInputs;
-  /// Evaluates the MilkdropPreset for a frame given the current values of MilkdropPreset inputs / outputs
-  /// All calculated values are stored in the associated MilkdropPreset outputs instance
-  void evaluateFrame();
+  /// Stages evaluating the MilkdropPreset for a frame given the current values of MilkdropPreset
+  /// inputs / outputs. All calculated values are stored in the associated MilkdropPreset outputs
+  /// instance and stage timings are added to the frame stats of the context
+  void evaluatePerFrame(int);
+  void evaluatePerPixel(int tile);
+  void evaluateWaves(int);
+  void evaluateShapes(int);
+  void finishFrame(int);
+
+  /// Number of mesh column tiles the per pixel equations are split into
+  int perPixelTiles() const;
+  /// Sizes what each tile keeps for itself
+  void setPerPixelTiles(int tiles);
+
+  const BeatDetect * _music;
+  const PipelineContext * _context;
+
+  /// Some equation assigns within itself or uses megabuf, the per pixel
+  /// equations, the custom waves and the custom shapes run in that order
+  bool _sequential;
+
+  MemberTask<MilkdropPreset> _perFrameTask;
+  std::vector<MemberTask<MilkdropPreset> > _perPixelTasks;
+  MemberTask<MilkdropPreset> _wavesTask;
+  MemberTask<MilkdropPreset> _shapesTask;
+  MemberTask<MilkdropPreset> _finishTask;
+
+  /// Stage times of the tasks running side by side, summed up by finishFrame
+  FrameStats _perFrameStats;
+  std::vector<FrameStats> _perPixelStats;
+  FrameStats _wavesStats;
+  FrameStats _shapesStats;
+
+  /// Loop time of each task in a frame, and of the per point equations of
+  /// all custom waves, which run while the waves are drawn after the tasks.
+  /// Loops running out of time are reported once per preset, not every frame
+  LoopTime _perFrameLoops;
+  std::vector<LoopTime> _perPixelLoops;
+  LoopTime _wavesLoops;
+  LoopTime _shapesLoops;
+  LoopTime _perPointLoops;
+  bool _loopsReported;
+  void reportLoops();
+
+  /// Compares the stage times of the frame with the budget of the context
+  /// and gives up what the budget asks for on the stages over it
+  void checkBudget();
+  std::vector<BudgetViolation> _violations;
+  /// Consecutive frames with some stage over budget
+  int _budgetStrikes;
+  bool _tooExpensive;
+
+  /// The per pixel pass runs on every _perPixelInterval-th frame, in between
+  /// the meshes keep what the last pass left in them
+  int _perPixelInterval;
+  int _perPixelCountdown;
+  bool _perPixelSkipped;
+  /// The last pass that ran was over budget
+  bool _perPixelOver;
+
+  /// Samples the custom waves are limited to, 0 for no limit, and the most
+  /// any of them asked for in the frame
+  int _waveSamples;
+  int _waveSamplesWanted;
+  /// Frames until the per point times show the last change of the limit
+  int _waveSamplesSettle;
 
   // The absolute file path of the MilkdropPreset
   std::string _absoluteFilePath;
@@ -162,17 +250,31 @@ private:
   void loadCustomShapeUnspecInitConds();
 
   void evalCustomWavePerFrameEquations();
+  void limitCustomWaveSamples(int samples);
   void evalCustomShapePerFrameEquations();
+  void evalCustomShapeInstance(CustomShape & shape);
   void evalPerFrameInitEquations();
   void evalCustomWaveInitConditions();
   void evalCustomShapeInitConditions();
-  void evalPerPixelEqns();
+  void evalPerPixelEqns(int begin, int end, int stride, int tile);
   void evalPerFrameEquations();
   void initialize_PerPixelMeshes();
   int readIn(std::istream & fs);
 
   void preloadInitialize();
   void postloadInitialize();
+  /// Rewrites the equations loaded, see ExprOptimizer
+  void optimizeEquations();
+
+  /// Invariants of the per pixel equations
+  ExprOptimizer _perPixelOptimizer;
+
+  /// Code of the equations, see ExprJit
+  ExprJit _jit;
+
+  Megabuf _megabuf;
+  /// Compiles the equations optimized
+  void compileEquations();
   
   PresetOutputs & _presetOutputs;
 
@@ -19,12 +19,6 @@
 
 MilkdropPresetFactory::MilkdropPresetFactory(int gx, int gy): _usePresetOutputs(false)
 {
-    /* Initializes the builtin function database */
-    BuiltinFuncs::init_builtin_func_db();
-
-    /* Initializes all infix operators */
-    Eval::init_infix_ops();
-
     _presetOutputs = createPresetOutputs(gx,gy);
     _presetOutputs2 = createPresetOutputs(gx, gy);
 }
@@ -32,10 +26,6 @@ MilkdropPresetFactory::MilkdropPresetFactory(int gx, int gy): _usePresetOutputs(
 MilkdropPresetFactory::~MilkdropPresetFactory()
 {
 
-    std::cerr << "[~MilkdropPresetFactory] destroy infix ops" << std::endl;
-    Eval::destroy_infix_ops();
-    std::cerr << "[~MilkdropPresetFactory] destroy builtin func" << std::endl;
-    BuiltinFuncs::destroy_builtin_func_db();
     std::cerr << "[~MilkdropPresetFactory] delete preset out puts" << std::endl;
     delete(_presetOutputs);
     delete(_presetOutputs2);
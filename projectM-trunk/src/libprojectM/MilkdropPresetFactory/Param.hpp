@@ -60,7 +60,7 @@ class Preset;
 //#include <map>
 
 /* Parameter Type */
-class Param {
+class Param : public ArenaObject {
 public:
     std::string name; /* name of the parameter, not necessary but useful neverthless */
     short int type; /* parameter number type (int, bool, or float) */
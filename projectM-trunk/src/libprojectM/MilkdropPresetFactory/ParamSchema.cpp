@@ -0,0 +1,126 @@
+/*
+ * ParamSchema.cpp
+ *
+ *  Builtin params shared by kind of object, and the params of one object.
+ */
+
+#include <cassert>
+
+#include "ParamSchema.hpp"
+
+ParamSchema::ParamSchema(const void * prototype, size_t size, const void * secondPrototype, size_t secondSize)
+{
+    _prototypes[0] = (const char *) prototype;
+    _sizes[0] = size;
+    _prototypes[1] = (const char *) secondPrototype;
+    _sizes[1] = secondSize;
+}
+
+/// Which prototype address is in, and where in it
+int ParamSchema::locate(const void * address, ptrdiff_t & offset) const
+{
+    const char * byte = (const char *) address;
+
+    for (int i = 0; i < 2; i++) {
+        if (_prototypes[i] && byte >= _prototypes[i] && byte < _prototypes[i] + _sizes[i]) {
+            offset = byte - _prototypes[i];
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool ParamSchema::add(Param * param, const void * matrix, const std::string & alias)
+{
+    assert(param);
+
+    if (_slots.count(param->name)) {
+        delete param;
+        return false;
+    }
+
+    Layout layout;
+    layout.object = locate(param->engine_val, layout.value);
+    layout.matrix = -1;
+    assert(layout.object >= 0);
+
+    if (matrix) {
+        const int object = locate(matrix, layout.matrix);
+        assert(object == layout.object);
+    }
+
+    const int slot = _params.size();
+    _params.push_back(*param);
+    _layouts.push_back(layout);
+    delete param;
+
+    _slots.insert(std::make_pair(_params.back().name, slot));
+
+    /* An alias wins over a param of the same name, as it always did */
+    if (!alias.empty())
+        _slots[alias] = slot;
+
+    return true;
+}
+
+int ParamSchema::slot(const std::string & name) const
+{
+    std::map<std::string, int>::const_iterator pos = _slots.find(name);
+    return pos == _slots.end() ? -1 : pos->second;
+}
+
+void ParamSchema::instantiate(std::vector<Param> & params, void * object, void * secondObject) const
+{
+    char * const objects[2] = { (char *) object, (char *) secondObject };
+
+    params = _params;
+
+    for (unsigned int i = 0; i < params.size(); i++) {
+        const Layout & layout = _layouts[i];
+        char * base = objects[layout.object];
+        assert(base);
+
+        params[i].engine_val = base + layout.value;
+        if (layout.matrix >= 0)
+            params[i].matrix = *(void **) (base + layout.matrix);
+    }
+}
+
+ParamTable::ParamTable() : _schema(NULL) {}
+
+ParamTable::~ParamTable()
+{
+    for (std::map<std::string, Param *>::iterator pos = _user.begin(); pos != _user.end(); ++pos)
+        delete pos->second;
+}
+
+void ParamTable::load(const ParamSchema & schema, void * object, void * secondObject)
+{
+    assert(_schema == NULL);
+
+    _schema = &schema;
+    schema.instantiate(_builtins, object, secondObject);
+}
+
+Param * ParamTable::find(const std::string & name)
+{
+    if (_schema) {
+        const int slot = _schema->slot(name);
+        if (slot >= 0)
+            return &_builtins[slot];
+    }
+
+    std::map<std::string, Param *>::iterator pos = _user.find(name);
+    return pos == _user.end() ? NULL : pos->second;
+}
+
+bool ParamTable::insert(Param * param)
+{
+    assert(param);
+
+    if (find(param->name))
+        return false;
+
+    return _user.insert(std::make_pair(param->name, param)).second;
+}
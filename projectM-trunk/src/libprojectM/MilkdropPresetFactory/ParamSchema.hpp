@@ -0,0 +1,100 @@
+/*
+ * ParamSchema.hpp
+ *
+ *  The builtin params of one kind of object (the preset, custom waves,
+ *  custom shapes) are described once, in a schema shared by every object of
+ *  that kind. Their names are interned into slots when the schema is built;
+ *  an object keeps its builtin params in one array indexed by slot, copied
+ *  from the schema with the addresses moved into the object, and only the
+ *  params a preset defines itself are allocated one by one.
+ */
+
+#ifndef PARAMSCHEMA_HPP_
+#define PARAMSCHEMA_HPP_
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Param.hpp"
+
+class ParamSchema
+{
+public:
+    /// Params of objects laid out like prototype, size bytes long. Params
+    /// may also point into a second object, as the preset's do into its
+    /// inputs besides its outputs
+    ParamSchema(const void * prototype, size_t size,
+                const void * secondPrototype = NULL, size_t secondSize = 0);
+
+    /// Takes param, created for the prototypes, and gives it the next slot.
+    /// matrix is the prototype member holding the address of its per point
+    /// or per pixel values, if it has any. alias is another name for it.
+    /// False if the name was taken, param is deleted then
+    bool add(Param * param, const void * matrix = NULL, const std::string & alias = std::string());
+
+    /// Slot of a name or alias, -1 if no builtin has it
+    int slot(const std::string & name) const;
+    unsigned int size() const { return _params.size(); }
+
+    /// Fills params, indexed by slot, with the builtins of the objects given
+    void instantiate(std::vector<Param> & params, void * object, void * secondObject = NULL) const;
+
+private:
+    /// Where a param lives in the objects
+    struct Layout {
+        int object;
+        ptrdiff_t value;
+        /// -1 if the param has no matrix
+        ptrdiff_t matrix;
+    };
+
+    int locate(const void * address, ptrdiff_t & offset) const;
+
+    const char * _prototypes[2];
+    size_t _sizes[2];
+
+    std::vector<Param> _params;
+    std::vector<Layout> _layouts;
+    std::map<std::string, int> _slots;
+};
+
+/// The params of one object: the builtins of its schema, then those the
+/// preset defines itself, created while parsing
+class ParamTable
+{
+public:
+    ParamTable();
+    /// Deletes the user defined params
+    ~ParamTable();
+
+    /// Takes the builtins of schema for the objects given. Once, before any
+    /// lookup, the builtins never move afterwards
+    void load(const ParamSchema & schema, void * object, void * secondObject = NULL);
+
+    /// The builtin or user defined param of that name, or NULL
+    Param * find(const std::string & name);
+
+    /// Takes a user defined param. False if the name is taken
+    bool insert(Param * param);
+
+    template <class Fun>
+    void apply(Fun & fun)
+    {
+        for (unsigned int i = 0; i < _builtins.size(); i++)
+            fun(&_builtins[i]);
+        for (std::map<std::string, Param *>::iterator pos = _user.begin(); pos != _user.end(); ++pos)
+            fun(pos->second);
+    }
+
+private:
+    const ParamSchema * _schema;
+    std::vector<Param> _builtins;
+    std::map<std::string, Param *> _user;
+
+    ParamTable(const ParamTable &);
+    ParamTable & operator=(const ParamTable &);
+};
+
+#endif /* PARAMSCHEMA_HPP_ */
@@ -9,6 +9,7 @@
 #include <map>
 #include <cassert>
 #include "BuiltinParams.hpp"
+#include "ParamSchema.hpp"
 
 class ParamUtils
 {
@@ -24,6 +25,14 @@ public:
 
   }
 
+  static bool insert(Param * param, ParamTable * paramTable)
+  {
+    assert(param);
+    assert(paramTable);
+
+    return paramTable->insert(param);
+  }
+
   static const int AUTO_CREATE = 1;
   static const int NO_CREATE = 0;
 
@@ -67,6 +76,35 @@ public:
   }
 
 
+  template <int FLAGS>
+  static Param * find(const std::string & name, ParamTable * paramTable)
+  {
+
+    assert(paramTable);
+
+    Param * param = paramTable->find(name);
+
+    if ((FLAGS == AUTO_CREATE) && (param == NULL))
+    {
+      /* Check if string is valid */
+      if (!Param::is_valid_param_string(name.c_str()))
+        return NULL;
+
+      /* Now, create the user defined parameter given the passed name */
+      if ((param = new Param(name)) == NULL)
+        return NULL;
+
+      /* Finally, insert the new parameter into the table */
+      const bool inserted = paramTable->insert(param);
+
+      assert(inserted);
+    }
+
+    return param;
+
+  }
+
+
   static Param * find(const std::string & name, BuiltinParams * builtinParams, std::map<std::string,Param*> * insertionTree)
   {
 
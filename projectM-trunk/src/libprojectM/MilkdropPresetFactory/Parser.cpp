@@ -25,6 +25,7 @@
 #include <cstring>
 #include <iostream>
 #include <stdlib.h>
+#include <ctype.h>
 
 #include "Common.hpp"
 #include "fatal.h"
@@ -46,26 +47,30 @@
 #include <iostream>
 #include <sstream>
 #include "BuiltinFuncs.hpp"
+#include "Megabuf.hpp"
 
 /* Grabs the next token from the file. The second argument points
    to the raw string */
 
-line_mode_t Parser::line_mode;
-CustomWave *Parser::current_wave;
-CustomShape *Parser::current_shape;
-int Parser::string_line_buffer_index;
-char Parser::string_line_buffer[STRING_LINE_SIZE];
-unsigned int Parser::line_count;
-int Parser::per_frame_eqn_count;
-int Parser::per_frame_init_eqn_count;
-int Parser::last_custom_wave_id;
-int Parser::last_custom_shape_id;
-char Parser::last_eqn_type[MAX_TOKEN_SIZE];
-int Parser::last_token_size;
-
-std::string Parser::lastLinePrefix("");
-
-bool Parser::tokenWrapAroundEnabled(false);
+Parser::Parser() :
+    lastLinePrefix(""),
+    line_mode(UNSET_LINE_MODE),
+    current_wave(NULL),
+    current_shape(NULL),
+    string_line_buffer_index(0),
+    line_count(1),
+    eqn_line(0),
+    per_frame_eqn_count(0),
+    per_frame_init_eqn_count(0),
+    last_custom_wave_id(0),
+    last_custom_shape_id(0),
+    last_token_size(0),
+    tokenWrapAroundEnabled(false),
+    last_terminal(tEOL)
+{
+    memset(string_line_buffer, 0, STRING_LINE_SIZE);
+    memset(last_eqn_type, 0, MAX_TOKEN_SIZE);
+}
 
 token_t Parser::parseToken(std::istream &  fs, char * string)
 {
@@ -245,12 +250,8 @@ GenExpr **Parser::parse_prefix_args(std::istream &  fs, int num_args, MilkdropPr
     GenExpr ** expr_list; /* List of arguments to function */
     GenExpr * gen_expr;
 
-    /* Malloc the expression list */
-    expr_list =  (GenExpr**)wipemalloc(sizeof(GenExpr*)*num_args);
-
-    /* Malloc failed */
-    if (expr_list == NULL)
-        return NULL;
+    /* Allocate the expression list, along with the expressions */
+    expr_list = (GenExpr**)ExprArena::create(sizeof(GenExpr*)*num_args);
 
 
     i = 0;
@@ -258,11 +259,11 @@ GenExpr **Parser::parse_prefix_args(std::istream &  fs, int num_args, MilkdropPr
     while (i < num_args) {
         //if (PARSE_DEBUG) printf("parse_prefix_args: parsing argument %d...\n", i+1);
         /* Parse the ith expression in the list */
-        if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+        if ((gen_expr = parse_sequence(fs, preset)) == NULL) {
             //if (PARSE_DEBUG) printf("parse_prefix_args: failed to get parameter # %d for function (LINE %d)\n", i+1, line_count);
             for (j = 0; j < i; j++)
                 delete expr_list[j];
-            free(expr_list);
+            ExprArena::destroy(expr_list);
             expr_list = NULL;
             return NULL;
         }
@@ -282,6 +283,8 @@ int Parser::parse_top_comment(std::istream &  fs)
     char string[MAX_TOKEN_SIZE];
     token_t token;
 
+    line_count = 1;
+
     /* Process tokens until left bracket is found */
     while ((token = parseToken(fs, string)) != tLBr) {
         if (token == tEOF)
@@ -309,8 +312,8 @@ int Parser::parse_preset_name(std::istream &  fs, char * name)
 }
 
 
-/* Parses per pixel equations */
-int Parser::parse_per_pixel_eqn(std::istream &  fs, MilkdropPreset * preset, char * init_string)
+/* Parses per pixel equations. token follows init_string when there is one */
+int Parser::parse_per_pixel_eqn(std::istream &  fs, MilkdropPreset * preset, char * init_string, token_t token)
 {
 
 
@@ -319,22 +322,27 @@ int Parser::parse_per_pixel_eqn(std::istream &  fs, MilkdropPreset * preset, cha
 
 
     if (init_string != 0) {
-        strncpy(string, init_string, strlen(init_string));
+        strncpy(string, init_string, MAX_TOKEN_SIZE);
     } else {
+        token = parseToken(fs, string);
+    }
 
-        if (parseToken(fs, string) != tEq) {
-            /* parse per pixel operator name */
-            return PROJECTM_PARSE_ERROR;
-        }
+    if (token == tLPr) {
+        gen_expr = parse_statement(fs, string, preset);
+    } else if (token != tEq) {
+        /* parse per pixel operator name */
+        return PROJECTM_PARSE_ERROR;
+    } else {
+        /* Parse right side of equation as an expression */
+        gen_expr = parse_gen_expr(fs, NULL, preset);
     }
 
-    /* Parse right side of equation as an expression */
-    if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+    if (gen_expr == NULL) {
         return PROJECTM_PARSE_ERROR;
     }
 
     /* Add the per pixel equation */
-    if (preset->add_per_pixel_eqn(string, gen_expr) < 0) {
+    if (preset->add_per_pixel_eqn(string, gen_expr, eqn_line) < 0) {
         if (PARSE_DEBUG) {
 
         }
@@ -360,12 +368,40 @@ int Parser::parse_line(std::istream &  fs, MilkdropPreset * preset)
 
     tokenWrapAroundEnabled = false;
 
+    eqn_line = line_count;
+
     token = parseToken( fs, eqn_string );
     switch (token ) {
 
+    case tLPr:
+        /* A statement starting with a call, following others on the line */
+        if (*eqn_string != 0) {
+            if (line_mode == PER_FRAME_LINE_MODE) {
+                tokenWrapAroundEnabled = true;
+                if ((per_frame_eqn = parse_implicit_per_frame_eqn(fs, eqn_string, ++per_frame_eqn_count, preset, tLPr)) == NULL) {
+                    tokenWrapAroundEnabled = false;
+                    return PROJECTM_PARSE_ERROR;
+                }
+
+                preset->per_frame_eqn_tree.push_back(per_frame_eqn);
+                return PROJECTM_SUCCESS;
+            }
+
+            if (line_mode == PER_PIXEL_LINE_MODE) {
+                tokenWrapAroundEnabled = true;
+                return parse_per_pixel_eqn(fs, preset, eqn_string, tLPr);
+            }
+
+            if (line_mode == CUSTOM_WAVE_PER_POINT_LINE_MODE) {
+                tokenWrapAroundEnabled = true;
+                if (parse_wave_helper(fs, preset, last_custom_wave_id, last_eqn_type, eqn_string, tLPr) < 0)
+                    return PROJECTM_FAILURE;
+                return PROJECTM_SUCCESS;
+            }
+        }
+
         /* Invalid Cases */
     case tRBr:
-    case tLPr:
     case tRPr:
     case tComma:
     case tLBr:
@@ -447,7 +483,8 @@ int Parser::parse_line(std::istream &  fs, MilkdropPreset * preset)
             }
 
             /* Insert the equation in the per frame equation tree */
-            preset->per_frame_init_eqn_tree.insert(std::make_pair(init_cond->param->name, init_cond));
+            if (!preset->per_frame_init_eqn_tree.insert(std::make_pair(init_cond->param->name, init_cond)).second)
+                delete init_cond;
 
             line_mode = PER_FRAME_INIT_LINE_MODE;
             return PROJECTM_SUCCESS;
@@ -573,7 +610,8 @@ int Parser::parse_line(std::istream &  fs, MilkdropPreset * preset)
             ++per_frame_init_eqn_count;
 
             /* Insert the equation in the per frame equation tree */
-            preset->per_frame_init_eqn_tree.insert(std::make_pair(init_cond->param->name, init_cond));
+            if (!preset->per_frame_init_eqn_tree.insert(std::make_pair(init_cond->param->name, init_cond)).second)
+                delete init_cond;
 
             return PROJECTM_SUCCESS;
         } else if (line_mode == PER_PIXEL_LINE_MODE) {
@@ -662,21 +700,54 @@ int Parser::parse_line(std::istream &  fs, MilkdropPreset * preset)
 
 /* Parses a general expression, this function is the meat of the parser */
 GenExpr * Parser::parse_gen_expr ( std::istream &  fs, TreeExpr * tree_expr, MilkdropPreset * preset)
+{
+    char string[MAX_TOKEN_SIZE];
+    const token_t token = parseToken(fs, string);
+
+    return parse_gen_expr(fs, token, string, tree_expr, preset);
+}
+
+/* Parses a general expression going on with a token read already, string
+   holding what was read before it */
+GenExpr * Parser::parse_gen_expr ( std::istream &  fs, token_t token, char * string, TreeExpr * tree_expr, MilkdropPreset * preset)
 {
 
     int i;
-    char string[MAX_TOKEN_SIZE];
-    token_t token;
     GenExpr * gen_expr;
     float val;
     Param * param = NULL;
     Func * func;
     GenExpr ** expr_list;
 
-    switch (token = parseToken(fs,string)) {
+    switch (token) {
         /* Left Parentice Case */
     case tLPr:
         //std::cerr << "token before tLPr:" << string << std::endl;
+        /* CASE 0 (Left Parentice): an item of megabuf or gmegabuf, read or assigned */
+        if (!strcmp(string, "megabuf") || !strcmp(string, "gmegabuf")) {
+            Megabuf * buffer = *string == 'g' ? &Megabuf::global() : &preset->megabuf();
+
+            if ((expr_list = parse_prefix_args(fs, 1, preset)) == NULL) {
+                if (tree_expr)
+                    delete tree_expr;
+                return NULL;
+            }
+
+            BufferExpr * item = new BufferExpr(buffer, expr_list[0]);
+            ExprArena::destroy(expr_list);
+
+            token = parseToken(fs, string);
+            if (token == tEq && tree_expr == NULL) {
+                if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+                    delete item;
+                    return NULL;
+                }
+                return new GenExpr(ASSIGN_T, new AssignExpr(item, gen_expr));
+            }
+
+            return parse_infix_op(fs, token, insert_gen_expr(new GenExpr(BUFFER_T, item), &tree_expr), preset);
+        }
+
         /* CASE 1 (Left Parentice): See if the previous string before this parentice is a function name */
         if ((func = BuiltinFuncs::find_func(string)) != NULL) {
             if (PARSE_DEBUG) {
@@ -697,14 +768,15 @@ GenExpr * Parser::parse_gen_expr ( std::istream &  fs, TreeExpr * tree_expr, Mil
             }
 
             /* Convert function to expression */
-            if ((gen_expr = GenExpr::prefun_to_expr((float (*)(void *))func->func_ptr, expr_list, func->getNumArgs())) == NULL) {
+            if ((gen_expr = GenExpr::prefun_to_expr((float (*)(void *))func->func_ptr, expr_list, func->getNumArgs(),
+                                                    func->getEvaluation())) == NULL) {
                 if (PARSE_DEBUG) printf("parse_prefix_args: failed to convert prefix function to general expression (LINE %d) \n",
                                             line_count);
                 if (tree_expr)
                     delete tree_expr;
                 for (i = 0; i < func->getNumArgs(); i++)
                     delete expr_list[i];
-                free(expr_list);
+                ExprArena::destroy(expr_list);
                 expr_list = NULL;
                 return NULL;
             }
@@ -733,7 +805,7 @@ GenExpr * Parser::parse_gen_expr ( std::istream &  fs, TreeExpr * tree_expr, Mil
         /* CASE 3 (Left Parentice): the following is enclosed parentices to change order
            of operations. So we create a new expression tree */
 
-        if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+        if ((gen_expr = parse_sequence(fs, preset)) == NULL) {
             if (PARSE_DEBUG) printf("parse_gen_expr:  found left parentice, but failed to create new expression tree \n");
             if (tree_expr)
                 delete tree_expr;
@@ -804,67 +876,22 @@ GenExpr * Parser::parse_gen_expr ( std::istream &  fs, TreeExpr * tree_expr, Mil
         }
 
 
-        /* CASE 4: custom shape variable */
-        if (current_shape != NULL) {
-            if ((param = ParamUtils::find<ParamUtils::NO_CREATE>(std::string(string), &current_shape->param_tree)) == NULL) {
-                if ((param = preset->builtinParams.find_builtin_param(std::string(string))) == NULL)
-                    if ((param = ParamUtils::find<ParamUtils::AUTO_CREATE>(std::string(string), &current_shape->param_tree)) == NULL) {
-                        if (tree_expr)
-                            delete tree_expr;
-                        return NULL;
-                    }
-            }
-
-            if (PARSE_DEBUG) {
-                std::cerr << "parse_gen_expr: custom shape parameter (name = "
-                          << param->name << ")" << std::endl;
-            }
-
-
-            /* Convert parameter to an expression */
-            if ((gen_expr = GenExpr::param_to_expr(param)) == NULL) {
-                delete tree_expr;
+        /* CASE 2: assignment, its value the one assigned */
+        if (token == tEq && tree_expr == NULL) {
+            if ((param = find_param(string, preset)) == NULL || (param->flags & P_FLAG_READONLY)) {
+                if (PARSE_DEBUG) printf("parse_gen_expr: can't assign \"%s\" (LINE %d)\n", string, line_count);
                 return NULL;
             }
 
-            //if (PARSE_DEBUG) printf("converted to expression (LINE %d)\n", line_count);
-
-            /* Parse the rest of the line */
-            return parse_infix_op(fs, token, insert_gen_expr(gen_expr, &tree_expr), preset);
-        }
-
-        /* CASE 5: custom wave variable */
-        if (current_wave != NULL) {
-            if ((param = ParamUtils::find<ParamUtils::NO_CREATE>(std::string(string), &current_wave->param_tree)) == NULL) {
-                if ((param = preset->builtinParams.find_builtin_param(std::string(string))) == NULL)
-                    if ((param = ParamUtils::find<ParamUtils::AUTO_CREATE>(std::string(string), &current_wave->param_tree)) == NULL) {
-                        if (tree_expr)
-                            delete tree_expr;
-                        return NULL;
-                    }
-            }
-            assert(param);
-
-            if (PARSE_DEBUG) {
-                std::cerr << "parse_gen_expr: custom wave parameter (name = " <<  param->name << ")" << std::endl;
-
-            }
-
-            /* Convert parameter to an expression */
-            if ((gen_expr = GenExpr::param_to_expr(param)) == NULL) {
-                delete tree_expr;
+            if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL)
                 return NULL;
-            }
-
-            //if (PARSE_DEBUG) printf("converted to expression (LINE %d)\n", line_count);
-
-            /* Parse the rest of the line */
-            return parse_infix_op(fs, token, insert_gen_expr(gen_expr, &tree_expr), preset);
 
+            return new GenExpr(ASSIGN_T, new AssignExpr(param, gen_expr));
         }
 
-        /* CASE 6: regular parameter. Will be created if necessary and the string has no invalid characters */
-        if ((param = ParamUtils::find(string, &preset->builtinParams, &preset->user_param_tree)) != NULL) {
+        /* CASE 3: a param of the custom shape or wave parsed, or a regular parameter.
+           Will be created if necessary and the string has no invalid characters */
+        if ((param = find_param(string, preset)) != NULL) {
 
             if (PARSE_DEBUG) {
                 std::cerr << "parse_gen_expr: parameter (name = \"" << param->name << "\")..." << std::endl;
@@ -876,14 +903,12 @@ GenExpr * Parser::parse_gen_expr ( std::istream &  fs, TreeExpr * tree_expr, Mil
                 return NULL;
             }
 
-            //if (PARSE_DEBUG) printf("converted to expression (LINE %d)\n", line_count);
-
             /* Parse the rest of the line */
             return parse_infix_op(fs, token, insert_gen_expr(gen_expr, &tree_expr), preset);
 
         }
 
-        /* CASE 7: Bad string, give up */
+        /* CASE 4: Bad string, give up */
         if (PARSE_DEBUG) {
             printf( "parse_gen_expr: syntax error [string = \"%s\"] (LINE %d)\n", string, line_count);
 
@@ -896,6 +921,84 @@ GenExpr * Parser::parse_gen_expr ( std::istream &  fs, TreeExpr * tree_expr, Mil
 
 
 
+/* Parses "exp; exp; ..." up to a comma or right parenthesis into one
+   expression evaluating them in order, its value that of the last. Empty
+   ones are left out */
+GenExpr * Parser::parse_sequence(std::istream & fs, MilkdropPreset * preset)
+{
+    /* A semicolon within parentheses doesn't end the equation */
+    const bool wrapAround = tokenWrapAroundEnabled;
+    GenExpr * sequence = NULL;
+
+    while (true) {
+        GenExpr * gen_expr = parse_gen_expr(fs, NULL, preset);
+        if (gen_expr == NULL) {
+            delete sequence;
+            return NULL;
+        }
+
+        if (sequence == NULL || (sequence->type == TREE_T && sequence->item == NULL)) {
+            delete sequence;
+            sequence = gen_expr;
+        } else if (gen_expr->type == TREE_T && gen_expr->item == NULL) {
+            delete gen_expr;
+        } else {
+            Func * exec2 = BuiltinFuncs::find_func("exec2");
+            GenExpr ** expr_list = (GenExpr**)ExprArena::create(sizeof(GenExpr*) * 2);
+            expr_list[0] = sequence;
+            expr_list[1] = gen_expr;
+            sequence = GenExpr::prefun_to_expr((float (*)(void *))exec2->func_ptr, expr_list, 2);
+        }
+
+        if (last_terminal != tSemiColon)
+            return sequence;
+
+        tokenWrapAroundEnabled = wrapAround;
+    }
+}
+
+/* Parses the rest of a statement starting with a call to the function
+   string names, then names the param the statement assigns in string */
+GenExpr * Parser::parse_statement(std::istream & fs, char * string, MilkdropPreset * preset)
+{
+    GenExpr * gen_expr = parse_gen_expr(fs, tLPr, string, NULL, preset);
+
+    strncpy(string, STATEMENT_PARAM, MAX_TOKEN_SIZE);
+    return gen_expr;
+}
+
+/* The param a name refers to where the parser is: one of the custom shape
+   or wave parsed, then a builtin, then one of the preset. Created if necessary.
+   None for a name with characters no param has, as "i<5": the parser has no
+   token for comparisons, which would otherwise make a param of them */
+Param * Parser::find_param(char * string, MilkdropPreset * preset)
+{
+    Param * param;
+
+    for (const char * c = string; *c; c++)
+        if (!isalnum((unsigned char) *c) && *c != '_') {
+            std::cerr << "find_param: \"" << string << "\" isn't a param, comparisons aren't supported (LINE "
+                      << line_count << ")" << std::endl;
+            return NULL;
+        }
+
+    if (current_shape != NULL) {
+        if ((param = ParamUtils::find<ParamUtils::NO_CREATE>(std::string(string), &current_shape->param_tree)) == NULL)
+            if ((param = preset->builtinParams.find_builtin_param(std::string(string))) == NULL)
+                param = ParamUtils::find<ParamUtils::AUTO_CREATE>(std::string(string), &current_shape->param_tree);
+        return param;
+    }
+
+    if (current_wave != NULL) {
+        if ((param = ParamUtils::find<ParamUtils::NO_CREATE>(std::string(string), &current_wave->param_tree)) == NULL)
+            if ((param = preset->builtinParams.find_builtin_param(std::string(string))) == NULL)
+                param = ParamUtils::find<ParamUtils::AUTO_CREATE>(std::string(string), &current_wave->param_tree);
+        return param;
+    }
+
+    return ParamUtils::find(string, &preset->builtinParams, &preset->user_param_tree);
+}
+
 /* Inserts expressions into tree according to operator precedence.
    If root is null, a new tree is created, with infix_op as only element */
 
@@ -1114,6 +1217,7 @@ GenExpr * Parser::parse_infix_op(std::istream &  fs, token_t token, TreeExpr * t
     case tRPr:
     case tComma:
         if (PARSE_DEBUG) printf("parse_infix_op: terminal found (LINE %d)\n", line_count);
+        last_terminal = token;
         gen_expr = new GenExpr(TREE_T, (void*)tree_expr);
         assert(gen_expr);
         return gen_expr;
@@ -1256,9 +1360,13 @@ PerFrameEqn * Parser::parse_per_frame_eqn(std::istream &  fs, int index, Milkdro
     Param * param;
     PerFrameEqn * per_frame_eqn;
     GenExpr * gen_expr;
+    token_t token;
 
 
-    if (parseToken(fs, string) != tEq) {
+    if ((token = parseToken(fs, string)) == tLPr)
+        return parse_implicit_per_frame_eqn(fs, string, index, preset, token);
+
+    if (token != tEq) {
         if (PARSE_DEBUG) printf("parse_per_frame_eqn: no equal sign after string \"%s\" (LINE %d)\n", string, line_count);
         return NULL;
     }
@@ -1289,18 +1397,22 @@ PerFrameEqn * Parser::parse_per_frame_eqn(std::istream &  fs, int index, Milkdro
         return NULL;
     }
 
+    per_frame_eqn->line = eqn_line;
+
     if (PARSE_DEBUG) printf("parse_per_frame_eqn: per_frame eqn parsed succesfully\n");
 
     return per_frame_eqn;
 }
 
-/* Parses an 'implicit' per frame equation. That is, interprets a stream of data as a per frame equation without a prefix */
-PerFrameEqn * Parser::parse_implicit_per_frame_eqn(std::istream &  fs, char * param_string, int index, MilkdropPreset * preset)
+/* Parses an 'implicit' per frame equation. That is, interprets a stream of data as a per frame equation without a prefix.
+   A statement starting with a call when token is tLPr */
+PerFrameEqn * Parser::parse_implicit_per_frame_eqn(std::istream &  fs, char * param_string, int index, MilkdropPreset * preset,
+                                                   token_t token)
 {
 
     Param * param;
     PerFrameEqn * per_frame_eqn;
-    GenExpr * gen_expr;
+    GenExpr * gen_expr = NULL;
 
     if (fs == NULL)
         return NULL;
@@ -1309,9 +1421,13 @@ PerFrameEqn * Parser::parse_implicit_per_frame_eqn(std::istream &  fs, char * pa
     if (preset == NULL)
         return NULL;
 
+    if (token == tLPr && (gen_expr = parse_statement(fs, param_string, preset)) == NULL)
+        return NULL;
+
     //rintf("param string: %s\n", param_string);
     /* Find the parameter associated with the string, create one if necessary */
     if ((param = ParamUtils::find(param_string, &preset->builtinParams, &preset->user_param_tree)) == NULL) {
+        delete gen_expr;
         return NULL;
     }
 
@@ -1324,7 +1440,7 @@ PerFrameEqn * Parser::parse_implicit_per_frame_eqn(std::istream &  fs, char * pa
     }
 
     /* Parse right side of equation as an expression */
-    if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+    if (gen_expr == NULL && (gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
         if (PARSE_DEBUG) printf("parse_implicit_per_frame_eqn: equation evaluated to null (LINE %d)\n", line_count);
         return NULL;
     }
@@ -1338,6 +1454,8 @@ PerFrameEqn * Parser::parse_implicit_per_frame_eqn(std::istream &  fs, char * pa
         return NULL;
     }
 
+    per_frame_eqn->line = eqn_line;
+
     if (PARSE_DEBUG) printf("parse_implicit_per_frame_eqn: per_frame eqn parsed succesfully\n");
 
     return per_frame_eqn;
@@ -1410,6 +1528,8 @@ InitCond * Parser::parse_init_cond(std::istream &  fs, char * name, MilkdropPres
         return NULL;
     }
 
+    init_cond->line = eqn_line;
+
     /* Finished */
     return init_cond;
 }
@@ -1430,14 +1550,14 @@ void Parser::parse_string_block(std::istream &  fs, std::string * out_string)
 
 }
 
-InitCond * Parser::parse_per_frame_init_eqn(std::istream &  fs, MilkdropPreset * preset, std::map<std::string,Param*> * database)
+InitCond * Parser::parse_per_frame_init_eqn(std::istream &  fs, MilkdropPreset * preset, ParamTable * database)
 {
 
     char name[MAX_TOKEN_SIZE];
     Param * param = NULL;
     CValue init_val;
     InitCond * init_cond;
-    GenExpr * gen_expr;
+    GenExpr * gen_expr = NULL;
     float val;
     token_t token;
 
@@ -1447,17 +1567,23 @@ InitCond * Parser::parse_per_frame_init_eqn(std::istream &  fs, MilkdropPreset *
     if (fs == NULL)
         return NULL;
 
-    if ((token = parseToken(fs, name)) != tEq)
+    if ((token = parseToken(fs, name)) == tLPr) {
+        /* Run for what it does, the init of its param is of no use */
+        if ((gen_expr = parse_statement(fs, name, preset)) == NULL)
+            return NULL;
+    } else if (token != tEq)
         return NULL;
 
 
     /* If a database was specified,then use ParamUtils::find_db instead */
     if ((database != NULL) && ((param = ParamUtils::find<ParamUtils::AUTO_CREATE>(name, database)) == NULL)) {
+        delete gen_expr;
         return NULL;
     }
 
     /* Otherwise use the builtin parameter and user databases. This is confusing. Sorry. */
     if ((param == NULL) && ((param = ParamUtils::find(name, &preset->builtinParams, &preset->user_param_tree)) == NULL)) {
+        delete gen_expr;
         return NULL;
     }
 
@@ -1473,7 +1599,7 @@ InitCond * Parser::parse_per_frame_init_eqn(std::istream &  fs, MilkdropPreset *
 
     if (PARSE_DEBUG) printf("parse_per_frame_init_eqn: parsing right hand side of per frame init equation.. (LINE %d)\n", line_count);
 
-    if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+    if (gen_expr == NULL && (gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
         if (PARSE_DEBUG) printf("parse_per_frame_init_eqn: failed to parse general expresion!\n");
         return NULL;
     }
@@ -1511,6 +1637,8 @@ InitCond * Parser::parse_per_frame_init_eqn(std::istream &  fs, MilkdropPreset *
         return NULL;
     }
 
+    init_cond->line = eqn_line;
+
     init_cond->evaluate(true);
 
     /* Finished */
@@ -1708,6 +1836,8 @@ int Parser::parse_wavecode(char * token, std::istream &  fs, MilkdropPreset * pr
         return PROJECTM_FAILURE;
     }
 
+    init_cond->line = eqn_line;
+
     std::pair<std::map<std::string, InitCond*>::iterator, bool> inserteePair =
         custom_wave->init_cond_tree.insert(std::make_pair(init_cond->param->name, init_cond));
 
@@ -1818,6 +1948,8 @@ int Parser::parse_shapecode(char * token, std::istream &  fs, MilkdropPreset * p
         return PROJECTM_FAILURE;
     }
 
+    init_cond->line = eqn_line;
+
     custom_shape->init_cond_tree.insert(std::make_pair(param->name,init_cond));
     line_mode = CUSTOM_SHAPE_SHAPECODE_LINE_MODE;
 
@@ -2024,11 +2156,12 @@ int Parser::parse_wave(char * token, std::istream &  fs, MilkdropPreset * preset
 
 }
 
-int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int id, char * eqn_type, char * init_string)
+int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int id, char * eqn_type, char * init_string,
+                              token_t token)
 {
 
     Param * param;
-    GenExpr * gen_expr;
+    GenExpr * gen_expr = NULL;
     char string[MAX_TOKEN_SIZE];
     PerFrameEqn * per_frame_eqn;
     CustomWave * custom_wave;
@@ -2052,10 +2185,10 @@ int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int
         }
 
         /* Insert the equation in the per frame equation tree */
-        custom_wave->per_frame_init_eqn_tree.insert(std::make_pair(init_cond->param->name,init_cond));
-
         line_mode = CUSTOM_WAVE_PER_FRAME_INIT_LINE_MODE;
         init_cond->evaluate(true);
+        if (!custom_wave->per_frame_init_eqn_tree.insert(std::make_pair(init_cond->param->name,init_cond)).second)
+            delete init_cond;
         return PROJECTM_SUCCESS;
 
     }
@@ -2065,7 +2198,13 @@ int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int
 
         if (PARSE_DEBUG) printf("parse_wave_helper (per_frame): [start] (custom wave id = %d)\n", custom_wave->id);
 
-        if (parseToken(fs, string) != tEq) {
+        if ((token = parseToken(fs, string)) == tLPr) {
+            current_wave = custom_wave;
+            gen_expr = parse_statement(fs, string, preset);
+            current_wave = NULL;
+            if (gen_expr == NULL)
+                return PROJECTM_PARSE_ERROR;
+        } else if (token != tEq) {
             if (PARSE_DEBUG) printf("parse_wave (per_frame): no equal sign after string \"%s\" (LINE %d)\n", string, line_count);
             return PROJECTM_PARSE_ERROR;
         }
@@ -2073,6 +2212,7 @@ int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int
         /* Find the parameter associated with the string in the custom wave database */
         if ((param =  ParamUtils::find<ParamUtils::AUTO_CREATE>(string, &custom_wave->param_tree)) == NULL) {
             if (PARSE_DEBUG) printf("parse_wave (per_frame): parameter \"%s\" not found or cannot be wipemalloc'ed!!\n", string);
+            delete gen_expr;
             return PROJECTM_FAILURE;
         }
 
@@ -2086,7 +2226,7 @@ int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int
         /* Parse right side of equation as an expression */
 
         current_wave = custom_wave;
-        if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+        if (gen_expr == NULL && (gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
             if (PARSE_DEBUG) printf("parse_wave (per_frame): equation evaluated to null (LINE %d)\n", line_count);
             current_wave = NULL;
             return PROJECTM_PARSE_ERROR;
@@ -2104,6 +2244,8 @@ int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int
             return PROJECTM_FAILURE;
         }
 
+        per_frame_eqn->line = eqn_line;
+
         custom_wave->per_frame_eqn_tree.push_back(per_frame_eqn);
         if (PARSE_DEBUG) printf("parse_wave (per_frame): equation %d associated with custom wave %d [success]\n",
                                     per_frame_eqn->index, custom_wave->id);
@@ -2126,18 +2268,24 @@ int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int
         /// Parser needs reworked. Don't have time for it. So this is the result.
         if (init_string)
             strncpy(string, init_string, strlen(init_string)+1);
-        else {
-            if (parseToken(fs, string) != tEq) {
-                /* parse per pixel operator  name */
-                if (PARSE_DEBUG) printf("parse_wave_helper (per_point): equal operator missing after per pixel operator. Last token = \"%s\"  (LINE %d)\n", string, line_count);
+        else
+            token = parseToken(fs, string);
 
-                return PROJECTM_PARSE_ERROR;
-            }
+        if (token != tEq && token != tLPr) {
+            /* parse per pixel operator  name */
+            if (PARSE_DEBUG) printf("parse_wave_helper (per_point): equal operator missing after per pixel operator. Last token = \"%s\"  (LINE %d)\n", string, line_count);
+
+            return PROJECTM_PARSE_ERROR;
         }
 
         /* Parse right side of equation as an expression, First tell parser we are parsing a custom wave */
         current_wave = custom_wave;
-        if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+        if (token == tLPr)
+            gen_expr = parse_statement(fs, string, preset);
+        else
+            gen_expr = parse_gen_expr(fs, NULL, preset);
+
+        if (gen_expr == NULL) {
             if (PARSE_DEBUG) printf("parse_wave_helper (per_point): equation evaluated to null? (LINE %d)\n", line_count);
 
             return PROJECTM_PARSE_ERROR;
@@ -2145,7 +2293,7 @@ int Parser::parse_wave_helper(std::istream &  fs, MilkdropPreset  * preset, int
 
 
         /* Add the per point equation */
-        if (custom_wave->add_per_point_eqn(string, gen_expr) < 0) {
+        if (custom_wave->add_per_point_eqn(string, gen_expr, eqn_line) < 0) {
             delete gen_expr;
 
             return PROJECTM_PARSE_ERROR;
@@ -2266,8 +2414,12 @@ int Parser::parse_shape_per_frame_init_eqn(std::istream &  fs, CustomShape * cus
 
     /// \idea possibly a good place to update a string buffer;
 
+    /* Insert the equation in the per frame init equation tree, so every copy
+       of the shape starts over from it */
     line_mode = CUSTOM_SHAPE_PER_FRAME_INIT_LINE_MODE;
     init_cond->evaluate(true);
+    if (!custom_shape->per_frame_init_eqn_tree.insert(std::make_pair(init_cond->param->name,init_cond)).second)
+        delete init_cond;
     return PROJECTM_SUCCESS;
 }
 
@@ -2275,14 +2427,21 @@ int Parser::parse_shape_per_frame_eqn(std::istream & fs, CustomShape * custom_sh
 {
 
     Param * param;
-    GenExpr * gen_expr;
+    GenExpr * gen_expr = NULL;
     PerFrameEqn * per_frame_eqn;
+    token_t token;
 
     char string[MAX_TOKEN_SIZE];
 
     if (PARSE_DEBUG) printf("parse_shape (per_frame): [start] (custom shape id = %d)\n", custom_shape->id);
 
-    if (parseToken(fs, string) != tEq) {
+    if ((token = parseToken(fs, string)) == tLPr) {
+        current_shape = custom_shape;
+        gen_expr = parse_statement(fs, string, preset);
+        current_shape = NULL;
+        if (gen_expr == NULL)
+            return PROJECTM_PARSE_ERROR;
+    } else if (token != tEq) {
         if (PARSE_DEBUG) printf("parse_shape (per_frame): no equal sign after string \"%s\" (LINE %d)\n", string, line_count);
         return PROJECTM_PARSE_ERROR;
     }
@@ -2290,6 +2449,7 @@ int Parser::parse_shape_per_frame_eqn(std::istream & fs, CustomShape * custom_sh
     /* Find the parameter associated with the string in the custom shape database */
     if ((param = ParamUtils::find<ParamUtils::AUTO_CREATE>(string, &custom_shape->param_tree)) == NULL) {
         if (PARSE_DEBUG) printf("parse_shape (per_frame): parameter \"%s\" not found or cannot be wipemalloc'ed!!\n", string);
+        delete gen_expr;
         return PROJECTM_FAILURE;
     }
 
@@ -2303,7 +2463,7 @@ int Parser::parse_shape_per_frame_eqn(std::istream & fs, CustomShape * custom_sh
     /* Parse right side of equation as an expression */
 
     current_shape = custom_shape;
-    if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+    if (gen_expr == NULL && (gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
         if (PARSE_DEBUG) printf("parse_shape (per_frame): equation evaluated to null (LINE %d)\n", line_count);
         current_shape = NULL;
         return PROJECTM_PARSE_ERROR;
@@ -2320,6 +2480,8 @@ int Parser::parse_shape_per_frame_eqn(std::istream & fs, CustomShape * custom_sh
         return PROJECTM_FAILURE;
     }
 
+    per_frame_eqn->line = eqn_line;
+
     custom_shape->per_frame_eqn_tree.push_back(per_frame_eqn);
 
     /// \idea add string buffer update for easy >> and <<
@@ -2332,14 +2494,21 @@ int Parser::parse_wave_per_frame_eqn(std::istream &  fs, CustomWave * custom_wav
 {
 
     Param * param;
-    GenExpr * gen_expr;
+    GenExpr * gen_expr = NULL;
     PerFrameEqn * per_frame_eqn;
+    token_t token;
 
     char string[MAX_TOKEN_SIZE];
 
     if (PARSE_DEBUG) printf("parse_wave (per_frame): [start] (custom shape id = %d)\n", custom_wave->id);
 
-    if (parseToken(fs, string) != tEq) {
+    if ((token = parseToken(fs, string)) == tLPr) {
+        current_wave = custom_wave;
+        gen_expr = parse_statement(fs, string, preset);
+        current_wave = NULL;
+        if (gen_expr == NULL)
+            return PROJECTM_PARSE_ERROR;
+    } else if (token != tEq) {
         if (PARSE_DEBUG) printf("parse_wave (per_frame): no equal sign after string \"%s\" (LINE %d)\n", string, line_count);
         return PROJECTM_PARSE_ERROR;
     }
@@ -2347,6 +2516,7 @@ int Parser::parse_wave_per_frame_eqn(std::istream &  fs, CustomWave * custom_wav
     /* Find the parameter associated with the string in the custom shape database */
     if ((param = ParamUtils::find<ParamUtils::AUTO_CREATE>(string, &custom_wave->param_tree)) == NULL) {
         if (PARSE_DEBUG) printf("parse_wave (per_frame): parameter \"%s\" not found or cannot be wipemalloc'ed!!\n", string);
+        delete gen_expr;
         return PROJECTM_FAILURE;
     }
 
@@ -2360,7 +2530,7 @@ int Parser::parse_wave_per_frame_eqn(std::istream &  fs, CustomWave * custom_wav
     /* Parse right side of equation as an expression */
 
     current_wave = custom_wave;
-    if ((gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
+    if (gen_expr == NULL && (gen_expr = parse_gen_expr(fs, NULL, preset)) == NULL) {
         if (PARSE_DEBUG) printf("parse_wave (per_frame): equation evaluated to null (LINE %d)\n", line_count);
         current_wave = NULL;
         return PROJECTM_PARSE_ERROR;
@@ -2377,6 +2547,8 @@ int Parser::parse_wave_per_frame_eqn(std::istream &  fs, CustomWave * custom_wav
         return PROJECTM_FAILURE;
     }
 
+    per_frame_eqn->line = eqn_line;
+
     custom_wave->per_frame_eqn_tree.push_back(per_frame_eqn);
     if (PARSE_DEBUG) printf("parse_wave (per_frame): equation %d associated with custom wave %d [success]\n",
                                 per_frame_eqn->index, custom_wave->id);
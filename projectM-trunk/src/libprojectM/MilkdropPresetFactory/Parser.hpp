@@ -79,6 +79,11 @@
 #define WAVE_INIT_STRING "init"
 #define WAVE_INIT_STRING_LENGTH 4
 
+/* Param assigned the value of a statement starting with a call, like
+   "megabuf(i)=v;" or "loop(n, ...);", which assigns nothing itself. No
+   equation can name it */
+#define STATEMENT_PARAM "(statement)"
+
 #include <set>
 
 typedef enum {
@@ -126,66 +131,80 @@ class GenExpr;
 class InfixOp;
 class PerFrameEqn;
 class MilkdropPreset;
+class Param;
+class ParamTable;
 class TreeExpr;
 
+/// Parses one preset. All parse state lives in the instance, so presets can be
+/// loaded on several threads at once with a Parser each
 class Parser {
 public:
-    static std::string lastLinePrefix;
-    static line_mode_t line_mode;
-    static CustomWave *current_wave;
-    static CustomShape *current_shape;
-    static int string_line_buffer_index;
-    static char string_line_buffer[STRING_LINE_SIZE];
-    static unsigned int line_count;
-    static int per_frame_eqn_count;
-    static int per_frame_init_eqn_count;
-    static int last_custom_wave_id;
-    static int last_custom_shape_id;
-    static char last_eqn_type[MAX_TOKEN_SIZE];
-    static int last_token_size;
-    static bool tokenWrapAroundEnabled;
-
-    static PerFrameEqn *parse_per_frame_eqn( std::istream & fs, int index,
-                                             MilkdropPreset * preset);
-    static int parse_per_pixel_eqn( std::istream & fs, MilkdropPreset * preset,
-                                    char * init_string);
-    static InitCond *parse_init_cond( std::istream & fs, char * name, MilkdropPreset * preset );
-    static int parse_preset_name( std::istream & fs, char * name );
-    static int parse_top_comment( std::istream & fs );
-    static int parse_line( std::istream & fs, MilkdropPreset * preset );
-
-    static int get_string_prefix_len(char * string);
-    static TreeExpr * insert_gen_expr(GenExpr * gen_expr, TreeExpr ** root);
-    static TreeExpr * insert_infix_op(InfixOp * infix_op, TreeExpr ** root);
-    static token_t parseToken(std::istream & fs, char * string);
-    static GenExpr ** parse_prefix_args(std::istream & fs, int num_args, MilkdropPreset * preset);
-    static GenExpr * parse_infix_op(std::istream & fs, token_t token, TreeExpr * tree_expr, MilkdropPreset * preset);
-    static GenExpr * parse_sign_arg(std::istream & fs);
-    static int parse_float(std::istream & fs, float * float_ptr);
-    static int parse_int(std::istream & fs, int * int_ptr);
-    static int insert_gen_rec(GenExpr * gen_expr, TreeExpr * root);
-    static int insert_infix_rec(InfixOp * infix_op, TreeExpr * root);
-    static GenExpr * parse_gen_expr(std::istream & fs, TreeExpr * tree_expr, MilkdropPreset * preset);
-    static PerFrameEqn * parse_implicit_per_frame_eqn(std::istream & fs, char * param_string, int index, MilkdropPreset * preset);
-    static InitCond * parse_per_frame_init_eqn(std::istream & fs, MilkdropPreset * preset, std::map<std::string,Param*> * database);
-    static int parse_wavecode_prefix(char * token, int * id, char ** var_string);
-    static int parse_wavecode(char * token, std::istream & fs, MilkdropPreset * preset);
-    static int parse_wave_prefix(char * token, int * id, char ** eqn_string);
-    static int parse_wave_helper(std::istream & fs, MilkdropPreset * preset, int id, char * eqn_type, char * init_string);
-    static int parse_shapecode(char * eqn_string, std::istream & fs, MilkdropPreset * preset);
-    static int parse_shapecode_prefix(char * token, int * id, char ** var_string);
-    static void parse_string_block(std::istream &  fs, std::string * out_string);
-    static bool scanForComment(std::istream & fs);
-    static int parse_wave(char * eqn_string, std::istream & fs, MilkdropPreset * preset);
-    static int parse_shape(char * eqn_string, std::istream & fs, MilkdropPreset * preset);
-    static int parse_shape_prefix(char * token, int * id, char ** eqn_string);
-    static void readStringUntil(std::istream & fs, std::string * out_buffer, bool wrapAround = true, const std::set<char> & skipList = std::set<char>()) ;
-
-    static int string_to_float(char * string, float * float_ptr);
-    static int parse_shape_per_frame_init_eqn(std::istream & fs, CustomShape * custom_shape, MilkdropPreset * preset);
-    static int parse_shape_per_frame_eqn(std::istream & fs, CustomShape * custom_shape, MilkdropPreset * preset);
-    static int parse_wave_per_frame_eqn(std::istream & fs, CustomWave * custom_wave, MilkdropPreset * preset);
-    static bool wrapsToNextLine(const std::string & str);
+    Parser();
+
+    std::string lastLinePrefix;
+    line_mode_t line_mode;
+    CustomWave *current_wave;
+    CustomShape *current_shape;
+    int string_line_buffer_index;
+    char string_line_buffer[STRING_LINE_SIZE];
+    unsigned int line_count;
+    unsigned int eqn_line; /* line the statement being parsed starts on */
+    int per_frame_eqn_count;
+    int per_frame_init_eqn_count;
+    int last_custom_wave_id;
+    int last_custom_shape_id;
+    char last_eqn_type[MAX_TOKEN_SIZE];
+    int last_token_size;
+    bool tokenWrapAroundEnabled;
+    token_t last_terminal; /* the token ending the expression parsed last */
+
+    PerFrameEqn *parse_per_frame_eqn( std::istream & fs, int index,
+                                      MilkdropPreset * preset);
+    int parse_per_pixel_eqn( std::istream & fs, MilkdropPreset * preset,
+                             char * init_string, token_t token = tEq);
+    InitCond *parse_init_cond( std::istream & fs, char * name, MilkdropPreset * preset );
+    int parse_preset_name( std::istream & fs, char * name );
+    int parse_top_comment( std::istream & fs );
+    int parse_line( std::istream & fs, MilkdropPreset * preset );
+
+    int get_string_prefix_len(char * string);
+    TreeExpr * insert_gen_expr(GenExpr * gen_expr, TreeExpr ** root);
+    TreeExpr * insert_infix_op(InfixOp * infix_op, TreeExpr ** root);
+    token_t parseToken(std::istream & fs, char * string);
+    GenExpr ** parse_prefix_args(std::istream & fs, int num_args, MilkdropPreset * preset);
+    GenExpr * parse_infix_op(std::istream & fs, token_t token, TreeExpr * tree_expr, MilkdropPreset * preset);
+    GenExpr * parse_sign_arg(std::istream & fs);
+    int parse_float(std::istream & fs, float * float_ptr);
+    int parse_int(std::istream & fs, int * int_ptr);
+    int insert_gen_rec(GenExpr * gen_expr, TreeExpr * root);
+    int insert_infix_rec(InfixOp * infix_op, TreeExpr * root);
+    GenExpr * parse_gen_expr(std::istream & fs, TreeExpr * tree_expr, MilkdropPreset * preset);
+    GenExpr * parse_gen_expr(std::istream & fs, token_t token, char * string, TreeExpr * tree_expr, MilkdropPreset * preset);
+    GenExpr * parse_sequence(std::istream & fs, MilkdropPreset * preset);
+    GenExpr * parse_statement(std::istream & fs, char * string, MilkdropPreset * preset);
+    Param * find_param(char * string, MilkdropPreset * preset);
+    PerFrameEqn * parse_implicit_per_frame_eqn(std::istream & fs, char * param_string, int index, MilkdropPreset * preset,
+                                               token_t token = tEq);
+    InitCond * parse_per_frame_init_eqn(std::istream & fs, MilkdropPreset * preset, ParamTable * database);
+    int parse_wavecode_prefix(char * token, int * id, char ** var_string);
+    int parse_wavecode(char * token, std::istream & fs, MilkdropPreset * preset);
+    int parse_wave_prefix(char * token, int * id, char ** eqn_string);
+    int parse_wave_helper(std::istream & fs, MilkdropPreset * preset, int id, char * eqn_type, char * init_string,
+                          token_t token = tEq);
+    int parse_shapecode(char * eqn_string, std::istream & fs, MilkdropPreset * preset);
+    int parse_shapecode_prefix(char * token, int * id, char ** var_string);
+    void parse_string_block(std::istream &  fs, std::string * out_string);
+    bool scanForComment(std::istream & fs);
+    int parse_wave(char * eqn_string, std::istream & fs, MilkdropPreset * preset);
+    int parse_shape(char * eqn_string, std::istream & fs, MilkdropPreset * preset);
+    int parse_shape_prefix(char * token, int * id, char ** eqn_string);
+    void readStringUntil(std::istream & fs, std::string * out_buffer, bool wrapAround = true, const std::set<char> & skipList = std::set<char>()) ;
+
+    int string_to_float(char * string, float * float_ptr);
+    int parse_shape_per_frame_init_eqn(std::istream & fs, CustomShape * custom_shape, MilkdropPreset * preset);
+    int parse_shape_per_frame_eqn(std::istream & fs, CustomShape * custom_shape, MilkdropPreset * preset);
+    int parse_wave_per_frame_eqn(std::istream & fs, CustomWave * custom_wave, MilkdropPreset * preset);
+    bool wrapsToNextLine(const std::string & str);
   };
 
 #endif /** !_PARSER_H */
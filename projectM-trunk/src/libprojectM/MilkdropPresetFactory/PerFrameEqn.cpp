@@ -38,6 +38,8 @@
 /* Evaluate an equation */
 void PerFrameEqn::evaluate()
 {
+    PROFILE_EVAL(profile);
+
 
     if (PER_FRAME_EQN_DEBUG) {
         printf("per_frame_%d=%s= ", index, param->name.c_str());
@@ -66,4 +68,4 @@ PerFrameEqn::~PerFrameEqn()
 
 /* Create a new per frame equation */
 PerFrameEqn::PerFrameEqn(int _index, Param * _param, GenExpr * _gen_expr) :
-    index(_index), param(_param), gen_expr(_gen_expr) {}
+    index(_index), param(_param), gen_expr(_gen_expr), line(0) {}
@@ -31,15 +31,22 @@
 
 #define PER_FRAME_EQN_DEBUG 0
 
+#include "EvalProfiler.hpp"
+#include "ExprArena.hpp"
+
 class GenExpr;
 class Param;
 class PerFrameEqn;
 
-class PerFrameEqn {
+class PerFrameEqn : public ArenaObject {
 public:
     int index; /* a unique id for each per frame eqn (generated by order in preset files) */
     Param *param; /* parameter to be assigned a value */
     GenExpr *gen_expr;   /* expression that paremeter is equal to */
+    unsigned int line; /* line of the preset file the equation starts on, 0 if unknown */
+#ifdef USE_PROFILER
+    EvalCounter profile;
+#endif
      
     PerFrameEqn(int index, Param * param, GenExpr * gen_expr);
     ~PerFrameEqn();
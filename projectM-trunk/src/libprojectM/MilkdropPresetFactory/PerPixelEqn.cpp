@@ -36,8 +36,10 @@
 #include "wipemalloc.h"
 #include <cassert>
 /* Evaluates a per pixel equation */
-void PerPixelEqn::evaluate(int mesh_i, int mesh_j)
+void PerPixelEqn::evaluate(int mesh_i, int mesh_j, int tile)
 {
+    PROFILE_EVAL(tileProfiles[tile]);
+
 
     GenExpr * eqn_ptr = 0;
 
@@ -53,19 +55,13 @@ void PerPixelEqn::evaluate(int mesh_i, int mesh_j)
     } else {
 
         assert(!(eqn_ptr == NULL || param_matrix == NULL));
+        assert(param->matrix_flag);
 
         param_matrix[mesh_i][mesh_j] = eqn_ptr->eval_gen_expr(mesh_i, mesh_j);
-
-        /* Now that this parameter has been referenced with a per
-           pixel equation, we let the evaluator know by setting
-           this flag */
-        /// @bug review and verify this behavior
-        param->matrix_flag = true;
-        param->flags |= P_FLAG_PER_PIXEL;
     }
 }
 
-PerPixelEqn::PerPixelEqn(int _index, Param * _param, GenExpr * _gen_expr):index(_index), param(_param), gen_expr(_gen_expr)
+PerPixelEqn::PerPixelEqn(int _index, Param * _param, GenExpr * _gen_expr):index(_index), param(_param), gen_expr(_gen_expr), line(0)
 {
 
     assert(index >= 0);
@@ -43,20 +43,33 @@
 #define WARP_OP 9
 #define NUM_OPS 10 /* obviously, this number is dependent on the number of existing per pixel operations */
 
+#include "EvalProfiler.hpp"
+#include "ExprArena.hpp"
+#include <vector>
+
 class GenExpr;
 class Param;
 class PerPixelEqn;
 class Preset;
 
-class PerPixelEqn {
+class PerPixelEqn : public ArenaObject {
 public:
     int index; /* used for splay tree ordering. */
     int flags; /* primarily to specify if this variable is user-defined */
     Param *param;
     GenExpr *gen_expr;
+    unsigned int line; /* line of the preset file the equation starts on, 0 if unknown */
+#ifdef USE_PROFILER
+    EvalCounter profile;
+    /// Counted by each tile of the mesh on its own, added to profile once
+    /// the tiles are done
+    std::vector<EvalCounter> tileProfiles;
+#endif
 
     void evalPerPixelEqns( Preset *preset );
-    void evaluate(int mesh_i, int mesh_j);
+    /// The param must be flagged per pixel already when it has a mesh, see
+    /// MilkdropPreset::initialize_PerPixelMeshes
+    void evaluate(int mesh_i, int mesh_j, int tile);
 
     PerPixelEqn(int index, Param * param, GenExpr * gen_expr);
 
@@ -40,6 +40,8 @@
 /* Evaluates a per point equation for the current custom wave given by interface_wave ptr */
 void PerPointEqn::evaluate(int i)
 {
+    PROFILE_EVAL(profile);
+
 
     float * param_matrix;
     GenExpr * eqn_ptr;
@@ -74,12 +76,39 @@ void PerPointEqn::evaluate(int i)
 
 }
 
+void PerPointEqn::evaluate(int begin, int end, bool threaded)
+{
+    PROFILE_EVAL(profile);
+#ifdef USE_PROFILER
+    /* The pass is timed once and counted once per point */
+    if (end > begin)
+        profile.evaluations += end - begin - 1;
+#endif
+
+    assert(param->matrix != NULL);
+
+    float * param_matrix = (float*)param->matrix;
+    GenExpr * eqn_ptr = gen_expr;
+    param->matrix_flag = true;
+
+    /* Only equations without assignments and megabuf are batched, see
+       CustomWave::planPerPoint, so the threads write their own points and
+       nothing else. The profile and the flag are updated here, before them */
+    threaded = threaded && end - begin >= PER_POINT_THREAD_SAMPLES;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) if (threaded)
+#endif
+    for (int i = begin; i < end; i++)
+        param_matrix[i] = eqn_ptr->eval_gen_expr(i, -1);
+}
+
 PerPointEqn::PerPointEqn(int _index, Param * _param, GenExpr * _gen_expr, int _samples):
     index(_index),
     samples(_samples),
     param(_param),
-    gen_expr(_gen_expr)
-
+    gen_expr(_gen_expr),
+    line(0)
 {}
 
 
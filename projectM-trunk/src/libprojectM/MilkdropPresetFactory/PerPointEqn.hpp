@@ -29,19 +29,32 @@
 #ifndef _PER_POINT_EQN_H
 #define _PER_POINT_EQN_H
 
+#include "EvalProfiler.hpp"
+#include "ExprArena.hpp"
+
+/* Fewest points of a pass worth splitting across threads */
+#define PER_POINT_THREAD_SAMPLES 256
+
 class CustomWave;
 class GenExpr;
 class Param;
 class PerPointEqn;
 
-class PerPointEqn {
+class PerPointEqn : public ArenaObject {
 public:
     int index;
     int samples; // the number of samples to iterate over
     Param *param;
     GenExpr * gen_expr;
+    unsigned int line; /* line of the preset file the equation starts on, 0 if unknown */
+#ifdef USE_PROFILER
+    EvalCounter profile;
+#endif
     ~PerPointEqn();
     void evaluate(int i);
+    /// Evaluates points [begin, end) in one pass, on several threads if
+    /// threaded. The param must have a matrix
+    void evaluate(int begin, int end, bool threaded);
     PerPointEqn( int index, Param *param, GenExpr *gen_expr, int samples);
  };
 
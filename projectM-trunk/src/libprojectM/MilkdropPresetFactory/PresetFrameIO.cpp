@@ -4,8 +4,10 @@
 #include <cassert>
 #include <iostream>
 #include "Renderer/BeatDetect.hpp"
+#include "FrameStats.hpp"
 
-PresetInputs::PresetInputs() : PipelineContext()
+PresetInputs::PresetInputs() : PipelineContext(),
+    bass(0), mid(0), treb(0), bass_att(0), mid_att(0), treb_att(0)
 {
 }
 
@@ -26,6 +28,9 @@ void PresetInputs::update(const BeatDetect & music, const PipelineContext & cont
 
     this->frame = context.frame;
     this->progress = context.progress;
+
+    this->onset = context.onset;
+    this->bassOnset = context.bassOnset;
 }
 
 void PresetInputs::Initialize ( int gx, int gy )
@@ -136,8 +141,16 @@ PresetOutputs::~PresetOutputs()
 
 void PresetOutputs::Render(const BeatDetect &music, const PipelineContext &context)
 {
-    PerPixelMath(context);
+    {
+        StageTimer timer(context.frameStats, FrameStats::STAGE_PER_PIXEL_MATH);
+        PerPixelMath(context);
+    }
+
+    updateDrawables();
+}
 
+void PresetOutputs::updateDrawables()
+{
     drawables.clear();
 
     drawables.push_back(&mv);
@@ -173,13 +186,16 @@ void PresetOutputs::Render(const BeatDetect &music, const PipelineContext &conte
 }
 
 
-void PresetOutputs::PerPixelMath(const PipelineContext &context)
+void PresetOutputs::PerPixelMath(const PipelineContext &context, int begin, int end)
 {
 
     int x, y;
     float fZoom2, fZoom2Inv;
 
-    for (x = 0; x < gx; x++) {
+    if (end < 0)
+        end = gx;
+
+    for (x = begin; x < end; x++) {
         for (y = 0; y < gy; y++) {
             fZoom2 = powf(this->zoom_mesh[x][y], powf(this->zoomexp_mesh[x][y],
                           rad_mesh[x][y] * 2.0f - 1.0f));
@@ -189,14 +205,14 @@ void PresetOutputs::PerPixelMath(const PipelineContext &context)
         }
     }
 
-    for (x = 0; x < gx; x++) {
+    for (x = begin; x < end; x++) {
         for (y = 0; y < gy; y++) {
             this->x_mesh[x][y] = (this->x_mesh[x][y] - this->cx_mesh[x][y])
                                  / this->sx_mesh[x][y] + this->cx_mesh[x][y];
         }
     }
 
-    for (x = 0; x < gx; x++) {
+    for (x = begin; x < end; x++) {
         for (y = 0; y < gy; y++) {
             this->y_mesh[x][y] = (this->y_mesh[x][y] - this->cy_mesh[x][y])
                                  / this->sy_mesh[x][y] + this->cy_mesh[x][y];
@@ -211,7 +227,7 @@ void PresetOutputs::PerPixelMath(const PipelineContext &context)
     f[2] = 10.54f + 3.0f * cosf(fWarpTime * 1.233f + 3);
     f[3] = 11.49f + 4.0f * cosf(fWarpTime * 0.933f + 5);
 
-    for (x = 0; x < gx; x++) {
+    for (x = begin; x < end; x++) {
         for (y = 0; y < gy; y++) {
             this->x_mesh[x][y] += this->warp_mesh[x][y] * 0.0035f * sinf(fWarpTime * 0.333f
                                   + fWarpScaleInv * (this->orig_x[x][y] * f[0] - this->orig_y[x][y] * f[3]));
@@ -223,7 +239,7 @@ void PresetOutputs::PerPixelMath(const PipelineContext &context)
                                   + fWarpScaleInv * (this->orig_x[x][y] * f[0] + this->orig_y[x][y] * f[3]));
         }
     }
-    for (x = 0; x < gx; x++) {
+    for (x = begin; x < end; x++) {
         for (y = 0; y < gy; y++) {
             float u2 = this->x_mesh[x][y] - this->cx_mesh[x][y];
             float v2 = this->y_mesh[x][y] - this->cy_mesh[x][y];
@@ -237,11 +253,11 @@ void PresetOutputs::PerPixelMath(const PipelineContext &context)
         }
     }
 
-    for (x = 0; x < gx; x++)
+    for (x = begin; x < end; x++)
         for (y = 0; y < gy; y++)
             this->x_mesh[x][y] -= this->dx_mesh[x][y];
 
-    for (x = 0; x < gx; x++)
+    for (x = begin; x < end; x++)
         for (y = 0; y < gy; y++)
             this->y_mesh[x][y] -= this->dy_mesh[x][y];
 
@@ -77,7 +77,10 @@ public:
     PresetOutputs();
     ~PresetOutputs();
     virtual void Render(const BeatDetect &music, const PipelineContext &context);
-    void PerPixelMath( const PipelineContext &context);
+    /// Warps mesh columns begin to end, all of them by default
+    void PerPixelMath( const PipelineContext &context, int begin = 0, int end = -1);
+    /// Collects the items to draw this frame
+    void updateDrawables();
     /* PER FRAME VARIABLES BEGIN */
 
     float zoom;
@@ -0,0 +1,179 @@
+/*
+ * OnsetDetector.cpp
+ *
+ *  Spectral flux onset detection on the audio thread.
+ */
+
+#include "OnsetDetector.hpp"
+#include "wipemalloc.h"
+#include "fftsg.h"
+
+#include <cmath>
+
+#ifdef WIN32
+#include <windows.h>
+#define ONSET_BARRIER() MemoryBarrier()
+#else
+#define ONSET_BARRIER() __sync_synchronize()
+#endif
+
+/// Upper end of the bass band in Hz
+#define BASS_LIMIT 200.0
+/// Threshold over the recent average flux
+#define THRESHOLD_RATIO 2.0f
+/// Threshold of the bass band. Its flux sums a few bins only, that of
+/// noise alone peaks at over 5 times its average
+#define BASS_THRESHOLD_RATIO 8.0f
+/// Flux below this never is an onset, keeps noise in quiet passages out
+#define THRESHOLD_FLOOR 0.5f
+/// Compression of the magnitudes before taking the flux
+#define LOG_GAIN 100.0f
+
+bool OnsetQueue::push(const OnsetEvent & event)
+{
+    const unsigned int tail = _tail;
+    if (tail - _head == SIZE) {
+        _dropped++;
+        return false;
+    }
+
+    _events[tail % SIZE] = event;
+
+    /* The event is complete before the consumer can see it */
+    ONSET_BARRIER();
+    _tail = tail + 1;
+    return true;
+}
+
+bool OnsetQueue::pop(OnsetEvent & event)
+{
+    const unsigned int head = _head;
+    if (head == _tail)
+        return false;
+
+    ONSET_BARRIER();
+    event = _events[head % SIZE];
+
+    /* Read before the producer may write the slot again */
+    ONSET_BARRIER();
+    _head = head + 1;
+    return true;
+}
+
+OnsetDetector::Band::Band(float ratio) : _ratio(ratio), _sum(0), _position(0), _previous(0), _beforePrevious(0), _gap(0)
+{
+    for (int i = 0; i < HISTORY; i++)
+        _history[i] = 0;
+}
+
+float OnsetDetector::Band::add(float flux)
+{
+    const float average = _sum / HISTORY;
+    const float peak = _previous;
+
+    float strength = 0;
+    if (_gap > 0)
+        _gap--;
+    else if (peak > _beforePrevious && peak >= flux &&
+             peak > _ratio * average && peak > THRESHOLD_FLOOR) {
+        /* Scaled so the threshold is THRESHOLD_RATIO in every band */
+        strength = (average > 0 ? peak / average : peak / THRESHOLD_FLOOR) * THRESHOLD_RATIO / _ratio;
+        _gap = MIN_GAP;
+    }
+
+    _sum += flux - _history[_position];
+    _history[_position] = flux;
+    _position = (_position + 1) % HISTORY;
+
+    _beforePrevious = _previous;
+    _previous = flux;
+
+    return strength;
+}
+
+OnsetDetector::OnsetDetector(int sampleRate) : _fill(0), _full(THRESHOLD_RATIO), _bass(BASS_THRESHOLD_RATIO), _hops(0)
+{
+    for (int i = 0; i < WINDOW; i++) {
+        _window[i] = 0;
+        _hann[i] = 0.5f - 0.5f * cos(2 * M_PI * i / WINDOW);
+    }
+    for (int i = 0; i < WINDOW / 2; i++)
+        _magnitudes[i] = 0;
+
+    _spectrum = (double *) wipemalloc(WINDOW * sizeof(double));
+    _w = (double *) wipemalloc(WINDOW / 2 * sizeof(double));
+    _ip = (int *) wipemalloc(WINDOW / 2 * sizeof(int));
+    _ip[0] = 0;
+
+    setSampleRate(sampleRate);
+}
+
+OnsetDetector::~OnsetDetector()
+{
+    free(_spectrum);
+    free(_w);
+    free(_ip);
+}
+
+void OnsetDetector::setSampleRate(int sampleRate)
+{
+    _sampleRate = sampleRate > 0 ? sampleRate : 44100;
+
+    _bassBins = (int) (BASS_LIMIT * WINDOW / _sampleRate + 0.5);
+    if (_bassBins < 1)
+        _bassBins = 1;
+}
+
+void OnsetDetector::analyze()
+{
+    for (int i = 0; i < WINDOW - HOP; i++)
+        _window[i] = _window[i + HOP];
+    for (int i = 0; i < HOP; i++)
+        _window[WINDOW - HOP + i] = _input[i];
+    _fill = 0;
+
+    for (int i = 0; i < WINDOW; i++)
+        _spectrum[i] = _window[i] * _hann[i];
+    rdft(WINDOW, 1, _spectrum, _ip, _w);
+
+    /* Bin 0 is DC, which says nothing about onsets */
+    float full = 0;
+    float bass = 0;
+    for (int bin = 1; bin < WINDOW / 2; bin++) {
+        const double re = _spectrum[2 * bin];
+        const double im = _spectrum[2 * bin + 1];
+        const float magnitude = log(1 + LOG_GAIN * sqrt(re * re + im * im) / WINDOW);
+
+        const float rise = magnitude - _magnitudes[bin];
+        if (rise > 0) {
+            full += rise;
+            if (bin <= _bassBins)
+                bass += rise;
+        }
+        _magnitudes[bin] = magnitude;
+    }
+
+    /* Scaled so both bands show similar numbers for a similar jump */
+    bass *= (WINDOW / 2 - 1) / (float) _bassBins / 8;
+
+    /* A peak found now was in the hop before this one, its centre half a
+     * window back from there */
+    const double time = (_hops * (double) HOP - WINDOW / 2) / _sampleRate;
+
+    OnsetEvent event;
+    event.time = time > 0 ? time : 0;
+
+    event.strength = _full.add(full / 8);
+    if (event.strength > 0) {
+        event.band = OnsetEvent::BAND_FULL;
+        _queue.push(event);
+    }
+
+    event.strength = _bass.add(bass);
+    if (event.strength > 0) {
+        event.band = OnsetEvent::BAND_BASS;
+        _queue.push(event);
+    }
+
+    _hops = _hops + 1;
+}
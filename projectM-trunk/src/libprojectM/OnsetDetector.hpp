@@ -0,0 +1,141 @@
+/*
+ * OnsetDetector.hpp
+ *
+ *  Onset detection running on the audio thread as samples arrive. Every hop
+ *  of HOP samples the spectrum of the last WINDOW samples is compared with
+ *  the one before; the rise in log magnitude (spectral flux) peaking above
+ *  its recent average is an onset. The hop is fixed in samples, so detection
+ *  doesn't depend on the frame rate. Onsets are timestamped in seconds of
+ *  audio and passed to the rendering thread through a lock-free queue.
+ */
+
+#ifndef ONSETDETECTOR_HPP_
+#define ONSETDETECTOR_HPP_
+
+#include "dlldefs.h"
+
+class OnsetEvent
+{
+public:
+    enum Band {
+        /// All frequencies, any instrument starting a note
+        BAND_FULL,
+        /// Up to about 200 Hz, kicks and bass
+        BAND_BASS
+    };
+
+    Band band;
+    /// Seconds of audio since the detector started
+    double time;
+    /// Flux of the onset over the recent average, 2 and up. Scaled so the
+    /// threshold of its band is 2, as bands differ in how noisy they are
+    float strength;
+};
+
+/// Queue of one producer thread and one consumer thread, neither ever waits
+class DLLEXPORT OnsetQueue
+{
+public:
+    static const unsigned int SIZE = 256;
+
+    OnsetQueue() : _head(0), _tail(0), _dropped(0) {}
+
+    /// Producer only. False if the queue is full, the event is dropped
+    bool push(const OnsetEvent & event);
+    /// Consumer only. False if the queue is empty
+    bool pop(OnsetEvent & event);
+
+    /// Events dropped because nobody took them
+    unsigned int dropped() const { return _dropped; }
+
+private:
+    OnsetEvent _events[SIZE];
+    /// Next event to pop, written by the consumer only
+    volatile unsigned int _head;
+    /// Next slot to push into, written by the producer only
+    volatile unsigned int _tail;
+    unsigned int _dropped;
+};
+
+class DLLEXPORT OnsetDetector
+{
+public:
+    static const int HOP = 512;
+    static const int WINDOW = 1024;
+
+    explicit OnsetDetector(int sampleRate = 44100);
+    ~OnsetDetector();
+
+    /// Sample rate of the PCM data, for the timestamps and the bass band.
+    /// Set it before samples arrive
+    void setSampleRate(int sampleRate);
+    int sampleRate() const { return _sampleRate; }
+
+    /// Audio thread: one mono sample
+    inline void addSample(float sample)
+    {
+        _input[_fill++] = sample;
+        if (_fill == HOP)
+            analyze();
+    }
+
+    /// Rendering thread: the oldest onset not taken yet
+    inline bool takeEvent(OnsetEvent & event) { return _queue.pop(event); }
+
+    /// Seconds of audio analyzed so far, read from any thread. Takes the
+    /// latency of an event: time() - event.time
+    double time() const { return _hops * (double) HOP / _sampleRate; }
+
+    const OnsetQueue & queue() const { return _queue; }
+
+private:
+    /// Averages of this many hops make the threshold, about 0.4 s
+    static const int HISTORY = 32;
+    /// Hops at least between two onsets of a band, about 50 ms
+    static const int MIN_GAP = 4;
+
+    /// Peak picking of one band
+    class Band
+    {
+    public:
+        /// Onsets peak over ratio times the recent average flux
+        explicit Band(float ratio);
+
+        /// Takes the flux of a hop and returns the strength of an onset
+        /// peaking in the hop before, or 0
+        float add(float flux);
+
+    private:
+        float _ratio;
+        float _history[HISTORY];
+        float _sum;
+        int _position;
+        float _previous;
+        float _beforePrevious;
+        int _gap;
+    };
+
+    void analyze();
+
+    int _sampleRate;
+    int _bassBins;
+
+    float _input[HOP];
+    int _fill;
+    /// The last WINDOW samples, oldest first
+    float _window[WINDOW];
+    float _hann[WINDOW];
+    float _magnitudes[WINDOW / 2];
+
+    /* Work areas of rdft() */
+    double * _spectrum;
+    int * _ip;
+    double * _w;
+
+    Band _full;
+    Band _bass;
+    OnsetQueue _queue;
+    volatile unsigned int _hops;
+};
+
+#endif /* ONSETDETECTOR_HPP_ */
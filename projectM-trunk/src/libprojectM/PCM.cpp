@@ -32,6 +32,7 @@
 #include "wipemalloc.h"
 #include "fftsg.h"
 #include "PCM.hpp"
+#include "OnsetDetector.hpp"
 #include <cassert>
 
 int PCM::maxsamples = 2048;
@@ -41,7 +42,7 @@ int PCM::maxsamples = 2048;
 //Initializes the PCM buffer to
 // number of samples specified.
 #include <iostream>
-PCM::PCM()
+PCM::PCM() : onsetDetector(0)
 {
     initPCM( 2048 );
 
@@ -108,6 +109,15 @@ PCM::~PCM()
 
 #include <iostream>
 
+/// Feeds the sample just written at j of the ring, mixed down to mono. Each
+/// sample goes in as it is written, so blocks longer than the ring reach the
+/// detector whole
+inline void PCM::detectOnset(int j)
+{
+    if (onsetDetector)
+        onsetDetector->addSample((PCMd[0][j] + PCMd[1][j]) * 0.5f);
+}
+
 void PCM::addPCMfloat(const float *PCMdata, int samples)
 {
     int i,j;
@@ -124,6 +134,7 @@ void PCM::addPCMfloat(const float *PCMdata, int samples)
             PCMd[0][j % maxsamples] = 0;
             PCMd[1][j % maxsamples] = 0;
         }
+        detectOnset(j % maxsamples);
     }
 
     start+=samples;
@@ -137,6 +148,27 @@ void PCM::addPCMfloat(const float *PCMdata, int samples)
     getPCM(vdataR,512,1,1,0,0);
 }
 
+void PCM::addPCMfloat_2ch(const float *PCMdata, int samples)
+{
+    int i, j;
+
+    for (i = 0; i < samples; ++i) {
+        j=i+start;
+        PCMd[0][j % maxsamples]=PCMdata[i * 2 + 0];
+        PCMd[1][j % maxsamples]=PCMdata[i * 2 + 1];
+        detectOnset(j % maxsamples);
+    }
+
+    start = (start + samples) % maxsamples;
+
+    newsamples+=samples;
+    if (newsamples>maxsamples) newsamples=maxsamples;
+    numsamples = getPCMnew(pcmdataR,1,0,waveSmoothing,0,0);
+    getPCMnew(pcmdataL,0,0,waveSmoothing,0,1);
+    getPCM(vdataL,512,0,1,0,0);
+    getPCM(vdataR,512,1,1,0,0);
+}
+
 void PCM::addPCM16Data(const short* pcm_data, short samples)
 {
     int i, j;
@@ -145,6 +177,7 @@ void PCM::addPCM16Data(const short* pcm_data, short samples)
         j=i+start;
         PCMd[0][j % maxsamples]=(pcm_data[i * 2 + 0]/16384.0);
         PCMd[1][j % maxsamples]=(pcm_data[i * 2 + 1]/16384.0);
+        detectOnset(j % maxsamples);
     }
 
     start = (start + samples) % maxsamples;
@@ -172,6 +205,7 @@ void PCM::addPCM16(short PCMdata[2][512])
             PCMd[0][j % maxsamples] = (float)0;
             PCMd[1][j % maxsamples] = (float)0;
         }
+        detectOnset(j % maxsamples);
     }
 
     // printf("Added %d samples %d %d %f\n",samples,start,(start+samples)%maxsamples,PCM[0][start+10]);
@@ -204,6 +238,7 @@ void PCM::addPCM8( unsigned char PCMdata[2][1024])
             PCMd[0][j % maxsamples] = 0;
             PCMd[1][j % maxsamples] = 0;
         }
+        detectOnset(j % maxsamples);
     }
 
 
@@ -235,6 +270,7 @@ void PCM::addPCM8_512( const unsigned char PCMdata[2][512])
             PCMd[0][j % maxsamples] = 0;
             PCMd[1][j % maxsamples] = 0;
         }
+        detectOnset(j % maxsamples);
     }
 
 
@@ -251,7 +287,6 @@ void PCM::addPCM8_512( const unsigned char PCMdata[2][512])
     getPCM(vdataR,512,1,1,0,0);
 }
 
-
 //puts sound data requested at provided pointer
 //
 //samples is number of PCM samples to return
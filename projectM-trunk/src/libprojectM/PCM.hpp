@@ -31,6 +31,8 @@
 
 #include "dlldefs.h"
 
+class OnsetDetector;
+
 class 
 #ifdef WIN32 
 DLLEXPORT 
@@ -55,11 +57,16 @@ public:
     float vdataL[512];  //holders for FFT data (spectrum)
     float vdataR[512];
 
+    /** Takes every sample added, not owned */
+    OnsetDetector *onsetDetector;
+
     static int maxsamples;
     PCM();
     ~PCM();
     void initPCM(int maxsamples);
     void addPCMfloat(const float *PCMdata, int samples);
+    /// Interleaved left/right pairs, samples counts pairs
+    void addPCMfloat_2ch(const float *PCMdata, int samples);
     void addPCM16(short [2][512]);
     void addPCM16Data(const short* pcm_data, short samples);
     void addPCM8( unsigned char [2][1024]);
@@ -68,6 +75,9 @@ public:
     void freePCM();
     int getPCMnew(float *PCMdata, int channel, int freq, float smoothing, int derive,int reset);
 
+private:
+    void detectOnset(int j);
+
 
   };
 
@@ -10,7 +10,7 @@
 Preset::~Preset() {}
 
 Preset::Preset(const std::string & presetName, const std::string & presetAuthor):
-    _name(presetName), _author(presetAuthor) {}
+    _name(presetName), _author(presetAuthor), _music(0), _context(0) {}
 
 void Preset::setName(const std::string & value)
 {
@@ -33,3 +33,20 @@ const std::string & Preset::author() const
 }
 
 
+
+void Preset::addFrameTasks(TaskGraph & graph, Task & start, Task & done,
+                           const BeatDetect & music, const PipelineContext & context)
+{
+    _music = &music;
+    _context = &context;
+    _renderTask.bind(this, &Preset::renderTask);
+
+    graph.add(_renderTask);
+    start.precede(_renderTask);
+    _renderTask.precede(done);
+}
+
+void Preset::renderTask(int)
+{
+    Render(*_music, *_context);
+}
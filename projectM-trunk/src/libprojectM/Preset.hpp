@@ -9,10 +9,14 @@
 #define PRESET_HPP_
 
 #include <string>
+#include <vector>
 
 #include "Renderer/BeatDetect.hpp"
 #include "Renderer/Pipeline.hpp"
 #include "Renderer/PipelineContext.hpp"
+#include "PresetProfile.hpp"
+#include "StageBudget.hpp"
+#include "TaskScheduler.hpp"
 
 class Preset {
 public:
@@ -30,9 +34,31 @@ public:
 	virtual Pipeline & pipeline() = 0;
 	virtual void Render(const BeatDetect &music, const PipelineContext &context) = 0;
 
+	/// Adds the tasks evaluating one frame to graph, running after start and
+	/// finishing before done. music and context have to stay valid until the
+	/// graph has run. The default is a single task calling Render
+	virtual void addFrameTasks(TaskGraph & graph, Task & start, Task & done,
+	                           const BeatDetect & music, const PipelineContext & context);
+
+	/// Appends the evaluation counts and cost of every equation. Presets without
+	/// equations, or libprojectM built without USE_PROFILER, add nothing
+	virtual void profile(PresetProfile &) const {}
+	virtual void resetProfile() {}
+
+	/// Appends the stages of the last frame over the budget of the context
+	virtual void budgetViolations(std::vector<BudgetViolation> &) const {}
+	/// Some stage stayed over budget for BUDGET_STRIKES frames while the
+	/// budget asks for StageBudget::SWITCH_PRESET
+	virtual bool tooExpensive() const { return false; }
+
 private:
 	std::string _name;
 	std::string _author;
+
+	void renderTask(int);
+	MemberTask<Preset> _renderTask;
+	const BeatDetect * _music;
+	const PipelineContext * _context;
 };
 
 #endif /* PRESET_HPP_ */
@@ -66,6 +66,13 @@ public:
 	_softCutRatingsEnabled = enabled;
     }
 
+    /// Treat presets whose 95th percentile frame cost is over budget
+    /// milliseconds as policy says. Presets never measured are within budget
+    inline void setCostPolicy(PresetCostPolicy policy, float budget) {
+	_costPolicy = policy;
+	_costBudget = budget;
+    }
+
     /// Choose a preset via the passed in index. Must be between 0 and num valid presets in directory
     /// \param index An index lying in the interval [0, this->getNumPresets())
     /// \param presetInputs the preset inputs to associate with the preset upon construction
@@ -105,10 +112,19 @@ private:
     std::vector<float> sampleWeights;
     const PresetLoader * _presetLoader;
     bool _softCutRatingsEnabled;
+    PresetCostPolicy _costPolicy;
+    float _costBudget;
+
+    /// What the rating of the preset at index is multiplied by for its cost
+    float costWeight(std::size_t index) const;
+
+    /// One step of next and previous, without regard to costs
+    inline void stepNext(PresetIterator & presetPos);
+    inline void stepPrevious(PresetIterator & presetPos);
 };
 
 
-inline PresetChooser::PresetChooser(const PresetLoader & presetLoader, bool softCutRatingsEnabled):_presetLoader(&presetLoader), _softCutRatingsEnabled(softCutRatingsEnabled) {
+inline PresetChooser::PresetChooser(const PresetLoader & presetLoader, bool softCutRatingsEnabled):_presetLoader(&presetLoader), _softCutRatingsEnabled(softCutRatingsEnabled), _costPolicy(PRESET_COST_IGNORED), _costBudget(0) {
 
 }
 
@@ -149,7 +165,43 @@ inline std::auto_ptr<Preset> PresetIterator::allocate() {
     return _presetChooser->directoryIndex(_currentIndex);
 }
 
+inline float PresetChooser::costWeight(std::size_t index) const {
+	if (_costPolicy == PRESET_COST_IGNORED || _costBudget <= 0)
+		return 1;
+
+	const PresetCost cost = _presetLoader->getPresetCost(index);
+	if (cost.frames == 0 || cost.p95 <= _costBudget)
+		return 1;
+
+	return _costPolicy == PRESET_COST_WEIGHTED ? _costBudget / cost.p95 : 0;
+}
+
+/// Filtered presets are passed over, unless there are only such presets
 inline void PresetChooser::nextPreset(PresetIterator & presetPos) {
+		const PresetIterator start = presetPos;
+		for (std::size_t i = 0; i < size(); i++) {
+			stepNext(presetPos);
+			if (costWeight(*presetPos) > 0)
+				return;
+		}
+
+		presetPos = start;
+		stepNext(presetPos);
+}
+
+inline void PresetChooser::previousPreset(PresetIterator & presetPos) {
+		const PresetIterator start = presetPos;
+		for (std::size_t i = 0; i < size(); i++) {
+			stepPrevious(presetPos);
+			if (costWeight(*presetPos) > 0)
+				return;
+		}
+
+		presetPos = start;
+		stepPrevious(presetPos);
+}
+
+inline void PresetChooser::stepNext(PresetIterator & presetPos) {
 
 		if (this->empty()) {
 			return;
@@ -169,7 +221,7 @@ inline void PresetChooser::nextPreset(PresetIterator & presetPos) {
 }
 
 
-inline void PresetChooser::previousPreset(PresetIterator & presetPos) {
+inline void PresetChooser::stepPrevious(PresetIterator & presetPos) {
 		if (this->empty())
 			return;
 
@@ -231,6 +283,21 @@ inline PresetChooser::iterator PresetChooser::weightedRandom(bool hardCut) const
 	
 	const std::vector<int> & weights = _presetLoader->getPresetRatings()[ratingsTypeIndex];
 
+	if (_costPolicy != PRESET_COST_IGNORED && _costBudget > 0) {
+		std::vector<float> costWeights(weights.size());
+		float sum = 0;
+		for (std::size_t i = 0; i < weights.size(); i++)
+			sum += costWeights[i] = weights[i] * costWeight(i);
+
+		/* With every preset filtered the ratings alone decide */
+		if (sum > 0) {
+			for (std::size_t i = 0; i < costWeights.size(); i++)
+				costWeights[i] /= sum;
+			return begin(RandomNumberGenerators::weightedRandomNormalized(costWeights));
+		}
+	}
+
+
 	const std::size_t index = RandomNumberGenerators::weightedRandom
 		(weights,
 		 _presetLoader->getPresetRatingsSums()[ratingsTypeIndex]);
@@ -0,0 +1,58 @@
+/*
+ * PresetCost.cpp
+ *
+ *  Measured frame cost of a preset.
+ */
+
+#include "PresetCost.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+PresetCost::PresetCost() : average(0), p95(0), frames(0)
+{
+}
+
+void PresetCost::add(std::vector<float> times)
+{
+    if (times.empty())
+        return;
+
+    float sum = 0;
+    for (unsigned int i = 0; i < times.size(); i++)
+        sum += times[i];
+
+    std::vector<float>::iterator percentile = times.begin() + (times.size() - 1) * 95 / 100;
+    std::nth_element(times.begin(), percentile, times.end());
+
+    /* The percentile of the union isn't known, the weighted mean of the two
+       is close enough to sort presets by */
+    const float earlier = std::min(frames, (unsigned int) PRESET_COST_HISTORY);
+    const float added = times.size();
+    average = (average * earlier + sum) / (earlier + added);
+    p95 = (p95 * earlier + *percentile * added) / (earlier + added);
+    frames += times.size();
+}
+
+std::string PresetCost::write(const std::string & url) const
+{
+    std::ostringstream out;
+    out << average << " " << p95 << " " << frames << " " << url;
+    return out.str();
+}
+
+bool PresetCost::read(const std::string & line, std::string & url)
+{
+    std::istringstream in(line);
+    PresetCost cost;
+    if (!(in >> cost.average >> cost.p95 >> cost.frames))
+        return false;
+
+    /* getline() leaves url as it was at the end of the line */
+    in >> std::ws;
+    if (!std::getline(in, url) || url.empty())
+        return false;
+
+    *this = cost;
+    return true;
+}
@@ -0,0 +1,56 @@
+/*
+ * PresetCost.hpp
+ *
+ *  What a preset costs to render on this machine, measured while it plays
+ *  alone: the average and 95th percentile time of its frames, merged over
+ *  every time it played, in this run and earlier ones.
+ */
+
+#ifndef PRESETCOST_HPP_
+#define PRESETCOST_HPP_
+
+#include <string>
+#include <vector>
+
+/* Kept next to config.inp, the preset directory may be shared and read only */
+#define PRESET_COST_FILE "preset-costs"
+/* Earlier frames weigh as much as this many at most, so the costs follow
+   a faster machine or build instead of averaging over all of them */
+#define PRESET_COST_HISTORY 3600
+/* Frames of a preset left out after it began to play, loading it and its
+   first frames cost more than the ones after */
+#define PRESET_COST_SETTLE_FRAMES 10
+/* Fewer frames than this measured in one time a preset played are dropped,
+   more than PRESET_COST_MAX_FRAMES aren't kept */
+#define PRESET_COST_MIN_FRAMES 20
+#define PRESET_COST_MAX_FRAMES 3600
+
+/// How presets costing more than the budget are chosen, by shuffle as well
+/// as by next and previous
+enum PresetCostPolicy {
+    PRESET_COST_IGNORED,   /* like any other preset */
+    PRESET_COST_WEIGHTED,  /* with their rating weighted down by budget / p95 */
+    PRESET_COST_FILTERED   /* not at all, unless every preset costs more */
+};
+
+class PresetCost
+{
+public:
+    PresetCost();
+
+    /// Milliseconds per frame, the slower of CPU and GPU
+    float average;
+    float p95;
+    /// Frames measured, 0 for a preset never measured
+    unsigned int frames;
+
+    /// Merges the frame times of one time the preset played
+    void add(std::vector<float> times);
+
+    /// A line of PRESET_COST_FILE, url last as it may hold spaces
+    std::string write(const std::string & url) const;
+    /// False for a line that isn't one
+    bool read(const std::string & line, std::string & url);
+};
+
+#endif /* PRESETCOST_HPP_ */
@@ -12,7 +12,9 @@
 #include "PresetLoader.hpp"
 #include "Preset.hpp"
 #include "PresetFactory.hpp"
+#include <cstdio>
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <set>
 
@@ -35,34 +37,78 @@ extern "C"
 
 #include "Common.hpp"
 
-PresetLoader::PresetLoader (int gx, int gy, std::string dirname = std::string()) :_dirname ( dirname ), _dir ( 0 )
+PresetLoader::PresetLoader (int gx, int gy, std::string dirname, const std::string & costsFile) :_dirname ( dirname ), _dir ( 0 ), _costsChanged ( false ), _costsFile ( costsFile )
 {
     _presetFactoryManager.initialize(gx,gy);
-    // Do one scan
-    if ( _dirname != std::string() )
-        rescan();
-    else
-        clear();
+
+    clearEntries();
+
+#ifdef USE_THREADS
+    _scanPending = false;
+    pthread_mutex_init(&_scanMutex, NULL);
+#endif
+
+    // Do one scan. Large preset directories take a while to read, so with threads
+    // the scan runs in the background until someone looks at the collection
+    if ( _dirname != std::string() ) {
+#ifdef USE_THREADS
+        if (pthread_create(&_scanThread, NULL, scanThread, this) == 0)
+            _scanPending = true;
+        else
+#endif
+            scan();
+    }
 }
 
 PresetLoader::~PresetLoader()
 {
+    waitForScan();
+#ifdef USE_THREADS
+    pthread_mutex_destroy(&_scanMutex);
+#endif
+
     if ( _dir )
         closedir ( _dir );
 }
 
 void PresetLoader::setScanDirectory ( std::string dirname )
 {
+    waitForScan();
     _dirname = dirname;
 }
 
+#ifdef USE_THREADS
+void * PresetLoader::scanThread ( void * loader )
+{
+    static_cast<PresetLoader *> ( loader )->scan();
+    return NULL;
+}
+
+void PresetLoader::waitForScan() const
+{
+    /* Only one thread may join, and the others only read the entries once
+       it has */
+    pthread_mutex_lock(&_scanMutex);
+    if ( _scanPending ) {
+        pthread_join ( _scanThread, NULL );
+        _scanPending = false;
+    }
+    pthread_mutex_unlock(&_scanMutex);
+}
+#endif
 
 void PresetLoader::rescan()
+{
+    waitForScan();
+    scan();
+}
+
+void PresetLoader::scan()
 {
     // std::cerr << "Rescanning..." << std::endl;
 
     // Clear the directory entry collection
-    clear();
+    clearEntries();
 
     // If directory already opened, close it first
     if ( _dir ) {
@@ -120,13 +166,13 @@ void PresetLoader::rescan()
 
     assert ( _entries.size() == _presetNames.size() );
 
-
-
+    loadCosts();
 }
 
 
 std::auto_ptr<Preset> PresetLoader::loadPreset ( unsigned int index )  const
 {
+    waitForScan();
 
     // Check that index isn't insane
     assert ( index >= 0 );
@@ -187,6 +233,7 @@ void PresetLoader::handleDirectoryError()
 
 void PresetLoader::setRating(unsigned int index, int rating, const PresetRatingType ratingType)
 {
+    waitForScan();
     assert ( index >=0 );
 
     const unsigned int ratingTypeIndex = static_cast<unsigned int>(ratingType);
@@ -202,6 +249,7 @@ void PresetLoader::setRating(unsigned int index, int rating, const PresetRatingT
 
 unsigned int PresetLoader::addPresetURL ( const std::string & url, const std::string & presetName, const std::vector<int> & ratings)
 {
+    waitForScan();
     _entries.push_back(url);
     _presetNames.push_back ( presetName );
 
@@ -219,6 +267,7 @@ unsigned int PresetLoader::addPresetURL ( const std::string & url, const std::st
 
 void PresetLoader::removePreset ( unsigned int index )
 {
+    waitForScan();
 
     _entries.erase ( _entries.begin() + index );
     _presetNames.erase ( _presetNames.begin() + index );
@@ -233,36 +282,43 @@ void PresetLoader::removePreset ( unsigned int index )
 
 const std::string & PresetLoader::getPresetURL ( unsigned int index ) const
 {
+    waitForScan();
     return _entries[index];
 }
 
 const std::string & PresetLoader::getPresetName ( unsigned int index ) const
 {
+    waitForScan();
     return _presetNames[index];
 }
 
 int PresetLoader::getPresetRating ( unsigned int index, const PresetRatingType ratingType ) const
 {
+    waitForScan();
     return _ratings[ratingType][index];
 }
 
 const std::vector<RatingList> & PresetLoader::getPresetRatings () const
 {
+    waitForScan();
     return _ratings;
 }
 
 const std::vector<int> & PresetLoader::getPresetRatingsSums() const
 {
+    waitForScan();
     return _ratingsSums;
 }
 
 void PresetLoader::setPresetName(unsigned int index, std::string name)
 {
+    waitForScan();
     _presetNames[index] = name;
 }
 
 void PresetLoader::insertPresetURL ( unsigned int index, const std::string & url, const std::string & presetName, const RatingList & ratings)
 {
+    waitForScan();
     _entries.insert ( _entries.begin() + index, url );
     _presetNames.insert ( _presetNames.begin() + index, presetName );
 
@@ -277,3 +333,62 @@ void PresetLoader::insertPresetURL ( unsigned int index, const std::string & url
 
 
 }
+
+void PresetLoader::loadCosts()
+{
+    if ( _costsFile.empty() )
+        return;
+
+    std::ifstream in ( _costsFile.c_str() );
+    std::string line;
+    std::string url;
+    PresetCost cost;
+
+    /* On a rescan what was measured since comes first */
+    while ( std::getline ( in, line ) )
+        if ( cost.read ( line, url ) )
+            _costs.insert ( std::make_pair ( url, cost ) );
+}
+
+bool PresetLoader::saveCosts()
+{
+    waitForScan();
+    if ( !_costsChanged || _costsFile.empty() )
+        return true;
+
+    /* Written aside and renamed over the old file, so a crash or a full disk
+       halfway leaves the costs of earlier runs */
+    const std::string written = _costsFile + ".new";
+    std::ofstream out ( written.c_str() );
+    for ( std::map<std::string, PresetCost>::const_iterator pos = _costs.begin(); pos != _costs.end(); ++pos )
+        out << pos->second.write ( pos->first ) << std::endl;
+    out.close();
+
+#ifdef WIN32
+    /* rename() doesn't replace an existing file there */
+    if ( out )
+        std::remove ( _costsFile.c_str() );
+#endif
+    if ( !out || std::rename ( written.c_str(), _costsFile.c_str() ) != 0 ) {
+        std::cerr << "[PresetLoader] could not write preset costs to " << _costsFile << std::endl;
+        std::remove ( written.c_str() );
+        return false;
+    }
+
+    _costsChanged = false;
+    return true;
+}
+
+PresetCost PresetLoader::getPresetCost ( unsigned int index ) const
+{
+    waitForScan();
+    std::map<std::string, PresetCost>::const_iterator pos = _costs.find ( _entries[index] );
+    return pos == _costs.end() ? PresetCost() : pos->second;
+}
+
+void PresetLoader::addPresetCost ( const std::string & url, const std::vector<float> & times )
+{
+    waitForScan();
+    _costs[url].add ( times );
+    _costsChanged = true;
+}
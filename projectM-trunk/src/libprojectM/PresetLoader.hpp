@@ -20,6 +20,11 @@
 #include <vector>
 #include <map>
 #include "PresetFactoryManager.hpp"
+#include "PresetCost.hpp"
+
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
 
 class Preset;
 class PresetFactory;
@@ -30,7 +35,8 @@ class PresetLoader {
 		
 		
 		/// Initializes the preset loader with the target directory specified 
-		PresetLoader(int gx, int gy, std::string dirname);
+		/// Costs are read from and written to costsFile, not kept for an empty one
+		PresetLoader(int gx, int gy, std::string dirname, const std::string & costsFile = std::string());
 				
 		~PresetLoader();
 	
@@ -54,9 +60,8 @@ class PresetLoader {
 	
 		/// Clears all presets from the collection
 		inline void clear() { 
-			_entries.clear(); _presetNames.clear(); 
-			_ratings = std::vector<RatingList>(TOTAL_RATING_TYPES, RatingList());
-			clearRatingsSum();
+			waitForScan();
+			clearEntries();
  		}
 
 		inline void clearRatingsSum() {
@@ -84,6 +89,7 @@ class PresetLoader {
 		
 		/// Returns the number of presets in the active directory 
 		inline std::size_t size() const {
+			waitForScan();
 			return _entries.size();
 		}
 					
@@ -98,8 +104,47 @@ class PresetLoader {
 		/// Rescans the active preset directory
 		void rescan();
 		void setPresetName(unsigned int index, std::string name);
+
+		/// Measured cost of a preset, kept by url in the costs file, read when
+		/// the directory is scanned
+		PresetCost getPresetCost(unsigned int index) const;
+
+		/// Merges the frame times of one time the preset at url played
+		void addPresetCost(const std::string & url, const std::vector<float> & times);
+
+		/// Writes the costs file if the costs changed. False if it couldn't
+		/// be written
+		bool saveCosts();
 	private:
 		void handleDirectoryError();
+
+		/// Reads the directory into the entry collection. Runs on a worker thread
+		/// when started from the constructor
+		void scan();
+
+		inline void clearEntries() {
+			_entries.clear(); _presetNames.clear(); 
+			_ratings = std::vector<RatingList>(TOTAL_RATING_TYPES, RatingList());
+			clearRatingsSum();
+		}
+
+		/// Blocks until the initial directory scan is done. Every accessor of the
+		/// entry collection goes through here first, from any thread: the
+		/// first one joins the scan thread, the others wait for it to. Past
+		/// the scan the loader has no locks, so a host changing the collection
+		/// (clear, add, remove, rescan) must not read it from another thread
+		/// at the same time
+#ifdef USE_THREADS
+		void waitForScan() const;
+		static void * scanThread(void * loader);
+		mutable pthread_t _scanThread;
+		mutable bool _scanPending;
+		/// Guards _scanPending and the join
+		mutable pthread_mutex_t _scanMutex;
+#else
+		inline void waitForScan() const {}
+#endif
+
 		std::string _dirname;
 		DIR * _dir;
 		std::vector<int> _ratingsSums;
@@ -111,6 +156,13 @@ class PresetLoader {
 
 		// Indexed by ratingType, preset position.
 		std::vector<RatingList> _ratings;
+
+		/// By url, not position, so costs stay with the presets as they come
+		/// and go from the collection
+		std::map<std::string, PresetCost> _costs;
+		bool _costsChanged;
+		std::string _costsFile;
+		void loadCosts();
 		
 
 };
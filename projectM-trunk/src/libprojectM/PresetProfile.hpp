@@ -0,0 +1,65 @@
+/*
+ * PresetProfile.hpp
+ *
+ *  Where a preset spends its evaluation time. Only filled in when libprojectM
+ *  is built with USE_PROFILER.
+ */
+
+#ifndef PRESETPROFILE_HPP_
+#define PRESETPROFILE_HPP_
+
+#include <string>
+#include <vector>
+
+/// Evaluation count and cost of one equation, or the total of one custom wave / shape
+class PresetProfileEntry
+{
+public:
+    enum Kind {
+        PER_FRAME,
+        PER_PIXEL,
+        PER_POINT,
+        INIT_COND,
+        WAVE,   /* every equation of one custom wave */
+        SHAPE   /* every equation of one custom shape */
+    };
+
+    Kind kind;
+    /// Id of the custom wave or shape the equation belongs to, -1 for the preset itself
+    int owner;
+    /// Line of the preset file the equation starts on, 0 for defaults and totals
+    unsigned int line;
+    /// Parameter the equation assigns
+    std::string name;
+    unsigned long long evaluations;
+    /// CPU timestamp counter cycles, or nanoseconds on CPUs without one
+    unsigned long long cycles;
+
+    PresetProfileEntry(Kind kind, int owner, unsigned int line, const std::string & name,
+                       unsigned long long evaluations, unsigned long long cycles)
+        : kind(kind), owner(owner), line(line), name(name), evaluations(evaluations), cycles(cycles) {}
+
+    static const char * kindName(Kind kind)
+    {
+        switch (kind) {
+        case PER_FRAME:
+            return "per frame";
+        case PER_PIXEL:
+            return "per pixel";
+        case PER_POINT:
+            return "per point";
+        case INIT_COND:
+            return "init";
+        case WAVE:
+            return "wave";
+        case SHAPE:
+            return "shape";
+        default:
+            return "";
+        }
+    }
+};
+
+typedef std::vector<PresetProfileEntry> PresetProfile;
+
+#endif /* PRESETPROFILE_HPP_ */
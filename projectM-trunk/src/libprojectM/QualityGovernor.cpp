@@ -0,0 +1,117 @@
+/*
+ * QualityGovernor.cpp
+ *
+ *  Steps through quality levels to hold a target frame time.
+ */
+
+#include "QualityGovernor.hpp"
+#include "FrameStats.hpp"
+
+#include <algorithm>
+
+static const QualityLevel qualityLevels[] = {
+    /* texture divisor, mesh stride, wave samples, blur levels */
+    { 1, 1,   0, 3 },
+    { 1, 1, 512, 2 },
+    { 1, 2, 256, 1 },
+    { 2, 2, 256, 1 },
+    { 2, 3, 128, 0 },
+    { 4, 4, 128, 0 }
+};
+
+/* Weight of the newest frame in the average */
+#define SMOOTHING 0.1f
+/* Quality goes down above the high water mark and back up only well below
+ * it, after being there for much longer */
+#define HIGH_WATER 1.0f
+#define LOW_WATER 0.6f
+#define DOWN_FRAMES 20
+#define UP_FRAMES 180
+#define SETTLE_FRAMES 60
+/* Frames over budget at the lowest level before a preset counts as too heavy */
+#define HEAVY_FRAMES 300
+
+QualityGovernor::QualityGovernor()
+    : _enabled(false), _target(1000.0f / 35), _average(0), _level(0), _overFrames(0), _underFrames(0),
+      _settleFrames(SETTLE_FRAMES), _heavyFrames(0), _heavy(false), _heavyTaken(false)
+{
+}
+
+int QualityGovernor::levels()
+{
+    return sizeof(qualityLevels) / sizeof(qualityLevels[0]);
+}
+
+const QualityLevel & QualityGovernor::quality() const
+{
+    return qualityLevels[_level];
+}
+
+void QualityGovernor::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+    _average = 0;
+    changeLevel(0);
+}
+
+void QualityGovernor::changeLevel(int level)
+{
+    _level = level;
+    _overFrames = 0;
+    _underFrames = 0;
+    _settleFrames = SETTLE_FRAMES;
+}
+
+bool QualityGovernor::frameDone(const FrameStats & stats, bool blending)
+{
+    if (!_enabled || _target <= 0)
+        return false;
+
+    const float cost = std::max(stats[FrameStats::STAGE_FRAME], stats[FrameStats::STAGE_GPU]);
+    _average = _average == 0 ? cost : _average + (cost - _average) * SMOOTHING;
+
+    if (_settleFrames > 0) {
+        _settleFrames--;
+        return false;
+    }
+
+    const bool over = _average > _target * HIGH_WATER;
+    const bool under = _average < _target * LOW_WATER;
+
+    _overFrames = over ? _overFrames + 1 : 0;
+    _underFrames = under ? _underFrames + 1 : 0;
+
+    if (over && _level == levels() - 1 && !blending && ++_heavyFrames >= HEAVY_FRAMES)
+        _heavy = true;
+
+    if (_overFrames >= DOWN_FRAMES && _level < levels() - 1) {
+        changeLevel(_level + 1);
+        return true;
+    }
+
+    if (_underFrames >= UP_FRAMES && _level > 0) {
+        changeLevel(_level - 1);
+        return true;
+    }
+
+    return false;
+}
+
+void QualityGovernor::presetChanged()
+{
+    _heavyFrames = 0;
+    _heavy = false;
+    _heavyTaken = false;
+    _overFrames = 0;
+    _underFrames = 0;
+    _settleFrames = SETTLE_FRAMES;
+}
+
+bool QualityGovernor::takeHeavyPreset()
+{
+    if (!_heavy || _heavyTaken)
+        return false;
+
+    _heavyTaken = true;
+    return true;
+}
@@ -0,0 +1,82 @@
+/*
+ * QualityGovernor.hpp
+ *
+ *  Trades picture quality for frame time. Watches the CPU and GPU time of
+ *  every frame and steps through a fixed list of quality levels to hold a
+ *  target frame time, slowly and with hysteresis so the picture doesn't
+ *  flip back and forth between two levels.
+ */
+
+#ifndef QUALITYGOVERNOR_HPP_
+#define QUALITYGOVERNOR_HPP_
+
+class FrameStats;
+
+/// The settings one quality level renders with
+class QualityLevel
+{
+public:
+    /// The configured feedback texture size is divided by this
+    int textureDivisor;
+    /// See PipelineContext::meshStride
+    int meshStride;
+    /// Upper bound on custom wave samples, 0 for none
+    int waveSamples;
+    /// Blur passes rendered at most
+    int blurLevels;
+};
+
+class QualityGovernor
+{
+public:
+    QualityGovernor();
+
+    /// Disabled, the level stays at 0, full quality. Off by default
+    void setEnabled(bool enabled);
+    inline bool enabled() const { return _enabled; }
+
+    /// Milliseconds a frame may take, usually the frame period
+    inline void setTargetFrameTime(float ms) { _target = ms; }
+    inline float targetFrameTime() const { return _target; }
+
+    /// Feeds the stats of a finished frame. Frames of a soft cut render two
+    /// presets and don't count against the preset. Returns true when the
+    /// quality level changed
+    bool frameDone(const FrameStats & stats, bool blending);
+
+    /// Current level, 0 is full quality
+    inline int level() const { return _level; }
+    static int levels();
+    const QualityLevel & quality() const;
+
+    /// Smoothed cost of the recent frames, the slower of CPU and GPU time
+    inline float averageFrameTime() const { return _average; }
+
+    /// Restarts the count of frames over budget for a new preset, and gives
+    /// the preset a moment to settle before judging it
+    void presetChanged();
+
+    /// True once per preset when it stayed over budget at the lowest quality
+    /// for several seconds
+    bool takeHeavyPreset();
+
+private:
+    void changeLevel(int level);
+
+    bool _enabled;
+    float _target;
+    float _average;
+    int _level;
+
+    /// Consecutive frames above the high and below the low water mark
+    int _overFrames;
+    int _underFrames;
+    /// Frames left without decisions after a change
+    int _settleFrames;
+
+    int _heavyFrames;
+    bool _heavy;
+    bool _heavyTaken;
+};
+
+#endif /* QUALITYGOVERNOR_HPP_ */
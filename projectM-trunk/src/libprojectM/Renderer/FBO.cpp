@@ -53,12 +53,14 @@ RenderTarget::~RenderTarget()
 
 }
 
-GLuint RenderTarget::initRenderToTexture()
+GLuint RenderTarget::initRenderToTexture(int width, int height)
 {
 #ifdef USE_FBO
 
     if (this->useFBO==1) {
         this->renderToTexture=1;
+        this->outputWidth = width > 0 ? width : this->texsize;
+        this->outputHeight = height > 0 ? height : this->texsize;
 
         GLuint   fb2, depth_rb2;
         glGenFramebuffersEXT(1, &fb2);
@@ -66,14 +68,14 @@ GLuint RenderTarget::initRenderToTexture()
         glGenRenderbuffersEXT(1, &depth_rb2);
         glBindRenderbufferEXT( GL_RENDERBUFFER_EXT, depth_rb2 );
 
-        glRenderbufferStorageEXT( GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, this->texsize,this->texsize  );
+        glRenderbufferStorageEXT( GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT, this->outputWidth,this->outputHeight  );
         glFramebufferRenderbufferEXT( GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, depth_rb2 );
         this->fbuffer[1] = fb2;
         this->depthb[1]=  depth_rb2;
         glGenTextures(1, &this->textureID[2]);
         glBindTexture(GL_TEXTURE_2D, this->textureID[2]);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, texsize, texsize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, this->outputWidth, this->outputHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
@@ -85,6 +87,29 @@ GLuint RenderTarget::initRenderToTexture()
 
 }
 
+void RenderTarget::takeOutput(RenderTarget &other)
+{
+#ifdef USE_FBO
+    if (!other.renderToTexture)
+        return;
+
+    if (!this->useFBO) {
+        std::cerr << "[RenderTarget] no FBO, the output texture is lost" << std::endl;
+        return;
+    }
+
+    this->renderToTexture = 1;
+    this->outputWidth = other.outputWidth;
+    this->outputHeight = other.outputHeight;
+    this->fbuffer[1] = other.fbuffer[1];
+    this->depthb[1] = other.depthb[1];
+    this->textureID[2] = other.textureID[2];
+
+    /* Other's destructor must leave them alone now */
+    other.renderToTexture = 0;
+#endif
+}
+
 /** Creates new pbuffers */
 RenderTarget::RenderTarget(int texsize, int width, int height) : useFBO(false)
 {
@@ -93,6 +118,8 @@ RenderTarget::RenderTarget(int texsize, int width, int height) : useFBO(false)
     int origtexsize = 0;
 
     this->renderToTexture = 0;
+    this->outputWidth = 0;
+    this->outputHeight = 0;
     this->texsize = texsize;
 
 #ifdef USE_FBO
@@ -65,13 +65,20 @@ public:
   
   int useFBO;
   int renderToTexture;
+  /** Size of the output texture */
+  int outputWidth;
+  int outputHeight;
 
   ~RenderTarget();
 
   RenderTarget( int texsize, int width, int height );
   void lock();
   void unlock();
-  GLuint initRenderToTexture();
+  /// Output the finished frames into a texture of width x height, 0 for
+  /// texsize x texsize, instead of the screen
+  GLuint initRenderToTexture(int width = 0, int height = 0);
+  /// Moves the output texture of other, so it outlives a change of texsize
+  void takeOutput(RenderTarget &other);
   int nearestPower2( int value, TextureScale scaleRule );
   void fallbackRescale(int width, int height);
 
@@ -15,6 +15,7 @@ class Brighten : public RenderItem
 public:
 	Brighten(){}
 	void Draw(RenderContext &context);
+	RenderItem * snapshot(BeatDetect *music) { return new Brighten(*this); }
 };
 
 class Darken : public RenderItem
@@ -22,6 +23,7 @@ class Darken : public RenderItem
 public:
 	Darken(){}
 	void Draw(RenderContext &context);
+	RenderItem * snapshot(BeatDetect *music) { return new Darken(*this); }
 };
 
 class Invert : public RenderItem
@@ -29,6 +31,7 @@ class Invert : public RenderItem
 public:
 	Invert(){}
 	void Draw(RenderContext &context);
+	RenderItem * snapshot(BeatDetect *music) { return new Invert(*this); }
 };
 
 class Solarize : public RenderItem
@@ -36,6 +39,7 @@ class Solarize : public RenderItem
 public:
 	Solarize(){}
 	void Draw(RenderContext &context);
+	RenderItem * snapshot(BeatDetect *music) { return new Solarize(*this); }
 };
 
 #endif /* FILTERS_HPP_ */
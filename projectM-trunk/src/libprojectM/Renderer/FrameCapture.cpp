@@ -0,0 +1,328 @@
+/*
+ * FrameCapture.cpp
+ *
+ *  Copies finished frames out through a ring of pixel pack buffers.
+ */
+
+#include "FrameCapture.hpp"
+
+#include <iostream>
+
+#ifdef USE_FBO
+
+/* Each RGBA pixel of the output holds 4 consecutive bytes of the I420 frame:
+ * first the luma rows, then the U plane and the V plane. Chroma is sampled
+ * between 4 pixels so linear filtering averages them */
+static const char * I420_SHADER =
+    "uniform sampler2D image;\n"
+    "uniform vec2 size;\n"
+    "\n"
+    "float byteAt(float index)\n"
+    "{\n"
+    "    float area = size.x * size.y;\n"
+    "    if (index < area) {\n"
+    "        float y = floor((index + 0.5) / size.x);\n"
+    "        float x = index - y * size.x;\n"
+    "        vec3 c = texture2D(image, vec2((x + 0.5) / size.x, 1.0 - (y + 0.5) / size.y)).rgb;\n"
+    "        return dot(c, vec3(0.257, 0.504, 0.098)) + 0.0625;\n"
+    "    }\n"
+    "\n"
+    "    index -= area;\n"
+    "    float quarter = area * 0.25;\n"
+    "    bool v = index >= quarter;\n"
+    "    if (v)\n"
+    "        index -= quarter;\n"
+    "\n"
+    "    float width = size.x * 0.5;\n"
+    "    float y = floor((index + 0.5) / width);\n"
+    "    float x = index - y * width;\n"
+    "    vec3 c = texture2D(image, vec2((2.0 * x + 1.0) / size.x, 1.0 - (2.0 * y + 1.0) / size.y)).rgb;\n"
+    "    if (v)\n"
+    "        return dot(c, vec3(0.439, -0.368, -0.071)) + 0.5;\n"
+    "    return dot(c, vec3(-0.148, -0.291, 0.439)) + 0.5;\n"
+    "}\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    float index = (floor(gl_FragCoord.y) * size.x * 0.25 + floor(gl_FragCoord.x)) * 4.0;\n"
+    "    gl_FragColor = vec4(byteAt(index), byteAt(index + 1.0), byteAt(index + 2.0), byteAt(index + 3.0));\n"
+    "}\n";
+
+static GLuint compileI420()
+{
+    GLuint shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(shader, 1, &I420_SHADER, NULL);
+    glCompileShader(shader);
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        char log[1024] = "";
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        std::cerr << "[FrameCapture] I420 conversion shader failed: " << log << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+static GLuint createTarget(GLuint & texture, int width, int height)
+{
+    GLuint framebuffer;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffersEXT(1, &framebuffer);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, framebuffer);
+    glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, texture, 0);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+    return framebuffer;
+}
+
+#endif
+
+FrameCapture::FrameCapture(FrameSink * sink, int width, int height, CapturedFrame::Format format, int latency)
+    : _sink(sink), _format(format), _width(width), _height(height), _latency(latency < 1 ? 1 : latency),
+      _initialized(false), _size(0), _read(0), _delivered(0)
+{
+#ifdef USE_FBO
+    _scaledFramebuffer = 0;
+    _scaledTexture = 0;
+    _packedFramebuffer = 0;
+    _packedTexture = 0;
+    _program = 0;
+#endif
+}
+
+FrameCapture::~FrameCapture()
+{
+#ifdef USE_FBO
+    if (!_buffers.empty())
+        glDeleteBuffers(_buffers.size(), &_buffers[0]);
+    if (_scaledFramebuffer) {
+        glDeleteFramebuffersEXT(1, &_scaledFramebuffer);
+        glDeleteTextures(1, &_scaledTexture);
+    }
+    if (_packedFramebuffer) {
+        glDeleteFramebuffersEXT(1, &_packedFramebuffer);
+        glDeleteTextures(1, &_packedTexture);
+    }
+    if (_program)
+        glDeleteProgram(_program);
+#endif
+}
+
+bool FrameCapture::supported(CapturedFrame::Format format)
+{
+#ifdef USE_FBO
+    if (!glewIsSupported("GL_EXT_framebuffer_blit")) {
+        std::cerr << "[FrameCapture] the driver has no framebuffer blits" << std::endl;
+        return false;
+    }
+    if (!glewIsSupported("GL_VERSION_2_1") && !glewIsSupported("GL_ARB_pixel_buffer_object")) {
+        std::cerr << "[FrameCapture] the driver has no pixel buffer objects" << std::endl;
+        return false;
+    }
+    if (format == CapturedFrame::FORMAT_I420 && !glewIsSupported("GL_VERSION_2_0")) {
+        std::cerr << "[FrameCapture] I420 needs OpenGL 2.0 shaders" << std::endl;
+        return false;
+    }
+    return true;
+#else
+    std::cerr << "[FrameCapture] libprojectM was built without USE_FBO" << std::endl;
+    return false;
+#endif
+}
+
+bool FrameCapture::init(int width, int height)
+{
+#ifdef USE_FBO
+    _initialized = true;
+
+    if (_width <= 0 || _height <= 0) {
+        _width = width;
+        _height = height;
+    }
+
+    switch (_format) {
+    case CapturedFrame::FORMAT_RGBA:
+        _size = _width * _height * 4;
+        break;
+    case CapturedFrame::FORMAT_RGB:
+        _size = _width * _height * 3;
+        break;
+    case CapturedFrame::FORMAT_RGB565:
+        _size = _width * _height * 2;
+        break;
+    case CapturedFrame::FORMAT_I420:
+        if (_width % 4 || _height % 2) {
+            std::cerr << "[FrameCapture] I420 needs a width divisible by 4 and an even height, not "
+                      << _width << "x" << _height << std::endl;
+            return false;
+        }
+        _size = _width * _height * 3 / 2;
+        break;
+    }
+
+    _scaledFramebuffer = createTarget(_scaledTexture, _width, _height);
+
+    if (_format == CapturedFrame::FORMAT_I420) {
+        _packedFramebuffer = createTarget(_packedTexture, _width / 4, _height * 3 / 2);
+        _program = compileI420();
+        if (!_program)
+            return false;
+    }
+
+    /* One buffer more than frames in flight, so the one written never is the one mapped */
+    _buffers.resize(_latency + 1);
+    glGenBuffers(_buffers.size(), &_buffers[0]);
+    for (unsigned int i = 0; i < _buffers.size(); i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, _size, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FrameCapture::capture(GLuint framebuffer, int width, int height)
+{
+#ifdef USE_FBO
+    if (!_initialized && !init(width, height))
+        std::cerr << "[FrameCapture] capturing nothing" << std::endl;
+    if (_buffers.empty())
+        return;
+
+    /* RGB rows are flipped by the blit, I420 rows by the shader */
+    const bool flip = _format != CapturedFrame::FORMAT_I420;
+    glBindFramebufferEXT(GL_READ_FRAMEBUFFER_EXT, framebuffer);
+    glBindFramebufferEXT(GL_DRAW_FRAMEBUFFER_EXT, _scaledFramebuffer);
+    glBlitFramebufferEXT(0, 0, width, height, 0, flip ? _height : 0, _width, flip ? 0 : _height,
+                         GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+    if (_format == CapturedFrame::FORMAT_I420)
+        convertI420();
+
+    GLenum format = GL_RGBA;
+    GLenum type = GL_UNSIGNED_BYTE;
+    int readWidth = _width;
+    int readHeight = _height;
+
+    switch (_format) {
+    case CapturedFrame::FORMAT_RGB:
+        format = GL_RGB;
+        break;
+    case CapturedFrame::FORMAT_RGB565:
+        format = GL_RGB;
+        type = GL_UNSIGNED_SHORT_5_6_5;
+        break;
+    case CapturedFrame::FORMAT_I420:
+        readWidth = _width / 4;
+        readHeight = _height * 3 / 2;
+        break;
+    default:
+        break;
+    }
+
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _format == CapturedFrame::FORMAT_I420 ? _packedFramebuffer : _scaledFramebuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[_read % _buffers.size()]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, readWidth, readHeight, format, type, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+    _read++;
+
+    /* Read latency frames ago, the GPU is done with it by now */
+    if (_read - _delivered > (unsigned int) _latency)
+        deliver(_delivered++);
+#endif
+}
+
+void FrameCapture::convertI420()
+{
+#ifdef USE_FBO
+    glPushAttrib(GL_ENABLE_BIT | GL_VIEWPORT_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _packedFramebuffer);
+    glViewport(0, 0, _width / 4, _height * 3 / 2);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, _scaledTexture);
+
+    glUseProgram(_program);
+    glUniform1i(glGetUniformLocation(_program, "image"), 0);
+    glUniform2f(glGetUniformLocation(_program, "size"), _width, _height);
+
+    glBegin(GL_QUADS);
+    glVertex2f(-1, -1);
+    glVertex2f(1, -1);
+    glVertex2f(1, 1);
+    glVertex2f(-1, 1);
+    glEnd();
+
+    glUseProgram(0);
+    glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    glPopAttrib();
+#endif
+}
+
+void FrameCapture::flush()
+{
+    while (_delivered < _read)
+        deliver(_delivered++);
+}
+
+void FrameCapture::deliver(unsigned int number)
+{
+#ifdef USE_FBO
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffers[number % _buffers.size()]);
+    const unsigned char * data = (const unsigned char *) glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+    if (data) {
+        CapturedFrame frame;
+        frame.data = data;
+        frame.size = _size;
+        frame.width = _width;
+        frame.height = _height;
+        frame.format = _format;
+        frame.number = number;
+        _sink->frameCaptured(frame);
+
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else
+        std::cerr << "[FrameCapture] mapping frame " << number << " failed" << std::endl;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+#endif
+}
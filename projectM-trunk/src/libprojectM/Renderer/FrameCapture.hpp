@@ -0,0 +1,66 @@
+/*
+ * FrameCapture.hpp
+ *
+ *  Copies finished frames out through a ring of pixel pack buffers. Each
+ *  frame is scaled with a framebuffer blit, converted on the GPU and read
+ *  into the next buffer; the buffer filled latency frames earlier is mapped
+ *  and handed to the sink, long after the GPU is done with it.
+ */
+
+#ifndef FRAMECAPTURE_HPP_
+#define FRAMECAPTURE_HPP_
+
+#include "FBO.hpp"
+#include "FrameSink.hpp"
+
+#include <vector>
+
+class FrameCapture
+{
+public:
+    /// Width and height 0 take the size of the first frame captured
+    FrameCapture(FrameSink * sink, int width, int height, CapturedFrame::Format format, int latency);
+    ~FrameCapture();
+
+    /// False if the driver can't do it, the reason went to std::cerr
+    static bool supported(CapturedFrame::Format format);
+
+    /// Reads the frame in framebuffer, width x height at the origin
+    void capture(GLuint framebuffer, int width, int height);
+
+    /// Hands over every frame still in flight
+    void flush();
+
+    inline FrameSink * sink() const { return _sink; }
+
+private:
+    bool init(int width, int height);
+    void deliver(unsigned int number);
+    void convertI420();
+
+    FrameSink * _sink;
+    CapturedFrame::Format _format;
+    int _width;
+    int _height;
+    int _latency;
+    bool _initialized;
+
+    /// Bytes per frame in the buffers
+    unsigned int _size;
+    std::vector<GLuint> _buffers;
+    /// Frames read into the buffers so far, and handed over so far
+    unsigned int _read;
+    unsigned int _delivered;
+
+#ifdef USE_FBO
+    /// The scaled frame
+    GLuint _scaledFramebuffer;
+    GLuint _scaledTexture;
+    /// The I420 bytes packed into RGBA pixels, a quarter of the width wide
+    GLuint _packedFramebuffer;
+    GLuint _packedTexture;
+    GLuint _program;
+#endif
+};
+
+#endif /* FRAMECAPTURE_HPP_ */
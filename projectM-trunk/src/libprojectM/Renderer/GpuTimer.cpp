@@ -0,0 +1,125 @@
+/*
+ * GpuTimer.cpp
+ *
+ *  Measures GPU time with GL_TIME_ELAPSED timer queries.
+ */
+
+#include "Common.hpp"
+
+#ifdef USE_FBO
+#ifdef USE_NATIVE_GLEW
+#include "glew.h"
+#else
+#include <GL/glew.h>
+#endif
+#endif
+
+#ifdef USE_GLES1
+#include <GLES/gl.h>
+#else
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+#endif
+
+#include <cstring>
+#include "GpuTimer.hpp"
+
+GpuTimer::GpuTimer() : _initialized(false), _supported(false), _arb(false), _running(false), _current(0), _result(-1)
+{
+    memset(_queries, 0, sizeof(_queries));
+    memset(_pending, 0, sizeof(_pending));
+}
+
+GpuTimer::~GpuTimer()
+{
+#ifdef USE_FBO
+    if (_supported)
+        glDeleteQueries(QUERIES, _queries);
+#endif
+}
+
+/* Done lazily, there is no GL context yet when the Renderer is constructed.
+ * The entry points come from GLEW, which the RenderTarget initialized; builds
+ * without it have no GPU time */
+void GpuTimer::init()
+{
+    _initialized = true;
+
+#ifdef USE_FBO
+#ifdef GL_ARB_timer_query
+    _arb = GLEW_ARB_timer_query;
+#endif
+    _supported = GLEW_VERSION_1_5 && (_arb || GLEW_EXT_timer_query);
+
+    if (_supported)
+        glGenQueries(QUERIES, _queries);
+#endif
+}
+
+void GpuTimer::begin()
+{
+    if (!_initialized)
+        init();
+
+    /* All queries still in flight: skip this frame rather than stall */
+    if (!_supported || _pending[_current])
+        return;
+
+#ifdef USE_FBO
+    glBeginQuery(GL_TIME_ELAPSED_EXT, _queries[_current]);
+    _running = true;
+#endif
+}
+
+void GpuTimer::end()
+{
+    if (!_running)
+        return;
+
+#ifdef USE_FBO
+    glEndQuery(GL_TIME_ELAPSED_EXT);
+#endif
+    _pending[_current] = true;
+    _current = (_current + 1) % QUERIES;
+    _running = false;
+}
+
+float GpuTimer::lastResult()
+{
+    if (!_supported)
+        return -1;
+
+#ifdef USE_FBO
+    /* oldest query first, so _result ends up holding the newest one */
+    for (int i = 0; i < QUERIES; i++) {
+        const int query = (_current + i) % QUERIES;
+
+        if (!_pending[query])
+            continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(_queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+#ifdef GL_ARB_timer_query
+        if (_arb) {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(_queries[query], GL_QUERY_RESULT, &nanoseconds);
+            _result = nanoseconds / 1000000.0f;
+        } else
+#endif
+        {
+            GLuint64EXT nanoseconds = 0;
+            glGetQueryObjectui64vEXT(_queries[query], GL_QUERY_RESULT, &nanoseconds);
+            _result = nanoseconds / 1000000.0f;
+        }
+        _pending[query] = false;
+    }
+#endif
+
+    return _result;
+}
@@ -0,0 +1,43 @@
+/*
+ * GpuTimer.hpp
+ *
+ *  Measures GPU time with GL_TIME_ELAPSED timer queries. Results are read a
+ *  few frames late so the CPU never waits on the GPU.
+ */
+
+#ifndef GPUTIMER_HPP_
+#define GPUTIMER_HPP_
+
+class GpuTimer
+{
+public:
+    GpuTimer();
+    ~GpuTimer();
+
+    void begin();
+    void end();
+
+    /// Milliseconds of the newest finished measurement, or -1 if the driver
+    /// has no timer queries
+    float lastResult();
+
+private:
+    static const int QUERIES = 3;
+
+    void init();
+
+    bool _initialized;
+    bool _supported;
+    /// GL_ARB_timer_query rather than GL_EXT_timer_query
+    bool _arb;
+    bool _running;
+    unsigned int _queries[QUERIES];
+    bool _pending[QUERIES];
+    int _current;
+    float _result;
+
+    GpuTimer(const GpuTimer &);
+    GpuTimer & operator=(const GpuTimer &);
+};
+
+#endif /* GPUTIMER_HPP_ */
@@ -43,6 +43,7 @@ public:
 
 	MilkdropWaveform();
 	void Draw(RenderContext &context);
+	RenderItem * snapshot(BeatDetect *music) { return new MilkdropWaveform(*this); }
 
 	float modOpacityStart;
 	float modOpacityEnd;
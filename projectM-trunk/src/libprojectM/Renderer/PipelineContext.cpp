@@ -7,5 +7,5 @@
 
 #include "PipelineContext.hpp"
 
-PipelineContext::PipelineContext() {}
+PipelineContext::PipelineContext() : fps(0), time(0), frame(0), progress(0), frameStats(0), meshStride(1), waveSamples(0), budget(0), onset(0), bassOnset(0) {}
 PipelineContext::~PipelineContext() {}
@@ -8,6 +8,9 @@
 #ifndef PIPELINECONTEXT_HPP_
 #define PIPELINECONTEXT_HPP_
 
+class FrameStats;
+class StageBudget;
+
 class PipelineContext
 {
 public:
@@ -16,6 +19,22 @@ public:
 	int   frame;
 	float progress;
 
+	/// Stage timings of the frame being rendered go here, if not null
+	FrameStats *frameStats;
+
+	/// Per pixel equations run on every meshStride-th mesh point in each
+	/// direction, the points between are interpolated. 1 runs them everywhere
+	int meshStride;
+	/// Upper bound on the samples of custom waves, 0 for none
+	int waveSamples;
+	/// Time budgets of the preset stages, none if null
+	const StageBudget *budget;
+
+	/// Strength of the strongest onset taken at the start of the frame, in
+	/// all frequencies and in the bass band, 0 if none. See OnsetEvent
+	float onset;
+	float bassOnset;
+
 	PipelineContext();
 	virtual ~PipelineContext();
 };
@@ -0,0 +1,89 @@
+/*
+ * PipelineSnapshot.cpp
+ *
+ *  A copy of a pipeline the renderer can draw while the presets that filled
+ *  the original already evaluate the next frame.
+ */
+
+#include "PipelineSnapshot.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+PipelineSnapshot::PipelineSnapshot() {}
+
+PipelineSnapshot::~PipelineSnapshot()
+{
+	clear();
+}
+
+void PipelineSnapshot::clear()
+{
+	for (std::vector<RenderItem*>::iterator pos = drawables.begin(); pos != drawables.end(); ++pos)
+		delete *pos;
+	for (std::vector<RenderItem*>::iterator pos = compositeDrawables.begin(); pos != compositeDrawables.end(); ++pos)
+		delete *pos;
+
+	drawables.clear();
+	compositeDrawables.clear();
+}
+
+bool PipelineSnapshot::copy(const Pipeline &pipeline, BeatDetect *music)
+{
+	clear();
+
+	if (!pipeline.staticPerPixel)
+		return false;
+
+	/* The meshes are allocated once and kept while the size stays the same */
+	if (!staticPerPixel || gx != pipeline.gx || gy != pipeline.gy) {
+		if (staticPerPixel) {
+			for (int x = 0; x < gx; x++) {
+				free(x_mesh[x]);
+				free(y_mesh[x]);
+			}
+			free(x_mesh);
+			free(y_mesh);
+		}
+		setStaticPerPixel(pipeline.gx, pipeline.gy);
+	}
+
+	for (int x = 0; x < gx; x++) {
+		memcpy(x_mesh[x], pipeline.x_mesh[x], gy * sizeof(float));
+		memcpy(y_mesh[x], pipeline.y_mesh[x], gy * sizeof(float));
+	}
+
+	textureWrap = pipeline.textureWrap;
+	screenDecay = pipeline.screenDecay;
+	memcpy(q, pipeline.q, sizeof(q));
+
+	blur1n = pipeline.blur1n;
+	blur2n = pipeline.blur2n;
+	blur3n = pipeline.blur3n;
+	blur1x = pipeline.blur1x;
+	blur2x = pipeline.blur2x;
+	blur3x = pipeline.blur3x;
+	blur1ed = pipeline.blur1ed;
+
+	if (!copyItems(pipeline.drawables, drawables, music) ||
+	    !copyItems(pipeline.compositeDrawables, compositeDrawables, music)) {
+		clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool PipelineSnapshot::copyItems(const std::vector<RenderItem*> &items, std::vector<RenderItem*> &copies, BeatDetect *music)
+{
+	for (std::vector<RenderItem*>::const_iterator pos = items.begin(); pos != items.end(); ++pos) {
+		if (*pos == NULL)
+			continue;
+
+		RenderItem *item = (*pos)->snapshot(music);
+		if (item == 0)
+			return false;
+		copies.push_back(item);
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+/*
+ * PipelineSnapshot.hpp
+ *
+ *  A copy of a pipeline the renderer can draw while the presets that filled
+ *  the original already evaluate the next frame.
+ */
+
+#ifndef PIPELINESNAPSHOT_HPP_
+#define PIPELINESNAPSHOT_HPP_
+
+#include "Pipeline.hpp"
+
+class BeatDetect;
+
+class PipelineSnapshot : public Pipeline
+{
+public:
+	PipelineSnapshot();
+	~PipelineSnapshot();
+
+	/// Copies the meshes, settings and render items of pipeline, evaluating
+	/// what the items would evaluate while drawing. Fails for pipelines
+	/// computing per pixel on the fly and for items that can't be copied.
+	/// The shaders stay behind: the renderer takes those from its current pipeline,
+	/// so a copy has to be dropped when the preset it came from is switched away
+	bool copy(const Pipeline &pipeline, BeatDetect *music);
+
+	/// Drops the render items of the last copy
+	void clear();
+
+private:
+	static bool copyItems(const std::vector<RenderItem*> &items, std::vector<RenderItem*> &copies, BeatDetect *music);
+};
+
+#endif /* PIPELINESNAPSHOT_HPP_ */
@@ -38,6 +38,10 @@ struct MatchResults {
 	/// @returns a list of match pairs, possibly self referencing, and an error estimate of the matching.
 	inline virtual void operator()(const RenderItemList & lhs, const RenderItemList & rhs) const {
 		
+		// The weight matrix is 8MB, only allocate it once a match is actually requested
+		if (!_weights)
+			_weights = new double[MAXIMUM_SET_SIZE][MAXIMUM_SET_SIZE];
+
 		// Ensure the first argument is greater than next to aid the helper function's logic.
 		if (lhs.size() >= rhs.size()) {
 		  _results.error = computeMatching(lhs, rhs);
@@ -50,18 +54,18 @@ struct MatchResults {
 	
 	}
 
-	RenderItemMatcher() {}
-	virtual ~RenderItemMatcher() {}
+	RenderItemMatcher() : _weights(0) {}
+	virtual ~RenderItemMatcher() { delete[] _weights; }
 
 	inline MatchResults & matchResults() { return _results; }
 
-	inline double weight(int i, int j) const { return _weights[i][j]; }
+	inline double weight(int i, int j) const { return _weights ? _weights[i][j] : 0; }
 
 	MasterRenderItemDistance & distanceFunction() { return _distanceFunction; }
 
 private:
 	mutable HungarianMethod<MAXIMUM_SET_SIZE> _hungarianMethod;
-	mutable double _weights[MAXIMUM_SET_SIZE][MAXIMUM_SET_SIZE];
+	mutable double (*_weights)[MAXIMUM_SET_SIZE];
 
 	mutable MatchResults _results;
 
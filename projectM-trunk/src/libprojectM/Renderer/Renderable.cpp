@@ -15,11 +15,27 @@
 
 #include "Renderable.hpp"
 #include <math.h>
+#include <algorithm>
 
 typedef float floatPair[2];
 typedef float floatTriple[3];
 typedef float floatQuad[4];
 
+ShapeArrays::ShapeArrays() : _unitSides(0) {}
+
+const float * ShapeArrays::unitPolygon(int sides)
+{
+    if (sides != _unitSides) {
+        _unitPolygon.resize(2 * sides);
+        for (int i = 0; i < sides; i++) {
+            _unitPolygon[2 * i] = cosf(i * 3.1415927f * 2 / sides);
+            _unitPolygon[2 * i + 1] = sinf(i * 3.1415927f * 2 / sides);
+        }
+        _unitSides = sides;
+    }
+    return &_unitPolygon[0];
+}
+
 RenderContext::RenderContext()
     : time(0),texsize(512), aspectRatio(1), aspectCorrect(false) {};
 
@@ -97,23 +113,94 @@ Shape::Shape():RenderItem()
 
 }
 
+ShapeInstance::ShapeInstance(const Shape &shape)
+    : sides(shape.sides), thickOutline(shape.thickOutline), additive(shape.additive), textured(shape.textured),
+      tex_zoom(shape.tex_zoom), tex_ang(shape.tex_ang), x(shape.x), y(shape.y), radius(shape.radius), ang(shape.ang),
+      r(shape.r), g(shape.g), b(shape.b), a(shape.a), r2(shape.r2), g2(shape.g2), b2(shape.b2), a2(shape.a2),
+      border_r(shape.border_r), border_g(shape.border_g), border_b(shape.border_b), border_a(shape.border_a) {}
+
+bool ShapeInstance::sameState(const ShapeInstance &other) const
+{
+    return textured == other.textured && additive == other.additive && thickOutline == other.thickOutline;
+}
+
+void ShapeInstance::bounds(const RenderContext &context, float box[4]) const
+{
+    /* The radius drawBatch draws with, and a margin for thick outlines */
+    const float margin = 4.0f / context.texsize;
+    const float height = fabsf(radius * (.707*.707*.707*1.04)) + margin;
+    const float width = fabsf(radius * (.707*.707*.707*1.04)) * (context.aspectCorrect ? context.aspectRatio : 1.0) + margin;
+
+    box[0] = x - width;
+    box[1] = 1 - y - height;
+    box[2] = x + width;
+    box[3] = 1 - y + height;
+}
+
+/* Vertices of the fills of a batch, so they can be indexed with shorts */
+#define SHAPE_BATCH_VERTICES 65535
+
 void Shape::Draw(RenderContext &context)
 {
+    if (instances.empty()) {
+        ShapeInstance self(*this);
+        drawBatch(context, &self, &self + 1);
+        return;
+    }
 
-    float xval, yval;
-    float t;
+    const ShapeInstance *all = &instances[0];
+    size_t begin = 0;
+    while (begin < instances.size()) {
+        size_t end = begin + 1;
+        int vertices = all[begin].sides + 2;
+
+        /* A batch draws its fills before its outlines, so a fill blended
+           over an outline drawn before it ends the batch. Adding blends the
+           same in any order. */
+        float outlines[4] = { 1, 1, 0, 0 };
+        if (all[begin].border_a > 0)
+            all[begin].bounds(context, outlines);
+
+        while (end < instances.size() && all[end].sameState(all[begin])
+               && vertices + all[end].sides + 2 <= SHAPE_BATCH_VERTICES) {
+            float box[4];
+            all[end].bounds(context, box);
+            if (!all[end].additive && box[0] < outlines[2] && outlines[0] < box[2]
+                && box[1] < outlines[3] && outlines[1] < box[3])
+                break;
+
+            if (all[end].border_a > 0) {
+                if (outlines[0] > outlines[2]) {
+                    for (int i = 0; i < 4; i++)
+                        outlines[i] = box[i];
+                } else {
+                    outlines[0] = std::min(outlines[0], box[0]);
+                    outlines[1] = std::min(outlines[1], box[1]);
+                    outlines[2] = std::max(outlines[2], box[2]);
+                    outlines[3] = std::max(outlines[3], box[3]);
+                }
+            }
+
+            vertices += all[end].sides + 2;
+            end++;
+        }
 
-    // printf("drawing shape %f\n", ang);
+        drawBatch(context, all + begin, all + end);
+        begin = end;
+    }
+}
+
+void Shape::drawBatch(RenderContext &context, const ShapeInstance *begin, const ShapeInstance *end)
+{
+    ShapeArrays &arrays = context.shapeArrays;
+    const ShapeInstance &first = *begin;
+    const bool single = end - begin == 1;
 
-    float temp_radius= radius*(.707*.707*.707*1.04);
     //Additive Drawing or Overwrite
-    if ( additive==0)  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if ( first.additive==0)  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     else    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 
-    xval= x;
-    yval= -(y-1);
-
-    if ( textured) {
+    if ( first.textured) {
         if (imageUrl !="") {
             GLuint tex= context.textureManager->getTexture(imageUrl);
             if (tex != 0) {
@@ -121,137 +208,143 @@ void Shape::Draw(RenderContext &context)
                 context.aspectRatio=1.0;
             }
         }
+    }
 
-        glMatrixMode(GL_TEXTURE);
-        glPushMatrix();
-        glLoadIdentity();
-
-        glEnable(GL_TEXTURE_2D);
-
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glEnableClientState(GL_COLOR_ARRAY);
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-
-        floatQuad *colors = new float[sides+2][4];
-        floatPair *tex = new float[sides+2][2];
-        floatPair *points = new float[sides+2][2];
+    arrays.points.clear();
+    arrays.colors.clear();
+    arrays.texCoords.clear();
+    arrays.fill.clear();
+    arrays.outline.clear();
+    arrays.outlineColors.clear();
+    arrays.lines.clear();
+
+    bool sameBorder = true;
+    const float aspect = context.aspectCorrect ? context.aspectRatio : 1.0;
+    for (const ShapeInstance *shape = begin; shape != end; ++shape) {
+        const int sides = shape->sides;
+        float temp_radius= shape->radius*(.707*.707*.707*1.04);
+        float xval= shape->x;
+        float yval= -(shape->y-1);
+
+        /* The corners turn the unit polygon by ang, the texture by tex_ang */
+        const float *unit = arrays.unitPolygon(sides);
+        const float cosAng = cosf(shape->ang + 3.1415927f*0.25f);
+        const float sinAng = sinf(shape->ang + 3.1415927f*0.25f);
+        const float cosTex = cosf(shape->tex_ang + 3.1415927f*0.25f);
+        const float sinTex = sinf(shape->tex_ang + 3.1415927f*0.25f);
 
         //Define the center point of the shape
-        colors[0][0] = r;
-        colors[0][1] = g;
-        colors[0][2] = b;
-        colors[0][3] = a * masterAlpha;
-        tex[0][0] = 0.5;
-        tex[0][1] = 0.5;
-        points[0][0] = xval;
-        points[0][1] = yval;
+        const unsigned short center = arrays.points.size() / 2;
+        arrays.colors.push_back(shape->r);
+        arrays.colors.push_back(shape->g);
+        arrays.colors.push_back(shape->b);
+        arrays.colors.push_back(shape->a * masterAlpha);
+        if (shape->textured) {
+            arrays.texCoords.push_back(0.5);
+            arrays.texCoords.push_back(0.5);
+        }
+        arrays.points.push_back(xval);
+        arrays.points.push_back(yval);
 
         for ( int i=1; i< sides+2; i++) {
-            colors[i][0]= r2;
-            colors[i][1]=g2;
-            colors[i][2]=b2;
-            colors[i][3]=a2 * masterAlpha;
+            arrays.colors.push_back(shape->r2);
+            arrays.colors.push_back(shape->g2);
+            arrays.colors.push_back(shape->b2);
+            arrays.colors.push_back(shape->a2 * masterAlpha);
+
+            const float c = unit[2 * ((i-1) % sides)];
+            const float s = unit[2 * ((i-1) % sides) + 1];
+            if (shape->textured) {
+                arrays.texCoords.push_back(0.5f + 0.5f*(c*cosTex - s*sinTex)*aspect/ shape->tex_zoom);
+                arrays.texCoords.push_back(0.5f + 0.5f*(s*cosTex + c*sinTex)/ shape->tex_zoom);
+            }
+            arrays.points.push_back(temp_radius*(c*cosAng - s*sinAng)*aspect+xval);
+            arrays.points.push_back(temp_radius*(s*cosAng + c*sinAng)+yval);
+
+            /* The fan as triangles, to draw the whole batch at once */
+            if (i < sides+1) {
+                arrays.fill.push_back(center);
+                arrays.fill.push_back(center + i);
+                arrays.fill.push_back(center + i + 1);
+            }
+        }
 
-            t = (i-1)/(float) sides;
-            tex[i][0] =0.5f + 0.5f*cosf(t*3.1415927f*2 +  tex_ang + 3.1415927f*0.25f)*(context.aspectCorrect ? context.aspectRatio : 1.0)/ tex_zoom;
-            tex[i][1] =  0.5f + 0.5f*sinf(t*3.1415927f*2 +  tex_ang + 3.1415927f*0.25f)/ tex_zoom;
-            points[i][0]=temp_radius*cosf(t*3.1415927f*2 +  ang + 3.1415927f*0.25f)*(context.aspectCorrect ? context.aspectRatio : 1.0)+xval;
-            points[i][1]=temp_radius*sinf(t*3.1415927f*2 +  ang + 3.1415927f*0.25f)+yval;
+        /* The outline starts a corner before the fill */
+        const unsigned short corner = arrays.outline.size() / 2;
+        for ( int i=0; i< sides; i++) {
+            const int k = center + 1 + (i + sides - 1) % sides;
+            arrays.outline.push_back(arrays.points[2 * k]);
+            arrays.outline.push_back(arrays.points[2 * k + 1]);
 
+            arrays.outlineColors.push_back(shape->border_r);
+            arrays.outlineColors.push_back(shape->border_g);
+            arrays.outlineColors.push_back(shape->border_b);
+            arrays.outlineColors.push_back(shape->border_a * masterAlpha);
 
+            arrays.lines.push_back(corner + i);
+            arrays.lines.push_back(corner + (i + 1) % sides);
         }
 
-        glVertexPointer(2,GL_FLOAT,0,points);
-        glColorPointer(4,GL_FLOAT,0,colors);
-        glTexCoordPointer(2,GL_FLOAT,0,tex);
+        sameBorder = sameBorder && shape->border_r == first.border_r && shape->border_g == first.border_g
+                     && shape->border_b == first.border_b && shape->border_a == first.border_a;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
 
-        glDrawArrays(GL_TRIANGLE_FAN,0,sides+2);
+    if ( first.textured) {
+        glMatrixMode(GL_TEXTURE);
+        glPushMatrix();
+        glLoadIdentity();
 
-        glDisable(GL_TEXTURE_2D);
-        glPopMatrix();
-        glMatrixMode(GL_MODELVIEW);
+        glEnable(GL_TEXTURE_2D);
 
-        //Reset Texture state since we might have changed it
-        /*
-        				if(this->renderTarget->useFBO)
-        				{
-        					glBindTexture( GL_TEXTURE_2D, renderTarget->textureID[1] );
-        				}
-        				else
-        				{
-        					glBindTexture( GL_TEXTURE_2D, renderTarget->textureID[0] );
-        				}
-        */
-
-        delete[] colors;
-        delete[] tex;
-        delete[] points;
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2,GL_FLOAT,0,&arrays.texCoords[0]);
     } else {
         //Untextured (use color values)
-
-
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glEnableClientState(GL_COLOR_ARRAY);
         glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
 
-        floatQuad *colors = new float[sides+2][4];
-        floatPair *points = new float[sides+2][2];
-
-        //Define the center point of the shape
-        colors[0][0]=r;
-        colors[0][1]=g;
-        colors[0][2]=b;
-        colors[0][3]=a * masterAlpha;
-        points[0][0]=xval;
-        points[0][1]=yval;
-
-
-
-        for ( int i=1; i< sides+2; i++) {
-            colors[i][0]=r2;
-            colors[i][1]=g2;
-            colors[i][2]=b2;
-            colors[i][3]=a2 * masterAlpha;
-            t = (i-1)/(float) sides;
-            points[i][0]=temp_radius*cosf(t*3.1415927f*2 +  ang + 3.1415927f*0.25f)*(context.aspectCorrect ? context.aspectRatio : 1.0)+xval;
-            points[i][1]=temp_radius*sinf(t*3.1415927f*2 +  ang + 3.1415927f*0.25f)+yval;
-
-        }
-
-        glVertexPointer(2,GL_FLOAT,0,points);
-        glColorPointer(4,GL_FLOAT,0,colors);
-
+    glVertexPointer(2,GL_FLOAT,0,&arrays.points[0]);
+    glColorPointer(4,GL_FLOAT,0,&arrays.colors[0]);
 
-        glDrawArrays(GL_TRIANGLE_FAN,0,sides+2);
-        //draw first n-1 triangular pieces
+    if (single)
+        glDrawArrays(GL_TRIANGLE_FAN,0,first.sides+2);
+    else
+        glDrawElements(GL_TRIANGLES,arrays.fill.size(),GL_UNSIGNED_SHORT,&arrays.fill[0]);
 
-        delete[] colors;
-        delete[] points;
+    if ( first.textured) {
+        glDisable(GL_TEXTURE_2D);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
     }
-    if (thickOutline==1)  glLineWidth(context.texsize < 512 ? 1 : 2*context.texsize/512);
 
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_COLOR_ARRAY);
-
-    floatPair *points = new float[sides+1][2];
-
-    glColor4f( border_r, border_g, border_b, border_a * masterAlpha);
+    if (first.thickOutline==1)  glLineWidth(context.texsize < 512 ? 1 : 2*context.texsize/512);
 
-    for ( int i=0; i< sides; i++) {
-        t = (i-1)/(float) sides;
-        points[i][0]= temp_radius*cosf(t*3.1415927f*2 +  ang + 3.1415927f*0.25f)*(context.aspectCorrect ? context.aspectRatio : 1.0)+xval;
-        points[i][1]=  temp_radius*sinf(t*3.1415927f*2 +  ang + 3.1415927f*0.25f)+yval;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2,GL_FLOAT,0,&arrays.outline[0]);
 
+    if (sameBorder) {
+        glDisableClientState(GL_COLOR_ARRAY);
+        glColor4f( first.border_r, first.border_g, first.border_b, first.border_a * masterAlpha);
+    } else {
+        glColorPointer(4,GL_FLOAT,0,&arrays.outlineColors[0]);
     }
 
-    glVertexPointer(2,GL_FLOAT,0,points);
-    glDrawArrays(GL_LINE_LOOP,0,sides);
-
-    if (thickOutline==1)  glLineWidth(context.texsize < 512 ? 1 : context.texsize/512);
-
-    delete[] points;
+    if (single)
+        glDrawArrays(GL_LINE_LOOP,0,first.sides);
+    else
+        glDrawElements(GL_LINES,arrays.lines.size(),GL_UNSIGNED_SHORT,&arrays.lines[0]);
 
+    if (!sameBorder) {
+        /* Left as a single outline would have left it */
+        const ShapeInstance &last = *(end - 1);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glColor4f( last.border_r, last.border_g, last.border_b, last.border_a * masterAlpha);
+    }
 
+    if (first.thickOutline==1)  glLineWidth(context.texsize < 512 ? 1 : context.texsize/512);
 }
 
 void MotionVectors::Draw(RenderContext &context)
@@ -269,7 +362,8 @@ void MotionVectors::Draw(RenderContext &context)
     glColor4f(r, g, b, a * masterAlpha);
 
     if (x_num + y_num < 600) {
-        int size = x_num * y_num ;
+        /* Whole vectors only, the product of fractional counts is more points than are filled */
+        int size = (int)x_num * (int)y_num;
 
         floatPair *points = new float[size][2];
 
@@ -6,6 +6,28 @@
 class BeatDetect;
 
 
+/// Arrays Shape::Draw fills, kept from one frame to the next
+class ShapeArrays
+{
+public:
+	std::vector<float> points;
+	std::vector<float> colors;
+	std::vector<float> texCoords;
+	std::vector<unsigned short> fill;
+	std::vector<float> outline;
+	std::vector<float> outlineColors;
+	std::vector<unsigned short> lines;
+
+	ShapeArrays();
+	/// Cosine and sine of the corners of a polygon of radius 1 with a
+	/// corner at angle 0, kept until a shape with other sides asks
+	const float * unitPolygon(int sides);
+
+private:
+	std::vector<float> _unitPolygon;
+	int _unitSides;
+};
+
 class RenderContext
 {
 public:
@@ -15,6 +37,7 @@ public:
 	bool aspectCorrect;
 	BeatDetect *beatDetect;
 	TextureManager *textureManager;
+	ShapeArrays shapeArrays;
 
 	RenderContext();
 };
@@ -24,7 +47,11 @@ class RenderItem
 public:
 	float masterAlpha;
 	virtual void Draw(RenderContext &context) = 0;
+	/// A copy the renderer can draw while the owner of this item goes on with
+	/// the next frame, or 0 if the item can't be copied
+	virtual RenderItem * snapshot(BeatDetect *music) { return 0; }
 	RenderItem();
+	virtual ~RenderItem() {}
 };
 
 typedef std::vector<RenderItem*> RenderItemList;
@@ -34,6 +61,49 @@ class DarkenCenter : public RenderItem
 public:
 	DarkenCenter();
 	void Draw(RenderContext &context);
+	RenderItem * snapshot(BeatDetect *music) { return new DarkenCenter(*this); }
+};
+
+class Shape;
+
+/// The values one copy of a shape is drawn with
+class ShapeInstance
+{
+public:
+    int sides;
+    bool thickOutline;
+    bool additive;
+    bool textured;
+
+    float tex_zoom;
+    float tex_ang;
+
+    float x;
+    float y;
+    float radius;
+    float ang;
+
+    float r;
+    float g;
+    float b;
+    float a;
+
+    float r2;
+    float g2;
+    float b2;
+    float a2;
+
+    float border_r;
+    float border_g;
+    float border_b;
+    float border_a;
+
+    explicit ShapeInstance(const Shape &shape);
+
+    /// Drawn with the same GL state, so in the same batch
+    bool sameState(const ShapeInstance &other) const;
+    /// Box the shape and its outline may draw in, left, bottom, right, top
+    void bounds(const RenderContext &context, float box[4]) const;
 };
 
 class Shape : public RenderItem
@@ -69,9 +139,19 @@ public:
     float border_b; /* blue color value */
     float border_a; /* alpha color value */
 
+    /// Copies drawn instead of the values above when there are any, all
+    /// of those drawn with the same state with one call for their fills and
+    /// one for their outlines, unless a fill would cover an outline drawn
+    /// before it
+    std::vector<ShapeInstance> instances;
 
     Shape();
     virtual void Draw(RenderContext &context);
+    /// Copies the shape part only, subclasses add behaviour but no drawing
+    virtual RenderItem * snapshot(BeatDetect *music) { return new Shape(*this); }
+
+private:
+    void drawBatch(RenderContext &context, const ShapeInstance *begin, const ShapeInstance *end);
 };
 
 class Text : RenderItem
@@ -92,6 +172,7 @@ public:
     float y_offset;
 
     void Draw(RenderContext &context);
+    RenderItem * snapshot(BeatDetect *music) { return new MotionVectors(*this); }
     MotionVectors();
 };
 
@@ -111,6 +192,7 @@ public:
     float inner_a;
 
     void Draw(RenderContext &context);
+    RenderItem * snapshot(BeatDetect *music) { return new Border(*this); }
     Border();
 };
 
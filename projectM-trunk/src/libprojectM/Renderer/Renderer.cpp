@@ -14,9 +14,9 @@
 class Preset;
 
 Renderer::Renderer(int width, int height, int gx, int gy, int texsize, BeatDetect *beatDetect, std::string _presetURL,
-                   std::string _titlefontURL, std::string _menufontURL) :
+                   std::string _titlefontURL, std::string _menufontURL, TextureManager *textures) :
     title_fontURL(_titlefontURL), menu_fontURL(_menufontURL), presetURL(_presetURL), m_presetName("None"), vw(width),
-    vh(height), texsize(texsize), mesh(gx, gy)
+    vh(height), texsize(texsize), mesh(gx, gy), currentPipe(0)
 {
     int x;
     int y;
@@ -30,6 +30,7 @@ Renderer::Renderer(int width, int height, int gx, int gy, int texsize, BeatDetec
     this->showstats = false;
     this->studio = false;
     this->realfps = 0;
+    this->frameHistogram = 0;
 
     this->drawtitle = 0;
 
@@ -41,7 +42,8 @@ Renderer::Renderer(int width, int height, int gx, int gy, int texsize, BeatDetec
 
     /// @bug put these on member init list
     this->renderTarget = new RenderTarget(texsize, width, height);
-    this->textureManager = new TextureManager(presetURL);
+    this->ownTextures = textures == 0;
+    this->textureManager = ownTextures ? new TextureManager(presetURL) : textures;
     this->beatDetect = beatDetect;
 
 #ifdef USE_FTGL
@@ -107,13 +109,41 @@ void Renderer::ResetTextures()
 {
     textureManager->Clear();
 
-    delete (renderTarget);
+    RenderTarget *old = renderTarget;
     renderTarget = new RenderTarget(texsize, vw, vh);
+    renderTarget->takeOutput(*old);
+    delete (old);
     reset(vw, vh);
 
     textureManager->Preload();
 }
 
+void Renderer::setTextureSize(int size)
+{
+    if (size == texsize)
+        return;
+
+    texsize = size;
+    RenderTarget *old = renderTarget;
+    renderTarget = new RenderTarget(texsize, vw, vh);
+    renderTarget->takeOutput(*old);
+    delete (old);
+
+    if (!renderTarget->useFBO)
+        renderTarget->fallbackRescale(vw, vh);
+
+#ifdef USE_CG
+    shaderEngine.setTextureSize(renderTarget->texsize, renderTarget->textureID[1]);
+#endif
+}
+
+void Renderer::setBlurLevels(int levels)
+{
+#ifdef USE_CG
+    shaderEngine.setBlurLevels(levels);
+#endif
+}
+
 void Renderer::SetupPass1(const Pipeline &pipeline, const PipelineContext &pipelineContext)
 {
     //glMatrixMode(GL_PROJECTION);
@@ -191,7 +221,7 @@ void Renderer::Pass2(const Pipeline &pipeline, const PipelineContext &pipelineCo
 #ifdef USE_FBO
     if (renderTarget->renderToTexture) {
         glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, this->renderTarget->fbuffer[1]);
-        glViewport(0, 0, this->renderTarget->texsize, this->renderTarget->texsize);
+        glViewport(0, 0, this->renderTarget->outputWidth, this->renderTarget->outputHeight);
     } else
 #endif
         glViewport(0, 0, this->vw, this->vh);
@@ -238,20 +268,60 @@ void Renderer::Pass2(const Pipeline &pipeline, const PipelineContext &pipelineCo
 
 void Renderer::RenderFrame(const Pipeline &pipeline, const PipelineContext &pipelineContext)
 {
+    FrameStats *stats = pipelineContext.frameStats;
+
+    gpuTimer.begin();
 
-    SetupPass1(pipeline, pipelineContext);
+    /* Drawing the waves and shapes counts as theirs, not as pass 1 */
+    {
+        StageTimer timer(stats, FrameStats::STAGE_PASS1);
+
+        SetupPass1(pipeline, pipelineContext);
 
 #ifdef USE_CG
-    shaderEngine.enableShader(currentPipe->warpShader, pipeline, pipelineContext);
+        shaderEngine.enableShader(currentPipe->warpShader, pipeline, pipelineContext);
 #endif
-    Interpolation(pipeline);
+        Interpolation(pipeline);
 #ifdef USE_CG
-    shaderEngine.disableShader();
+        shaderEngine.disableShader();
 #endif
+    }
 
-    RenderItems(pipeline, pipelineContext);
-    FinishPass1();
-    Pass2(pipeline, pipelineContext);
+    {
+        StageTimer timer(stats, FrameStats::STAGE_WAVES_SHAPES);
+        RenderItems(pipeline, pipelineContext);
+    }
+
+    {
+        StageTimer timer(stats, FrameStats::STAGE_PASS1);
+        FinishPass1();
+    }
+
+    {
+        StageTimer timer(stats, FrameStats::STAGE_PASS2);
+        Pass2(pipeline, pipelineContext);
+    }
+
+    gpuTimer.end();
+
+    if (stats) {
+        /* Outputs drawing the same frame add up, -1 stays if none can tell */
+        float &total = stats->stages[FrameStats::STAGE_GPU];
+        const float gpu = gpuTimer.lastResult();
+        if (gpu >= 0)
+            total = (total > 0 ? total : 0) + gpu;
+        else if (total == 0)
+            total = gpu;
+    }
+
+    if (!captures.empty()) {
+        StageTimer timer(stats, FrameStats::STAGE_CAPTURE);
+
+        int width, height;
+        const GLuint framebuffer = outputFramebuffer(width, height);
+        for (std::vector<FrameCapture*>::iterator pos = captures.begin(); pos != captures.end(); ++pos)
+            (*pos)->capture(framebuffer, width, height);
+    }
 }
 
 void Renderer::Interpolation(const Pipeline &pipeline)
@@ -311,7 +381,7 @@ void Renderer::Interpolation(const Pipeline &pipeline)
 
     } else {
         mesh.Reset();
-        omptl::transform(mesh.p.begin(), mesh.p.end(), mesh.identity.begin(), mesh.p.begin(), &Renderer::PerPixel);
+        omptl::transform(mesh.p.begin(), mesh.p.end(), mesh.identity.begin(), mesh.p.begin(), PerPixel(currentPipe));
 
         for (int j = 0; j < mesh.height - 1; j++) {
             int base = j * mesh.width * 2 * 5;
@@ -342,16 +412,18 @@ void Renderer::Interpolation(const Pipeline &pipeline)
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 }
-Pipeline* Renderer::currentPipe;
 
 Renderer::~Renderer()
 {
 
     int x;
 
+    for (std::vector<FrameCapture*>::iterator pos = captures.begin(); pos != captures.end(); ++pos)
+        delete *pos;
+
     if (renderTarget)
         delete (renderTarget);
-    if (textureManager)
+    if (textureManager && ownTextures)
         delete (textureManager);
 
     //std::cerr << "grid assign end" << std::endl;
@@ -430,9 +502,28 @@ void Renderer::reset(int w, int h)
     }
 }
 
-GLuint Renderer::initRenderToTexture()
+GLuint Renderer::initRenderToTexture(int width, int height)
+{
+    return renderTarget->initRenderToTexture(width, height);
+}
+
+GLuint Renderer::outputTexture() const
+{
+    return renderTarget->renderToTexture ? renderTarget->textureID[2] : 0;
+}
+
+GLuint Renderer::outputFramebuffer(int &width, int &height) const
 {
-    return renderTarget->initRenderToTexture();
+#ifdef USE_FBO
+    if (renderTarget->renderToTexture) {
+        width = renderTarget->outputWidth;
+        height = renderTarget->outputHeight;
+        return renderTarget->fbuffer[1];
+    }
+#endif
+    width = vw;
+    height = vh;
+    return 0;
 }
 
 void Renderer::draw_title_to_texture()
@@ -656,6 +747,7 @@ void Renderer::draw_stats()
     glRasterPos2f(0, -.25 + offset);
     sprintf(buffer, "      textures: %.1fkB", textureManager->getTextureMemorySize() / 1000.0f);
     other_font->Render(buffer);
+    float line = -.29;
 #ifdef USE_CG
     glRasterPos2f(0, -.29 + offset);
     sprintf(buffer, "shader profile: %s", shaderEngine.profileName.c_str());
@@ -668,7 +760,22 @@ void Renderer::draw_stats()
     glRasterPos2f(0, -.37 + offset);
     sprintf(buffer, "   comp shader: %s", currentPipe->compositeShader.enabled ? "on" : "off");
     other_font->Render(buffer);
+    line = -.41;
 #endif
+
+    if (frameHistogram && frameHistogram->size() > 0) {
+        const FrameStats average = frameHistogram->average();
+
+        for (int stage = 0; stage < FrameStats::STAGE_COUNT; stage++, line -= .04) {
+            glRasterPos2f(0, line + offset);
+            sprintf(buffer, "%14s: %.2fms", FrameStats::stageName((FrameStats::Stage) stage), average.stages[stage]);
+            other_font->Render(buffer);
+        }
+
+        glRasterPos2f(0, line + offset);
+        sprintf(buffer, "     frame p99: %.2fms", frameHistogram->percentile(FrameStats::STAGE_FRAME, 0.99f));
+        other_font->Render(buffer);
+    }
     glPopMatrix();
     // glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
 
@@ -34,6 +34,9 @@
 #include "PerPixelMesh.hpp"
 #include "Transformation.hpp"
 #include "ShaderEngine.hpp"
+#include "FrameStats.hpp"
+#include "GpuTimer.hpp"
+#include "FrameCapture.hpp"
 
 class UserTexture;
 class BeatDetect;
@@ -62,17 +65,38 @@ public:
   int drawtitle;
   int texsize;
 
+  /// Frame timing history drawn by the stats overlay, owned by projectM
+  const FrameHistogram *frameHistogram;
 
-  Renderer( int width, int height, int gx, int gy, int texsize,  BeatDetect *beatDetect, std::string presetURL, std::string title_fontURL, std::string menu_fontURL);
+
+  /// textures shares the preset textures of another renderer of the same (or
+  /// a sharing) GL context, which has to outlive this one
+  Renderer( int width, int height, int gx, int gy, int texsize,  BeatDetect *beatDetect, std::string presetURL, std::string title_fontURL, std::string menu_fontURL, TextureManager *textures = 0);
   ~Renderer();
 
   void RenderFrame(const Pipeline &pipeline, const PipelineContext &pipelineContext);
   void ResetTextures();
   void reset(int w, int h);
-  GLuint initRenderToTexture();
+  /// Renders into a feedback texture of a new size from the next frame on,
+  /// keeping everything else. The picture in the old texture is dropped
+  void setTextureSize(int size);
+  /// Blur passes the shaders get at most, 0-3. Only matters with USE_CG
+  void setBlurLevels(int levels);
+  GLuint initRenderToTexture(int width = 0, int height = 0);
+
+  /// Framebuffer holding the finished frame after RenderFrame() and its size:
+  /// the window's, or the texture's after initRenderToTexture()
+  GLuint outputFramebuffer(int &width, int &height) const;
+  /// Texture of initRenderToTexture(), 0 while drawing to the window
+  GLuint outputTexture() const;
+
+  /// Run at the end of every RenderFrame(), owned by the renderer
+  std::vector<FrameCapture*> captures;
 
 
   void SetPipeline(Pipeline &pipeline);
+  Pipeline * pipeline() const { return currentPipe; }
+  TextureManager * textures() const { return textureManager; }
 
   void setPresetName(const std::string& theValue)
   {
@@ -90,7 +114,8 @@ private:
   RenderTarget *renderTarget;
   BeatDetect *beatDetect;
   TextureManager *textureManager;
-  static Pipeline* currentPipe;
+  bool ownTextures;
+  Pipeline* currentPipe;
   RenderContext renderContext;
   //per pixel equation variables
 #ifdef USE_CG
@@ -98,6 +123,8 @@ private:
 #endif
   std::string m_presetName;
 
+  GpuTimer gpuTimer;
+
   float* p;
 
 
@@ -123,10 +150,21 @@ private:
   void Pass2 (const Pipeline &pipeline, const PipelineContext &pipelineContext);
   void CompositeOutput(const Pipeline &pipeline, const PipelineContext &pipelineContext);
 
-  inline static Point PerPixel(Point p, PerPixelContext &context)
+  /// Runs the per pixel equations of one pipeline over the mesh. Carries the
+  /// pipeline itself so renderers on different threads never share it
+  class PerPixel
   {
-	  return currentPipe->PerPixel(p,context);
-  }
+  public:
+	  PerPixel(Pipeline *pipeline) : pipeline(pipeline) {}
+
+	  inline Point operator()(Point p, PerPixelContext &context) const
+	  {
+		  return pipeline->PerPixel(p,context);
+	  }
+
+  private:
+	  Pipeline *pipeline;
+  };
 
   void rescale_per_pixel_matrices();
 
@@ -12,17 +12,36 @@
 ShaderEngine::ShaderEngine()
 {
 #ifdef USE_CG
+    noise = 0;
+    noise_textures_loaded = false;
+    blurLevels = 3;
+#ifdef USE_THREADS
+    noise_thread_running = false;
+#endif
     SetupCg();
 #endif
 }
 
 ShaderEngine::~ShaderEngine()
 {
-    // TODO Auto-generated destructor stub
+#ifdef USE_CG
+#ifdef USE_THREADS
+    if (noise_thread_running)
+        pthread_join(noise_thread, (void **) &noise);
+#endif
+    delete noise;
+#endif
 }
 
 #ifdef USE_CG
 
+#ifdef USE_THREADS
+static void *generate_noise(void *)
+{
+    return new PerlinNoise();
+}
+#endif
+
 void ShaderEngine::setParams(const int texsize, const unsigned int texId, const float aspect, BeatDetect *beatDetect,
                              TextureManager *textureManager)
 {
@@ -62,13 +81,37 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
     blur2_enabled = false;
     blur3_enabled = false;
 
-    //std::cout << "Generating Noise Textures" << std::endl;
+    /* (re)upload the noise textures the next time a shader needs them */
+    noise_textures_loaded = false;
+
+#ifdef USE_THREADS
+    if (noise == 0 && !noise_thread_running) {
+        if (pthread_create(&noise_thread, NULL, generate_noise, NULL) == 0)
+            noise_thread_running = true;
+        else
+            std::cerr << "[ShaderEngine] failed to start noise thread, generating noise on first use" << std::endl;
+    }
+#endif
+}
+
+void ShaderEngine::LoadNoiseTextures()
+{
+    if (noise_textures_loaded)
+        return;
+
+#ifdef USE_THREADS
+    if (noise_thread_running) {
+        pthread_join(noise_thread, (void **) &noise);
+        noise_thread_running = false;
+    }
+#endif
 
-    PerlinNoise noise;
+    if (noise == 0)
+        noise = new PerlinNoise();
 
     glGenTextures(1, &noise_texture_lq_lite);
     glBindTexture(GL_TEXTURE_2D, noise_texture_lq_lite);
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, 32, 32, 0, GL_LUMINANCE, GL_FLOAT, noise.noise_lq_lite);
+    glTexImage2D(GL_TEXTURE_2D, 0, 4, 32, 32, 0, GL_LUMINANCE, GL_FLOAT, noise->noise_lq_lite);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -77,7 +120,7 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
 
     glGenTextures(1, &noise_texture_lq);
     glBindTexture(GL_TEXTURE_2D, noise_texture_lq);
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, 256, 256, 0, GL_LUMINANCE, GL_FLOAT, noise.noise_lq);
+    glTexImage2D(GL_TEXTURE_2D, 0, 4, 256, 256, 0, GL_LUMINANCE, GL_FLOAT, noise->noise_lq);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -86,7 +129,7 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
 
     glGenTextures(1, &noise_texture_mq);
     glBindTexture(GL_TEXTURE_2D, noise_texture_mq);
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, 256, 256, 0, GL_LUMINANCE, GL_FLOAT, noise.noise_mq);
+    glTexImage2D(GL_TEXTURE_2D, 0, 4, 256, 256, 0, GL_LUMINANCE, GL_FLOAT, noise->noise_mq);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -95,7 +138,7 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
 
     glGenTextures(1, &noise_texture_hq);
     glBindTexture(GL_TEXTURE_2D, noise_texture_hq);
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, 256, 256, 0, GL_LUMINANCE, GL_FLOAT, noise.noise_hq);
+    glTexImage2D(GL_TEXTURE_2D, 0, 4, 256, 256, 0, GL_LUMINANCE, GL_FLOAT, noise->noise_hq);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -104,7 +147,7 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
 
     glGenTextures(1, &noise_texture_perlin);
     glBindTexture(GL_TEXTURE_2D, noise_texture_perlin);
-    glTexImage2D(GL_TEXTURE_2D, 0, 4, 512, 512, 0, GL_LUMINANCE, GL_FLOAT, noise.noise_perlin);
+    glTexImage2D(GL_TEXTURE_2D, 0, 4, 512, 512, 0, GL_LUMINANCE, GL_FLOAT, noise->noise_perlin);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -114,7 +157,7 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
     /*
      glGenTextures( 1, &noise_texture_lq_vol );
      glBindTexture( GL_TEXTURE_3D, noise_texture_lq_vol );
-     glTexImage3D(GL_TEXTURE_3D,0,4,32,32,32,0,GL_LUMINANCE,GL_FLOAT,noise.noise_lq_vol);
+     glTexImage3D(GL_TEXTURE_3D,0,4,32,32,32,0,GL_LUMINANCE,GL_FLOAT,noise->noise_lq_vol);
      glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
      glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -123,7 +166,7 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
 
      glGenTextures( 1, &noise_texture_hq_vol );
      glBindTexture( GL_TEXTURE_3D, noise_texture_hq_vol );
-     glTexImage3D(GL_TEXTURE_3D,0,4,32,32,32,0,GL_LUMINANCE,GL_FLOAT,noise.noise_hq_vol);
+     glTexImage3D(GL_TEXTURE_3D,0,4,32,32,32,0,GL_LUMINANCE,GL_FLOAT,noise->noise_hq_vol);
      glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
      glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -131,6 +174,7 @@ void ShaderEngine::setParams(const int texsize, const unsigned int texId, const
      textureManager->setTexture("noisevol_hq", noise_texture_hq_vol, 8, 8);
      */
 
+    noise_textures_loaded = true;
 }
 
 bool ShaderEngine::LoadCgProgram(Shader &shader)
@@ -161,6 +205,9 @@ bool ShaderEngine::LoadCgProgram(Shader &shader)
 
         shader.textures.clear();
 
+        if (program.find("sampler_noise") != std::string::npos)
+            LoadNoiseTextures();
+
         found = 0;
         found = program.find("sampler_", found);
         while (found != std::string::npos) {
@@ -472,10 +519,25 @@ void ShaderEngine::setAspect(float aspect)
 {
     this->aspect = aspect;
 }
+void ShaderEngine::setTextureSize(const int texsize, const unsigned int texId)
+{
+    mainTextureId = texId;
+    this->texsize = texsize;
+
+    textureManager->setTexture("main", texId, texsize, texsize);
+
+    glBindTexture(GL_TEXTURE_2D, blur1_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texsize/2, texsize/2, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+    glBindTexture(GL_TEXTURE_2D, blur2_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texsize / 4, texsize / 4, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+    glBindTexture(GL_TEXTURE_2D, blur3_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texsize / 8, texsize / 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+}
+
 void ShaderEngine::RenderBlurTextures(const Pipeline &pipeline, const PipelineContext &pipelineContext,
                                       const int texsize)
 {
-    if (blur1_enabled || blur2_enabled || blur3_enabled) {
+    if ((blur1_enabled || blur2_enabled || blur3_enabled) && blurLevels > 0) {
         float tex[4][2] = {
             { 0, 1 },
             { 0, 0 },
@@ -532,7 +594,7 @@ void ShaderEngine::RenderBlurTextures(const Pipeline &pipeline, const PipelineCo
 
         }
 
-        if (blur2_enabled) {
+        if (blur2_enabled && blurLevels > 1) {
             cgGLSetParameter4f(cgGetNamedParameter(blur1Program, "srctexsize"), texsize/2, texsize/2, 2 / (float) texsize,
                                2 / (float) texsize);
             cgGLSetParameter4f(cgGetNamedParameter(blur2Program, "srctexsize"), texsize/2, texsize/2, 2 / (float) texsize,
@@ -559,7 +621,7 @@ void ShaderEngine::RenderBlurTextures(const Pipeline &pipeline, const PipelineCo
 
         }
 
-        if (blur3_enabled) {
+        if (blur3_enabled && blurLevels > 2) {
             cgGLSetParameter4f(cgGetNamedParameter(blur2Program, "srctexsize"), texsize/4, texsize/4, 4 / (float) texsize,
                                4/ (float) texsize);
             cgGLSetParameter4f(cgGetNamedParameter(blur2Program, "srctexsize"), texsize / 4, texsize / 4, 4
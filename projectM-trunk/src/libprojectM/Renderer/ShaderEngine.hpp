@@ -29,9 +29,14 @@
 #endif
 
 
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
 #include "Pipeline.hpp"
 #include "PipelineContext.hpp"
 class ShaderEngine;
+class PerlinNoise;
 #include "TextureManager.hpp"
 
 #include <cstdlib>
@@ -57,9 +62,20 @@ class ShaderEngine
   GLuint noise_texture_lq_vol;
   GLuint noise_texture_hq_vol;
 
+  /* Noise tables are computed in the background at startup and only
+   * uploaded once a shader samples them */
+  PerlinNoise *noise;
+  bool noise_textures_loaded;
+#ifdef USE_THREADS
+  pthread_t noise_thread;
+  bool noise_thread_running;
+#endif
+
   bool blur1_enabled;
   bool blur2_enabled;
   bool blur3_enabled;
+  /// Blur passes rendered at most, the shaders sample stale blur textures above
+  int blurLevels;
   GLuint blur1_tex;
   GLuint blur2_tex;
   GLuint blur3_tex;
@@ -89,6 +105,8 @@ class ShaderEngine
  void SetupUserTexture(CGprogram program, const UserTexture* texture);
  void SetupUserTextureState(const UserTexture* texture);
 
+ void LoadNoiseTextures();
+
 
 
 #endif
@@ -104,6 +122,9 @@ public:
 	void disableShader();
 	void reset();
 	void setAspect(float aspect);
+	/// Resizes the blur textures for a new main texture
+	void setTextureSize(const int texsize, const unsigned int texId);
+	inline void setBlurLevels(int levels) { blurLevels = levels; }
     std::string profileName;
 
 #endif
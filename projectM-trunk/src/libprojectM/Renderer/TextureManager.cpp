@@ -12,6 +12,10 @@
 #include <IL/ilut.h>
 #else
 #include "SOIL/SOIL.h"
+#include "SOIL/image_helper.h"
+extern "C" {
+#include "SOIL/image_DXT.h"
+}
 #endif
 
 #ifdef WIN32
@@ -29,9 +33,134 @@
 #include "Common.hpp"
 #include "IdleTextures.hpp"
 
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#ifndef GL_TEXTURE_COMPRESSED_IMAGE_SIZE
+#define GL_TEXTURE_COMPRESSED_IMAGE_SIZE 0x86A0
+#endif
+
+/* Formats and types of uncompressed KTX levels, not all GL headers have them */
+#ifndef GL_RED
+#define GL_RED 0x1903
+#endif
+#ifndef GL_UNSIGNED_INT
+#define GL_UNSIGNED_INT 0x1405
+#endif
+#ifndef GL_INT
+#define GL_INT 0x1404
+#endif
+#ifndef GL_BGR
+#define GL_BGR 0x80E0
+#endif
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+#ifndef GL_RG
+#define GL_RG 0x8227
+#endif
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+#ifndef GL_UNSIGNED_SHORT_5_6_5
+#define GL_UNSIGNED_SHORT_5_6_5 0x8363
+#endif
+#ifndef GL_UNSIGNED_SHORT_4_4_4_4
+#define GL_UNSIGNED_SHORT_4_4_4_4 0x8033
+#endif
+#ifndef GL_UNSIGNED_SHORT_5_5_5_1
+#define GL_UNSIGNED_SHORT_5_5_5_1 0x8034
+#endif
+#ifndef GL_UNSIGNED_INT_8_8_8_8
+#define GL_UNSIGNED_INT_8_8_8_8 0x8035
+#endif
+#ifndef GL_UNSIGNED_INT_8_8_8_8_REV
+#define GL_UNSIGNED_INT_8_8_8_8_REV 0x8367
+#endif
+#ifndef GL_UNSIGNED_INT_2_10_10_10_REV
+#define GL_UNSIGNED_INT_2_10_10_10_REV 0x8368
+#endif
+
+#ifndef USE_DEVIL
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+/// The idle textures are compiled in as TGA files. They are decoded once per process
+/// and the pixels kept around, so Preload() after a texture reset is just an upload.
+struct IdleImage
+{
+    const unsigned char *bytes;
+    int length;
+    unsigned char *pixels;
+    int width;
+    int height;
+    int channels;
+};
+
+static IdleImage idle_M = { M_data, M_bytes, 0, 0, 0, 0 };
+static IdleImage idle_project = { project_data, project_bytes, 0, 0, 0, 0 };
+static IdleImage idle_headphones = { headphones_data, headphones_bytes, 0, 0, 0, 0 };
+
+#ifdef USE_THREADS
+/// Several projectM instances may preload their textures at the same time
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned int uploadIdleImage(IdleImage & image, unsigned int & bytes)
+{
+#ifdef USE_THREADS
+    pthread_mutex_lock(&idle_mutex);
+#endif
+    if (image.pixels == 0)
+        image.pixels = SOIL_load_image_from_memory(image.bytes, image.length,
+                       &image.width, &image.height, &image.channels, SOIL_LOAD_AUTO);
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&idle_mutex);
+#endif
+
+    if (image.pixels == 0)
+        return 0;
+
+    bytes = image.width * image.height * 4;
+
+    return SOIL_create_OGL_texture(image.pixels, image.width, image.height, image.channels,
+                                   SOIL_CREATE_NEW_ID,
+                                   SOIL_FLAG_POWER_OF_TWO
+                                   |  SOIL_FLAG_MULTIPLY_ALPHA);
+}
+#endif
+
+/// Returns the image path with its extension replaced, or an empty string if it has none.
+static std::string replaceExtension(const std::string & imageURL, const std::string & extension)
+{
+    const std::size_t dot = imageURL.find_last_of('.');
+    const std::size_t slash = imageURL.find_last_of(PATH_SEPARATOR);
+
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return "";
+
+    return imageURL.substr(0, dot + 1) + extension;
+}
+
+static bool fileExists(const std::string & path)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    return file.good();
+}
+
+static bool isCompressed(const std::string & imageURL)
+{
+    const std::string extension = parseExtension(imageURL);
+    return strcasecmp(extension.c_str(), "dds") == 0 || strcasecmp(extension.c_str(), "ktx") == 0;
+}
+
 
 
-TextureManager::TextureManager(const std::string _presetURL): presetURL(_presetURL)
+TextureManager::TextureManager(const std::string _presetURL): presetURL(_presetURL), textureDirLoaded(false)
 {
 #ifdef USE_DEVIL
     ilInit();
@@ -40,8 +169,9 @@ TextureManager::TextureManager(const std::string _presetURL): presetURL(_presetU
     ilutRenderer(ILUT_OPENGL);
 #endif
 
+    /* The texture directory is only loaded once a preset asks for a texture
+     * we don't have, most presets never do */
     Preload();
-    loadTextureDir();
 }
 
 TextureManager::~TextureManager()
@@ -59,16 +189,9 @@ void TextureManager::Preload()
     ilLoadL(IL_TYPE_UNKNOWN,(ILvoid*) M_data, M_bytes);
     GLuint tex = ilutGLBindTexImage();
 #else
-    unsigned int tex = SOIL_load_OGL_texture_from_memory(
-                           M_data,
-                           M_bytes,
-                           SOIL_LOAD_AUTO,
-                           SOIL_CREATE_NEW_ID,
-
-                           SOIL_FLAG_POWER_OF_TWO
-                           |  SOIL_FLAG_MULTIPLY_ALPHA
-                           // |  SOIL_FLAG_COMPRESS_TO_DXT
-                       );
+    unsigned int bytes = 0;
+    unsigned int tex = uploadIdleImage(idle_M, bytes);
+    sizes["M.tga"]=bytes;
 #endif
 
     textures["M.tga"]=tex;
@@ -77,16 +200,8 @@ void TextureManager::Preload()
     ilLoadL(IL_TYPE_UNKNOWN,(ILvoid*) project_data,project_bytes);
     tex = ilutGLBindTexImage();
 #else
-    tex = SOIL_load_OGL_texture_from_memory(
-              project_data,
-              project_bytes,
-              SOIL_LOAD_AUTO,
-              SOIL_CREATE_NEW_ID,
-
-              SOIL_FLAG_POWER_OF_TWO
-              |  SOIL_FLAG_MULTIPLY_ALPHA
-              //|  SOIL_FLAG_COMPRESS_TO_DXT
-          );
+    tex = uploadIdleImage(idle_project, bytes);
+    sizes["project.tga"]=bytes;
 #endif
 
     textures["project.tga"]=tex;
@@ -95,16 +210,8 @@ void TextureManager::Preload()
     ilLoadL(IL_TYPE_UNKNOWN,(ILvoid*) headphones_data, headphones_bytes);
     tex = ilutGLBindTexImage();
 #else
-    tex = SOIL_load_OGL_texture_from_memory(
-              headphones_data,
-              headphones_bytes,
-              SOIL_LOAD_AUTO,
-              SOIL_CREATE_NEW_ID,
-
-              SOIL_FLAG_POWER_OF_TWO
-              |  SOIL_FLAG_MULTIPLY_ALPHA
-              // |  SOIL_FLAG_COMPRESS_TO_DXT
-          );
+    tex = uploadIdleImage(idle_headphones, bytes);
+    sizes["headphones.tga"]=bytes;
 #endif
 
     textures["headphones.tga"]=tex;
@@ -118,6 +225,12 @@ void TextureManager::Clear()
         glDeleteTextures(1,&iter->second);
     }
     textures.clear();
+    sizes.clear();
+    refusedCompressed.clear();
+
+    user_textures.clear();
+    user_texture_names.clear();
+    textureDirLoaded = false;
 }
 
 void TextureManager::setTexture(const std::string name, const unsigned int texId, const int width, const int height)
@@ -125,6 +238,7 @@ void TextureManager::setTexture(const std::string name, const unsigned int texId
     textures[name] = texId;
     widths[name] = width;
     heights[name] = height;
+    sizes[name] = width * height * 4;
 }
 
 //void TextureManager::unloadTextures(const PresetOutputs::cshape_container &shapes)
@@ -160,37 +274,384 @@ GLuint TextureManager::getTexture(const std::string filename)
 GLuint TextureManager::getTextureFullpath(const std::string filename, const std::string imageURL)
 {
 
+    if (textures.find(filename) == textures.end() && !textureDirLoaded)
+        loadTextureDir();
+
     if (textures.find(filename)!= textures.end()) {
         return textures[filename];
     } else {
 
-#ifdef USE_DEVIL
-        GLuint tex = ilutGLLoadImage((char *)imageURL.c_str());
-#else
-        int width, height;
-
-        unsigned int tex = SOIL_load_OGL_texture_size(
-                               imageURL.c_str(),
-                               SOIL_LOAD_AUTO,
-                               SOIL_CREATE_NEW_ID,
+        int width = 0, height = 0;
+        unsigned int bytes = 0;
 
-                               //SOIL_FLAG_POWER_OF_TWO
-                               //  SOIL_FLAG_MIPMAPS
-                               SOIL_FLAG_MULTIPLY_ALPHA
-                               //|  SOIL_FLAG_COMPRESS_TO_DXT
-                               //| SOIL_FLAG_DDS_LOAD_DIRECT
-                               ,&width,&height);
+        /* Precompressed textures go straight to the GPU with their own mipmaps */
+        GLuint tex = loadCompressedTexture(imageURL, width, height, bytes);
 
+        /* SOIL can't decode a .dds or .ktx the GPU refused, don't read it again */
+        if (tex == 0 && !isCompressed(imageURL)) {
+#ifdef USE_DEVIL
+            tex = ilutGLLoadImage((char *)imageURL.c_str());
+#else
+            tex = SOIL_load_OGL_texture_size(
+                      imageURL.c_str(),
+                      SOIL_LOAD_AUTO,
+                      SOIL_CREATE_NEW_ID,
+
+                      //SOIL_FLAG_POWER_OF_TWO
+                      //  SOIL_FLAG_MIPMAPS
+                      SOIL_FLAG_MULTIPLY_ALPHA
+                      //|  SOIL_FLAG_COMPRESS_TO_DXT
+                      ,&width,&height);
+            bytes = width * height * 4;
 #endif
+        }
+
         textures[filename]=tex;
         widths[filename]=width;
         heights[filename]=height;
+        sizes[filename]=bytes;
         return tex;
 
 
     }
 }
 
+/// Tries, in order, the image itself if it is a .dds or .ktx file, then a .dds and a .ktx
+/// with the same name next to it. Returns 0 if there is nothing the GPU can take as is.
+unsigned int TextureManager::loadCompressedTexture(const std::string & imageURL, int & width, int & height, unsigned int & bytes)
+{
+    std::vector<std::string> candidates;
+
+    if (isCompressed(imageURL))
+        candidates.push_back(imageURL);
+
+    const std::string ddsURL = replaceExtension(imageURL, "dds");
+    const std::string ktxURL = replaceExtension(imageURL, "ktx");
+    if (ddsURL != "" && ddsURL != imageURL)
+        candidates.push_back(ddsURL);
+    if (ktxURL != "" && ktxURL != imageURL)
+        candidates.push_back(ktxURL);
+
+    for (std::vector<std::string>::const_iterator pos = candidates.begin(); pos != candidates.end(); ++pos) {
+
+        /* A file the driver refused once is refused again, the texture directory
+         * and the images next to it lead to the same files more than once */
+        if (refusedCompressed.count(*pos) || !fileExists(*pos))
+            continue;
+
+        const std::string extension = parseExtension(*pos);
+        unsigned int tex;
+        if (strcasecmp(extension.c_str(), "dds") == 0)
+            tex = loadDDS(*pos, width, height, bytes);
+        else
+            tex = loadKTX(*pos, width, height, bytes);
+
+        if (tex != 0)
+            return tex;
+        refusedCompressed.insert(*pos);
+    }
+
+    return 0;
+}
+
+unsigned int TextureManager::loadDDS(const std::string & imageURL, int & width, int & height, unsigned int & bytes)
+{
+#ifdef USE_DEVIL
+    return 0;
+#else
+    /* SOIL uploads the DDS as is or not at all: its fallback decodes the file like
+     * any other image, and the DDS decoder is compiled out (STBI_NO_DDS) */
+    unsigned int tex = SOIL_load_OGL_texture_size(
+                           imageURL.c_str(),
+                           SOIL_LOAD_AUTO,
+                           SOIL_CREATE_NEW_ID,
+                           SOIL_FLAG_MULTIPLY_ALPHA
+                           | SOIL_FLAG_DDS_LOAD_DIRECT
+                           ,&width,&height);
+
+    if (tex == 0)
+        return 0;
+
+#ifndef USE_GLES1
+    /* the direct path does not report the size, ask the driver */
+    GLint w = 0, h = 0, compressed = GL_FALSE, size = 0;
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    if (compressed == GL_TRUE)
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    width = w;
+    height = h;
+    bytes = size > 0 ? size : w * h * 4;
+#else
+    bytes = width * height * 4;
+#endif
+
+    return tex;
+#endif
+}
+
+static inline unsigned int swapBytes(unsigned int value)
+{
+    return ((value & 0xff) << 24) | ((value & 0xff00) << 8) |
+           ((value >> 8) & 0xff00) | ((value >> 24) & 0xff);
+}
+
+/// Bytes per texel of an uncompressed level, 0 for formats and types this
+/// loader does not know
+static unsigned int ktxTexelBytes(unsigned int format, unsigned int type)
+{
+    switch (type) {
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+        return 2;
+    case GL_UNSIGNED_INT_8_8_8_8:
+    case GL_UNSIGNED_INT_8_8_8_8_REV:
+    case GL_UNSIGNED_INT_2_10_10_10_REV:
+        return 4;
+    }
+
+    unsigned int component;
+    switch (type) {
+    case GL_UNSIGNED_BYTE: case GL_BYTE: component = 1; break;
+    case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: component = 2; break;
+    case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: component = 4; break;
+    default: return 0;
+    }
+
+    switch (format) {
+    case GL_ALPHA: case GL_LUMINANCE: case GL_RED: return component;
+    case GL_LUMINANCE_ALPHA: case GL_RG: return component * 2;
+    case GL_RGB: case GL_BGR: return component * 3;
+    case GL_RGBA: case GL_BGRA: return component * 4;
+    }
+    return 0;
+}
+
+/// Loads a 2D KTX 1.1 file (single face, no array), uploading every mip level it
+/// contains. glType == 0 marks compressed formats (DXT, ETC1/ETC2, ...); whether
+/// those are accepted is up to the driver, a refused upload makes this return 0.
+/// Uncompressed levels have to hold every row, each padded to 4 bytes; a level
+/// that comes short ends the texture before it.
+unsigned int TextureManager::loadKTX(const std::string & imageURL, int & width, int & height, unsigned int & bytes)
+{
+    static const unsigned char identifier[12] = {
+        0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+    };
+
+    enum {
+        KTX_ENDIANNESS, KTX_GL_TYPE, KTX_GL_TYPE_SIZE, KTX_GL_FORMAT, KTX_GL_INTERNAL_FORMAT,
+        KTX_GL_BASE_INTERNAL_FORMAT, KTX_WIDTH, KTX_HEIGHT, KTX_DEPTH, KTX_ARRAY_ELEMENTS,
+        KTX_FACES, KTX_MIPMAP_LEVELS, KTX_KEY_VALUE_BYTES, KTX_HEADER_FIELDS
+    };
+
+    std::ifstream file(imageURL.c_str(), std::ios::in | std::ios::binary);
+    if (!file.good())
+        return 0;
+
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const std::size_t headerSize = sizeof(identifier) + KTX_HEADER_FIELDS * 4;
+
+    if (data.size() < headerSize || memcmp(&data[0], identifier, sizeof(identifier)) != 0) {
+        std::cerr << "[TextureManager] " << imageURL << " is not a KTX file" << std::endl;
+        return 0;
+    }
+
+    unsigned int header[KTX_HEADER_FIELDS];
+    memcpy(header, &data[sizeof(identifier)], sizeof(header));
+
+    if (header[KTX_ENDIANNESS] != 0x04030201 && header[KTX_ENDIANNESS] != 0x01020304) {
+        std::cerr << "[TextureManager] " << imageURL << ": bad KTX endianness" << std::endl;
+        return 0;
+    }
+
+    const bool swap = header[KTX_ENDIANNESS] == 0x01020304;
+    if (swap)
+        for (int i = 0; i < KTX_HEADER_FIELDS; i++)
+            header[i] = swapBytes(header[i]);
+
+    if (header[KTX_DEPTH] > 1 || header[KTX_ARRAY_ELEMENTS] > 0 || header[KTX_FACES] != 1) {
+        std::cerr << "[TextureManager] " << imageURL << ": only plain 2D KTX textures are supported" << std::endl;
+        return 0;
+    }
+
+    const bool compressed = header[KTX_GL_TYPE] == 0;
+    const unsigned int levels = header[KTX_MIPMAP_LEVELS] == 0 ? 1 : header[KTX_MIPMAP_LEVELS];
+    const unsigned int texelBytes = compressed ? 0 : ktxTexelBytes(header[KTX_GL_FORMAT], header[KTX_GL_TYPE]);
+
+    if (!compressed && texelBytes == 0) {
+        std::cerr << "[TextureManager] " << imageURL << ": format 0x" << std::hex << header[KTX_GL_FORMAT]
+                  << " type 0x" << header[KTX_GL_TYPE] << std::dec << " not supported" << std::endl;
+        return 0;
+    }
+
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    /* flush stale errors so the upload check below only sees ours */
+    while (glGetError() != GL_NO_ERROR) {}
+
+    std::size_t offset = headerSize + header[KTX_KEY_VALUE_BYTES];
+    unsigned int level;
+    bool truncated = false;
+    bytes = 0;
+
+    for (level = 0; level < levels; level++) {
+        if (offset + 4 > data.size()) {
+            truncated = true;
+            break;
+        }
+
+        unsigned int imageSize;
+        memcpy(&imageSize, &data[offset], 4);
+        if (swap)
+            imageSize = swapBytes(imageSize);
+        offset += 4;
+
+        GLsizei w = header[KTX_WIDTH] >> level;
+        GLsizei h = header[KTX_HEIGHT] >> level;
+        if (w < 1) w = 1;
+        if (h < 1) h = 1;
+
+        /* glTexImage2D reads whole rows whatever imageSize says */
+        const std::size_t levelSize = compressed ? imageSize
+                                      : (((std::size_t)w * texelBytes + 3) & ~(std::size_t)3) * h;
+        if (imageSize < levelSize || offset + levelSize > data.size()) {
+            truncated = true;
+            break;
+        }
+
+        if (compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, header[KTX_GL_INTERNAL_FORMAT], w, h, 0,
+                                   imageSize, &data[offset]);
+        else
+            glTexImage2D(GL_TEXTURE_2D, level, header[KTX_GL_INTERNAL_FORMAT], w, h, 0,
+                         header[KTX_GL_FORMAT], header[KTX_GL_TYPE], &data[offset]);
+
+        if (glGetError() != GL_NO_ERROR)
+            break;
+
+        bytes += imageSize;
+        offset += (imageSize + 3) & ~3u;
+    }
+
+    if (level == 0) {
+        if (truncated)
+            std::cerr << "[TextureManager] " << imageURL << " is truncated" << std::endl;
+        else
+            std::cerr << "[TextureManager] " << imageURL << ": format 0x" << std::hex
+                      << header[KTX_GL_INTERNAL_FORMAT] << std::dec << " rejected by the driver" << std::endl;
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDeleteTextures(1, &tex);
+        return 0;
+    }
+
+#ifndef USE_GLES1
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+#endif
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, level > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    width = header[KTX_WIDTH];
+    height = header[KTX_HEIGHT];
+    return tex;
+}
+
+bool TextureManager::convertToDDS(const std::string & imageURL, const std::string & ddsURL)
+{
+#ifdef USE_DEVIL
+    return false;
+#else
+    int width, height, channels;
+    unsigned char *pixels = SOIL_load_image(imageURL.c_str(), &width, &height, &channels, SOIL_LOAD_AUTO);
+
+    if (pixels == 0) {
+        std::cerr << "[TextureManager] could not decode " << imageURL << ": " << SOIL_last_result() << std::endl;
+        return false;
+    }
+
+    /* The DDS is uploaded as is, premultiply here what SOIL_FLAG_MULTIPLY_ALPHA
+     * premultiplies for the image itself */
+    if (channels == 2 || channels == 4)
+        for (int i = 0; i < width * height * channels; i += channels)
+            for (int c = 0; c < channels - 1; c++)
+                pixels[i + c] = (pixels[i + c] * pixels[i + channels - 1] + 128) >> 8;
+
+    /* SOIL reads the mip levels of a DDS assuming each halves the one before,
+     * which only holds for power of two sizes, the others get a single level */
+    int levels = 1;
+    if ((width & (width - 1)) == 0 && (height & (height - 1)) == 0)
+        while ((1 << levels) <= width || (1 << levels) <= height)
+            levels++;
+
+    /* DXT1 for opaque images, DXT5 when there is alpha */
+    const bool alpha = (channels & 1) == 0;
+
+    DDS_header header;
+    memset(&header, 0, sizeof(header));
+    header.dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+    header.dwSize = 124;
+    header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+    header.dwWidth = width;
+    header.dwHeight = height;
+    header.sPixelFormat.dwSize = 32;
+    header.sPixelFormat.dwFlags = DDPF_FOURCC;
+    header.sPixelFormat.dwFourCC = ('D' << 0) | ('X' << 8) | ('T' << 16) | ((alpha ? '5' : '1') << 24);
+    header.sCaps.dwCaps1 = DDSCAPS_TEXTURE;
+    if (levels > 1) {
+        header.dwFlags |= DDSD_MIPMAPCOUNT;
+        header.dwMipMapCount = levels;
+        header.sCaps.dwCaps1 |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+    }
+
+    std::vector<unsigned char> mip(width * height * channels);
+    std::vector<unsigned char> data;
+
+    for (int level = 0; level < levels; level++) {
+        int w = width >> level, h = height >> level;
+        if (w < 1) w = 1;
+        if (h < 1) h = 1;
+
+        /* every level is averaged down from the full image, like SOIL_FLAG_MIPMAPS */
+        const unsigned char *image = pixels;
+        if (level > 0) {
+            mipmap_image(pixels, width, height, channels, &mip[0], 1 << level, 1 << level);
+            image = &mip[0];
+        }
+
+        int size = 0;
+        unsigned char *compressed = alpha ? convert_image_to_DXT5(image, w, h, channels, &size)
+                                          : convert_image_to_DXT1(image, w, h, channels, &size);
+        if (compressed == 0)
+            break;
+        if (level == 0)
+            header.dwPitchOrLinearSize = size;
+        data.insert(data.end(), compressed, compressed + size);
+        free(compressed);
+    }
+    SOIL_free_image_data(pixels);
+
+    std::ofstream file(ddsURL.c_str(), std::ios::out | std::ios::binary);
+    file.write((const char *)&header, sizeof(header));
+    if (!data.empty())
+        file.write((const char *)&data[0], data.size());
+
+    if (data.empty() || !file.good()) {
+        std::cerr << "[TextureManager] could not write " << ddsURL << std::endl;
+        return false;
+    }
+    return true;
+#endif
+}
+
 int TextureManager::getTextureWidth(const std::string imageURL)
 {
     return widths[imageURL];
@@ -203,13 +664,18 @@ int TextureManager::getTextureHeight(const std::string imageURL)
 
 unsigned int TextureManager::getTextureMemorySize()
 {
-    return 0;
+    unsigned int total = 0;
+    for (std::map<std::string, unsigned int>::const_iterator pos = sizes.begin(); pos != sizes.end(); ++pos)
+        total += pos->second;
+    return total;
 }
 
 void TextureManager::loadTextureDir()
 {
     std::string dirname = CMAKE_INSTALL_PREFIX "/share/projectM/textures";
 
+    textureDirLoaded = true;
+
     DIR * m_dir;
 
     // Allocate a new a stream given the current directory name
@@ -219,6 +685,9 @@ void TextureManager::loadTextureDir()
     }
 
     struct dirent * dir_entry;
+    std::vector<std::string> filenames;
+    std::set<std::string> sourceStems;
+    std::set<std::string> ddsStems;
 
     while ((dir_entry = readdir(m_dir)) != NULL) {
 
@@ -228,6 +697,30 @@ void TextureManager::loadTextureDir()
         if (filename.length() > 0 && filename[0] == '.')
             continue;
 
+        filenames.push_back(filename);
+
+        const std::string extension = parseExtension(filename);
+        const std::string stem = filename.substr(0, filename.find_last_of('.'));
+        if (strcasecmp(extension.c_str(), "dds") == 0)
+            ddsStems.insert(stem);
+        else if (strcasecmp(extension.c_str(), "ktx") != 0)
+            sourceStems.insert(stem);
+    }
+
+    for (std::vector<std::string>::const_iterator pos = filenames.begin(); pos != filenames.end(); ++pos) {
+
+        const std::string & filename = *pos;
+        const std::string extension = parseExtension(filename);
+        const std::string stem = filename.substr(0, filename.find_last_of('.'));
+
+        // A .dds/.ktx converted from another image in this directory is picked up
+        // when that image is loaded, and a .ktx next to a .dds when the .dds is,
+        // don't register them a second time
+        if (strcasecmp(extension.c_str(), "dds") == 0 && sourceStems.count(stem))
+            continue;
+        if (strcasecmp(extension.c_str(), "ktx") == 0 && (sourceStems.count(stem) || ddsStems.count(stem)))
+            continue;
+
         // Create full path name
         std::string fullname = dirname + PATH_SEPARATOR + filename;
 
@@ -248,6 +741,9 @@ void TextureManager::loadTextureDir()
 
 std::string TextureManager::getRandomTextureName(std::string random_id)
 {
+    if (!textureDirLoaded)
+        loadTextureDir();
+
     if (user_texture_names.size() > 0) {
         std::string random_name = user_texture_names[rand() % user_texture_names.size()];
         random_textures.push_back(random_id);
@@ -260,6 +756,7 @@ void TextureManager::clearRandomTextures()
 {
     for (std::vector<std::string>::iterator pos = random_textures.begin(); pos	!= random_textures.end(); ++pos) {
         textures.erase(*pos);
+        sizes.erase(*pos);
         widths.erase(*pos);
         heights.erase(*pos);
     }
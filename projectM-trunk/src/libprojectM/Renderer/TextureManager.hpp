@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <set>
 #include <vector>
 
 class TextureManager
@@ -12,9 +13,13 @@ class TextureManager
   std::map<std::string,unsigned int> textures;
   std::map<std::string,unsigned int> heights;
   std::map<std::string,unsigned int> widths;
+  std::map<std::string,unsigned int> sizes;
   std::vector<unsigned int> user_textures;
   std::vector<std::string> user_texture_names;
   std::vector<std::string> random_textures;
+  /// .dds and .ktx files the driver did not take
+  std::set<std::string> refusedCompressed;
+  bool textureDirLoaded;
 public:
   ~TextureManager();
   TextureManager(std::string _presetURL);
@@ -30,6 +35,18 @@ public:
   void loadTextureDir();
   std::string getRandomTextureName(std::string rand_name);
   void clearRandomTextures();
+
+  /// Decodes an image on the CPU and writes it back out as a DXT compressed DDS file,
+  /// alpha premultiplied like the image itself is uploaded, with mip levels if its
+  /// sizes are powers of two.
+  /// Run this offline over a texture directory, projectM-dds does; getTextureFullpath()
+  /// will then pick up the .dds next to the original image and upload it without decoding.
+  static bool convertToDDS(const std::string & imageURL, const std::string & ddsURL);
+
+private:
+  unsigned int loadCompressedTexture(const std::string & imageURL, int & width, int & height, unsigned int & bytes);
+  unsigned int loadDDS(const std::string & imageURL, int & width, int & height, unsigned int & bytes);
+  unsigned int loadKTX(const std::string & imageURL, int & width, int & height, unsigned int & bytes);
 };
 
 #endif
@@ -26,6 +26,7 @@ public:
 	Orientation orientation;
 
 	void Draw(RenderContext &context);
+	RenderItem * snapshot(BeatDetect *music) { return new VideoEcho(*this); }
 };
 
 #endif /* VIDEOECHO_HPP_ */
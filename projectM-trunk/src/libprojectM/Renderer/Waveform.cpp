@@ -37,26 +37,38 @@ Waveform::Waveform(int samples)
     sep = 0;
 
 }
-void Waveform::Draw(RenderContext &context)
-{
-
-    //if (samples > 2048) samples = 2048;
 
+/// A waveform whose points were evaluated already
+class FixedWaveform : public Waveform
+{
+public:
+    FixedWaveform(const Waveform &wave) : Waveform(wave) {}
 
-    if (additive)  glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    else glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    void Draw(RenderContext &context) { drawPoints(context); }
+};
 
-    if (thick) {
-        glLineWidth(context.texsize <= 512 ? 2 : 2*context.texsize/512);
-        glPointSize(context.texsize <= 512 ? 2 : 2*context.texsize/512);
+void Waveform::Draw(RenderContext &context)
+{
+    computePoints(context.beatDetect);
+    drawPoints(context);
+}
 
-    } else glPointSize(context.texsize <= 512 ? 1 : context.texsize/512);
+RenderItem * Waveform::snapshot(BeatDetect *music)
+{
+    computePoints(music);
+    return new FixedWaveform(*this);
+}
 
+void Waveform::computePoints(BeatDetect *music)
+{
+    /* The samples can be raised after construction */
+    if ((int) points.size() < samples)
+        points.resize(samples);
 
     float *value1 = new float[samples];
     float *value2 = new float[samples];
-    context.beatDetect->pcm->getPCM( value1, samples, 0, spectrum, smoothing, 0);
-    context.beatDetect->pcm->getPCM( value2, samples, 1, spectrum, smoothing, 0);
+    music->pcm->getPCM( value1, samples, 0, spectrum, smoothing, 0);
+    music->pcm->getPCM( value2, samples, 1, spectrum, smoothing, 0);
     // printf("%f\n",pcmL[0]);
 
 
@@ -66,16 +78,40 @@ void Waveform::Draw(RenderContext &context)
     std::transform(&value1[0],&value1[samples],&value1[0],std::bind2nd(std::multiplies<float>(),mult));
     std::transform(&value2[0],&value2[samples],&value2[0],std::bind2nd(std::multiplies<float>(),mult));
 
-    WaveformContext waveContext(samples, context.beatDetect);
+    PerPoints(points, value1, value2, music);
+
+    delete[] value1;
+    delete[] value2;
+}
+
+void Waveform::PerPoints(std::vector<ColoredPoint> &points, const float *left, const float *right, BeatDetect *music)
+{
+    WaveformContext waveContext(samples, music);
 
     for(int x=0; x< samples; x++) {
         waveContext.sample = x/(float)(samples - 1);
         waveContext.sample_int = x;
-        waveContext.left = value1[x];
-        waveContext.right = value2[x];
+        waveContext.left = left[x];
+        waveContext.right = right[x];
 
         points[x] = PerPoint(points[x],waveContext);
     }
+}
+
+void Waveform::drawPoints(RenderContext &context)
+{
+
+    //if (samples > 2048) samples = 2048;
+
+
+    if (additive)  glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    else glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    if (thick) {
+        glLineWidth(context.texsize <= 512 ? 2 : 2*context.texsize/512);
+        glPointSize(context.texsize <= 512 ? 2 : 2*context.texsize/512);
+
+    } else glPointSize(context.texsize <= 512 ? 1 : context.texsize/512);
 
     floatQuad *colors = new float[samples][4];
     floatPair *p = new float[samples][2];
@@ -111,8 +147,6 @@ void Waveform::Draw(RenderContext &context)
 
     delete[] colors;
     delete[] p;
-    delete[] value1;
-    delete[] value2;
 
 }
 
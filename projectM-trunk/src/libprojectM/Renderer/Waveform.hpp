@@ -54,9 +54,20 @@ public:
 
     Waveform(int samples);
     void Draw(RenderContext &context);
+    /// Evaluates the points now, the copy draws them without evaluating again
+    RenderItem * snapshot(BeatDetect *music);
+
+protected:
+    /// Runs PerPoints over the current PCM data
+    void computePoints(BeatDetect *music);
+    void drawPoints(RenderContext &context);
+
+    /// Computes all points from the scaled PCM data of both channels. Calls
+    /// PerPoint for one point after the other unless overridden
+    virtual void PerPoints(std::vector<ColoredPoint> &points, const float *left, const float *right, BeatDetect *music);
 
 private:
-	virtual ColoredPoint PerPoint(ColoredPoint p, const WaveformContext context)=0;
+	virtual ColoredPoint PerPoint(ColoredPoint p, const WaveformContext context) { return p; }
 	std::vector<ColoredPoint> points;
 	std::vector<float> pointContext;
 
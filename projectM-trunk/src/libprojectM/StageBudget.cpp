@@ -0,0 +1,38 @@
+/*
+ * StageBudget.cpp
+ *
+ *  Time budgets of the stages evaluating a preset.
+ */
+
+#include "StageBudget.hpp"
+
+StageBudget::StageBudget() : actions(REPORT)
+{
+    for (int i = 0; i < STAGE_COUNT; i++)
+        milliseconds[i] = 0;
+}
+
+bool StageBudget::enabled() const
+{
+    for (int i = 0; i < STAGE_COUNT; i++)
+        if (milliseconds[i] > 0)
+            return true;
+
+    return false;
+}
+
+const char * StageBudget::stageName(Stage stage)
+{
+    switch (stage) {
+    case PER_FRAME:
+        return "per frame";
+    case PER_PIXEL:
+        return "per pixel";
+    case WAVES:
+        return "waves";
+    case SHAPES:
+        return "shapes";
+    default:
+        return "";
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * StageBudget.hpp
+ *
+ *  Time budgets of the stages evaluating a preset, and what a preset gives
+ *  up while a stage runs over its budget. Where the QualityGovernor holds
+ *  the frame time of all presets, this catches the single preset costing
+ *  far more than any quality level makes up for: a custom wave of 2048
+ *  samples with heavy per point equations, a deep per pixel expression.
+ */
+
+#ifndef STAGEBUDGET_HPP_
+#define STAGEBUDGET_HPP_
+
+/* Custom waves over budget are halved down to this many samples at most */
+#define BUDGET_MIN_SAMPLES 32
+/* The per pixel pass over budget runs on every 2nd, 4th, ... frame, up to this */
+#define BUDGET_MAX_INTERVAL 8
+/* Frames in a row a preset has some stage over budget before it is switched from */
+#define BUDGET_STRIKES 30
+/* Frames after giving something up before the times show what it saved */
+#define BUDGET_SETTLE_FRAMES 2
+
+class StageBudget
+{
+public:
+    enum Stage {
+        PER_FRAME,  /* per frame init and per frame equations */
+        PER_PIXEL,  /* per pixel equations */
+        WAVES,      /* custom wave per frame equations and the per point equations of their last drawing */
+        SHAPES,     /* custom shape per frame equations of every instance */
+        STAGE_COUNT
+    };
+
+    /// What a preset gives up for the stages over budget, any combination
+    enum Action {
+        REPORT = 0,          /* nothing, violations are only reported */
+        REDUCE_SAMPLES = 1,  /* the custom waves draw half the samples */
+        SKIP_PER_PIXEL = 2,  /* the per pixel pass runs on half the frames, the others keep the mesh */
+        SWITCH_PRESET = 4    /* the next preset is selected after BUDGET_STRIKES frames over */
+    };
+
+    /// No budgets, reporting only
+    StageBudget();
+
+    /// Milliseconds a stage of one preset may take in a frame, 0 for no limit
+    float milliseconds[STAGE_COUNT];
+    /// Actions or'ed together
+    int actions;
+
+    /// Some stage has a budget
+    bool enabled() const;
+
+    static const char * stageName(Stage stage);
+};
+
+/// A stage of a preset over its budget in one frame
+class BudgetViolation
+{
+public:
+    BudgetViolation(StageBudget::Stage stage, float milliseconds, float budget)
+        : stage(stage), milliseconds(milliseconds), budget(budget) {}
+
+    StageBudget::Stage stage;
+    /// Time the stage took
+    float milliseconds;
+    float budget;
+};
+
+#endif /* STAGEBUDGET_HPP_ */
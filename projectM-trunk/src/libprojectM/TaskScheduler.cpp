@@ -0,0 +1,282 @@
+/*
+ * TaskScheduler.cpp
+ *
+ *  Work-stealing scheduler for the task graph of one frame.
+ */
+
+#include "TaskScheduler.hpp"
+
+#include <deque>
+#include <iostream>
+
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/// Tasks ready to run on one worker. The owner takes from the back, thieves from the front
+class TaskQueue
+{
+public:
+    std::deque<Task*> tasks;
+
+#ifdef USE_THREADS
+    TaskQueue() { pthread_mutex_init(&_mutex, NULL); }
+    ~TaskQueue() { pthread_mutex_destroy(&_mutex); }
+
+    inline void lock() { pthread_mutex_lock(&_mutex); }
+    inline void unlock() { pthread_mutex_unlock(&_mutex); }
+
+private:
+    pthread_mutex_t _mutex;
+#else
+    inline void lock() {}
+    inline void unlock() {}
+#endif
+};
+
+/// Guards the counters of the scheduler and puts idle workers to sleep
+class TaskScheduler::Sync
+{
+public:
+#ifdef USE_THREADS
+    Sync()
+    {
+        pthread_mutex_init(&_mutex, NULL);
+        pthread_cond_init(&_wake, NULL);
+    }
+
+    ~Sync()
+    {
+        pthread_cond_destroy(&_wake);
+        pthread_mutex_destroy(&_mutex);
+    }
+
+    inline void lock() { pthread_mutex_lock(&_mutex); }
+    inline void unlock() { pthread_mutex_unlock(&_mutex); }
+    inline void wait() { pthread_cond_wait(&_wake, &_mutex); }
+    inline void signal() { pthread_cond_signal(&_wake); }
+    inline void broadcast() { pthread_cond_broadcast(&_wake); }
+
+    /// Argument of each worker thread
+    class Start
+    {
+    public:
+        TaskScheduler * scheduler;
+        unsigned int worker;
+    };
+
+    std::vector<Start> starts;
+    std::vector<pthread_t> threads;
+
+private:
+    pthread_mutex_t _mutex;
+    pthread_cond_t _wake;
+#else
+    inline void lock() {}
+    inline void unlock() {}
+    inline void wait() {}
+    inline void signal() {}
+    inline void broadcast() {}
+#endif
+};
+
+TaskScheduler::TaskScheduler(unsigned int workers) : _remaining(0), _queued(0), _quit(false), _sync(new Sync())
+{
+#ifndef USE_THREADS
+    workers = 0;
+#endif
+
+    /* Queue 0 belongs to the thread calling run() */
+    for (unsigned int i = 0; i <= workers; i++)
+        _queues.push_back(new TaskQueue());
+
+#ifdef USE_THREADS
+    _sync->starts.resize(workers);
+    for (unsigned int i = 0; i < workers; i++) {
+        _sync->starts[i].scheduler = this;
+        _sync->starts[i].worker = i + 1;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerThread, &_sync->starts[i]) != 0) {
+            std::cerr << "[TaskScheduler] failed to start worker " << i + 1 << " of " << workers << std::endl;
+            break;
+        }
+        _sync->threads.push_back(thread);
+    }
+
+    /* Workers that didn't start lose their queues, so threads() counts only
+       those running. The others don't look at the queues before a task is
+       pushed */
+    _sync->lock();
+    while (_queues.size() > _sync->threads.size() + 1) {
+        delete _queues.back();
+        _queues.pop_back();
+    }
+    _sync->unlock();
+#endif
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    _sync->lock();
+    _quit = true;
+    _sync->broadcast();
+    _sync->unlock();
+
+#ifdef USE_THREADS
+    for (unsigned int i = 0; i < _sync->threads.size(); i++)
+        pthread_join(_sync->threads[i], NULL);
+#endif
+
+    for (unsigned int i = 0; i < _queues.size(); i++)
+        delete _queues[i];
+
+    delete _sync;
+}
+
+unsigned int TaskScheduler::hardwareThreads()
+{
+#ifdef WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const long count = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    const long count = 1;
+#endif
+    return count > 1 ? count : 1;
+}
+
+void * TaskScheduler::workerThread(void * data)
+{
+#ifdef USE_THREADS
+    Sync::Start * start = (Sync::Start *) data;
+    start->scheduler->work(start->worker);
+#endif
+    return NULL;
+}
+
+void TaskScheduler::run(TaskGraph & graph)
+{
+    start(graph);
+    wait();
+}
+
+void TaskScheduler::start(TaskGraph & graph)
+{
+    if (graph.empty())
+        return;
+
+    _sync->lock();
+    _remaining = graph._tasks.size();
+    for (std::vector<Task*>::iterator pos = graph._tasks.begin(); pos != graph._tasks.end(); ++pos)
+        (*pos)->_pending = (*pos)->_dependencies;
+
+    for (std::vector<Task*>::iterator pos = graph._tasks.begin(); pos != graph._tasks.end(); ++pos)
+        if ((*pos)->_dependencies == 0)
+            push(*pos, 0);
+    _sync->unlock();
+}
+
+void TaskScheduler::wait()
+{
+    _sync->lock();
+    while (_remaining > 0) {
+        if (_queued == 0) {
+            /* Alone, nothing queued means nothing is running either */
+            if (_queues.size() == 1) {
+                std::cerr << "[TaskScheduler] the task graph has a cycle, " << _remaining << " tasks never ran" << std::endl;
+                break;
+            }
+            _sync->wait();
+            continue;
+        }
+
+        _sync->unlock();
+        for (Task * task = take(0); task != 0; task = take(0))
+            execute(task, 0);
+        _sync->lock();
+    }
+    _sync->unlock();
+}
+
+void TaskScheduler::work(unsigned int worker)
+{
+    _sync->lock();
+    while (!_quit) {
+        if (_queued == 0) {
+            _sync->wait();
+            continue;
+        }
+
+        _sync->unlock();
+        for (Task * task = take(worker); task != 0; task = take(worker))
+            execute(task, worker);
+        _sync->lock();
+    }
+    _sync->unlock();
+}
+
+/* Called with the scheduler locked */
+void TaskScheduler::push(Task * task, unsigned int worker)
+{
+    TaskQueue & queue = *_queues[worker];
+    queue.lock();
+    queue.tasks.push_back(task);
+    queue.unlock();
+
+    _queued++;
+    _sync->signal();
+}
+
+/// Newest task of the worker's own queue, else the oldest one of another queue
+Task * TaskScheduler::take(unsigned int worker)
+{
+    Task * task = 0;
+    const unsigned int count = _queues.size();
+
+    for (unsigned int i = 0; i < count && task == 0; i++) {
+        TaskQueue & queue = *_queues[(worker + i) % count];
+        queue.lock();
+        if (!queue.tasks.empty()) {
+            if (i == 0) {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
+            } else {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            }
+        }
+        queue.unlock();
+    }
+
+    if (task != 0) {
+        _sync->lock();
+        _queued--;
+        _sync->unlock();
+    }
+
+    return task;
+}
+
+/// Runs task and queues the successors it was the last dependency of on the same worker
+void TaskScheduler::execute(Task * task, unsigned int worker)
+{
+    task->run();
+
+    _sync->lock();
+    for (std::vector<Task*>::iterator pos = task->_successors.begin(); pos != task->_successors.end(); ++pos)
+        if (--(*pos)->_pending == 0)
+            push(*pos, worker);
+
+    if (--_remaining == 0)
+        _sync->broadcast();
+    _sync->unlock();
+}
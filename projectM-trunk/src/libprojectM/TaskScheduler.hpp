@@ -0,0 +1,146 @@
+/*
+ * TaskScheduler.hpp
+ *
+ *  A small work-stealing scheduler for the task graph of one frame. Every
+ *  worker owns a queue; it runs the newest task of its own queue and steals
+ *  the oldest task of another queue when its own is empty. Without
+ *  USE_THREADS, or with no workers, the calling thread runs the whole graph.
+ */
+
+#ifndef TASKSCHEDULER_HPP_
+#define TASKSCHEDULER_HPP_
+
+#include <vector>
+
+/// One node of a task graph
+class Task
+{
+public:
+    Task() : _dependencies(0), _pending(0) {}
+    virtual ~Task() {}
+
+    virtual void run() = 0;
+
+    /// Makes successor wait for this task
+    inline void precede(Task & successor)
+    {
+        _successors.push_back(&successor);
+        successor._dependencies++;
+    }
+
+private:
+    friend class TaskGraph;
+    friend class TaskScheduler;
+
+    std::vector<Task*> _successors;
+    /// Number of tasks preceding this one
+    int _dependencies;
+    /// Preceding tasks not finished yet while the graph runs
+    int _pending;
+};
+
+/// A task that does nothing, used to join and fork parts of a graph
+class TaskBarrier : public Task
+{
+public:
+    void run() {}
+};
+
+/// Task calling a member function of an object with a fixed argument
+template <class T>
+class MemberTask : public Task
+{
+public:
+    typedef void (T::*Method)(int);
+
+    MemberTask() : _object(0), _method(0), _argument(0) {}
+
+    inline void bind(T * object, Method method, int argument = 0)
+    {
+        _object = object;
+        _method = method;
+        _argument = argument;
+    }
+
+    void run() { (_object->*_method)(_argument); }
+
+private:
+    T * _object;
+    Method _method;
+    int _argument;
+};
+
+/// The tasks of one frame. The tasks are owned by whoever added them and have
+/// to outlive the graph; clear() drops them and their dependencies so the same
+/// tasks can be wired up again for the next frame without allocating
+class TaskGraph
+{
+public:
+    inline void add(Task & task) { _tasks.push_back(&task); }
+
+    void clear()
+    {
+        for (std::vector<Task*>::iterator pos = _tasks.begin(); pos != _tasks.end(); ++pos) {
+            (*pos)->_successors.clear();
+            (*pos)->_dependencies = 0;
+        }
+        _tasks.clear();
+    }
+
+    inline bool empty() const { return _tasks.empty(); }
+
+private:
+    friend class TaskScheduler;
+
+    std::vector<Task*> _tasks;
+};
+
+class TaskQueue;
+
+class TaskScheduler
+{
+public:
+    /// Starts workers threads next to the thread calling run()
+    explicit TaskScheduler(unsigned int workers);
+    ~TaskScheduler();
+
+    /// Runs every task of graph once, each after the tasks preceding it, and
+    /// returns when all of them are done. The calling thread takes part
+    void run(TaskGraph & graph);
+
+    /// Hands graph to the workers and returns right away. wait() finishes it,
+    /// the graph and its tasks must stay untouched until then. Without workers
+    /// nothing runs before wait()
+    void start(TaskGraph & graph);
+
+    /// Takes part in the graph passed to start() until all of its tasks are done
+    void wait();
+
+    /// Threads running tasks, including the caller of run() or wait(). Less
+    /// than workers + 1 when some workers failed to start
+    inline unsigned int threads() const { return _queues.size(); }
+
+    /// Processors available to this process, at least 1
+    static unsigned int hardwareThreads();
+
+private:
+    Task * take(unsigned int worker);
+    void execute(Task * task, unsigned int worker);
+    void push(Task * task, unsigned int worker);
+    void work(unsigned int worker);
+
+    static void * workerThread(void * data);
+
+    std::vector<TaskQueue*> _queues;
+
+    /// Tasks of the running graph not finished yet
+    int _remaining;
+    /// Tasks sitting in the queues, a hint for idle workers
+    int _queued;
+    bool _quit;
+
+    class Sync;
+    Sync * _sync;
+};
+
+#endif /* TASKSCHEDULER_HPP_ */
@@ -15,6 +15,7 @@
 #endif
 
 #include "TimeKeeper.hpp"
+#include "Clock.hpp"
 #include "RandomNumberGenerators.hpp"
 
 TimeKeeper::TimeKeeper(double presetDuration, double smoothDuration, double easterEgg)
@@ -22,6 +23,8 @@ TimeKeeper::TimeKeeper(double presetDuration, double smoothDuration, double east
     _smoothDuration = smoothDuration;
     _presetDuration = presetDuration;
     _easterEgg = easterEgg;
+    _fixedTimestep = 0;
+    _clock = 0;
 
 #ifndef WIN32
     gettimeofday ( &this->startTime, NULL );
@@ -34,10 +37,15 @@ TimeKeeper::TimeKeeper(double presetDuration, double smoothDuration, double east
 
 void TimeKeeper::UpdateTimers()
 {
+    if (_fixedTimestep > 0)
+        _currentTime += _fixedTimestep;
+    else if (_clock != 0)
+        _currentTime = _clock->seconds();
+    else
 #ifndef WIN32
-    _currentTime = getTicks ( &startTime ) * 0.001;
+        _currentTime = getTicks ( &startTime ) * 0.001;
 #else
-    _currentTime = getTicks ( startTime ) * 0.001;
+        _currentTime = getTicks ( startTime ) * 0.001;
 #endif /** !WIN32 */
 
     _presetFrameA++;
@@ -45,6 +53,34 @@ void TimeKeeper::UpdateTimers()
 
 }
 
+void TimeKeeper::SetFixedTimestep(double seconds)
+{
+    _fixedTimestep = seconds;
+
+    if (_fixedTimestep > 0) {
+        _currentTime = 0;
+        _presetTimeA = 0;
+        _presetTimeB = 0;
+    }
+}
+
+void TimeKeeper::SetClock(Clock * clock)
+{
+    _clock = clock;
+
+    if (_clock != 0)
+        _currentTime = _clock->seconds();
+    else
+#ifndef WIN32
+        _currentTime = getTicks ( &startTime ) * 0.001;
+#else
+        _currentTime = getTicks ( startTime ) * 0.001;
+#endif /** !WIN32 */
+
+    _presetTimeA = _currentTime;
+    _presetTimeB = _currentTime;
+}
+
 void TimeKeeper::StartPreset()
 {
     _isSmoothing = false;
@@ -7,6 +7,8 @@
 
 #include "timer.h"
 
+class Clock;
+
 #define HARD_CUT_DELAY 3
 
 class TimeKeeper
@@ -39,6 +41,20 @@ public:
 
   void ChangePresetDuration(int seconds) { _presetDuration = seconds; }
 
+  /// Advance a virtual clock by seconds on every UpdateTimers() instead of reading
+  /// the system clock. The virtual clock restarts at 0; 0 goes back to the system clock
+  void SetFixedTimestep(double seconds);
+  double FixedTimestep() const { return _fixedTimestep; }
+
+  /// Read the time from clock on every UpdateTimers() instead of the system
+  /// clock, 0 goes back to the system clock. The running presets start over
+  /// at the time of the new clock
+  void SetClock(Clock * clock);
+  Clock * GetClock() const { return _clock; }
+
+  /// True while time doesn't come from the system clock
+  bool VirtualClock() const { return _fixedTimestep > 0 || _clock != 0; }
+
 #ifndef WIN32
   /* The first ticks value of the application */
   struct timeval startTime;
@@ -55,6 +71,8 @@ private:
   double _smoothDuration;
 
   double _currentTime;
+  double _fixedTimestep;
+  Clock * _clock;
   double _presetTimeA;
   double _presetTimeB;
   int _presetFrameA;
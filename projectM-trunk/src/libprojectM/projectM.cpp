@@ -46,6 +46,7 @@
 #include "PCM.hpp"                    //Sound data handler (buffering, FFT, etc.)
 
 #include <map>
+#include <algorithm>
 
 #include "Renderer.hpp"
 #include "PresetChooser.hpp"
@@ -54,44 +55,80 @@
 #include "TimeKeeper.hpp"
 #include "RenderItemMergeFunction.hpp"
 
-#ifdef USE_THREADS
-#include "pthread.h"
-
-pthread_mutex_t mutex;
-pthread_cond_t  condition;
-pthread_t thread;
+#include "TaskScheduler.hpp"
+#include "PipelineSnapshot.hpp"
 
 #ifdef SYNC_PRESET_SWITCHES
-pthread_mutex_t preset_mutex;
-#endif
+#include "pthread.h"
+
+/// Keeps preset switches out of the frame being rendered, per instance
+class PresetSwitchLock
+{
+public:
+    pthread_mutex_t mutex;
+};
 #endif
 
+/// Blends the pipelines of the two presets during a soft cut
+class MergeTask : public Task
+{
+public:
+    Preset * preset;
+    Preset * preset2;
+    Pipeline * pipeline;
+    RenderItemMatcher * matcher;
+    MasterRenderItemMerge * merger;
+    double ratio;
+    FrameStats * stats;
+
+    void run()
+    {
+        StageTimer timer(stats, FrameStats::STAGE_MERGE);
+
+        PipelineMerger::mergePipelines(preset->pipeline(), preset2->pipeline(), *pipeline,
+                                       matcher->matchResults(), *merger, ratio);
+    }
+};
+
+/// Task graph of one frame. The tasks stay around so renderFrame can wire them
+/// up again every frame without allocating
+class FrameTasks
+{
+public:
+    TaskGraph graph;
+    TaskBarrier start;
+    TaskBarrier presetDone;
+    TaskBarrier preset2Done;
+    MergeTask merge;
+
+    /// The two presets blend into this during a soft cut
+    Pipeline merged;
+
+    /// With pipelined rendering, the frame evaluated last and waiting to be drawn
+    PipelineSnapshot snapshot;
+    PipelineContext snapshotContext;
+    bool ahead;
+
+    FrameTasks() : ahead(false) {}
+};
+
 projectM::~projectM()
 {
 
-#ifdef USE_THREADS
-    std::cout << "[projectM] thread ";
-    printf("c");
-    running = false;
-    printf("l");
-    pthread_cond_signal(&condition);
-    printf("e");
-    pthread_mutex_unlock( &mutex );
-    printf("a");
-    pthread_detach(thread);
-    printf("n");
-    pthread_cond_destroy(&condition);
-    printf("u");
-    pthread_mutex_destroy( &mutex );
+    delete _scheduler;
+    delete _frameTasks;
+
 #ifdef SYNC_PRESET_SWITCHES
-    pthread_mutex_destroy( &preset_mutex );
+    pthread_mutex_destroy( &_switchLock->mutex );
+    delete _switchLock;
 #endif
 
-    printf("p");
-    std::cout << std::endl;
-#endif
     destroyPresetTools();
 
+    /* They use the textures of the renderer */
+    for (unsigned int i = 0; i < _outputs.size(); i++)
+        delete _outputs[i];
+
     if ( renderer )
         delete ( renderer );
     if ( beatDetect )
@@ -117,20 +154,28 @@ void projectM::projectM_resetTextures()
 
 
 projectM::projectM ( std::string config_file, int flags) :
-    beatDetect ( 0 ), renderer ( 0 ),  _pcm(0), m_presetPos(0), m_flags(flags), _pipelineContext(new PipelineContext()), _pipelineContext2(new PipelineContext())
+    beatDetect ( 0 ), renderer ( 0 ),  _pcm(0), m_presetPos(0), m_flags(flags), _pipelineContext(new PipelineContext()), _pipelineContext2(new PipelineContext()),
+    _scheduler(0), _frameTasks(0), _switchLock(0), _pipelined(false), _budgetCut(false),
+    _costPolicy(PRESET_COST_IGNORED), _costBudget(0), _costSettleFrames(0), _onsetHardCuts(0)
 {
+    beginStartupTrace();
     readConfig(config_file);
     projectM_reset();
     projectM_resetGL(_settings.windowWidth, _settings.windowHeight);
+    traceStartup("gl reset");
 
 }
 
 projectM::projectM(Settings settings, int flags):
-    beatDetect ( 0 ), renderer ( 0 ),  _pcm(0), m_presetPos(0), m_flags(flags), _pipelineContext(new PipelineContext()), _pipelineContext2(new PipelineContext())
+    beatDetect ( 0 ), renderer ( 0 ),  _pcm(0), m_presetPos(0), m_flags(flags), _pipelineContext(new PipelineContext()), _pipelineContext2(new PipelineContext()),
+    _scheduler(0), _frameTasks(0), _switchLock(0), _pipelined(false), _budgetCut(false),
+    _costPolicy(PRESET_COST_IGNORED), _costBudget(0), _costSettleFrames(0), _onsetHardCuts(0)
 {
+    beginStartupTrace();
     readSettings(settings);
     projectM_reset();
     projectM_resetGL(_settings.windowWidth, _settings.windowHeight);
+    traceStartup("gl reset");
 }
 
 
@@ -169,6 +214,11 @@ void projectM::readConfig (const std::string & configFile )
 {
     std::cout << "[projectM] config file: " << configFile << std::endl;
 
+    /* The preset directory is often installed read only and shared between
+       users, the config file is the user's own */
+    const std::size_t slash = configFile.find_last_of(PATH_SEPARATOR);
+    _costsFile = (slash == std::string::npos ? std::string() : configFile.substr(0, slash + 1)) + PRESET_COST_FILE;
+
     ConfigFile config ( configFile );
     _settings.meshX = config.read<int> ( "Mesh X", 32 );
     _settings.meshY = config.read<int> ( "Mesh Y", 24 );
@@ -235,6 +285,20 @@ void projectM::readConfig (const std::string & configFile )
         renderer->correction = false;
     }
 
+    setPipelinedRendering(config.read<bool> ( "Pipelined Rendering", false ));
+    setAdaptiveQuality(config.read<bool> ( "Adaptive Quality", false ));
+    setOnsetHardCuts(config.read<float> ( "Hard Cut Onset Strength", 0 ));
+
+    StageBudget budget;
+    budget.milliseconds[StageBudget::PER_FRAME] = config.read<float> ( "Per Frame Budget", 0 );
+    budget.milliseconds[StageBudget::PER_PIXEL] = config.read<float> ( "Per Pixel Budget", 0 );
+    budget.milliseconds[StageBudget::WAVES] = config.read<float> ( "Waves Budget", 0 );
+    budget.milliseconds[StageBudget::SHAPES] = config.read<float> ( "Shapes Budget", 0 );
+    budget.actions = config.read<int> ( "Budget Actions", StageBudget::REPORT );
+    setStageBudget(budget);
+
+    setPresetCostPolicy((PresetCostPolicy) config.read<int> ( "Preset Cost Policy", PRESET_COST_IGNORED ),
+                        config.read<float> ( "Preset Cost Budget", 0 ));
 
 }
 
@@ -267,53 +331,108 @@ void projectM::readSettings (const Settings & settings )
 
 }
 
-#ifdef USE_THREADS
-static void *thread_callback(void *prjm)
+void projectM::renderFrame()
 {
-    projectM *p = (projectM *)prjm;
+#ifdef SYNC_PRESET_SWITCHES
+    pthread_mutex_lock(&_switchLock->mutex);
+#endif
 
-    p->thread_func(prjm);
-    return NULL;
-}
+#ifdef DEBUG
+    char fname[1024];
+    FILE *f = NULL;
+    int index = 0;
+    int x, y;
+#endif
 
+    const double frameStart = getMonotonicTime();
+    _frameStats.clear();
+    _frameStats2.clear();
 
-void *projectM::thread_func(void *vptr_args)
-{
-    pthread_mutex_lock( &mutex );
-    //  printf("in thread: %f\n", timeKeeper->PresetProgressB());
-    while (true) {
-        pthread_cond_wait( &condition, &mutex );
-        if(!running) {
-            pthread_mutex_unlock( &mutex );
-            return NULL;
+    FrameTasks & tasks = *_frameTasks;
+    bool rendered = false;
+
+    /* Pipelined, every call draws the frame the call before evaluated, so the
+     * first call has to get one frame ahead */
+    if (_pipelined && _scheduler->threads() > 1 && !tasks.ahead) {
+        Pipeline & pipeline = prepareFrame();
+        _scheduler->run(tasks.graph);
+
+        if (!takeSnapshot(pipeline)) {
+            drawFrame(pipeline, pipelineContext());
+            rendered = true;
         }
-        evaluateSecondPreset();
     }
-}
-#endif
 
-void projectM::evaluateSecondPreset()
-{
-    pipelineContext2().time = timeKeeper->GetRunningTime();
-    pipelineContext2().frame = timeKeeper->PresetFrameB();
-    pipelineContext2().progress = timeKeeper->PresetProgressB();
+    if (!rendered) {
+        Pipeline & pipeline = prepareFrame();
+
+        if (tasks.ahead) {
+            /* The workers evaluate this frame while the last one is drawn */
+            _scheduler->start(tasks.graph);
+            drawFrame(tasks.snapshot, tasks.snapshotContext);
+            _scheduler->wait();
+
+            /* Without a snapshot this frame is never drawn, the next call
+             * starts over */
+            takeSnapshot(pipeline);
+        } else {
+            _scheduler->run(tasks.graph);
+
+            /* Drawing evaluates the waves, once is enough for all outputs */
+            if (!_outputs.empty() && tasks.snapshot.copy(pipeline, beatDetect))
+                drawFrame(tasks.snapshot, pipelineContext());
+            else
+                drawFrame(pipeline, pipelineContext());
+        }
+    }
+
+    // Second preset's equation time counts towards this frame
+    _frameStats.add(_frameStats2);
+
+    //	std::cout<< m_activePreset->absoluteFilePath()<<std::endl;
+    //	renderer->presetName = m_activePreset->absoluteFilePath();
+
+
+
+    _frameStats.stages[FrameStats::STAGE_FRAME] = getMonotonicTime() - frameStart;
+
+    count++;
+
+    /* No waiting on a virtual clock, and no output depending on the speed
+     * of the machine either */
+    const bool virtualClock = timeKeeper->VirtualClock();
+    if (!virtualClock)
+        _pacer.frameDone(_frameStats);
+    renderer->realfps = _pacer.measuredFps();
+
+    _frameHistogram.add(_frameStats);
+
+    if (!virtualClock && _governor.frameDone(_frameStats, timeKeeper->IsSmoothing()))
+        applyQuality();
+
+    unsigned int index;
+    if (_governor.takeHeavyPreset() && selectedPresetIndex(index)) {
+        std::cerr << "[projectM] preset too heavy even at the lowest quality: "
+                  << m_presetLoader->getPresetName(index) << std::endl;
+        presetTooHeavyEvent(index, _governor.averageFrameTime());
+    }
+
+    checkBudget();
+    if (!virtualClock)
+        measurePresetCost();
 
-    m_activePreset2->Render(*beatDetect, pipelineContext2());
-}
 
-void projectM::renderFrame()
-{
 #ifdef SYNC_PRESET_SWITCHES
-    pthread_mutex_lock(&preset_mutex);
+    pthread_mutex_unlock(&_switchLock->mutex);
 #endif
 
-#ifdef DEBUG
-    char fname[1024];
-    FILE *f = NULL;
-    int index = 0;
-    int x, y;
-#endif
+}
 
+/// Advances the clocks, detects beats, switches presets when it is time and
+/// wires up the task graph of the next frame. Returns the pipeline the graph
+/// fills for the renderer
+Pipeline & projectM::prepareFrame()
+{
     timeKeeper->UpdateTimers();
     /*
             if (timeKeeper->IsSmoothing())
@@ -325,8 +444,6 @@ void projectM::renderFrame()
                 printf("          A:%f\n", timeKeeper->PresetProgressA());
             }*/
 
-    mspf= ( int ) ( 1000.0/ ( float ) settings().fps ); //milliseconds per frame
-
     /// @bug who is responsible for updating this now?"
     pipelineContext().time = timeKeeper->GetRunningTime();
     pipelineContext().frame = timeKeeper->PresetFrameA();
@@ -334,7 +451,22 @@ void projectM::renderFrame()
 
     //m_activePreset->Render(*beatDetect, pipelineContext());
 
-    beatDetect->detectFromSamples();
+    {
+        StageTimer timer(&_frameStats, FrameStats::STAGE_BEAT_DETECT);
+        beatDetect->detectFromSamples();
+    }
+
+    bool onsetCut = false;
+    float onsets[2] = { 0, 0 };
+    OnsetEvent onset;
+    while (_onsets.takeEvent(onset)) {
+        onsetEvent(onset);
+        if (_onsetHardCuts > 0 && onset.strength >= _onsetHardCuts)
+            onsetCut = true;
+        onsets[onset.band] = std::max(onsets[onset.band], onset.strength);
+    }
+    pipelineContext().onset = pipelineContext2().onset = onsets[OnsetEvent::BAND_FULL];
+    pipelineContext().bassOnset = pipelineContext2().bassOnset = onsets[OnsetEvent::BAND_BASS];
 
     //m_activePreset->evaluateFrame();
 
@@ -350,7 +482,8 @@ void projectM::renderFrame()
 
         }
 
-        else if ((beatDetect->vol-beatDetect->vol_old>beatDetect->beat_sensitivity ) &&
+        else if ((_onsetHardCuts > 0 ? onsetCut :
+                  beatDetect->vol-beatDetect->vol_old>beatDetect->beat_sensitivity ) &&
                  timeKeeper->CanHardCut()) {
             // printf("Hard Cut\n");
             if (settings().shuffleEnabled)
@@ -358,47 +491,50 @@ void projectM::renderFrame()
             else
                 selectNext(true);
         }
+
+        else if (_budgetCut && !timeKeeper->IsSmoothing()) {
+            if (settings().shuffleEnabled)
+                selectRandom(true);
+            else
+                selectNext(true);
+        }
     }
 
 
     if ( timeKeeper->IsSmoothing() && timeKeeper->SmoothRatio() <= 1.0 && !m_presetChooser->empty() ) {
 
 
-        //	 printf("start thread\n");
         assert ( m_activePreset2.get() );
 
-#ifdef USE_THREADS
-
-        pthread_cond_signal(&condition);
-        pthread_mutex_unlock( &mutex );
-#endif
-        m_activePreset->Render(*beatDetect, pipelineContext());
-
-#ifdef USE_THREADS
-        pthread_mutex_lock( &mutex );
-#else
-        evaluateSecondPreset();
-#endif
-
-        Pipeline pipeline;
-
-        pipeline.setStaticPerPixel(settings().meshX, settings().meshY);
+        pipelineContext2().time = timeKeeper->GetRunningTime();
+        pipelineContext2().frame = timeKeeper->PresetFrameB();
+        pipelineContext2().progress = timeKeeper->PresetProgressB();
 
         assert(_matcher);
-        PipelineMerger::mergePipelines( m_activePreset->pipeline(),
-                                        m_activePreset2->pipeline(), pipeline,
-                                        _matcher->matchResults(),
-                                        *_merger, timeKeeper->SmoothRatio());
-
-        renderer->RenderFrame(pipeline, pipelineContext());
-
-        pipeline.drawables.clear();
-
-        /*
-        while (!pipeline.drawables.empty()) {
-        delete(pipeline.drawables.back());
-        pipeline.drawables.pop_back();
-        } */
+        MergeTask & merge = _frameTasks->merge;
+        merge.preset = m_activePreset.get();
+        merge.preset2 = m_activePreset2.get();
+        merge.pipeline = &_frameTasks->merged;
+        merge.matcher = _matcher;
+        merge.merger = _merger;
+        merge.ratio = timeKeeper->SmoothRatio();
+        merge.stats = &_frameStats;
+
+        /* Both presets evaluate side by side, the merge waits for the two */
+        TaskGraph & graph = _frameTasks->graph;
+        graph.clear();
+        graph.add(_frameTasks->start);
+        graph.add(_frameTasks->presetDone);
+        graph.add(_frameTasks->preset2Done);
+        graph.add(merge);
+        m_activePreset->addFrameTasks(graph, _frameTasks->start, _frameTasks->presetDone,
+                                      *beatDetect, pipelineContext());
+        m_activePreset2->addFrameTasks(graph, _frameTasks->start, _frameTasks->preset2Done,
+                                       *beatDetect, pipelineContext2());
+        _frameTasks->presetDone.precede(merge);
+        _frameTasks->preset2Done.precede(merge);
+
+        return _frameTasks->merged;
 
     } else {
 
@@ -410,62 +546,92 @@ void projectM::renderFrame()
         }
         //printf("Normal\n");
 
-        m_activePreset->Render(*beatDetect, pipelineContext());
-        renderer->RenderFrame (m_activePreset->pipeline(), pipelineContext());
-
+        TaskGraph & graph = _frameTasks->graph;
+        graph.clear();
+        graph.add(_frameTasks->start);
+        graph.add(_frameTasks->presetDone);
+        m_activePreset->addFrameTasks(graph, _frameTasks->start, _frameTasks->presetDone,
+                                      *beatDetect, pipelineContext());
 
+        return m_activePreset->pipeline();
     }
 
-    //	std::cout<< m_activePreset->absoluteFilePath()<<std::endl;
-    //	renderer->presetName = m_activePreset->absoluteFilePath();
+}
 
+/// Keeps a copy of the evaluated frame for the next call to draw
+bool projectM::takeSnapshot(const Pipeline & pipeline)
+{
+    FrameTasks & tasks = *_frameTasks;
 
+    tasks.ahead = tasks.snapshot.copy(pipeline, beatDetect);
+    tasks.snapshotContext = pipelineContext();
+    return tasks.ahead;
+}
 
-    count++;
-#ifndef WIN32
-    /** Frame-rate limiter */
-    /** Compute once per preset */
-    if ( this->count%100==0 ) {
-        this->renderer->realfps=100.0/ ( ( getTicks ( &timeKeeper->startTime )-this->fpsstart ) /1000 );
-        this->fpsstart=getTicks ( &timeKeeper->startTime );
-    }
+void projectM::drawFrame(const Pipeline & pipeline, const PipelineContext & context)
+{
+    /* The window last, the GL state is left the way it was before outputs */
+    for (unsigned int i = 0; i < _outputs.size(); i++)
+        if (_outputs[i])
+            _outputs[i]->RenderFrame(pipeline, context);
 
-    int timediff = getTicks ( &timeKeeper->startTime )-this->timestart;
+    renderer->RenderFrame(pipeline, context);
+}
 
-    if ( timediff < this->mspf ) {
-        // printf("%s:",this->mspf-timediff);
-        int sleepTime = ( unsigned int ) ( this->mspf-timediff ) * 1000;
-        //		DWRITE ( "usleep: %d\n", sleepTime );
-        if ( sleepTime > 0 && sleepTime < 100000 ) {
-            if ( usleep ( sleepTime ) != 0 ) {}}
+/// Hands the pipeline of a new preset to the renderers for its shaders
+void projectM::showPipeline(Pipeline & pipeline)
+{
+    /* A frame evaluated ahead would be drawn with the shaders of the preset
+     * that replaces it, the next frame is drawn without one */
+    if (_frameTasks) {
+        _frameTasks->ahead = false;
+        _frameTasks->snapshot.clear();
     }
-    this->timestart=getTicks ( &timeKeeper->startTime );
-#endif /** !WIN32 */
 
-#ifdef SYNC_PRESET_SWITCHES
-    pthread_mutex_unlock(&preset_mutex);
-#endif
+    renderer->SetPipeline(pipeline);
 
+    for (unsigned int i = 0; i < _outputs.size(); i++)
+        if (_outputs[i])
+            _outputs[i]->SetPipeline(pipeline);
+}
+
+void projectM::setPipelinedRendering(bool enabled)
+{
+    _pipelined = enabled;
+
+    /* An evaluated frame left behind would be drawn out of turn later */
+    _frameTasks->ahead = false;
+    _frameTasks->snapshot.clear();
 }
 
 void projectM::projectM_reset()
 {
-    this->mspf = 0;
-    this->timed = 0;
-    this->timestart = 0;
     this->count = 0;
 
-    this->fpsstart = 0;
-
     setlocale(LC_NUMERIC, "C");
 
     projectM_resetengine();
 }
 
+void projectM::beginStartupTrace()
+{
+    _startupTrace.clear();
+    _startupMark = getMonotonicTime();
+}
+
+void projectM::traceStartup(const char * step)
+{
+    const double now = getMonotonicTime();
+    _startupTrace.push_back(std::make_pair(std::string(step), (unsigned int)(now - _startupMark)));
+    _startupMark = now;
+}
+
 void projectM::projectM_init ( int gx, int gy, int fps, int texsize, int width, int height )
 {
     setlocale(LC_NUMERIC, "C");
 
+    traceStartup("configuration");
+
     /** Initialise start time */
     timeKeeper = new TimeKeeper(_settings.presetDuration,_settings.smoothPresetDuration, _settings.easterEgg);
 
@@ -478,34 +644,34 @@ void projectM::projectM_init ( int gx, int gy, int fps, int texsize, int width,
     if (!_pcm)
         _pcm = new PCM();
     assert(pcm());
+    _pcm->onsetDetector = &_onsets;
     beatDetect = new BeatDetect ( _pcm );
 
+    _pacer.setTargetFps(_settings.fps);
     if ( _settings.fps > 0 )
-        mspf= ( int ) ( 1000.0/ ( float ) _settings.fps );
-    else mspf = 0;
+        _governor.setTargetFrameTime(1000.0f / _settings.fps);
 
-    this->renderer = new Renderer ( width, height, gx, gy, texsize,  beatDetect, settings().presetURL, settings().titleFontURL, settings().menuFontURL );
-
-    running = true;
-
-    initPresetTools(gx, gy);
+    traceStartup("audio");
 
+    this->renderer = new Renderer ( width, height, gx, gy, texsize,  beatDetect, settings().presetURL, settings().titleFontURL, settings().menuFontURL );
+    this->renderer->frameHistogram = &_frameHistogram;
 
-#ifdef USE_THREADS
-    pthread_mutex_init(&mutex, NULL);
+    traceStartup("renderer");
 
 #ifdef SYNC_PRESET_SWITCHES
-    pthread_mutex_init(&preset_mutex, NULL);
+    _switchLock = new PresetSwitchLock;
+    pthread_mutex_init(&_switchLock->mutex, NULL);
 #endif
 
-    pthread_cond_init(&condition, NULL);
-    if (pthread_create(&thread, NULL, thread_callback, this) != 0) {
+    initPresetTools(gx, gy);
 
-        std::cerr << "[projectM] failed to allocate a thread! try building with option USE_THREADS turned off" << std::endl;;
-        exit(EXIT_FAILURE);
-    }
-    pthread_mutex_lock( &mutex );
-#endif
+    traceStartup("preset tools");
+
+    /* Audio analysis has to finish before the preset switch it may trigger, so
+       the frame graph starts at the presets. The GL thread takes part too */
+    _scheduler = new TaskScheduler(TaskScheduler::hardwareThreads() - 1);
+    _frameTasks = new FrameTasks();
+    _frameTasks->merged.setStaticPerPixel(gx, gy);
 
     /// @bug order of operatoins here is busted
     //renderer->setPresetName ( m_activePreset->name() );
@@ -515,6 +681,10 @@ void projectM::projectM_init ( int gx, int gy, int fps, int texsize, int width,
     pipelineContext().fps = fps;
     pipelineContext2().fps = fps;
 
+    pipelineContext().frameStats = &_frameStats;
+    pipelineContext2().frameStats = &_frameStats2;
+    pipelineContext().budget = pipelineContext2().budget = &_budget;
+
 }
 
 /* Reinitializes the engine variables to a default (conservative and sane) value */
@@ -555,7 +725,7 @@ int projectM::initPresetTools(int gx, int gy)
 
     std::string url = (m_flags & FLAG_DISABLE_PLAYLIST_LOAD) ? std::string() : settings().presetURL;
 
-    if ( ( m_presetLoader = new PresetLoader ( gx, gy, url) ) == 0 ) {
+    if ( ( m_presetLoader = new PresetLoader ( gx, gy, url, _costsFile) ) == 0 ) {
         m_presetLoader = 0;
         std::cerr << "[projectM] error allocating preset loader" << std::endl;
         return PROJECTM_FAILURE;
@@ -570,6 +740,7 @@ int projectM::initPresetTools(int gx, int gy)
         std::cerr << "[projectM] error allocating preset chooser" << std::endl;
         return PROJECTM_FAILURE;
     }
+    setPresetCostPolicy(_costPolicy, _costBudget);
 
     // Start the iterator
     if (!m_presetPos)
@@ -578,22 +749,19 @@ int projectM::initPresetTools(int gx, int gy)
     // Initialize a preset queue position as well
     //	m_presetQueuePos = new PresetIterator();
 
-    // Start at end ptr- this allows next/previous to easily be done from this position.
-    *m_presetPos = m_presetChooser->end();
-
     // Load idle preset
     std::cerr << "[projectM] Allocating idle preset..." << std::endl;
     m_activePreset = m_presetLoader->loadPreset
                      ("idle://Geiss & Sperl - Feedback (projectM idle HDR mix).milk");
 
-    renderer->SetPipeline(m_activePreset->pipeline());
+    showPipeline(m_activePreset->pipeline());
 
     // Case where no valid presets exist in directory. Could also mean
     // playlist initialization was deferred
-    if (m_presetChooser->empty()) {
-        //std::cerr << "[projectM] warning: no valid files found in preset directory \""
-        //<< m_presetLoader->directoryName() << "\"" << std::endl;
-    }
+    //if (m_presetChooser->empty()) {
+    //std::cerr << "[projectM] warning: no valid files found in preset directory \""
+    //<< m_presetLoader->directoryName() << "\"" << std::endl;
+    //}
 
     _matcher = new RenderItemMatcher();
     _merger = new MasterRenderItemMerge();
@@ -605,6 +773,11 @@ int projectM::initPresetTools(int gx, int gy)
     /// @bug These should be requested by the preset factories.
     _matcher->distanceFunction().addMetric(new ShapeXYDistance());
 
+    // Start at end ptr- this allows next/previous to easily be done from this position.
+    // This waits on the preset directory scan, so it is left until everything
+    // that can overlap with it is done.
+    *m_presetPos = m_presetChooser->end();
+
     //std::cerr << "[projectM] Idle preset allocated." << std::endl;
 
     projectM_resetengine();
@@ -615,6 +788,10 @@ int projectM::initPresetTools(int gx, int gy)
 
 void projectM::destroyPresetTools()
 {
+    if ( m_presetLoader ) {
+        finishPresetCost();
+        m_presetLoader->saveCosts();
+    }
 
     if ( m_presetPos )
         delete ( m_presetPos );
@@ -707,10 +884,14 @@ void projectM::selectRandom(const bool hardCut)
     if (m_presetChooser->empty())
         return;
 
+    /* Chosen knowing what the preset playing cost */
+    finishPresetCost();
+
     if (!hardCut) {
         timeKeeper->StartSmoothing();
     }
 
+    applyCostBudget();
     *m_presetPos = m_presetChooser->weightedRandom(hardCut);
 
     if (!hardCut) {
@@ -730,10 +911,14 @@ void projectM::selectPrevious(const bool hardCut)
     if (m_presetChooser->empty())
         return;
 
+    /* Chosen knowing what the preset playing cost */
+    finishPresetCost();
+
     if (!hardCut) {
         timeKeeper->StartSmoothing();
     }
 
+    applyCostBudget();
     m_presetChooser->previousPreset(*m_presetPos);
 
     if (!hardCut) {
@@ -759,11 +944,15 @@ void projectM::selectNext(const bool hardCut)
     if (m_presetChooser->empty())
         return;
 
+    /* Chosen knowing what the preset playing cost */
+    finishPresetCost();
+
     if (!hardCut) {
         timeKeeper->StartSmoothing();
         std::cout << "start smoothing" << std::endl;
     }
 
+    applyCostBudget();
     m_presetChooser->nextPreset(*m_presetPos);
 
     if (!hardCut) {
@@ -785,17 +974,19 @@ void projectM::switchPreset(std::auto_ptr<Preset> & targetPreset)
 {
 
 #ifdef SYNC_PRESET_SWITCHES
-    pthread_mutex_lock(&preset_mutex);
+    pthread_mutex_lock(&_switchLock->mutex);
 #endif
 
     targetPreset = m_presetPos->allocate();
 
     // Set preset name here- event is not done because at the moment this function is oblivious to smooth/hard switches
     renderer->setPresetName(targetPreset->name());
-    renderer->SetPipeline(targetPreset->pipeline());
+    showPipeline(targetPreset->pipeline());
+    _governor.presetChanged();
+    _budgetCut = false;
 
 #ifdef SYNC_PRESET_SWITCHES
-    pthread_mutex_unlock(&preset_mutex);
+    pthread_mutex_unlock(&_switchLock->mutex);
 #endif
 }
 
@@ -857,6 +1048,273 @@ unsigned int projectM::getPlaylistSize() const
     return m_presetLoader->size();
 }
 
+class MoreCycles {
+public:
+    bool operator()(const PresetProfileEntry & lhs, const PresetProfileEntry & rhs) const {
+        return lhs.cycles > rhs.cycles;
+    }
+};
+
+PresetProfile projectM::presetHotSpots(unsigned int count) const
+{
+    PresetProfile entries;
+
+    if (m_activePreset.get() == 0)
+        return entries;
+
+    m_activePreset->profile(entries);
+
+    std::sort(entries.begin(), entries.end(), MoreCycles());
+    if (entries.size() > count)
+        entries.erase(entries.begin() + count, entries.end());
+
+    return entries;
+}
+
+void projectM::setFixedTimestep(double seconds)
+{
+    timeKeeper->SetFixedTimestep(seconds);
+    _pacer.restart();
+}
+
+void projectM::setClock(Clock * clock)
+{
+    timeKeeper->SetFixedTimestep(0);
+    timeKeeper->SetClock(clock);
+    _pacer.restart();
+}
+
+void projectM::renderFrameAt(double seconds, const float * samples, int count)
+{
+    _stepClock.set(seconds);
+    if (timeKeeper->GetClock() != &_stepClock || timeKeeper->FixedTimestep() > 0)
+        setClock(&_stepClock);
+
+    if (samples != 0 && count > 0)
+        _pcm->addPCMfloat(samples, count);
+
+    renderFrame();
+}
+
+void projectM::setRandomSeed(unsigned int seed)
+{
+    srand(seed);
+
+    /* Tasks running side by side would take turns on rand() in any order */
+    if (_scheduler->threads() > 1) {
+        delete _scheduler;
+        _scheduler = new TaskScheduler(0);
+        setPipelinedRendering(_pipelined);
+    }
+}
+
+bool projectM::startCapture(FrameSink * sink, int width, int height, CapturedFrame::Format format, int latency,
+                            unsigned int output)
+{
+    Renderer * target = this->output(output);
+    if (!target) {
+        std::cerr << "[projectM] no output " << output << " to capture" << std::endl;
+        return false;
+    }
+
+    if (!FrameCapture::supported(format))
+        return false;
+
+    target->captures.push_back(new FrameCapture(sink, width, height, format, latency));
+    return true;
+}
+
+void projectM::stopCapture(FrameSink * sink)
+{
+    for (unsigned int output = 0; output <= _outputs.size(); output++) {
+        Renderer * target = this->output(output);
+        if (!target)
+            continue;
+
+        std::vector<FrameCapture*> & captures = target->captures;
+        for (std::vector<FrameCapture*>::iterator pos = captures.begin(); pos != captures.end(); ) {
+            if ((*pos)->sink() == sink) {
+                (*pos)->flush();
+                delete *pos;
+                pos = captures.erase(pos);
+            } else
+                ++pos;
+        }
+    }
+}
+
+Renderer * projectM::output(unsigned int output) const
+{
+    if (output == 0)
+        return renderer;
+    return output <= _outputs.size() ? _outputs[output - 1] : 0;
+}
+
+unsigned int projectM::addOutput(int width, int height, bool aspectCorrection)
+{
+    const QualityLevel & quality = _governor.quality();
+
+    Renderer * target = new Renderer(width, height, _settings.meshX, _settings.meshY,
+                                     _settings.textureSize / quality.textureDivisor, beatDetect,
+                                     _settings.presetURL, _settings.titleFontURL, _settings.menuFontURL,
+                                     renderer->textures());
+
+    if (target->initRenderToTexture(width, height) == (GLuint) -1) {
+        std::cerr << "[projectM] outputs need framebuffer objects" << std::endl;
+        delete target;
+        return 0;
+    }
+
+    target->reset(width, height);
+    target->correction = aspectCorrection;
+    target->setBlurLevels(quality.blurLevels);
+    if (renderer->pipeline())
+        target->SetPipeline(*renderer->pipeline());
+
+    /* The window's viewport again */
+    renderer->reset(_settings.windowWidth, _settings.windowHeight);
+
+    for (unsigned int i = 0; i < _outputs.size(); i++) {
+        if (!_outputs[i]) {
+            _outputs[i] = target;
+            return i + 1;
+        }
+    }
+
+    _outputs.push_back(target);
+    return _outputs.size();
+}
+
+void projectM::removeOutput(unsigned int output)
+{
+    if (output == 0 || output > _outputs.size())
+        return;
+
+    delete _outputs[output - 1];
+    _outputs[output - 1] = 0;
+}
+
+unsigned int projectM::outputTexture(unsigned int output) const
+{
+    Renderer * target = this->output(output);
+    return target && output > 0 ? target->outputTexture() : 0;
+}
+
+void projectM::setFramePacing(FramePacer::Mode mode)
+{
+    _pacer.setMode(mode);
+}
+
+void projectM::setAdaptiveQuality(bool enabled)
+{
+    _governor.setEnabled(enabled);
+    applyQuality();
+}
+
+PresetCost projectM::getPresetCost(unsigned int index) const
+{
+    return m_presetLoader->getPresetCost(index);
+}
+
+bool projectM::savePresetCosts()
+{
+    finishPresetCost();
+    return m_presetLoader->saveCosts();
+}
+
+void projectM::setPresetCostPolicy(PresetCostPolicy policy, float budget)
+{
+    _costPolicy = policy;
+    _costBudget = budget;
+    applyCostBudget();
+}
+
+/// Hands the policy to the chooser. Done again before every choice, so a budget
+/// of 0 follows the frame period as it is then, not as it was when set
+void projectM::applyCostBudget()
+{
+    m_presetChooser->setCostPolicy(_costPolicy, _costBudget > 0 ? _costBudget : _governor.targetFrameTime());
+}
+
+/// Adds the cost of the frame to the preset playing, unless it is blending
+/// with another one or only began to play
+void projectM::measurePresetCost()
+{
+    unsigned int index;
+    if (timeKeeper->IsSmoothing() || !selectedPresetIndex(index))
+        return;
+
+    const std::string & url = m_presetLoader->getPresetURL(index);
+    if (url != _costURL) {
+        finishPresetCost();
+        _costURL = url;
+        _costSettleFrames = PRESET_COST_SETTLE_FRAMES;
+    }
+
+    if (_costSettleFrames > 0)
+        _costSettleFrames--;
+    else if (_costFrames.size() < PRESET_COST_MAX_FRAMES)
+        _costFrames.push_back(std::max(_frameStats[FrameStats::STAGE_FRAME], _frameStats[FrameStats::STAGE_GPU]));
+}
+
+void projectM::finishPresetCost()
+{
+    if (_costFrames.size() >= PRESET_COST_MIN_FRAMES)
+        m_presetLoader->addPresetCost(_costURL, _costFrames);
+
+    _costFrames.clear();
+    _costURL.clear();
+}
+
+void projectM::setStageBudget(const StageBudget & budget)
+{
+    _budget = budget;
+}
+
+/// Reports the stages of the active preset over budget, and moves on from it
+/// once it is too expensive. While blending the preset blended to is judged
+void projectM::checkBudget()
+{
+    Preset * preset = timeKeeper->IsSmoothing() && m_activePreset2.get() ? m_activePreset2.get() : m_activePreset.get();
+    unsigned int index;
+    if (!_budget.enabled() || preset == 0 || !selectedPresetIndex(index))
+        return;
+
+    std::vector<BudgetViolation> violations;
+    preset->budgetViolations(violations);
+    for (unsigned int i = 0; i < violations.size(); i++)
+        presetOverBudgetEvent(index, violations[i]);
+
+    if (preset->tooExpensive() && !_budgetCut) {
+        std::cerr << "[projectM] preset over its budget for too long: "
+                  << m_presetLoader->getPresetName(index) << std::endl;
+        _budgetCut = true;
+    }
+}
+
+/// Hands the settings of the governor's quality level to the renderer and presets
+void projectM::applyQuality()
+{
+    const QualityLevel & quality = _governor.quality();
+
+    for (unsigned int output = 0; output <= _outputs.size(); output++) {
+        Renderer * target = this->output(output);
+        if (target) {
+            target->setTextureSize(_settings.textureSize / quality.textureDivisor);
+            target->setBlurLevels(quality.blurLevels);
+        }
+    }
+
+    pipelineContext().meshStride = pipelineContext2().meshStride = quality.meshStride;
+    pipelineContext().waveSamples = pipelineContext2().waveSamples = quality.waveSamples;
+}
+
+void projectM::resetPresetProfile()
+{
+    if (m_activePreset.get() != 0)
+        m_activePreset->resetProfile();
+}
+
 void projectM::changePresetRating (unsigned int index, int rating, const PresetRatingType ratingType)
 {
     m_presetLoader->setRating(index, rating, ratingType);
@@ -905,12 +1363,7 @@ void projectM::changePresetName ( unsigned int index, std::string name )
 void projectM::changeTextureSize(int size)
 {
     _settings.textureSize = size;
-
-    delete renderer;
-    renderer = new Renderer(_settings.windowWidth, _settings.windowHeight,
-                            _settings.meshX, _settings.meshY,
-                            _settings.textureSize, beatDetect, _settings.presetURL,
-                            _settings.titleFontURL, _settings.menuFontURL);
+    applyQuality();
 }
 
 void projectM::changePresetDuration(int seconds)
@@ -37,6 +37,7 @@
 #include <cmath>
 #include <cstdio>
 #include <string>
+#include <vector>
 #include <cstdlib>
 #ifndef WIN32
 #include <unistd.h>
@@ -75,8 +76,20 @@ class TimeKeeper;
 class Pipeline;
 class RenderItemMatcher;
 class MasterRenderItemMerge;
+class TaskScheduler;
+class FrameTasks;
+class PresetSwitchLock;
 
 #include "Common.hpp"
+#include "FrameStats.hpp"
+#include "FramePacer.hpp"
+#include "Clock.hpp"
+#include "FrameSink.hpp"
+#include "QualityGovernor.hpp"
+#include "StageBudget.hpp"
+#include "PresetCost.hpp"
+#include "OnsetDetector.hpp"
+#include "PresetProfile.hpp"
 
 #include <memory>
 #ifdef WIN32
@@ -225,7 +238,120 @@ public:
   /// Returns the size of the play list
   unsigned int getPlaylistSize() const;
 
-  void evaluateSecondPreset();
+  /// Frame cost of the preset at index, measured on this machine while it
+  /// played alone, in this run and earlier ones. The costs are kept in
+  /// PRESET_COST_FILE next to the config file, read when the preset directory
+  /// is scanned and written by savePresetCosts() and when projectM is
+  /// destroyed. Constructed from Settings, projectM keeps them for this run only
+  PresetCost getPresetCost(unsigned int index) const;
+  bool savePresetCosts();
+
+  /// Choose presets whose 95th percentile frame cost is over budget
+  /// milliseconds as policy says, 0 for the frame period of the FPS setting.
+  /// PRESET_COST_IGNORED by default, or the "Preset Cost Policy" (0, 1 or 2)
+  /// and "Preset Cost Budget" keys of the config file
+  void setPresetCostPolicy(PresetCostPolicy policy, float budget = 0);
+
+  /// Milliseconds spent in each step of initialization, in the order the steps ran
+  typedef std::vector<std::pair<std::string, unsigned int> > StartupTrace;
+  const StartupTrace & startupTrace() const { return _startupTrace; }
+
+  /// Time spent in each stage of the last rendered frame
+  const FrameStats & frameStats() const { return _frameHistogram.last(); }
+
+  /// Stage timings of the most recent frames, with a histogram of frame times
+  const FrameHistogram & frameHistogram() const { return _frameHistogram; }
+
+  /// The count most expensive equations of the active preset since it was loaded
+  /// or resetPresetProfile(), ordered by cycles. Always empty unless libprojectM
+  /// is built with USE_PROFILER
+  PresetProfile presetHotSpots(unsigned int count = 10) const;
+  void resetPresetProfile();
+
+  /// Advance time by seconds every frame instead of following the system clock,
+  /// so rendering is repeatable (benchmarks, offline rendering). Time restarts at
+  /// 0 and the frame rate limiter is off. 0 goes back to real time
+  void setFixedTimestep(double seconds);
+
+  /// Read the time from clock instead of the system clock, 0 goes back to the
+  /// system clock. The clock is not owned. As with a fixed timestep, frames are
+  /// neither paced nor is their quality adapted to their cost
+  void setClock(Clock * clock);
+
+  /// Adds samples (mono, as PCM::addPCMfloat takes them) and renders one frame
+  /// at seconds on a clock of its own, replacing any fixed timestep or clock.
+  /// Offline renderers call it once per video frame; after setRandomSeed() the
+  /// same calls render the same frames
+  void renderFrameAt(double seconds, const float * samples, int count);
+
+  /// Seeds the random numbers of presets, preset selection and shaders. The
+  /// presets share one sequence, so from here on frames evaluate on the calling
+  /// thread only, always in the same order. Select the first preset after it
+  void setRandomSeed(unsigned int seed);
+
+  /// Evaluate the presets of the next frame on the worker threads while this
+  /// thread draws the frame evaluated by the previous call. Raises the frame
+  /// rate when both the equations and the GL driver take time, adds one frame
+  /// of latency and does nothing without a worker thread. Off by default, or the
+  /// "Pipelined Rendering" key of the config file
+  void setPipelinedRendering(bool enabled);
+
+  /// How renderFrame() keeps to the FPS setting: by waiting until the next
+  /// frame is due (the default, except on Windows), by leaving it to the host
+  /// waiting on vsync, or not at all. Frames done late show up in the "late"
+  /// stage of frameStats() in every mode but unlimited
+  void setFramePacing(FramePacer::Mode mode);
+  const FramePacer & framePacer() const { return _pacer; }
+
+  /// Lower the mesh detail, feedback texture size, custom wave samples and
+  /// blur passes while frames take longer than the FPS setting allows, and
+  /// raise them again once there is time to spare. Off by default, or the
+  /// "Adaptive Quality" key of the config file
+  void setAdaptiveQuality(bool enabled);
+  const QualityGovernor & qualityGovernor() const { return _governor; }
+
+  /// Time budgets of the stages evaluating the active preset. Stages over
+  /// budget are reported to presetOverBudgetEvent() every frame, and the
+  /// preset gives up what the actions of the budget say. No budgets by
+  /// default, or the "Per Frame Budget", "Per Pixel Budget", "Waves Budget"
+  /// and "Shapes Budget" keys of the config file, in milliseconds, and
+  /// "Budget Actions", the StageBudget::Action flags or'ed together
+  void setStageBudget(const StageBudget & budget);
+  const StageBudget & stageBudget() const { return _budget; }
+
+  /// Copy every frame from now on to sink, scaled to width x height (0 keeps
+  /// the output size) and converted to format on the GPU. Frames arrive from
+  /// renderFrame() latency frames after they were drawn, 1 or 2, so reading
+  /// them back never waits for the GPU. False if the driver lacks framebuffer
+  /// blits or pixel buffer objects, or shaders for I420. The sink isn't owned
+  bool startCapture(FrameSink * sink, int width = 0, int height = 0,
+                    CapturedFrame::Format format = CapturedFrame::FORMAT_RGBA, int latency = 2,
+                    unsigned int output = 0);
+  /// Hands the frames still in flight to sink and stops capturing into it.
+  /// Needs the GL context
+  void stopCapture(FrameSink * sink);
+
+  /// Adds an output drawing the frames of the window once more, into a texture
+  /// of width x height with a feedback texture and aspect correction of its
+  /// own. Presets, audio analysis and preset textures are shared, so an output
+  /// costs drawing only. Hosts driving several displays share objects between
+  /// their GL contexts and draw outputTexture() in each. Returns the number of
+  /// the output, the window being 0, or 0 without framebuffer objects
+  unsigned int addOutput(int width, int height, bool aspectCorrection = true);
+  void removeOutput(unsigned int output);
+  unsigned int outputTexture(unsigned int output) const;
+  bool pipelinedRendering() const { return _pipelined; }
+
+  /// Onsets found in the audio as it is added, hop by hop whatever the frame
+  /// rate. Set its sample rate when the audio isn't 44.1 kHz. Milkdrop presets
+  /// read the onsets of a frame as onset and bass_onset
+  OnsetDetector & onsetDetector() { return _onsets; }
+
+  /// Hard cut on an onset at least strength times the recent average flux
+  /// instead of on a jump of the volume over the hard cut sensitivity. Cuts
+  /// then land on the beat a frame or more sooner. 0, the default, keeps the
+  /// volume jump, or the "Hard Cut Onset Strength" key of the config file
+  void setOnsetHardCuts(float strength) { _onsetHardCuts = strength; }
 
   inline void setShuffleEnabled(bool value)
   {
@@ -247,11 +373,22 @@ public:
   /// Occurs whenever preset rating has changed via changePresetRating() method
   virtual void presetRatingChanged(unsigned int index, int rating, PresetRatingType ratingType) const {};
 
+  /// Occurs when the preset at index misses the frame time at the lowest
+  /// adaptive quality for several seconds, once per time it is loaded
+  virtual void presetTooHeavyEvent(unsigned int index, float frameTime) const {};
+
+  /// Occurs for every stage of the preset at index over its budget in a
+  /// frame, see setStageBudget()
+  virtual void presetOverBudgetEvent(unsigned int index, const BudgetViolation & violation) const {};
+
+  /// Occurs once per onset detected in the audio, on the rendering thread at
+  /// the start of the next frame. onsetDetector().time() - event.time is its age
+  virtual void onsetEvent(const OnsetEvent & event) const {};
+
 
   inline PCM * pcm() {
 	  return _pcm;
   }
-  void *thread_func(void *vptr_args);
   PipelineContext & pipelineContext() { return *_pipelineContext; }
   PipelineContext & pipelineContext2() { return *_pipelineContext2; }
 
@@ -264,24 +401,70 @@ private:
   double sampledPresetDuration();
   BeatDetect * beatDetect;
   Renderer *renderer;
+  /// Outputs from 1 on, 0 where one was removed
+  std::vector<Renderer*> _outputs;
   PipelineContext * _pipelineContext;
   PipelineContext * _pipelineContext2;
+  /// Runs the tasks of each frame on all cores when built with USE_THREADS
+  TaskScheduler * _scheduler;
+  FrameTasks * _frameTasks;
+  /// Only allocated when built with SYNC_PRESET_SWITCHES
+  PresetSwitchLock * _switchLock;
+  bool _pipelined;
+  /// Time of renderFrameAt()
+  ManualClock _stepClock;
   Settings _settings;
 
+  StartupTrace _startupTrace;
+
+  /** Stage timings of the frame in progress, and of the blend target preset
+   *  which is evaluated next to it */
+  FrameStats _frameStats;
+  FrameStats _frameStats2;
+  FrameHistogram _frameHistogram;
+  double _startupMark;
+  void beginStartupTrace();
+  void traceStartup(const char * step);
+
 
   int wvw;      //windowed dimensions
   int wvh;
 
   /** Timing information */
-  int mspf;
-  int timed;
-  int timestart;
   int count;
-  float fpsstart;
+  FramePacer _pacer;
+  QualityGovernor _governor;
+  void applyQuality();
+
+  StageBudget _budget;
+  /// The active preset stayed over budget, the next one is selected
+  bool _budgetCut;
+  void checkBudget();
+
+  PresetCostPolicy _costPolicy;
+  float _costBudget;
+  /// Frame times of the preset at _costURL since it began playing alone
+  std::string _costURL;
+  std::vector<float> _costFrames;
+  /// PRESET_COST_FILE in the directory of the config file, empty without one
+  std::string _costsFile;
+  int _costSettleFrames;
+  void measurePresetCost();
+  void finishPresetCost();
+  void applyCostBudget();
+
+  OnsetDetector _onsets;
+  /// Onset strength of a hard cut, 0 for cuts on volume jumps
+  float _onsetHardCuts;
 
   void readConfig(const std::string &configFile);
   void readSettings(const Settings &settings);
   void projectM_init(int gx, int gy, int fps, int texsize, int width, int height);
+  Pipeline & prepareFrame();
+  bool takeSnapshot(const Pipeline & pipeline);
+  void drawFrame(const Pipeline & pipeline, const PipelineContext & context);
+  void showPipeline(Pipeline & pipeline);
+  Renderer * output(unsigned int output) const;
   void projectM_reset();
 
   void projectM_initengine();
@@ -316,8 +499,6 @@ private:
   RenderItemMatcher * _matcher;
   MasterRenderItemMerge * _merger;
 
-  bool running;
-
   Pipeline* currentPipe;
 
 void switchPreset(std::auto_ptr<Preset> & targetPreset);
@@ -27,6 +27,12 @@
 #include "timer.h"
 #include <stdlib.h>
 
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#elif !defined(WIN32)
+#include <time.h>
+#endif
+
 #ifndef WIN32
 /** Get number of ticks since the given timestamp */
 unsigned int getTicks( struct timeval *start )
@@ -47,5 +53,26 @@ unsigned int getTicks( long start )
 
 #endif /** !WIN32 */
 
+double getMonotonicTime()
+{
+#if defined(WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
 
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart * 1000.0 / frequency.QuadPart;
+#elif defined(__APPLE__)
+    static mach_timebase_info_data_t timebase;
 
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+    return mach_absolute_time() * (double) timebase.numer / timebase.denom / 1000000.0;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#endif
+}
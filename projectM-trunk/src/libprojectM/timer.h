@@ -48,4 +48,8 @@ unsigned int getTicks( long start );
 
 #endif /** !WIN32 */
 
+/** Milliseconds on a monotonic clock with sub-millisecond resolution. Only
+ *  differences between two readings are meaningful */
+double getMonotonicTime();
+
 #endif /** _TIMER_H */
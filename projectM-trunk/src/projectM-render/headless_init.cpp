@@ -0,0 +1,141 @@
+//headless_init.cpp - offscreen OpenGL context without a display server
+//
+//Renders into an EGL pbuffer. Mesa's surfaceless platform needs no X server
+//or GPU at all, anything else falls back to the default display.
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstdio>
+
+#include "headless_init.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+static EGLConfig config;
+
+struct HeadlessContext {
+    EGLContext context;
+    EGLSurface surface;
+};
+
+static EGLDisplay open_display()
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (getPlatformDisplay) {
+        EGLDisplay surfaceless = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (surfaceless != EGL_NO_DISPLAY && eglInitialize(surfaceless, NULL, NULL))
+            return surfaceless;
+    }
+
+    EGLDisplay fallback = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (fallback != EGL_NO_DISPLAY && eglInitialize(fallback, NULL, NULL))
+        return fallback;
+
+    return EGL_NO_DISPLAY;
+}
+
+static bool create_context(int width, int height, EGLContext & newContext, EGLSurface & newSurface)
+{
+    const EGLint surfaceAttributes[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+
+    /* projectM draws with the fixed function pipeline, so a compatibility context */
+    eglBindAPI(EGL_OPENGL_API);
+    newContext = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+    newSurface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+
+    if (newContext == EGL_NO_CONTEXT || newSurface == EGL_NO_SURFACE ||
+        !eglMakeCurrent(display, newSurface, newSurface, newContext)) {
+        fprintf(stderr, "OpenGL context creation failed: EGL error 0x%x\n", eglGetError());
+        return false;
+    }
+
+    return true;
+}
+
+bool init_headless(int width, int height)
+{
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 16,
+        EGL_NONE
+    };
+
+    display = open_display();
+    if (display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "No EGL display available\n");
+        return false;
+    }
+
+    EGLint configs = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs < 1) {
+        fprintf(stderr, "No EGL config renders OpenGL into a pbuffer\n");
+        close_headless();
+        return false;
+    }
+
+    if (!create_context(width, height, context, surface)) {
+        close_headless();
+        return false;
+    }
+
+    return true;
+}
+
+void close_headless()
+{
+    if (display == EGL_NO_DISPLAY)
+        return;
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    if (context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+    eglTerminate(display);
+
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+    surface = EGL_NO_SURFACE;
+}
+
+HeadlessContext * create_headless_context(int width, int height)
+{
+    if (display == EGL_NO_DISPLAY)
+        return 0;
+
+    HeadlessContext * created = new HeadlessContext;
+    if (!create_context(width, height, created->context, created->surface)) {
+        destroy_headless_context(created);
+        return 0;
+    }
+
+    return created;
+}
+
+void destroy_headless_context(HeadlessContext * destroyed)
+{
+    if (destroyed == 0)
+        return;
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (destroyed->surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, destroyed->surface);
+    if (destroyed->context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, destroyed->context);
+    delete destroyed;
+}
@@ -0,0 +1,14 @@
+//headless_init.h - offscreen OpenGL context without a display server
+
+/// Makes an OpenGL context current that renders into an offscreen surface of
+/// width x height. False if EGL has no such context to offer
+bool init_headless(int width, int height);
+void close_headless();
+
+/// Another context on the display init_headless() opened, sharing nothing
+/// with its context, made current on the calling thread. Each thread
+/// rendering on its own needs one. 0 if EGL has none to offer
+struct HeadlessContext;
+HeadlessContext * create_headless_context(int width, int height);
+/// Called on the thread the context is current on, before close_headless()
+void destroy_headless_context(HeadlessContext * context);
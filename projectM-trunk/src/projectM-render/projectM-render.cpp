@@ -0,0 +1,320 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Renders an audio file to raw video, headless and as fast as the GPU goes.
+ * Every video frame gets exactly the samples that play during it, time comes
+ * from the frame number and the random numbers from a fixed seed, so the same
+ * input renders the same video. Frames are captured one frame late, so the
+ * GPU copies frame N while frame N-1 is written out, and converted to I420
+ * on the GPU for y4m.
+ *
+ * usage: projectM-render [options] AUDIO
+ *   -o FILE     output file, - for stdout (default)
+ *   -f FORMAT   y4m (default, 4:2:0) or rgb (raw rgb24, top row first)
+ *   -s WxH      frame size (default 1280x720)
+ *   -r FPS      frame rate (default 30)
+ *   -p PATH     preset directory, or a single preset file
+ *   -d SECONDS  preset duration (default 15)
+ *   -t SIZE     texture size (default 1024)
+ *   -S SEED     random seed (default 1)
+ *
+ * AUDIO is anything libsndfile reads: WAV, FLAC, Ogg... For example
+ *   projectM-render -p presets song.flac | ffmpeg -i - -i song.flac -shortest song.mp4
+ */
+
+#include <projectM.hpp>
+
+#include "headless_init.h"
+
+#include <sndfile.h>
+
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef PROJECTM_PREFIX
+#define PROJECTM_PREFIX "/usr/local"
+#endif
+
+enum Format { FORMAT_Y4M, FORMAT_RGB };
+
+struct Options {
+    std::string audio;
+    std::string output;
+    Format format;
+    int width;
+    int height;
+    int fps;
+    std::string presets;
+    int presetDuration;
+    int textureSize;
+    unsigned int seed;
+};
+
+/// Writes captured frames as Y4M or raw RGB
+class FrameWriter : public FrameSink
+{
+public:
+    FrameWriter(FILE * file, Format format, int width, int height, int fps)
+        : _file(file), _format(format), _frames(0), _failed(false)
+    {
+        if (_format == FORMAT_Y4M)
+            fprintf(_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+    }
+
+    void frameCaptured(const CapturedFrame & frame)
+    {
+        if (_format == FORMAT_Y4M)
+            fputs("FRAME\n", _file);
+
+        if (fwrite(frame.data, 1, frame.size, _file) != frame.size)
+            _failed = true;
+        _frames++;
+    }
+
+    CapturedFrame::Format captureFormat() const
+    {
+        return _format == FORMAT_Y4M ? CapturedFrame::FORMAT_I420 : CapturedFrame::FORMAT_RGB;
+    }
+
+    int frames() const { return _frames; }
+    bool failed() const { return _failed || ferror(_file); }
+
+private:
+    FILE * _file;
+    Format _format;
+    int _frames;
+    bool _failed;
+};
+
+static double seconds(const struct timeval & start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start.tv_sec) + (now.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+static bool isPresetFile(const std::string & path)
+{
+    const std::string::size_type dot = path.rfind('.');
+    if (dot == std::string::npos)
+        return false;
+
+    const std::string extension = path.substr(dot + 1);
+    return extension == "milk" || extension == "prjm" || extension == "so";
+}
+
+static int usage(const char * name)
+{
+    std::cerr << "usage: " << name << " [-o FILE] [-f y4m|rgb] [-s WxH] [-r FPS] [-p PRESETS]"
+              << " [-d SECONDS] [-t TEXSIZE] [-S SEED] AUDIO" << std::endl;
+    return 1;
+}
+
+static bool parseOptions(int argc, char **argv, Options & options)
+{
+    options.output = "-";
+    options.format = FORMAT_Y4M;
+    options.width = 1280;
+    options.height = 720;
+    options.fps = 30;
+    options.presets = PROJECTM_PREFIX "/share/projectM/presets";
+    options.presetDuration = 15;
+    options.textureSize = 1024;
+    options.seed = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const bool value = i + 1 < argc;
+
+        if (!strcmp(argv[i], "-o") && value)
+            options.output = argv[++i];
+        else if (!strcmp(argv[i], "-f") && value) {
+            const std::string format = argv[++i];
+            if (format == "y4m")
+                options.format = FORMAT_Y4M;
+            else if (format == "rgb")
+                options.format = FORMAT_RGB;
+            else
+                return false;
+        } else if (!strcmp(argv[i], "-s") && value) {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2)
+                return false;
+        } else if (!strcmp(argv[i], "-r") && value)
+            options.fps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-p") && value)
+            options.presets = argv[++i];
+        else if (!strcmp(argv[i], "-d") && value)
+            options.presetDuration = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && value)
+            options.textureSize = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-S") && value)
+            options.seed = strtoul(argv[++i], NULL, 10);
+        else if (argv[i][0] != '-' && options.audio.empty())
+            options.audio = argv[i];
+        else
+            return false;
+    }
+
+    if (options.format == FORMAT_Y4M && (options.width % 4 || options.height % 2)) {
+        std::cerr << "y4m frames need a width divisible by 4 and an even height" << std::endl;
+        return false;
+    }
+
+    return !options.audio.empty() && options.width > 0 && options.height > 0 &&
+        options.fps > 0 && options.presetDuration > 0 && options.textureSize > 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return usage(argv[0]);
+
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE * audio = sf_open(options.audio.c_str(), SFM_READ, &info);
+    if (!audio) {
+        std::cerr << "cannot read " << options.audio << ": " << sf_strerror(NULL) << std::endl;
+        return 1;
+    }
+
+    FILE * output = options.output == "-" ? stdout : fopen(options.output.c_str(), "wb");
+    if (!output) {
+        std::cerr << "cannot write " << options.output << std::endl;
+        sf_close(audio);
+        return 1;
+    }
+
+    if (!init_headless(options.width, options.height)) {
+        std::cerr << "no headless OpenGL context" << std::endl;
+        sf_close(audio);
+        return 1;
+    }
+
+    const bool singlePreset = isPresetFile(options.presets);
+
+    projectM::Settings settings;
+    settings.meshX = 48;
+    settings.meshY = 36;
+    settings.fps = options.fps;
+    settings.textureSize = options.textureSize;
+    settings.windowWidth = options.width;
+    settings.windowHeight = options.height;
+    settings.presetURL = singlePreset ? std::string() : options.presets;
+    settings.titleFontURL = PROJECTM_PREFIX "/share/projectM/fonts/Vera.ttf";
+    settings.menuFontURL = PROJECTM_PREFIX "/share/projectM/fonts/VeraMono.ttf";
+    settings.smoothPresetDuration = 5;
+    settings.presetDuration = options.presetDuration;
+    settings.beatSensitivity = 10;
+    settings.aspectCorrection = true;
+    settings.easterEgg = 0;
+    settings.shuffleEnabled = true;
+    settings.softCutRatingsEnabled = false;
+
+    projectM * pm = new projectM(settings, singlePreset ? projectM::FLAG_DISABLE_PLAYLIST_LOAD : projectM::FLAG_NONE);
+    pm->projectM_resetGL(options.width, options.height);
+    pm->setRandomSeed(options.seed);
+    pm->onsetDetector().setSampleRate(info.samplerate);
+
+    if (singlePreset) {
+        RatingList ratings;
+        ratings.push_back(3);
+        ratings.push_back(3);
+        pm->addPresetURL(options.presets, options.presets, ratings);
+        pm->setPresetLock(true);
+    }
+
+    if (pm->getPlaylistSize() == 0) {
+        std::cerr << "no presets found at " << options.presets << std::endl;
+        delete pm;
+        close_headless();
+        sf_close(audio);
+        return 1;
+    }
+    pm->selectRandom(true);
+
+    const int channels = info.channels;
+    const long long rate = info.samplerate;
+    const long long frames = (info.frames * options.fps + rate - 1) / rate;
+
+    std::cerr << "rendering " << frames << " frames of " << options.width << "x" << options.height
+              << " at " << options.fps << " fps from " << options.audio << std::endl;
+
+    FrameWriter writer(output, options.format, options.width, options.height, options.fps);
+    if (!pm->startCapture(&writer, options.width, options.height, writer.captureFormat(), 1)) {
+        delete pm;
+        close_headless();
+        sf_close(audio);
+        return 1;
+    }
+
+    std::vector<float> samples;
+    std::vector<float> stereo;
+
+    struct timeval start;
+    gettimeofday(&start, NULL);
+
+    int frame = 0;
+
+    for (; !writer.failed(); frame++) {
+        /* The samples playing from this frame up to the next one */
+        const int count = (frame + 1) * rate / options.fps - frame * rate / options.fps;
+        samples.resize(count * channels);
+        const int read = sf_readf_float(audio, &samples[0], count);
+        if (read <= 0)
+            break;
+
+        if (channels == 1)
+            pm->pcm()->addPCMfloat(&samples[0], read);
+        else {
+            stereo.resize(read * 2);
+            for (int i = 0; i < read; i++) {
+                stereo[i * 2] = samples[i * channels];
+                stereo[i * 2 + 1] = samples[i * channels + 1];
+            }
+            pm->pcm()->addPCMfloat_2ch(&stereo[0], read);
+        }
+
+        pm->renderFrameAt(frame / (double) options.fps, 0, 0);
+    }
+    pm->stopCapture(&writer);
+
+    const bool ok = !writer.failed() && writer.frames() == frame;
+    const double elapsed = seconds(start);
+    std::cerr << "rendered " << writer.frames() << " frames in " << elapsed << " s, "
+              << writer.frames() / (elapsed * options.fps) << "x real time" << std::endl;
+
+    if (!ok)
+        std::cerr << "writing " << options.output << " failed" << std::endl;
+
+    delete pm;
+    close_headless();
+    sf_close(audio);
+    if (output != stdout)
+        fclose(output);
+
+    return ok ? 0 : 1;
+}
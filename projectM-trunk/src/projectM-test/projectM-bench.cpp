@@ -0,0 +1,586 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Benchmark: runs a fixed list of reference presets for N frames on
+ * synthetic audio and a virtual clock, so two runs on the same machine
+ * see exactly the same input, and prints the results as JSON.
+ *
+ * The cpu mode evaluates the preset equations and the warp mesh without
+ * a GL context; custom wave per point equations run while drawing, so only
+ * the gl mode covers them. The gl mode renders through projectM.
+ *
+ * usage: projectM-bench [options]
+ *   --frames N        frames per run (default 600)
+ *   --mode M          cpu, gl or both (default both)
+ *   --audio A         sine, noise, wav or all (default all, wav needs --wav)
+ *   --wav FILE        16 bit PCM WAV file to loop
+ *   --presets DIR     directory holding the reference presets
+ *   --set S           reference (default) or nested-if, the list of presets to run
+ *   --preset NAME     preset in DIR to run instead of a list, repeatable
+ *   --jit on|off      compile the equations to native code where available (default on)
+ *   --output FILE     write the JSON to FILE instead of stdout
+ *   --baseline FILE   compare against an earlier --output and fail on regressions
+ *   --tolerance F     slowdown allowed against the baseline (default 0.10)
+ */
+
+#include <SDL/SDL.h>
+#include <GL/gl.h>
+#include "video_init.h"
+#include <projectM.hpp>
+
+#include "PresetFactoryManager.hpp"
+#include "Renderer/BeatDetect.hpp"
+#include "Renderer/PipelineContext.hpp"
+#include "MilkdropPresetFactory/ExprJit.hpp"
+
+#include <time.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BENCH_FPS 60
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_SAMPLES_PER_FRAME (BENCH_SAMPLE_RATE / BENCH_FPS)
+#define BENCH_MESH_X 32
+#define BENCH_MESH_Y 24
+#define BENCH_SIZE 512
+#define BENCH_SEED 1234
+
+/// Presets picked to cover per frame, per pixel, custom wave and custom shape heavy code
+static const char * referencePresets[] = {
+    "Aderrasi - Aimless (Gravity Directive Mix).milk",
+    "Aderrasi - Agitator.milk",
+    "Krash - 3D Shapes Demo.milk",
+    "Eo.s and PieturP - Starfield.milk",
+    "CatalystTheElder - Electric Rosebud_Phat_texture_edit.milk",
+    0
+};
+
+/// Presets branching a lot in their per pixel and per point equations, for
+/// the cost of if, band and bor
+static const char * nestedIfPresets[] = {
+    "Rozzor & Shreyas - Deeper Aesthetics.milk",
+    "Unchained - Deeper Logic.milk",
+    "fiShbRaiN - brainstem activation.milk",
+    "Krash - Framed Geometry.milk",
+    "Mstress & Juppy - Dancers In The Dark.milk",
+    0
+};
+
+/* Every operator new while measuring is counted, including those in libprojectM */
+static volatile unsigned long allocations = 0;
+
+void * operator new(size_t size) throw(std::bad_alloc)
+{
+    __sync_add_and_fetch(&allocations, 1);
+
+    void * memory = malloc(size ? size : 1);
+    if (memory == 0)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void * memory) throw()
+{
+    free(memory);
+}
+
+static double now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000.0 + time.tv_nsec / 1000000.0;
+}
+
+/// Mono samples in -1..1 from a 16 bit PCM WAV file, empty on failure
+static std::vector<float> loadWav(const std::string & filename)
+{
+    std::vector<float> samples;
+
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    char header[12];
+    if (!file.read(header, 12) || strncmp(header, "RIFF", 4) || strncmp(header + 8, "WAVE", 4)) {
+        std::cerr << "[bench] " << filename << " is not a WAV file" << std::endl;
+        return samples;
+    }
+
+    unsigned short channels = 0, bits = 0;
+    char chunk[8];
+    while (file.read(chunk, 8)) {
+        const unsigned char * size = (const unsigned char *) chunk + 4;
+        const unsigned int length = size[0] | (size[1] << 8) | (size[2] << 16) | (size[3] << 24);
+
+        if (!strncmp(chunk, "fmt ", 4)) {
+            std::vector<unsigned char> format(length);
+            if (length < 16 || !file.read((char *) &format[0], length))
+                break;
+            channels = format[2] | (format[3] << 8);
+            bits = format[14] | (format[15] << 8);
+        } else if (!strncmp(chunk, "data", 4)) {
+            if (channels == 0 || bits != 16) {
+                std::cerr << "[bench] " << filename << ": only 16 bit PCM is supported" << std::endl;
+                break;
+            }
+
+            std::vector<unsigned char> data(length);
+            file.read((char *) &data[0], length);
+            const unsigned int frames = file.gcount() / (2 * channels);
+
+            samples.resize(frames);
+            for (unsigned int i = 0; i < frames; i++) {
+                float sum = 0;
+                for (unsigned int c = 0; c < channels; c++) {
+                    const unsigned char * sample = &data[(i * channels + c) * 2];
+                    sum += (short) (sample[0] | (sample[1] << 8)) / 32768.0f;
+                }
+                samples[i] = sum / channels;
+            }
+            break;
+        } else {
+            file.seekg(length + (length & 1), std::ios::cur);
+        }
+    }
+
+    return samples;
+}
+
+/// Deterministic audio: a repeating 10 second log sweep, seeded noise or a WAV loop
+class AudioSource
+{
+public:
+    AudioSource(const std::string & kind, const std::vector<float> & wav)
+        : _kind(kind), _wav(wav), _position(0), _phase(0), _seed(BENCH_SEED) {}
+
+    void fill(float * buffer, int samples)
+    {
+        for (int i = 0; i < samples; i++, _position++) {
+            if (_kind == "sine") {
+                const double sweep = (_position % (BENCH_SAMPLE_RATE * 10)) / (double) (BENCH_SAMPLE_RATE * 10);
+                const double frequency = 20.0 * pow(500.0, sweep);
+                _phase += 2 * M_PI * frequency / BENCH_SAMPLE_RATE;
+                buffer[i] = 0.8f * sin(_phase);
+            } else if (_kind == "noise") {
+                _seed = _seed * 1103515245 + 12345;
+                buffer[i] = ((_seed >> 16) & 0x7fff) / 16384.0f - 1.0f;
+            } else {
+                buffer[i] = _wav[_position % _wav.size()];
+            }
+        }
+    }
+
+private:
+    std::string _kind;
+    const std::vector<float> & _wav;
+    unsigned long _position;
+    double _phase;
+    unsigned int _seed;
+};
+
+struct Result {
+    std::string preset;
+    std::string audio;
+    std::string mode;
+    int frames;
+    double fps;
+    double p50;
+    double p99;
+    double allocationsPerFrame;
+};
+
+/// Fills in the numbers of result from per frame times in milliseconds
+static void summarize(std::vector<double> times, unsigned long allocated, Result & result)
+{
+    double total = 0;
+    for (unsigned int i = 0; i < times.size(); i++)
+        total += times[i];
+
+    std::sort(times.begin(), times.end());
+
+    result.frames = times.size();
+    result.fps = total > 0 ? times.size() * 1000.0 / total : 0;
+    result.p50 = times.empty() ? 0 : times[(times.size() - 1) / 2];
+    result.p99 = times.empty() ? 0 : times[(int) ((times.size() - 1) * 0.99)];
+    result.allocationsPerFrame = times.empty() ? 0 : allocated / (double) times.size();
+}
+
+static bool runCpu(const std::string & url, AudioSource & audio, int frames, Result & result)
+{
+    const std::string::size_type dot = url.rfind('.');
+    const std::string extension = dot == std::string::npos ? std::string() : url.substr(dot + 1);
+
+    PresetFactoryManager factories;
+    factories.initialize(BENCH_MESH_X, BENCH_MESH_Y);
+
+    srand(BENCH_SEED);
+
+    std::auto_ptr<Preset> preset;
+    try {
+        preset = factories.factory(extension).allocate(url);
+    } catch (const PresetFactoryException & e) {
+        std::cerr << "[bench] " << e.message() << std::endl;
+        return false;
+    } catch (...) {
+        std::cerr << "[bench] failed to load " << url << std::endl;
+        return false;
+    }
+
+    PCM pcm;
+    BeatDetect beatDetect(&pcm);
+    PipelineContext context;
+    context.fps = BENCH_FPS;
+
+    std::vector<double> times;
+    float buffer[BENCH_SAMPLES_PER_FRAME];
+    const unsigned long allocated = allocations;
+
+    for (int frame = 0; frame < frames; frame++) {
+        audio.fill(buffer, BENCH_SAMPLES_PER_FRAME);
+        pcm.addPCMfloat(buffer, BENCH_SAMPLES_PER_FRAME);
+
+        const double start = now();
+
+        beatDetect.detectFromSamples();
+        context.time = frame / (float) BENCH_FPS;
+        context.frame = frame + 1;
+        context.progress = 0;
+        preset->Render(beatDetect, context);
+
+        times.push_back(now() - start);
+    }
+
+    summarize(times, allocations - allocated, result);
+    return true;
+}
+
+static bool runGl(projectM & pm, const std::string & url, const std::string & name,
+                  AudioSource & audio, int frames, Result & result)
+{
+    const unsigned int index = pm.addPresetURL(url, name, RatingList(TOTAL_RATING_TYPES, 3));
+
+    srand(BENCH_SEED);
+    pm.setFixedTimestep(1.0 / BENCH_FPS);
+    pm.selectPreset(index, true);
+
+    std::vector<double> times;
+    float buffer[BENCH_SAMPLES_PER_FRAME];
+    const unsigned long allocated = allocations;
+
+    for (int frame = 0; frame < frames; frame++) {
+        audio.fill(buffer, BENCH_SAMPLES_PER_FRAME);
+        pm.pcm()->addPCMfloat(buffer, BENCH_SAMPLES_PER_FRAME);
+
+        const double start = now();
+
+        pm.renderFrame();
+        glFinish();
+
+        times.push_back(now() - start);
+
+        SDL_GL_SwapBuffers();
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event))
+            if (event.type == SDL_QUIT)
+                return false;
+    }
+
+    summarize(times, allocations - allocated, result);
+    return true;
+}
+
+static std::string escape(const std::string & value)
+{
+    std::string escaped;
+    for (unsigned int i = 0; i < value.size(); i++) {
+        if (value[i] == '"' || value[i] == '\\')
+            escaped += '\\';
+        escaped += value[i];
+    }
+    return escaped;
+}
+
+static void writeJson(std::ostream & out, int frames, const std::vector<Result> & results)
+{
+    out << "{" << std::endl;
+    out << "  \"frames\": " << frames << "," << std::endl;
+    out << "  \"results\": [" << std::endl;
+
+    /* One result per line, readBaseline() depends on it */
+    for (unsigned int i = 0; i < results.size(); i++) {
+        const Result & result = results[i];
+        out << "    {\"preset\": \"" << escape(result.preset) << "\", \"audio\": \"" << result.audio
+            << "\", \"mode\": \"" << result.mode << "\", \"frames\": " << result.frames
+            << ", \"fps\": " << result.fps << ", \"p50_ms\": " << result.p50 << ", \"p99_ms\": " << result.p99
+            << ", \"allocs_per_frame\": " << result.allocationsPerFrame << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+
+    out << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
+
+static std::string jsonString(const std::string & line, const std::string & key)
+{
+    std::string::size_type pos = line.find("\"" + key + "\": \"");
+    if (pos == std::string::npos)
+        return std::string();
+
+    std::string value;
+    for (pos += key.size() + 5; pos < line.size() && line[pos] != '"'; pos++) {
+        if (line[pos] == '\\' && pos + 1 < line.size())
+            pos++;
+        value += line[pos];
+    }
+    return value;
+}
+
+static double jsonNumber(const std::string & line, const std::string & key)
+{
+    const std::string::size_type pos = line.find("\"" + key + "\": ");
+    if (pos == std::string::npos)
+        return 0;
+    return atof(line.c_str() + pos + key.size() + 4);
+}
+
+/// Reads the results of an earlier run written by writeJson()
+static std::vector<Result> readBaseline(const std::string & filename)
+{
+    std::vector<Result> results;
+    std::ifstream file(filename.c_str());
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find("\"preset\": ") == std::string::npos)
+            continue;
+
+        Result result;
+        result.preset = jsonString(line, "preset");
+        result.audio = jsonString(line, "audio");
+        result.mode = jsonString(line, "mode");
+        result.frames = (int) jsonNumber(line, "frames");
+        result.fps = jsonNumber(line, "fps");
+        result.p50 = jsonNumber(line, "p50_ms");
+        result.p99 = jsonNumber(line, "p99_ms");
+        result.allocationsPerFrame = jsonNumber(line, "allocs_per_frame");
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+/// Prints every run whose median frame time got slower than the baseline allows,
+/// returns how many did. p99 is too noisy on short runs to fail on
+static int compare(const std::vector<Result> & results, const std::vector<Result> & baseline, double tolerance)
+{
+    int regressions = 0;
+
+    for (unsigned int i = 0; i < results.size(); i++) {
+        const Result & current = results[i];
+
+        for (unsigned int j = 0; j < baseline.size(); j++) {
+            const Result & previous = baseline[j];
+            if (previous.preset != current.preset || previous.audio != current.audio || previous.mode != current.mode)
+                continue;
+
+            const bool slower = current.p50 > previous.p50 * (1 + tolerance);
+
+            std::cerr << "[bench] " << (slower ? "REGRESSION " : "") << current.mode << " " << current.audio
+                      << " \"" << current.preset << "\": p50 " << previous.p50 << " -> " << current.p50
+                      << "ms, p99 " << previous.p99 << " -> " << current.p99 << "ms, allocs/frame "
+                      << previous.allocationsPerFrame << " -> " << current.allocationsPerFrame << std::endl;
+
+            if (slower)
+                regressions++;
+            break;
+        }
+    }
+
+    return regressions;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 600;
+    std::string mode = "both";
+    std::string audioKind = "all";
+    std::string wavFile;
+    std::string presetDir = std::string(PROJECTM_PREFIX) + "/share/projectM/presets";
+    std::string presetSet = "reference";
+    std::vector<std::string> presets;
+    std::string outputFile;
+    std::string baselineFile;
+    double tolerance = 0.10;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (option == "--frames" && hasValue)
+            frames = atoi(argv[++i]);
+        else if (option == "--mode" && hasValue)
+            mode = argv[++i];
+        else if (option == "--audio" && hasValue)
+            audioKind = argv[++i];
+        else if (option == "--wav" && hasValue)
+            wavFile = argv[++i];
+        else if (option == "--presets" && hasValue)
+            presetDir = argv[++i];
+        else if (option == "--set" && hasValue)
+            presetSet = argv[++i];
+        else if (option == "--preset" && hasValue)
+            presets.push_back(argv[++i]);
+        else if (option == "--jit" && hasValue)
+            ExprJit::setEnabled(std::string(argv[++i]) != "off");
+        else if (option == "--output" && hasValue)
+            outputFile = argv[++i];
+        else if (option == "--baseline" && hasValue)
+            baselineFile = argv[++i];
+        else if (option == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else {
+            std::cerr << "usage: projectM-bench [--frames N] [--mode cpu|gl|both] [--audio sine|noise|wav|all]"
+                      << " [--wav FILE] [--presets DIR] [--set reference|nested-if] [--preset NAME]..."
+                      << " [--jit on|off] [--output FILE]"
+                      << " [--baseline FILE] [--tolerance F]" << std::endl;
+            return 2;
+        }
+    }
+
+    if (presets.empty()) {
+        const char ** list = referencePresets;
+        if (presetSet == "nested-if")
+            list = nestedIfPresets;
+        else if (presetSet != "reference") {
+            std::cerr << "[bench] unknown preset set " << presetSet << std::endl;
+            return 2;
+        }
+
+        for (int i = 0; list[i]; i++)
+            presets.push_back(list[i]);
+    }
+
+    std::vector<float> wav;
+    if (!wavFile.empty()) {
+        wav = loadWav(wavFile);
+        if (wav.empty())
+            return 2;
+    }
+
+    std::vector<std::string> audioKinds;
+    if (audioKind == "all" || audioKind == "sine")
+        audioKinds.push_back("sine");
+    if (audioKind == "all" || audioKind == "noise")
+        audioKinds.push_back("noise");
+    if ((audioKind == "all" && !wav.empty()) || audioKind == "wav") {
+        if (wav.empty()) {
+            std::cerr << "[bench] --audio wav needs --wav FILE" << std::endl;
+            return 2;
+        }
+        audioKinds.push_back("wav");
+    }
+
+    std::vector<Result> results;
+
+    if (mode == "cpu" || mode == "both") {
+        for (unsigned int p = 0; p < presets.size(); p++) {
+            for (unsigned int a = 0; a < audioKinds.size(); a++) {
+                AudioSource audio(audioKinds[a], wav);
+                Result result;
+                result.preset = presets[p];
+                result.audio = audioKinds[a];
+                result.mode = "cpu";
+
+                if (runCpu(presetDir + "/" + presets[p], audio, frames, result))
+                    results.push_back(result);
+            }
+        }
+    }
+
+    if (mode == "gl" || mode == "both") {
+        atexit(SDL_Quit);
+
+        int fvw, fvh;
+        init_display(BENCH_SIZE, BENCH_SIZE, &fvw, &fvh, false);
+
+        projectM::Settings settings;
+        settings.meshX = BENCH_MESH_X;
+        settings.meshY = BENCH_MESH_Y;
+        settings.fps = BENCH_FPS;
+        settings.textureSize = BENCH_SIZE;
+        settings.windowWidth = BENCH_SIZE;
+        settings.windowHeight = BENCH_SIZE;
+        settings.presetURL = presetDir;
+        settings.smoothPresetDuration = 0;
+        settings.presetDuration = 100000;
+        settings.beatSensitivity = 10;
+        settings.aspectCorrection = true;
+        settings.easterEgg = 0;
+        settings.shuffleEnabled = false;
+        settings.softCutRatingsEnabled = false;
+
+        projectM pm(settings, projectM::FLAG_DISABLE_PLAYLIST_LOAD);
+        pm.setPresetLock(true);
+
+        for (unsigned int p = 0; p < presets.size(); p++) {
+            for (unsigned int a = 0; a < audioKinds.size(); a++) {
+                AudioSource audio(audioKinds[a], wav);
+                Result result;
+                result.preset = presets[p];
+                result.audio = audioKinds[a];
+                result.mode = "gl";
+
+                if (runGl(pm, presetDir + "/" + presets[p], presets[p], audio, frames, result))
+                    results.push_back(result);
+            }
+        }
+    }
+
+    if (outputFile.empty()) {
+        writeJson(std::cout, frames, results);
+    } else {
+        std::ofstream out(outputFile.c_str());
+        writeJson(out, frames, results);
+    }
+
+    if (!baselineFile.empty()) {
+        const std::vector<Result> baseline = readBaseline(baselineFile);
+        if (baseline.empty()) {
+            std::cerr << "[bench] no results in baseline " << baselineFile << std::endl;
+            return 2;
+        }
+
+        const int regressions = compare(results, baseline, tolerance);
+        if (regressions > 0) {
+            std::cerr << "[bench] FAILED: " << regressions << " runs slower than the baseline" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Writes a DXT compressed .dds next to every image it is given, so projectM
+ * uploads the textures as they are instead of decoding them at preset load.
+ * A directory stands for the images in it, .dds and .ktx files are skipped.
+ * Decoding and compressing happen on the CPU, no OpenGL context is needed.
+ *
+ * usage: projectM-dds IMAGE|DIRECTORY...
+ *   for example projectM-dds /usr/local/share/projectM/textures
+ */
+
+#include "Common.hpp"
+#include "Renderer/TextureManager.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <strings.h>
+
+static bool convert(const std::string & imageURL)
+{
+    const std::string extension = parseExtension(imageURL);
+    if (strcasecmp(extension.c_str(), "dds") == 0 || strcasecmp(extension.c_str(), "ktx") == 0)
+        return true;
+
+    const std::size_t dot = imageURL.find_last_of('.');
+    const std::size_t slash = imageURL.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        std::cerr << "[projectM-dds] " << imageURL << " has no extension, skipped" << std::endl;
+        return true;
+    }
+
+    const std::string ddsURL = imageURL.substr(0, dot + 1) + "dds";
+    if (!TextureManager::convertToDDS(imageURL, ddsURL))
+        return false;
+
+    std::cout << imageURL << " -> " << ddsURL << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: projectM-dds IMAGE|DIRECTORY..." << std::endl;
+        return 2;
+    }
+
+    int failures = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string path = argv[i];
+
+        DIR * dir = opendir(path.c_str());
+        if (dir == 0) {
+            if (!convert(path))
+                failures++;
+            continue;
+        }
+
+        std::vector<std::string> images;
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != 0)
+            if (entry->d_name[0] != '.')
+                images.push_back(path + "/" + entry->d_name);
+        closedir(dir);
+
+        for (std::vector<std::string>::const_iterator pos = images.begin(); pos != images.end(); ++pos)
+            if (!convert(*pos))
+                failures++;
+    }
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Runs several independent preset pipelines at once, one per thread, each
+ * with its own preset factories, preset, PCM and beat detection, the way a
+ * process driving several displays would. Every thread also tears its
+ * factories down and builds them again halfway through, which used to free
+ * the parser and builtin function state the other threads were using.
+ * Then it does the same with whole projectM instances, each rendering into
+ * an offscreen context of its own.
+ *
+ * The pipeline state after the last frame, and the pixels of the last frame
+ * rendered, are summed up and compared with a serial run of the same presets,
+ * so presets calling rand() will differ: pass ones that don't.
+ *
+ * Known limits, state still shared by all instances in the process:
+ *   - rand(), seeded by projectM::setRandomSeed()
+ *   - ExprJit::setEnabled(), a switch for the whole process; set it before
+ *     the instances start
+ *   - InitCond::init_cond_string_buffer, written by init_cond_to_string()
+ *     which nothing calls
+ *
+ * usage: projectM-test-instances PRESET [PRESET...]
+ *   -t N   threads (default 6), presets are handed out round robin
+ *   -f N   frames per thread (default 300)
+ */
+
+#include <projectM.hpp>
+
+#include "headless_init.h"
+#include "PresetFactoryManager.hpp"
+#include "Renderer/BeatDetect.hpp"
+#include "Renderer/PipelineContext.hpp"
+#include "Renderer/Pipeline.hpp"
+
+#include <GL/gl.h>
+#include <pthread.h>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_FPS 60
+#define TEST_SAMPLES_PER_FRAME (44100 / TEST_FPS)
+#define TEST_MESH_X 32
+#define TEST_MESH_Y 24
+#define TEST_WIDTH 160
+#define TEST_HEIGHT 120
+#define TEST_TEXTURE_SIZE 256
+
+struct Instance {
+    std::string url;
+    int frames;
+    bool loaded;
+    double sum;
+};
+
+static std::auto_ptr<Preset> loadPreset(PresetFactoryManager & factories, const std::string & url)
+{
+    const std::string::size_type dot = url.rfind('.');
+    const std::string extension = dot == std::string::npos ? std::string() : url.substr(dot + 1);
+
+    try {
+        return factories.factory(extension).allocate(url);
+    } catch (...) {
+        std::cerr << "[instances] failed to load " << url << std::endl;
+        return std::auto_ptr<Preset>();
+    }
+}
+
+static void fillSamples(float * buffer, int frame, double & phase)
+{
+    for (int i = 0; i < TEST_SAMPLES_PER_FRAME; i++) {
+        phase += 2 * M_PI * (100 + frame) / 44100.0;
+        buffer[i] = 0.8f * sin(phase);
+    }
+}
+
+/// Sum of everything the renderer would read from the pipeline
+static double pipelineSum(const Pipeline & pipeline)
+{
+    double sum = pipeline.screenDecay + pipeline.drawables.size();
+
+    for (unsigned int i = 0; i < NUM_Q_VARIABLES; i++)
+        sum += pipeline.q[i];
+
+    if (pipeline.staticPerPixel)
+        for (int x = 0; x < pipeline.gx; x++)
+            for (int y = 0; y < pipeline.gy; y++)
+                sum += pipeline.x_mesh[x][y] + pipeline.y_mesh[x][y];
+
+    return sum;
+}
+
+static void * runInstance(void * data)
+{
+    Instance & instance = *(Instance *) data;
+    instance.loaded = false;
+
+    PCM pcm;
+    BeatDetect beatDetect(&pcm);
+    PipelineContext context;
+    context.fps = TEST_FPS;
+
+    /* Milkdrop presets render into outputs owned by their factory */
+    std::auto_ptr<PresetFactoryManager> factories;
+    std::auto_ptr<Preset> preset;
+    float buffer[TEST_SAMPLES_PER_FRAME];
+    double phase = 0;
+
+    for (int frame = 0; frame < instance.frames; frame++) {
+        if (frame == 0 || frame == instance.frames / 2) {
+            preset.reset();
+            factories.reset(new PresetFactoryManager());
+            factories->initialize(TEST_MESH_X, TEST_MESH_Y);
+            preset = loadPreset(*factories, instance.url);
+            if (!preset.get())
+                return 0;
+        }
+
+        fillSamples(buffer, frame, phase);
+        pcm.addPCMfloat(buffer, TEST_SAMPLES_PER_FRAME);
+        beatDetect.detectFromSamples();
+
+        context.time = frame / (float) TEST_FPS;
+        context.frame = frame + 1;
+        context.progress = 0;
+        preset->Render(beatDetect, context);
+    }
+
+    instance.sum = pipelineSum(preset->pipeline());
+    instance.loaded = true;
+
+    preset.reset();
+    return 0;
+}
+
+/// A projectM of its own rendering the preset into a context of its own
+static void * renderInstance(void * data)
+{
+    Instance & instance = *(Instance *) data;
+    instance.loaded = false;
+
+    HeadlessContext * context = create_headless_context(TEST_WIDTH, TEST_HEIGHT);
+    if (!context)
+        return 0;
+
+    projectM::Settings settings;
+    settings.meshX = TEST_MESH_X;
+    settings.meshY = TEST_MESH_Y;
+    settings.fps = TEST_FPS;
+    settings.textureSize = TEST_TEXTURE_SIZE;
+    settings.windowWidth = TEST_WIDTH;
+    settings.windowHeight = TEST_HEIGHT;
+    settings.smoothPresetDuration = 5;
+    settings.presetDuration = 15;
+    settings.beatSensitivity = 10;
+    settings.aspectCorrection = true;
+    settings.easterEgg = 0;
+    settings.shuffleEnabled = false;
+    settings.softCutRatingsEnabled = false;
+
+    projectM * pm = new projectM(settings, projectM::FLAG_DISABLE_PLAYLIST_LOAD);
+    pm->projectM_resetGL(TEST_WIDTH, TEST_HEIGHT);
+    pm->setRandomSeed(1);
+
+    RatingList ratings;
+    ratings.push_back(3);
+    ratings.push_back(3);
+    pm->addPresetURL(instance.url, instance.url, ratings);
+    pm->setPresetLock(true);
+    pm->selectPreset(0);
+
+    float buffer[TEST_SAMPLES_PER_FRAME];
+    double phase = 0;
+    for (int frame = 0; frame < instance.frames; frame++) {
+        fillSamples(buffer, frame, phase);
+        pm->renderFrameAt(frame / (double) TEST_FPS, buffer, TEST_SAMPLES_PER_FRAME);
+    }
+
+    std::vector<unsigned char> pixels(TEST_WIDTH * TEST_HEIGHT * 4);
+    glReadPixels(0, 0, TEST_WIDTH, TEST_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+
+    instance.sum = 0;
+    for (unsigned int i = 0; i < pixels.size(); i++)
+        instance.sum += pixels[i] * (double) (i % 251 + 1);
+    instance.loaded = true;
+
+    delete pm;
+    destroy_headless_context(context);
+    return 0;
+}
+
+/// Runs every instance alone and then all of them at once, each on a thread
+/// of its own, and counts those where the two differ
+static int compareRuns(const char * name, void * (*run)(void *),
+                       const std::vector<std::string> & presets, int threads, int frames)
+{
+    std::vector<Instance> serial(threads);
+    std::vector<Instance> concurrent(threads);
+
+    for (int i = 0; i < threads; i++) {
+        serial[i].url = concurrent[i].url = presets[i % presets.size()];
+        serial[i].frames = concurrent[i].frames = frames;
+        run(&serial[i]);
+    }
+
+    std::vector<pthread_t> ids(threads);
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&ids[i], NULL, run, &concurrent[i]) != 0) {
+            std::cerr << "[instances] failed to start thread " << i << std::endl;
+            return threads;
+        }
+    }
+
+    for (int i = 0; i < threads; i++)
+        pthread_join(ids[i], NULL);
+
+    int failures = 0;
+    for (int i = 0; i < threads; i++) {
+        const bool match = serial[i].loaded && concurrent[i].loaded && serial[i].sum == concurrent[i].sum;
+        if (!match)
+            failures++;
+
+        std::cout << (match ? "ok   " : "FAIL ") << name << " " << i << " " << concurrent[i].url
+                  << " serial " << serial[i].sum << " concurrent " << concurrent[i].sum << std::endl;
+    }
+
+    std::cout << threads - failures << " of " << threads << " " << name << " instances matched" << std::endl;
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = 6;
+    int frames = 300;
+    std::vector<std::string> presets;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else
+            presets.push_back(argv[i]);
+    }
+
+    if (presets.empty() || threads < 1 || frames < 2) {
+        std::cerr << "usage: " << argv[0] << " [-t threads] [-f frames] PRESET [PRESET...]" << std::endl;
+        return 1;
+    }
+
+    int failures = compareRuns("pipeline", runInstance, presets, threads, frames);
+
+    if (!init_headless(TEST_WIDTH, TEST_HEIGHT)) {
+        std::cerr << "[instances] no headless OpenGL context, projectM instances not run" << std::endl;
+        return 1;
+    }
+
+    failures += compareRuns("projectM", renderInstance, presets, threads, frames);
+    close_headless();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,312 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Runs every Milkdrop preset twice, with its equations interpreted and with
+ * them compiled to native code (see ExprJit), and compares what they
+ * computed bit for bit after every frame: the params of the preset and of
+ * its custom waves and shapes, the per pixel meshes and the points of the
+ * custom waves. rand() is seeded the same way for both runs.
+ * Read only params (sample, value1, value2) are left out: what they hold
+ * between frames isn't defined.
+ * With -o both runs are interpreted, the first with the equations as they
+ * were parsed and the second with them optimized (see ExprOptimizer).
+ *
+ * usage: projectM-test-jit PRESET|DIRECTORY [...]
+ *   -f N   frames per preset (default 60)
+ *   -o     compare unoptimized with optimized equations instead
+ *   -v     print every preset, not only those differing
+ */
+
+#include "PresetFactoryManager.hpp"
+#include "MilkdropPresetFactory/MilkdropPreset.hpp"
+#include "MilkdropPresetFactory/ExprJit.hpp"
+#include "MilkdropPresetFactory/ExprOptimizer.hpp"
+#include "Renderer/BeatDetect.hpp"
+#include "Renderer/PipelineContext.hpp"
+
+#include <dirent.h>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_FPS 60
+#define TEST_SAMPLES_PER_FRAME (44100 / TEST_FPS)
+#define TEST_MESH_X 32
+#define TEST_MESH_Y 24
+
+/// What a frame computed, in the order it is collected
+typedef std::vector<float> Trace;
+
+class CollectParam
+{
+public:
+    CollectParam(Trace & trace) : _trace(trace) {}
+
+    void operator()(Param * param)
+    {
+        if (param->flags & P_FLAG_READONLY)
+            return;
+
+        switch (param->type) {
+        case P_TYPE_BOOL:
+            _trace.push_back(*(bool *) param->engine_val);
+            break;
+        case P_TYPE_INT:
+            _trace.push_back(*(int *) param->engine_val);
+            break;
+        case P_TYPE_DOUBLE:
+            _trace.push_back(*(float *) param->engine_val);
+            break;
+        }
+    }
+
+private:
+    Trace & _trace;
+};
+
+static void collectMesh(Trace & trace, float ** mesh, int gx, int gy)
+{
+    if (mesh == NULL)
+        return;
+
+    for (int x = 0; x < gx; x++)
+        trace.insert(trace.end(), mesh[x], mesh[x] + gy);
+}
+
+static void collect(Trace & trace, MilkdropPreset & preset, BeatDetect & music)
+{
+    CollectParam collectParam(trace);
+    preset.builtinParams.apply(collectParam);
+    for (std::map<std::string, Param *>::iterator pos = preset.user_param_tree.begin();
+         pos != preset.user_param_tree.end(); ++pos)
+        collectParam(pos->second);
+
+    PresetOutputs & outputs = preset.presetOutputs();
+    float ** meshes[] = { outputs.x_mesh, outputs.y_mesh, outputs.zoom_mesh, outputs.zoomexp_mesh,
+                          outputs.rot_mesh, outputs.sx_mesh, outputs.sy_mesh, outputs.dx_mesh,
+                          outputs.dy_mesh, outputs.cx_mesh, outputs.cy_mesh, outputs.warp_mesh };
+    for (unsigned int i = 0; i < sizeof(meshes) / sizeof(meshes[0]); i++)
+        collectMesh(trace, meshes[i], outputs.gx, outputs.gy);
+
+    for (PresetOutputs::cwave_container::iterator pos = preset.customWaves.begin(); pos != preset.customWaves.end(); ++pos) {
+        CustomWave & wave = **pos;
+        wave.param_tree.apply(collectParam);
+        if (!wave.enabled)
+            continue;
+
+        /* Runs the per point equations */
+        delete wave.snapshot(&music);
+
+        float * points[] = { wave.x_mesh, wave.y_mesh, wave.r_mesh, wave.g_mesh, wave.b_mesh, wave.a_mesh };
+        for (unsigned int i = 0; i < sizeof(points) / sizeof(points[0]); i++)
+            trace.insert(trace.end(), points[i], points[i] + wave.samples);
+    }
+
+    for (PresetOutputs::cshape_container::iterator pos = preset.customShapes.begin(); pos != preset.customShapes.end(); ++pos)
+        (*pos)->param_tree.apply(collectParam);
+}
+
+/// How the equations of a preset run
+class Setup
+{
+public:
+    Setup(const char * name, bool compiled, bool optimized)
+        : name(name), compiled(compiled), optimized(optimized) {}
+
+    const char * name;
+    bool compiled;
+    bool optimized;
+};
+
+/// Traces of every frame of a preset, false if it doesn't load
+static bool run(const std::string & url, const Setup & setup, int frames, std::vector<Trace> & traces)
+{
+    ExprJit::setEnabled(setup.compiled);
+    ExprOptimizer::setEnabled(setup.optimized);
+
+    PresetFactoryManager factories;
+    factories.initialize(TEST_MESH_X, TEST_MESH_Y);
+
+    /* The init equations run while loading */
+    srand(0);
+    std::auto_ptr<Preset> loaded;
+    try {
+        loaded = factories.factory("milk").allocate(url);
+    } catch (...) {
+        return false;
+    }
+
+    MilkdropPreset * preset = dynamic_cast<MilkdropPreset *>(loaded.get());
+    if (preset == NULL)
+        return false;
+
+    PCM pcm;
+    BeatDetect beatDetect(&pcm);
+    PipelineContext context;
+    context.fps = TEST_FPS;
+    float buffer[TEST_SAMPLES_PER_FRAME];
+    double phase = 0;
+
+    traces.assign(frames, Trace());
+    for (int frame = 0; frame < frames; frame++) {
+        for (int i = 0; i < TEST_SAMPLES_PER_FRAME; i++) {
+            phase += 2 * M_PI * (100 + 5 * frame) / 44100.0;
+            buffer[i] = 0.8f * sin(phase) * (frame % 20 < 3 ? 1.0f : 0.3f);
+        }
+        pcm.addPCMfloat(buffer, TEST_SAMPLES_PER_FRAME);
+        beatDetect.detectFromSamples();
+
+        context.time = frame / (float) TEST_FPS;
+        context.frame = frame + 1;
+        context.progress = frame / (float) frames;
+
+        srand(frame + 1);
+        preset->Render(beatDetect, context);
+        collect(traces[frame], *preset, beatDetect);
+    }
+
+    return true;
+}
+
+static bool milkdropPreset(const std::string & name)
+{
+    const std::string::size_type dot = name.rfind('.');
+    if (dot == std::string::npos)
+        return false;
+
+    const std::string extension = name.substr(dot + 1);
+    return extension == "milk" || extension == "prjm";
+}
+
+/// The presets of a directory and those below it, or url itself
+static void findPresets(const std::string & url, std::vector<std::string> & presets)
+{
+    DIR * directory = opendir(url.c_str());
+    if (directory == NULL) {
+        presets.push_back(url);
+        return;
+    }
+
+    std::vector<std::string> below;
+    while (struct dirent * entry = readdir(directory)) {
+        const std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+
+        const std::string path = url + "/" + name;
+        if (milkdropPreset(name))
+            presets.push_back(path);
+        else
+            below.push_back(path);
+    }
+    closedir(directory);
+
+    for (unsigned int i = 0; i < below.size(); i++) {
+        DIR * subdirectory = opendir(below[i].c_str());
+        if (subdirectory) {
+            closedir(subdirectory);
+            findPresets(below[i], presets);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 60;
+    bool verbose = false;
+    bool optimizer = false;
+    std::vector<std::string> presets;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-v"))
+            verbose = true;
+        else if (!strcmp(argv[i], "-o"))
+            optimizer = true;
+        else
+            findPresets(argv[i], presets);
+    }
+
+    if (presets.empty() || frames < 1) {
+        std::cerr << "usage: " << argv[0] << " [-f frames] [-o] [-v] PRESET|DIRECTORY [...]" << std::endl;
+        return 1;
+    }
+
+    const Setup reference = optimizer ? Setup("unoptimized", false, false) : Setup("interpreted", false, true);
+    const Setup tested = optimizer ? Setup("optimized", false, true) : Setup("compiled", true, true);
+
+    if (!optimizer && !ExprJit::available()) {
+        std::cerr << "[jit] no native code on this platform or build, nothing to compare" << std::endl;
+        return 1;
+    }
+
+    int compared = 0;
+    int failures = 0;
+    for (unsigned int i = 0; i < presets.size(); i++) {
+        std::vector<Trace> expected, traced;
+        if (!run(presets[i], reference, frames, expected)) {
+            if (verbose)
+                std::cout << "skip " << presets[i] << std::endl;
+            continue;
+        }
+        compared++;
+
+        if (!run(presets[i], tested, frames, traced)) {
+            failures++;
+            std::cout << "FAIL " << presets[i] << " loads only " << reference.name << std::endl;
+            continue;
+        }
+
+        bool match = true;
+        for (int frame = 0; frame < frames && match; frame++) {
+            const Trace & a = expected[frame];
+            const Trace & b = traced[frame];
+            if (a.size() != b.size()) {
+                std::cout << "FAIL " << presets[i] << " frame " << frame << ": " << a.size() << " values "
+                          << reference.name << ", " << b.size() << " " << tested.name << std::endl;
+                match = false;
+                break;
+            }
+            for (unsigned int k = 0; k < a.size(); k++) {
+                if (memcmp(&a[k], &b[k], sizeof(float))) {
+                    std::cout << "FAIL " << presets[i] << " frame " << frame << " value " << k << ": "
+                              << a[k] << " " << reference.name << ", " << b[k] << " " << tested.name << std::endl;
+                    match = false;
+                    break;
+                }
+            }
+        }
+
+        if (!match)
+            failures++;
+        else if (verbose)
+            std::cout << "ok   " << presets[i] << std::endl;
+    }
+
+    std::cout << compared - failures << " of " << compared << " presets computed the same" << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Checks onset detection without a GL context: OnsetQueue keeps its events
+ * in order and drops those that don't fit, OnsetDetector finds the clicks
+ * and kicks of a synthetic track where they are and nothing in a steady
+ * tone, at two sample rates, also through PCM in blocks longer than its
+ * ring, and a Milkdrop preset reads the onsets of a frame as onset and
+ * bass_onset.
+ *
+ * usage: projectM-test-onset
+ */
+
+#include "test_harness.h"
+#include "OnsetDetector.hpp"
+#include "PCM.hpp"
+#include "Renderer/PipelineContext.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/* The track: TEST_BEATS beats TEST_BEAT seconds apart after TEST_LEAD_IN
+   seconds of quiet noise, clicks and kicks in turn, then TEST_TONE seconds
+   of a steady tone starting on the beat after */
+#define TEST_LEAD_IN 1.0
+#define TEST_BEAT 0.5
+#define TEST_BEATS 12
+#define TEST_TONE 2.0
+/* Seconds an onset found may be away from the beat it belongs to, a hop
+   and a half at 44.1 kHz */
+#define TEST_TOLERANCE 0.02
+
+static void testQueue()
+{
+    OnsetQueue queue;
+    OnsetEvent event;
+    check(!queue.pop(event), "an empty queue has nothing to pop");
+
+    bool pushed = true;
+    for (unsigned int i = 0; i < OnsetQueue::SIZE; i++) {
+        event.time = i;
+        pushed = pushed && queue.push(event);
+    }
+    check(pushed, "a queue holds SIZE events");
+    check(!queue.push(event) && queue.dropped() == 1, "an event pushed into a full queue is dropped");
+
+    bool ordered = true;
+    for (unsigned int i = 0; i < OnsetQueue::SIZE; i++)
+        ordered = ordered && queue.pop(event) && event.time == i;
+    check(ordered && !queue.pop(event), "events pop in the order they were pushed");
+
+    /* Past the end of the ring */
+    ordered = true;
+    for (unsigned int i = 0; i < OnsetQueue::SIZE / 2 * 3; i++) {
+        event.time = i;
+        ordered = ordered && queue.push(event) && queue.pop(event) && event.time == i;
+    }
+    check(ordered, "events keep their order around the ring");
+}
+
+/// Beat of the track an onset belongs to, TEST_BEATS for the start of the
+/// tone, -1 if it is none
+static int beat(const OnsetEvent & event)
+{
+    const int nearest = (int) floor((event.time - TEST_LEAD_IN) / TEST_BEAT + 0.5);
+    if (nearest < 0 || nearest > TEST_BEATS)
+        return -1;
+    return fabs(event.time - (TEST_LEAD_IN + nearest * TEST_BEAT)) <= TEST_TOLERANCE ? nearest : -1;
+}
+
+/// The track at sampleRate, mono
+static std::vector<float> track(int sampleRate)
+{
+    srand(1);
+
+    const int beatSamples = (int) (TEST_BEAT * sampleRate);
+    const int toneStart = (int) ((TEST_LEAD_IN + TEST_BEATS * TEST_BEAT) * sampleRate);
+    const int samples = toneStart + (int) (TEST_TONE * sampleRate);
+
+    std::vector<float> audio(samples);
+    for (int i = 0; i < samples; i++) {
+        float sample = 0.01f * (rand() / (float) RAND_MAX - 0.5f);
+
+        const int sinceLeadIn = i - (int) (TEST_LEAD_IN * sampleRate);
+        if (i >= toneStart)
+            sample += 0.5f * sin(2 * M_PI * 440 * (i - toneStart) / sampleRate);
+        else if (sinceLeadIn >= 0) {
+            const int sinceBeat = sinceLeadIn % beatSamples;
+            const float seconds = sinceBeat / (float) sampleRate;
+            if ((sinceLeadIn / beatSamples) % 2 == 0)
+                /* A click, 5 ms of noise dying away */
+                sample += 0.8f * (rand() / (float) RAND_MAX - 0.5f) * exp(-seconds / 0.005f);
+            else
+                /* A kick, a 60 Hz sine dying away in 100 ms */
+                sample += 0.8f * sin(2 * M_PI * 60 * seconds) * exp(-seconds / 0.1f);
+        }
+        audio[i] = sample;
+    }
+    return audio;
+}
+
+static void testDetector(int sampleRate)
+{
+    char rate[16];
+    sprintf(rate, "%d Hz", sampleRate);
+
+    OnsetDetector detector(sampleRate);
+    const std::vector<float> audio = track(sampleRate);
+    const int samples = audio.size();
+    for (int i = 0; i < samples; i++)
+        detector.addSample(audio[i]);
+
+    check(fabs(detector.time() - samples / (double) sampleRate) <= OnsetDetector::HOP / (double) sampleRate,
+          std::string("the detector counts the audio analyzed, ") + rate);
+
+    std::vector<int> full(TEST_BEATS + 1, 0);
+    std::vector<int> bass(TEST_BEATS + 1, 0);
+    int strays = 0;
+    bool strong = true;
+    OnsetEvent event;
+    while (detector.takeEvent(event)) {
+        const int found = beat(event);
+        if (found < 0) {
+            strays++;
+            continue;
+        }
+        strong = strong && event.strength >= 2;
+        if (event.band == OnsetEvent::BAND_FULL)
+            full[found]++;
+        else
+            bass[found]++;
+    }
+
+    bool everyBeat = true;
+    bool everyKick = true;
+    for (int i = 0; i <= TEST_BEATS; i++) {
+        everyBeat = everyBeat && full[i] == 1;
+        if (i % 2 && i < TEST_BEATS)
+            everyKick = everyKick && bass[i] == 1;
+    }
+    check(everyBeat, std::string("one onset for every click, kick and the tone starting, where it is, ") + rate);
+    check(everyKick, std::string("one bass onset for every kick, where it is, ") + rate);
+    check(strays == 0, std::string("no onsets off the beats nor in the steady tone, ") + rate);
+    check(strong, std::string("onsets are 2 and up times the recent flux, ") + rate);
+    check(detector.queue().dropped() == 0, std::string("no onsets dropped, ") + rate);
+}
+
+/// Blocks longer than the PCM ring, as projectM-render passes at 96 kHz and
+/// 30 fps, reach the detector as they are
+static void testLongBlocks()
+{
+    const std::vector<float> audio = track(96000);
+
+    OnsetDetector direct(96000);
+    for (unsigned int i = 0; i < audio.size(); i++)
+        direct.addSample(audio[i]);
+
+    OnsetDetector fed(96000);
+    PCM pcm;
+    pcm.onsetDetector = &fed;
+    const int block = 96000 / 30;
+    for (unsigned int i = 0; i < audio.size(); i += block)
+        pcm.addPCMfloat(&audio[i], std::min<int>(block, audio.size() - i));
+
+    bool same = fed.time() == direct.time();
+    OnsetEvent expected, event;
+    while (direct.takeEvent(expected))
+        same = same && fed.takeEvent(event) && event.time == expected.time && event.band == expected.band;
+    check(same && !fed.takeEvent(event), "blocks longer than the PCM ring reach the detector whole");
+}
+
+static void testPresetInputs()
+{
+    TestDirectory directory("onset");
+    TestPreset preset(directory, "onset",
+                      "[preset00]\n"
+                      "per_frame_1=full = onset;\n"
+                      "per_frame_2=kick = bass_onset;\n");
+    if (!preset.loaded()) {
+        check(false, "the onset preset loads");
+        return;
+    }
+
+    PipelineContext context;
+    context.fps = 60;
+    context.onset = 3;
+    context.bassOnset = 0;
+    preset.render(context);
+    check(preset["full"] == 3 && preset["kick"] == 0, "a preset reads the onsets of the frame");
+
+    context.onset = 0;
+    context.bassOnset = 2.5f;
+    preset.render(context);
+    check(preset["full"] == 0 && preset["kick"] == 2.5f, "a preset reads 0 for a frame without onsets");
+}
+
+int main(int argc, char **argv)
+{
+    testQueue();
+    testDetector(44100);
+    testDetector(48000);
+    testLongBlocks();
+    testPresetInputs();
+
+    return check_summary();
+}
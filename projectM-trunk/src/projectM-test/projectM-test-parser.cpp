@@ -0,0 +1,163 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Checks the Milkdrop 2 parts of the equation parser without a GL context:
+ * megabuf and gmegabuf, loop, while and exec2, semicolons within
+ * parentheses and the time loops may take. Each preset is written to a
+ * directory made for the test, loaded and run for a frame, interpreted and
+ * compiled (see ExprJit), then the params it assigned are compared.
+ *
+ * usage: projectM-test-parser
+ */
+
+#include "test_harness.h"
+#include "MilkdropPresetFactory/MilkdropPreset.hpp"
+#include "MilkdropPresetFactory/ExprJit.hpp"
+#include "MilkdropPresetFactory/Expr.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/* A loop stopped by the budget may overrun it by PREFUN_LOOP_CLOCK runs */
+#define TEST_LOOP_SLACK 50
+
+/// A preset written from its per frame equations, one per line ended as
+/// Milkdrop writes them, run for a frame
+class EquationPreset : public TestPreset
+{
+public:
+    EquationPreset(const TestDirectory & directory, const std::string & name, const char ** equations)
+        : TestPreset(directory, name, text(equations))
+    {
+        _milliseconds = render();
+    }
+
+    float milliseconds() const { return _milliseconds; }
+
+private:
+    static std::string text(const char ** equations)
+    {
+        std::ostringstream text;
+        text << "[preset00]" << std::endl;
+        for (int i = 0; equations[i]; i++)
+            text << "per_frame_" << i + 1 << "=" << equations[i] << ";" << std::endl;
+        return text.str();
+    }
+
+    float _milliseconds;
+};
+
+static void testMegabuf(const TestDirectory & directory)
+{
+    const char * equations[] = {
+        "megabuf(5) = 3",
+        "megabuf(70000) = megabuf(5) + 1",
+        "a = megabuf(5) + megabuf(6) + megabuf(70000)",
+        "megabuf(-1) = 9",
+        "b = megabuf(-1) + megabuf(2000000)",
+        "gmegabuf(123) = 7",
+        0
+    };
+    EquationPreset preset(directory, "megabuf", equations);
+    check(preset.loaded(), "the megabuf preset loads");
+    check(preset["a"] == 7, "megabuf items read back what was assigned, 0 if nothing was");
+    check(preset["b"] == 0, "megabuf indexes out of range read 0");
+    check(preset.loaded() && preset.preset()->megabuf().allocated() == 2 * MEGABUF_PAGE_ITEMS * sizeof(float),
+          "megabuf allocates the pages assigned only");
+
+    const char * shared[] = { "g = gmegabuf(123)", 0 };
+    EquationPreset other(directory, "gmegabuf", shared);
+    check(other["g"] == 7, "gmegabuf is shared by presets");
+}
+
+static void testLoops(const TestDirectory & directory)
+{
+    const char * equations[] = {
+        "n = 0",
+        "loop(10, n = n + 1)",
+        "m = loop(4, k = k + 2; j = j + 1)",
+        "i = 0",
+        "while(exec2(i = i + 1, 5 - i))",
+        "e = exec2(u = 2, u * 3)",
+        "s = exec3(t = 1; t = t + 1, t * 10, t * 100)",
+        0
+    };
+    EquationPreset preset(directory, "loops", equations);
+    check(preset.loaded(), "the loops preset loads");
+    check(preset["n"] == 10, "loop runs its code count times");
+    check(preset["k"] == 8 && preset["j"] == 4, "a semicolon within the parentheses of loop doesn't end it");
+    check(preset["i"] == 5, "while runs until its code is 0");
+    check(preset["e"] == 6 && preset["u"] == 2, "exec2 runs both, its value the second");
+    check(preset["s"] == 200 && preset["t"] == 2, "exec3 runs a sequence first, its value the last");
+}
+
+static void testBudget(const TestDirectory & directory)
+{
+    const char * equations[] = {
+        "loop(1000000, loop(1000000, w = w + 1))",
+        "after = 1",
+        0
+    };
+    EquationPreset preset(directory, "budget", equations);
+    check(preset.loaded(), "the budget preset loads");
+    check(preset["w"] > 0, "loops run until they are out of time");
+    check(preset.milliseconds() < PREFUN_LOOP_BUDGET + TEST_LOOP_SLACK, "loops stop when they are out of time");
+    check(preset["after"] == 1, "the equations after a loop out of time still run");
+}
+
+static void testRejected(const TestDirectory & directory)
+{
+    const char * equations[] = {
+        "i = 0",
+        "while(exec2(i = i + 1, i<5))",
+        "after = 1",
+        0
+    };
+    EquationPreset preset(directory, "rejected", equations);
+    check(preset.loaded(), "a preset comparing loads");
+    check(preset["i"] == 0, "an equation comparing is left out, not run once");
+    check(std::isnan(preset["i<5"]), "a comparison doesn't make a param");
+    check(preset["after"] == 1, "the equations after one left out still run");
+}
+
+int main(int argc, char **argv)
+{
+    TestDirectory directory("parser");
+    if (directory.path().empty())
+        return 1;
+
+    for (int compiled = 0; compiled < 2; compiled++) {
+        if (compiled && !ExprJit::available())
+            break;
+        ExprJit::setEnabled(compiled);
+        check_mode(compiled ? "compiled" : "interpreted");
+
+        testMegabuf(directory);
+        testLoops(directory);
+        testBudget(directory);
+        testRejected(directory);
+    }
+
+    return check_summary();
+}
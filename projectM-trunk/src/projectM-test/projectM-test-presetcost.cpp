@@ -0,0 +1,261 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Checks the preset costs without a GL context: how PresetCost merges the
+ * frame times of a preset and reads back what it wrote, how PresetLoader
+ * keeps them in its costs file, and how PresetChooser weights and filters
+ * presets over budget. The presets are empty files in a directory made for
+ * the test, nothing loads them.
+ *
+ * usage: projectM-test-presetcost
+ */
+
+#include "test_harness.h"
+#include "PresetCost.hpp"
+#include "PresetLoader.hpp"
+#include "PresetChooser.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef USE_THREADS
+#include <pthread.h>
+#endif
+
+#define TEST_PRESETS 4
+#define TEST_BUDGET 10.0f
+#define TEST_DRAWS 20000
+#define TEST_READERS 4
+
+static bool near(float value, float expected)
+{
+    return std::fabs(value - expected) < 0.001f;
+}
+
+static void testAdd()
+{
+    PresetCost cost;
+    std::vector<float> times;
+    for (int i = 1; i <= 100; i++)
+        times.push_back(i);
+
+    cost.add(std::vector<float>());
+    check(cost.frames == 0, "adding no frames changes nothing");
+
+    cost.add(times);
+    check(near(cost.average, 50.5f) && near(cost.p95, 95) && cost.frames == 100,
+          "average and 95th percentile of one time played");
+
+    cost.add(std::vector<float>(100, 10.0f));
+    check(near(cost.average, 30.25f) && near(cost.p95, 52.5f) && cost.frames == 200,
+          "two times played weigh by their frames");
+
+    /* Past PRESET_COST_HISTORY frames the earlier ones weigh as that many */
+    PresetCost history;
+    history.add(std::vector<float>(PRESET_COST_HISTORY, 1.0f));
+    history.add(std::vector<float>(PRESET_COST_HISTORY, 3.0f));
+    history.add(std::vector<float>(PRESET_COST_HISTORY, 3.0f));
+    check(near(history.average, 2.5f) && history.frames == 3 * PRESET_COST_HISTORY,
+          "earlier frames weigh as PRESET_COST_HISTORY at most");
+}
+
+static void testReadWrite()
+{
+    PresetCost cost;
+    cost.add(std::vector<float>(50, 4.5f));
+
+    const std::string url = "/presets/Geiss - Spiral Artifact.milk";
+    PresetCost read;
+    std::string readURL;
+    check(read.read(cost.write(url), readURL) && readURL == url && near(read.average, 4.5f)
+          && near(read.p95, 4.5f) && read.frames == 50, "a written line reads back, url with spaces");
+
+    PresetCost untouched = read;
+    check(!untouched.read("garbage", readURL) && untouched.frames == 50, "a line that isn't one is rejected");
+    check(!untouched.read("1 2 3", readURL) && untouched.frames == 50, "a line without url is rejected");
+}
+
+/// A test directory of TEST_PRESETS empty presets and the costs file next to them
+class PresetDirectory : public TestDirectory
+{
+public:
+    PresetDirectory() : TestDirectory("presetcost")
+    {
+        if (path().empty())
+            return;
+        mkdir(presets().c_str(), 0755);
+        for (int i = 0; i < TEST_PRESETS; i++)
+            std::ofstream(presetURL(i).c_str());
+    }
+
+    std::string presets() const { return file("presets"); }
+    std::string costsFile() const { return file(PRESET_COST_FILE); }
+
+    std::string presetURL(int index) const
+    {
+        char name[32];
+        sprintf(name, "/%c.milk", 'a' + index);
+        return presets() + name;
+    }
+};
+
+static void testLoader(const PresetDirectory & directory)
+{
+    {
+        PresetLoader loader(32, 24, directory.presets(), directory.costsFile());
+        check(loader.size() == TEST_PRESETS, "the loader finds the test presets");
+        check(loader.saveCosts() && !std::ifstream(directory.costsFile().c_str()).good(),
+              "nothing measured, nothing written");
+
+        loader.addPresetCost(loader.getPresetURL(1), std::vector<float>(30, 7.0f));
+        check(loader.saveCosts(), "the costs file is written");
+    }
+
+    std::ifstream aside((directory.costsFile() + ".new").c_str());
+    check(!aside.good(), "the file written aside is renamed over the costs file");
+
+    PresetLoader loader(32, 24, directory.presets(), directory.costsFile());
+    const PresetCost cost = loader.getPresetCost(1);
+    check(cost.frames == 30 && near(cost.average, 7), "the costs file reads back");
+    check(loader.getPresetCost(0).frames == 0, "a preset never measured has no cost");
+
+    PresetLoader unkept(32, 24, directory.presets());
+    check(unkept.getPresetCost(1).frames == 0, "without a costs file nothing is read");
+}
+
+#ifdef USE_THREADS
+/// What a thread reading the loader during its scan saw
+class Reader
+{
+public:
+    PresetLoader * loader;
+    std::size_t size;
+    std::string name;
+};
+
+static void * readLoader(void * data)
+{
+    Reader & reader = *static_cast<Reader *>(data);
+    reader.size = reader.loader->size();
+    reader.name = reader.size > 0 ? reader.loader->getPresetName(0) : std::string();
+    return NULL;
+}
+
+/// Threads reading a loader while it scans all wait for the scan, one joins it
+static void testScanReaders(const PresetDirectory & directory)
+{
+    PresetLoader loader(32, 24, directory.presets());
+
+    Reader readers[TEST_READERS];
+    pthread_t threads[TEST_READERS];
+    int started = 0;
+    for (int i = 0; i < TEST_READERS; i++) {
+        readers[i].loader = &loader;
+        readers[i].size = 0;
+        if (pthread_create(&threads[i], NULL, readLoader, &readers[i]) == 0)
+            started++;
+        else
+            break;
+    }
+
+    const std::size_t size = loader.size();
+    bool same = size == TEST_PRESETS;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        same = same && readers[i].size == size && readers[i].name == loader.getPresetName(0);
+    }
+    check(started == TEST_READERS, "the reader threads start");
+    check(same, "threads reading the loader during its scan all see the whole scan");
+}
+#endif
+
+static void testChooser(const PresetDirectory & directory)
+{
+    PresetLoader loader(32, 24, directory.presets());
+    PresetChooser chooser(loader, false);
+
+    /* Preset 0 costs four times the budget, the others half of it */
+    loader.addPresetCost(loader.getPresetURL(0), std::vector<float>(PRESET_COST_MIN_FRAMES, 4 * TEST_BUDGET));
+    for (int i = 1; i < TEST_PRESETS; i++)
+        loader.addPresetCost(loader.getPresetURL(i), std::vector<float>(PRESET_COST_MIN_FRAMES, TEST_BUDGET / 2));
+
+    srand(1);
+    chooser.setCostPolicy(PRESET_COST_WEIGHTED, TEST_BUDGET);
+    int expensive = 0;
+    for (int i = 0; i < TEST_DRAWS; i++)
+        if (*chooser.weightedRandom(true) == 0)
+            expensive++;
+    /* rated budget / p95 = 1/4 of the others: 0.25 / 3.25 of the draws */
+    const float share = (float) expensive / TEST_DRAWS;
+    check(share > 0.06f && share < 0.095f, "weighted, the preset over budget is drawn a quarter as often");
+
+    chooser.setCostPolicy(PRESET_COST_FILTERED, TEST_BUDGET);
+    expensive = 0;
+    for (int i = 0; i < TEST_DRAWS; i++)
+        if (*chooser.weightedRandom(true) == 0)
+            expensive++;
+    check(expensive == 0, "filtered, the preset over budget is never drawn");
+
+    PresetIterator position = chooser.begin(TEST_PRESETS - 1);
+    chooser.nextPreset(position);
+    check(*position == 1, "filtered, next passes over the preset over budget");
+    chooser.previousPreset(position);
+    check(*position == TEST_PRESETS - 1, "filtered, previous passes over the preset over budget");
+
+    /* With every preset over budget the ratings alone decide */
+    chooser.setCostPolicy(PRESET_COST_FILTERED, TEST_BUDGET / 4);
+    expensive = 0;
+    for (int i = 0; i < TEST_DRAWS; i++)
+        if (*chooser.weightedRandom(true) == 0)
+            expensive++;
+    check(expensive > 0, "filtered, with every preset over budget all are drawn");
+
+    position = chooser.begin(TEST_PRESETS - 1);
+    chooser.nextPreset(position);
+    check(*position == 0, "filtered, with every preset over budget next still moves on");
+
+    chooser.setCostPolicy(PRESET_COST_IGNORED, TEST_BUDGET);
+    position = chooser.begin(TEST_PRESETS - 1);
+    chooser.nextPreset(position);
+    check(*position == 0, "ignored, next takes the preset over budget");
+}
+
+int main(int argc, char **argv)
+{
+    testAdd();
+    testReadWrite();
+
+    PresetDirectory directory;
+    if (directory.path().empty())
+        return 1;
+    testLoader(directory);
+#ifdef USE_THREADS
+    testScanReaders(directory);
+#endif
+    testChooser(directory);
+
+    return check_summary();
+}
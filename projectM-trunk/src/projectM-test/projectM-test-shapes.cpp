@@ -0,0 +1,180 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Checks the copies of custom shapes num_inst asks for: a Milkdrop preset
+ * runs the per frame equations of a shape once for every copy, each with
+ * its instance, starting over from the init equations and the q variables
+ * every frame, and as many copies as there may be at most. Then, in an
+ * offscreen context, the copies drawn in batches are compared pixel for
+ * pixel with the same copies drawn one at a time, overlapping or not.
+ *
+ * usage: projectM-test-shapes
+ */
+
+#include "headless_init.h"
+#include "test_harness.h"
+#include "MilkdropPresetFactory/MilkdropPreset.hpp"
+#include "MilkdropPresetFactory/CustomShape.hpp"
+#include "Renderer/Renderable.hpp"
+
+#include <GL/gl.h>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define TEST_INSTANCES 5
+#define TEST_SIZE 128
+
+static void testInstances()
+{
+    std::ostringstream text;
+    text << "[preset00]" << std::endl
+         << "per_frame_1=q1 = 0.25;" << std::endl
+         << "shapecode_0_enabled=1" << std::endl
+         << "shapecode_0_num_inst=" << TEST_INSTANCES << std::endl
+         << "shape_0_init1=t1 = 5;" << std::endl
+         << "shape_0_per_frame1=x = instance / 10;" << std::endl
+         << "shape_0_per_frame2=t1 = t1 + instance;" << std::endl
+         << "shape_0_per_frame3=y = t1 / 100;" << std::endl
+         << "shape_0_per_frame4=rad = q1;" << std::endl
+         << "shape_0_per_frame5=q1 = 0.5;" << std::endl
+         << "shapecode_1_enabled=1" << std::endl
+         << "shapecode_1_num_inst=1" << std::endl
+         << "shapecode_2_enabled=1" << std::endl
+         << "shapecode_2_num_inst=" << MAX_SHAPE_INSTANCES * 2 << std::endl;
+
+    TestDirectory directory("shapes");
+    TestPreset test(directory, "shapes", text.str());
+    MilkdropPreset * preset = test.preset();
+    if (!preset || preset->customShapes.size() != 3) {
+        check(false, "the shapes preset loads with its shapes");
+        return;
+    }
+
+    /* The second frame shows whether a copy starts from what the last copy
+       of the frame before left */
+    test.render(1);
+    test.render(2);
+
+    const std::vector<ShapeInstance> & copies = preset->customShapes[0]->instances;
+    check(copies.size() == TEST_INSTANCES, "a shape is drawn num_inst times");
+
+    bool counted = copies.size() == TEST_INSTANCES;
+    bool started = counted;
+    bool shared = counted;
+    for (unsigned int i = 0; i < copies.size(); i++) {
+        counted = counted && fabs(copies[i].x - i / 10.0f) < 1e-6;
+        started = started && fabs(copies[i].y - (5 + i) / 100.0f) < 1e-6;
+        shared = shared && copies[i].radius == 0.25f;
+    }
+    check(counted, "every copy runs with its instance");
+    check(started, "every copy starts over from the init equations, the first one too");
+    check(shared, "every copy starts over from the q variables of the preset");
+
+    check(preset->customShapes[1]->instances.empty(), "a shape with num_inst 1 is drawn from its own values");
+    check(preset->customShapes[2]->instances.size() == MAX_SHAPE_INSTANCES,
+          "num_inst is at most MAX_SHAPE_INSTANCES");
+}
+
+/// A copy with a fill of its own color and a white outline
+static ShapeInstance copy(Shape & shape, float x, float y, float r, float g, float b)
+{
+    shape.x = x;
+    shape.y = y;
+    shape.r = shape.r2 = r;
+    shape.g = shape.g2 = g;
+    shape.b = shape.b2 = b;
+    return ShapeInstance(shape);
+}
+
+static std::vector<unsigned char> draw(Shape & shape, RenderContext & context, bool batched)
+{
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if (batched)
+        shape.Draw(context);
+    else {
+        const std::vector<ShapeInstance> copies = shape.instances;
+        for (unsigned int i = 0; i < copies.size(); i++) {
+            shape.instances.assign(1, copies[i]);
+            shape.Draw(context);
+        }
+        shape.instances = copies;
+    }
+
+    std::vector<unsigned char> pixels(TEST_SIZE * TEST_SIZE * 4);
+    glReadPixels(0, 0, TEST_SIZE, TEST_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    return pixels;
+}
+
+static void testBatches()
+{
+    if (!init_headless(TEST_SIZE, TEST_SIZE)) {
+        std::cerr << "[shapes] no headless OpenGL context, batches not drawn" << std::endl;
+        return;
+    }
+
+    glViewport(0, 0, TEST_SIZE, TEST_SIZE);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0.0, 1, 0.0, 1, -40, 40);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glEnable(GL_BLEND);
+
+    RenderContext context;
+    context.texsize = TEST_SIZE;
+
+    Shape shape;
+    shape.sides = 5;
+    shape.radius = 0.3f;
+    shape.a = shape.a2 = 0.7f;
+    shape.border_r = shape.border_g = shape.border_b = 1;
+    shape.border_a = 1;
+
+    /* Apart, then each over the last */
+    shape.instances.push_back(copy(shape, 0.25f, 0.25f, 1, 0, 0));
+    shape.instances.push_back(copy(shape, 0.75f, 0.75f, 0, 1, 0));
+    shape.instances.push_back(copy(shape, 0.55f, 0.6f, 0, 0, 1));
+    shape.instances.push_back(copy(shape, 0.5f, 0.5f, 1, 1, 0));
+    check(draw(shape, context, true) == draw(shape, context, false),
+          "copies drawn in batches cover outlines as copies drawn one at a time do");
+
+    shape.additive = true;
+    for (unsigned int i = 0; i < shape.instances.size(); i++)
+        shape.instances[i].additive = true;
+    check(draw(shape, context, true) == draw(shape, context, false),
+          "copies added in batches are drawn as copies added one at a time");
+
+    close_headless();
+}
+
+int main(int argc, char **argv)
+{
+    testInstances();
+    testBatches();
+
+    return check_summary();
+}
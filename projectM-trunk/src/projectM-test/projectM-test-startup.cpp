@@ -0,0 +1,88 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Startup time test: constructs projectM, renders the first frame and
+ * fails if that took longer than the budget.
+ *
+ * usage: projectM-test-startup [budget in ms, default 1000]
+ */
+
+#include <SDL/SDL.h>
+#include "video_init.h"
+#include <projectM.hpp>
+#include "ConfigFile.h"
+#include "getConfigFilename.h"
+
+#include <sys/time.h>
+#include <iostream>
+
+static unsigned int elapsed(const struct timeval & start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start.tv_sec) * 1000 + (now.tv_usec - start.tv_usec) / 1000;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int budget = 1000;
+    if (argc > 1)
+        budget = atoi(argv[1]);
+
+    atexit(SDL_Quit);
+
+    std::string config_filename = getConfigFilename();
+    ConfigFile config(config_filename);
+
+    int wvw = config.read<int>("Window Width", 512);
+    int wvh = config.read<int>("Window Height", 512);
+    int fvw, fvh;
+
+    init_display(wvw, wvh, &fvw, &fvh, false);
+
+    struct timeval start;
+    gettimeofday(&start, NULL);
+
+    projectM *pm = new projectM(config_filename);
+    const unsigned int construction = elapsed(start);
+
+    pm->renderFrame();
+    SDL_GL_SwapBuffers();
+    const unsigned int firstFrame = elapsed(start);
+
+    const projectM::StartupTrace & trace = pm->startupTrace();
+    for (projectM::StartupTrace::const_iterator pos = trace.begin(); pos != trace.end(); ++pos)
+        std::cout << "[startup] " << pos->first << ": " << pos->second << "ms" << std::endl;
+
+    std::cout << "[startup] constructor: " << construction << "ms" << std::endl;
+    std::cout << "[startup] first frame: " << firstFrame << "ms (budget " << budget << "ms)" << std::endl;
+
+    delete pm;
+
+    if (firstFrame > budget) {
+        std::cerr << "[startup] FAILED: first frame took " << firstFrame - budget
+                  << "ms longer than the budget" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+/**
+ * projectM -- Milkdrop-esque visualisation SDK
+ * Copyright (C)2003-2008 projectM Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * See 'LICENSE.txt' included within this release
+ *
+ */
+
+/**
+ * Checks the textures TextureManager uploads without decoding, in an
+ * offscreen context: an image converted with convertToDDS uploads the
+ * pixels the image itself uploads, a KTX file uploads the texels it holds,
+ * and a truncated KTX file, one whose levels claim less than their rows
+ * take, or one with a bad endianness marker, uploads nothing.
+ *
+ * usage: projectM-test-textures
+ */
+
+#include "headless_init.h"
+#include "test_harness.h"
+#include "Renderer/TextureManager.hpp"
+
+#include <GL/gl.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_SIZE 8
+#define TEST_KTX_WIDTH 3
+#define TEST_KTX_HEIGHT 2
+
+static void writeFile(const std::string & url, const std::vector<unsigned char> & data)
+{
+    std::ofstream file(url.c_str(), std::ios::out | std::ios::binary);
+    file.write((const char *)&data[0], data.size());
+}
+
+static void put32(std::vector<unsigned char> & data, unsigned int value)
+{
+    for (int i = 0; i < 4; i++)
+        data.push_back((value >> (i * 8)) & 0xff);
+}
+
+/// Level 0 of a texture as RGBA, top row first like the images are uploaded
+static std::vector<unsigned char> readTexture(unsigned int tex, int width, int height)
+{
+    std::vector<unsigned char> pixels(width * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return pixels;
+}
+
+/// Four opaque quadrants of colors DXT1 keeps exactly, as a top-down TGA
+static std::vector<unsigned char> quadrantImage()
+{
+    static const unsigned char colors[4][3] = {
+        { 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 255 }
+    };
+
+    std::vector<unsigned char> tga(18, 0);
+    tga[2] = 2;
+    tga[12] = TEST_SIZE;
+    tga[14] = TEST_SIZE;
+    tga[16] = 24;
+    tga[17] = 0x20;
+
+    for (int y = 0; y < TEST_SIZE; y++)
+        for (int x = 0; x < TEST_SIZE; x++) {
+            const unsigned char *color = colors[(y >= TEST_SIZE / 2) * 2 + (x >= TEST_SIZE / 2)];
+            tga.push_back(color[2]);
+            tga.push_back(color[1]);
+            tga.push_back(color[0]);
+        }
+    return tga;
+}
+
+static void testDDS(const TestDirectory & directory)
+{
+    const std::string imageURL = directory.file("quadrants.tga");
+    const std::string ddsURL = directory.file("quadrants.dds");
+    writeFile(imageURL, quadrantImage());
+
+    TextureManager textures(directory.path());
+    const unsigned int image = textures.getTextureFullpath("quadrants.tga", imageURL);
+    check(image != 0, "the image uploads");
+
+    check(TextureManager::convertToDDS(imageURL, ddsURL), "the image converts to a DDS");
+
+    const unsigned int dds = textures.getTextureFullpath("quadrants.dds", ddsURL);
+    check(dds != 0, "the converted DDS uploads");
+
+    if (image != 0 && dds != 0) {
+        check(textures.getTextureWidth("quadrants.dds") == TEST_SIZE &&
+              textures.getTextureHeight("quadrants.dds") == TEST_SIZE, "the DDS keeps the size of the image");
+        check(readTexture(dds, TEST_SIZE, TEST_SIZE) == readTexture(image, TEST_SIZE, TEST_SIZE),
+              "the DDS uploads the pixels of the image");
+
+        GLint last = 0;
+        glBindTexture(GL_TEXTURE_2D, dds);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 3, GL_TEXTURE_WIDTH, &last);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        check(last == 1, "the DDS brings its mip levels down to 1x1");
+    }
+}
+
+/// An uncompressed RGB KTX of TEST_KTX_WIDTH x TEST_KTX_HEIGHT, rows padded to
+/// 4 bytes, claiming imageSize bytes for its only level
+static std::vector<unsigned char> rgbKTX(const std::vector<unsigned char> & texels, unsigned int imageSize,
+        unsigned int endianness)
+{
+    static const unsigned char identifier[12] = {
+        0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+    };
+
+    std::vector<unsigned char> ktx(identifier, identifier + sizeof(identifier));
+    put32(ktx, endianness);
+    put32(ktx, GL_UNSIGNED_BYTE);
+    put32(ktx, 1);
+    put32(ktx, GL_RGB);
+    put32(ktx, GL_RGB8);
+    put32(ktx, GL_RGB);
+    put32(ktx, TEST_KTX_WIDTH);
+    put32(ktx, TEST_KTX_HEIGHT);
+    put32(ktx, 0);
+    put32(ktx, 0);
+    put32(ktx, 1);
+    put32(ktx, 1);
+    put32(ktx, 0);
+    put32(ktx, imageSize);
+
+    const int row = (TEST_KTX_WIDTH * 3 + 3) & ~3;
+    for (int y = 0; y < TEST_KTX_HEIGHT; y++) {
+        ktx.insert(ktx.end(), texels.begin() + y * TEST_KTX_WIDTH * 3, texels.begin() + (y + 1) * TEST_KTX_WIDTH * 3);
+        ktx.insert(ktx.end(), row - TEST_KTX_WIDTH * 3, 0);
+    }
+    return ktx;
+}
+
+static void testKTX(const TestDirectory & directory)
+{
+    std::vector<unsigned char> texels;
+    for (int i = 0; i < TEST_KTX_WIDTH * TEST_KTX_HEIGHT * 3; i++)
+        texels.push_back(i * 13);
+
+    const unsigned int imageSize = ((TEST_KTX_WIDTH * 3 + 3) & ~3) * TEST_KTX_HEIGHT;
+    const std::vector<unsigned char> valid = rgbKTX(texels, imageSize, 0x04030201);
+
+    const std::string validURL = directory.file("valid.ktx");
+    writeFile(validURL, valid);
+
+    const std::string truncatedURL = directory.file("truncated.ktx");
+    writeFile(truncatedURL, std::vector<unsigned char>(valid.begin(), valid.end() - 4));
+
+    const std::string shortURL = directory.file("short.ktx");
+    writeFile(shortURL, rgbKTX(texels, TEST_KTX_WIDTH * TEST_KTX_HEIGHT * 3, 0x04030201));
+
+    const std::string endianURL = directory.file("endian.ktx");
+    writeFile(endianURL, rgbKTX(texels, imageSize, 0x12345678));
+
+    TextureManager textures(directory.path());
+
+    const unsigned int tex = textures.getTextureFullpath("valid.ktx", validURL);
+    check(tex != 0, "a valid KTX uploads");
+    if (tex != 0) {
+        check(textures.getTextureWidth("valid.ktx") == TEST_KTX_WIDTH &&
+              textures.getTextureHeight("valid.ktx") == TEST_KTX_HEIGHT, "the KTX keeps its size");
+
+        const std::vector<unsigned char> pixels = readTexture(tex, TEST_KTX_WIDTH, TEST_KTX_HEIGHT);
+        bool same = true;
+        for (int i = 0; i < TEST_KTX_WIDTH * TEST_KTX_HEIGHT; i++)
+            same = same && memcmp(&pixels[i * 4], &texels[i * 3], 3) == 0 && pixels[i * 4 + 3] == 255;
+        check(same, "the KTX uploads its texels, rows padded to 4 bytes");
+    }
+
+    check(textures.getTextureFullpath("truncated.ktx", truncatedURL) == 0, "a truncated KTX uploads nothing");
+    check(textures.getTextureFullpath("short.ktx", shortURL) == 0,
+          "a KTX level claiming less than its padded rows uploads nothing");
+    check(textures.getTextureFullpath("endian.ktx", endianURL) == 0, "a KTX with a bad endianness uploads nothing");
+}
+
+int main(int argc, char **argv)
+{
+    if (!init_headless(TEST_SIZE, TEST_SIZE)) {
+        std::cerr << "[textures] no headless OpenGL context, nothing uploaded" << std::endl;
+        return 0;
+    }
+
+    {
+        TestDirectory directory("textures");
+        if (directory.path().empty())
+            check(false, "a directory for the test textures");
+        else {
+            testDDS(directory);
+            testKTX(directory);
+        }
+    }
+
+    close_headless();
+
+    return check_summary();
+}
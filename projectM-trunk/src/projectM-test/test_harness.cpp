@@ -0,0 +1,142 @@
+//test_harness.cpp - checks, test directories and test presets for the
+//projectM-test-* programs
+
+#include "test_harness.h"
+
+#include "PresetFactoryManager.hpp"
+#include "MilkdropPresetFactory/MilkdropPreset.hpp"
+#include "Renderer/BeatDetect.hpp"
+#include "Renderer/PipelineContext.hpp"
+#include "timer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int checks = 0;
+static int failures = 0;
+static std::string mode;
+
+void check(bool passed, const std::string & what)
+{
+    checks++;
+    if (!passed) {
+        failures++;
+        if (mode.empty())
+            std::cout << "FAIL " << what << std::endl;
+        else
+            std::cout << "FAIL " << mode << ": " << what << std::endl;
+    }
+}
+
+void check_mode(const std::string & newMode)
+{
+    mode = newMode;
+}
+
+int check_summary()
+{
+    std::cout << checks - failures << " of " << checks << " checks passed" << std::endl;
+    return failures > 0 ? 1 : 0;
+}
+
+/// Removes path, and what it holds if it is a directory
+static void removeAll(const std::string & path)
+{
+    DIR * dir = opendir(path.c_str());
+    if (dir == 0) {
+        std::remove(path.c_str());
+        return;
+    }
+
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != 0) {
+        const std::string name = entry->d_name;
+        if (name != "." && name != "..")
+            removeAll(path + "/" + name);
+    }
+    closedir(dir);
+    rmdir(path.c_str());
+}
+
+TestDirectory::TestDirectory(const std::string & test)
+{
+    const std::string pattern = "/tmp/projectM-test-" + test + "-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+
+    if (mkdtemp(&name[0]) == 0)
+        std::cerr << "[" << test << "] could not make a directory for the test" << std::endl;
+    else
+        _path = &name[0];
+}
+
+TestDirectory::~TestDirectory()
+{
+    if (!_path.empty())
+        removeAll(_path);
+}
+
+TestPreset::TestPreset(const TestDirectory & directory, const std::string & name, const std::string & text)
+    : _preset(0)
+{
+    if (directory.path().empty())
+        return;
+
+    const std::string url = directory.file(name + ".milk");
+    {
+        std::ofstream file(url.c_str());
+        file << text;
+    }
+
+    _factories.reset(new PresetFactoryManager());
+    _factories->initialize(TEST_MESH_X, TEST_MESH_Y);
+    try {
+        _loaded = _factories->factory("milk").allocate(url);
+    } catch (...) {
+        return;
+    }
+    _preset = dynamic_cast<MilkdropPreset *>(_loaded.get());
+}
+
+TestPreset::~TestPreset()
+{
+}
+
+float TestPreset::render(int frame)
+{
+    PipelineContext context;
+    context.fps = 60;
+    context.frame = frame;
+    return render(context);
+}
+
+float TestPreset::render(const PipelineContext & context)
+{
+    if (_preset == 0)
+        return 0;
+
+    PCM pcm;
+    BeatDetect beatDetect(&pcm);
+
+    const double start = getMonotonicTime();
+    _preset->Render(beatDetect, context);
+    return getMonotonicTime() - start;
+}
+
+float TestPreset::operator[](const std::string & name) const
+{
+    if (_preset == 0)
+        return NAN;
+
+    std::map<std::string, Param *>::const_iterator pos = _preset->user_param_tree.find(name);
+    if (pos == _preset->user_param_tree.end())
+        return NAN;
+    return *(float *) pos->second->engine_val;
+}
@@ -0,0 +1,74 @@
+//test_harness.h - what the projectM-test-* programs share: counting checks,
+//a directory of their own and Milkdrop presets written to it
+
+#ifndef _TEST_HARNESS_H
+#define _TEST_HARNESS_H
+
+#include <memory>
+#include <string>
+
+class Preset;
+class PresetFactoryManager;
+class MilkdropPreset;
+class PipelineContext;
+
+/* The mesh the test presets are loaded with */
+#define TEST_MESH_X 32
+#define TEST_MESH_Y 24
+
+/// Counts a check, printing what it checks when it fails
+void check(bool passed, const std::string & what);
+/// Put before what the failing checks from now on print, as in "FAIL mode: what".
+/// An empty mode puts nothing
+void check_mode(const std::string & mode);
+/// Prints how many checks passed, returns the exit status of the test
+int check_summary();
+
+/// A directory made for the test under /tmp, removed with all it holds
+class TestDirectory
+{
+public:
+    explicit TestDirectory(const std::string & test);
+    ~TestDirectory();
+
+    /// Empty if no directory could be made
+    const std::string & path() const { return _path; }
+    std::string file(const std::string & name) const { return _path + "/" + name; }
+
+private:
+    TestDirectory(const TestDirectory &);
+    TestDirectory & operator=(const TestDirectory &);
+
+    std::string _path;
+};
+
+/// A Milkdrop preset written to name.milk in a test directory, loaded with
+/// the test mesh. The factories that loaded it stay as long as it does, its
+/// outputs are theirs
+class TestPreset
+{
+public:
+    TestPreset(const TestDirectory & directory, const std::string & name, const std::string & text);
+    ~TestPreset();
+
+    bool loaded() const { return _preset != 0; }
+    MilkdropPreset * preset() const { return _preset; }
+
+    /// Runs a frame of the preset at 60 fps, returns the milliseconds it took
+    float render(int frame = 1);
+    /// Runs a frame of the preset as context has it, returns the milliseconds it took
+    float render(const PipelineContext & context);
+
+    /// What the last frame left in a param the preset made, NAN if it has none
+    float operator[](const std::string & name) const;
+
+private:
+    TestPreset(const TestPreset &);
+    TestPreset & operator=(const TestPreset &);
+
+    std::auto_ptr<PresetFactoryManager> _factories;
+    std::auto_ptr<Preset> _loaded;
+    MilkdropPreset * _preset;
+};
+
+#endif	/* _TEST_HARNESS_H */